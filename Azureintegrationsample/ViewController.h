@@ -22,6 +22,8 @@
 #import "WACloudAccessControlClient.h"
 #import "WACloudAccessToken.h"
 
+#import "WATableEntityCursor.h"
+
 
 
 
@@ -35,6 +37,7 @@
 	WACloudStorageClient *storageClient;
     
      WAResultContinuation *_resultContinuation;
+    WATableEntityCursor *_entityCursor;
     
   
     
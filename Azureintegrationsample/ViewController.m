@@ -40,11 +40,36 @@
 
 -(IBAction)azure:(id)sender{
     
-    WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Your Table Name here"];
-    fetchRequest.resultContinuation = self.resultContinuation;
-    fetchRequest.topRows = 20;
-    [storageClient fetchEntitiesWithRequest:fetchRequest];
+    if (!_entityCursor || _entityCursor.isFinished) {
+        WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Your Table Name here"];
+        fetchRequest.topRows = 20;
+        
+        [_entityCursor cancel];
+        [_entityCursor release];
+        _entityCursor = [[storageClient entityCursorWithRequest:fetchRequest prefetchDepth:WATableEntityCursorDefaultPrefetchDepth] retain];
+    }
+    
+    // the cursor takes one page request at a time; a cursor that failed is finished and rebuilt on the next tap
+    [sender setEnabled:NO];
     
+    // the cursor follows the continuations and already has the next page on the way
+    [_entityCursor nextPageWithCompletionHandler:^(NSArray *entities, NSError *error) {
+        [sender setEnabled:YES];
+        if (error) {
+            [self storageClient:storageClient didFailRequest:nil withError:error];
+            return;
+        }
+        if (entities) {
+            [self storageClient:storageClient didFetchEntities:entities fromTableNamed:@"Your Table Name here" withResultContinuation:nil];
+        }
+    }];
+    
+}
+
+- (void)storageClient:(WACloudStorageClient *)client didFailRequest:(NSURLRequest *)request withError:(NSError *)error
+{
+    NSLog(@"Request failed: %@", error);
+    vieww.text = [error localizedDescription];
 }
 
 - (void)storageClient:(WACloudStorageClient *)client didFetchEntities:(NSArray *)entities fromTableNamed:(NSString *)tableName withResultContinuation:(WAResultContinuation *)resultContinuation
@@ -0,0 +1,143 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WABlob;
+@class WASharedKeySigner;
+@class WAStreamingURLRequest;
+
+/**
+ The default size, in bytes, of the ranges a WABlobDownload requests.
+ */
+#define WABlobDownloadDefaultChunkSize (4 * 1024 * 1024)
+
+/**
+ A download that fetches a blob straight into a local file using parallel ranged requests.
+
+ The blob is split into chunks of chunkSize bytes which are requested with x-ms-range, at most maxConcurrentChunks at a time. The destination file is created at the full size of the blob up front and every piece of a response is written at its offset with pwrite as it arrives, so memory use stays around chunkSize x maxConcurrentChunks whatever the size of the blob.
+
+ A chunk that fails with a transport error or a server error is requested again from the first byte not yet written, up to maxRetriesPerChunk times. If the download still fails, starting it again fetches only what is missing. The ETag of the blob is sent with every range, so a blob that changes during the download makes it fail instead of producing a mixed file.
+ */
+@interface WABlobDownload : NSObject {
+@private
+	WACloudStorageClient *_client;
+	WABlob *_blob;
+	NSString *_destinationPath;
+	NSUInteger _chunkSize;
+	NSUInteger _maxConcurrentChunks;
+	NSUInteger _maxRetriesPerChunk;
+	unsigned long long _contentLength;
+	unsigned long long _bytesWritten;
+	NSString *_etag;
+	WASharedKeySigner *_signer;
+	NSMutableArray *_chunks;
+	WAStreamingURLRequest *_propertiesRequest;
+	NSUInteger _activeChunks;
+	int _fd;
+	BOOL _running;
+	void (^_progressHandler)(unsigned long long bytesWritten, unsigned long long contentLength);
+	void (^_completionHandler)(NSError *error);
+}
+
+/**
+ The blob to download.
+ */
+@property (readonly) WABlob *blob;
+
+/**
+ The path of the local file the blob is written to.
+ */
+@property (readonly) NSString *destinationPath;
+
+/**
+ The size of each ranged request. The default is WABlobDownloadDefaultChunkSize. Changing it after the first start has no effect.
+ */
+@property (assign) NSUInteger chunkSize;
+
+/**
+ The maximum number of ranges requested at the same time. The default is 4.
+ */
+@property (assign) NSUInteger maxConcurrentChunks;
+
+/**
+ The number of times a failed range is requested again before the download fails. The default is 3.
+ */
+@property (assign) NSUInteger maxRetriesPerChunk;
+
+/**
+ The size of the blob, or 0 until it is known.
+ */
+@property (readonly) unsigned long long contentLength;
+
+/**
+ The number of bytes written to the destination file so far.
+ */
+@property (readonly) unsigned long long bytesWritten;
+
+/**
+ Called on the thread that started the download each time data is written.
+ */
+@property (copy) void (^progressHandler)(unsigned long long bytesWritten, unsigned long long contentLength);
+
+/**
+ Initializes a newly created download.
+
+ @param client The storage client whose credential is used for the requests.
+ @param blob The blob to download.
+ @param destinationPath The path of the local file. The file is created if needed and overwritten.
+
+ @returns The newly initialized WABlobDownload object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client blob:(WABlob *)blob destinationPath:(NSString *)destinationPath;
+
+/**
+ Starts the download, or resumes it after a failure.
+
+ The size and ETag are taken from the properties of the blob. If the blob does not carry them, they are fetched first.
+
+ @param block A block object called once the whole blob has been written or the download failed.
+ */
+- (void)startWithCompletionHandler:(void (^)(NSError *error))block;
+
+/**
+ Cancels the running requests. The completion handler is not called. The download can be resumed later with startWithCompletionHandler:.
+ */
+- (void)cancel;
+
+@end
+
+/**
+ Ranged blob downloads for WACloudStorageClient.
+ */
+@interface WACloudStorageClient (BlobDownload)
+
+/**
+ Downloads a blob into a local file using parallel ranged requests.
+
+ @param blob The blob to download.
+ @param path The path of the local file.
+ @param block A block object called once the download has completed or failed.
+
+ @returns The running download, which can be cancelled or resumed.
+
+ @see WABlobDownload
+ */
+- (WABlobDownload *)downloadBlob:(WABlob *)blob toFile:(NSString *)path withCompletionHandler:(void (^)(NSError *error))block;
+
+@end
@@ -0,0 +1,387 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABlobDownload.h"
+
+#import <fcntl.h>
+#import <unistd.h>
+
+#import "WABufferChain.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WAToolkitPrivate.h"
+
+// error bodies are small XML documents; anything longer is not worth keeping
+#define WABlobDownloadMaxErrorBodySize (64 * 1024)
+
+static BOOL WAWriteFully(int fd, const void *bytes, size_t length, off_t offset)
+{
+	while (length > 0) {
+		ssize_t written = pwrite(fd, bytes, length, offset);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return NO;
+		}
+		bytes = (const char *)bytes + written;
+		length -= written;
+		offset += written;
+	}
+	return YES;
+}
+
+/*
+ One range of the blob and how much of it is already on disk.
+ */
+@interface WABlobDownloadChunk : NSObject {
+@public
+	unsigned long long offset;
+	unsigned long long length;
+	unsigned long long received;
+	NSUInteger retries;
+	NSInteger statusCode;
+	BOOL accepting;
+	WABufferChain *errorBody;
+	WAStreamingURLRequest *request;
+}
+
+@end
+
+@implementation WABlobDownloadChunk
+
+- (void)dealloc
+{
+	[errorBody release];
+	[request release];
+	[super dealloc];
+}
+
+@end
+
+@interface WABlobDownload ()
+
+- (void)fetchProperties;
+- (void)planChunks;
+- (void)scheduleChunks;
+- (void)startChunk:(WABlobDownloadChunk *)chunk;
+- (void)chunk:(WABlobDownloadChunk *)chunk didCompleteWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error;
+- (void)stopRequests;
+- (void)finishWithError:(NSError *)error;
+
+@end
+
+@implementation WABlobDownload
+
+@synthesize blob = _blob;
+@synthesize destinationPath = _destinationPath;
+@synthesize chunkSize = _chunkSize;
+@synthesize maxConcurrentChunks = _maxConcurrentChunks;
+@synthesize maxRetriesPerChunk = _maxRetriesPerChunk;
+@synthesize contentLength = _contentLength;
+@synthesize bytesWritten = _bytesWritten;
+@synthesize progressHandler = _progressHandler;
+
+- (id)initWithClient:(WACloudStorageClient *)client blob:(WABlob *)blob destinationPath:(NSString *)destinationPath
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_client = [client retain];
+	_blob = [blob retain];
+	_destinationPath = [destinationPath copy];
+	_chunkSize = WABlobDownloadDefaultChunkSize;
+	_maxConcurrentChunks = 4;
+	_maxRetriesPerChunk = 3;
+	_fd = -1;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_fd >= 0) {
+		close(_fd);
+	}
+	[_client release];
+	[_blob release];
+	[_destinationPath release];
+	[_etag release];
+	[_signer release];
+	[_chunks release];
+	[_propertiesRequest release];
+	[_progressHandler release];
+	[_completionHandler release];
+	[super dealloc];
+}
+
+- (void)startWithCompletionHandler:(void (^)(NSError *error))block
+{
+	NSAssert(!_running, @"The download is already running");
+
+	// balanced in finishWithError: or cancel
+	[self retain];
+	_running = YES;
+	_completionHandler = [block copy];
+
+	if (!_signer) {
+		_signer = [[WASharedKeySigner signerForCredential:WAStorageClientCredential(_client)] retain];
+		if (!_signer) {
+			[self finishWithError:WAToolkitError(-1, nil, @"Ranged downloads require a credential with an account name and access key.")];
+			return;
+		}
+	}
+
+	if (!_chunks) {
+		NSDictionary *properties = _blob.properties;
+		id length = [properties objectForKey:WABlobPropertyKeyContentLength];
+		if (!length) {
+			[self fetchProperties];
+			return;
+		}
+
+		_contentLength = [length longLongValue];
+		_etag = [[properties objectForKey:WABlobPropertyKeyEtag] copy];
+		[self planChunks];
+	}
+
+	[self scheduleChunks];
+}
+
+- (void)cancel
+{
+	if (!_running) {
+		return;
+	}
+
+	[self stopRequests];
+	_running = NO;
+	[_completionHandler release];
+	_completionHandler = nil;
+	[self autorelease];
+}
+
+#pragma mark - Private
+
+- (void)fetchProperties
+{
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeBlob path:WABlobResourcePath(_blob.containerName, _blob.name) query:nil httpMethod:@"HEAD"];
+	WARequestMetrics *metrics = [_client metricsForOperation:@"GetBlobProperties" resourceName:_blob.containerName];
+	[_signer signRequest:request forStorageType:WAStorageTypeBlob metrics:metrics];
+
+	_propertiesRequest = [[WAStreamingURLRequest alloc] initWithURLRequest:request];
+	_propertiesRequest.retryPolicy = _client.retryPolicy;
+	_propertiesRequest.metrics = metrics;
+	_propertiesRequest.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForBlob(_signer.accountName, _blob.containerName, _blob.name)];
+	[_propertiesRequest startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		[_propertiesRequest release];
+		_propertiesRequest = nil;
+
+		if (!error && response.statusCode >= 300) {
+			error = WAStorageErrorFromResponse(response, nil);
+		}
+		if (error) {
+			[self finishWithError:error];
+			return;
+		}
+
+		_contentLength = [WAHeaderValueForKey(response, @"Content-Length") longLongValue];
+		_etag = [WAHeaderValueForKey(response, @"ETag") copy];
+		[self planChunks];
+		[self scheduleChunks];
+	}];
+}
+
+- (void)planChunks
+{
+	NSUInteger chunkSize = MAX(_chunkSize, 1);
+	_chunks = [[NSMutableArray alloc] initWithCapacity:(NSUInteger)(_contentLength / chunkSize + 1)];
+
+	for (unsigned long long offset = 0; offset < _contentLength; offset += chunkSize) {
+		WABlobDownloadChunk *chunk = [[WABlobDownloadChunk alloc] init];
+		chunk->offset = offset;
+		chunk->length = MIN(chunkSize, _contentLength - offset);
+		[_chunks addObject:chunk];
+		[chunk release];
+	}
+}
+
+- (void)scheduleChunks
+{
+	if (_fd < 0) {
+		_fd = open([_destinationPath fileSystemRepresentation], O_RDWR | O_CREAT, 0644);
+		if (_fd < 0 || ftruncate(_fd, _contentLength) != 0) {
+			[self finishWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+			return;
+		}
+	}
+
+	BOOL complete = YES;
+	for (WABlobDownloadChunk *chunk in _chunks) {
+		if (chunk->received == chunk->length) {
+			continue;
+		}
+		complete = NO;
+		if (!chunk->request && _activeChunks < MAX(_maxConcurrentChunks, 1)) {
+			[self startChunk:chunk];
+		}
+	}
+
+	if (complete) {
+		[self finishWithError:nil];
+	}
+}
+
+- (void)startChunk:(WABlobDownloadChunk *)chunk
+{
+	unsigned long long first = chunk->offset + chunk->received;
+	unsigned long long last = chunk->offset + chunk->length - 1;
+
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeBlob path:WABlobResourcePath(_blob.containerName, _blob.name) query:nil httpMethod:@"GET"];
+	[request setValue:[NSString stringWithFormat:@"bytes=%llu-%llu", first, last] forHTTPHeaderField:@"x-ms-range"];
+	if (_etag) {
+		[request setValue:_etag forHTTPHeaderField:@"If-Match"];
+	}
+	WARequestMetrics *metrics = [_client metricsForOperation:@"GetBlob" resourceName:_blob.containerName];
+	[_signer signRequest:request forStorageType:WAStorageTypeBlob metrics:metrics];
+
+	chunk->statusCode = 0;
+	chunk->accepting = NO;
+	[chunk->errorBody release];
+	chunk->errorBody = nil;
+	chunk->request = [[WAStreamingURLRequest alloc] initWithURLRequest:request];
+	chunk->request.retryPolicy = _client.retryPolicy;
+	chunk->request.metrics = metrics;
+	chunk->request.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForBlob(_signer.accountName, _blob.containerName, _blob.name)];
+	_activeChunks++;
+
+	chunk->request.responseHandler = ^(NSHTTPURLResponse *response) {
+		chunk->statusCode = response.statusCode;
+		// a service that ignores the range sends the whole blob, which is only usable from the start
+		chunk->accepting = response.statusCode == 206 || (response.statusCode == 200 && first == 0);
+		if (response.statusCode >= 300) {
+			chunk->errorBody = [[WABufferChain alloc] initWithCapacity:WABlobDownloadMaxErrorBodySize];
+		}
+	};
+	chunk->request.dataHandler = ^(NSData *data) {
+		if (!chunk->accepting) {
+			[chunk->errorBody appendData:data];
+			return;
+		}
+
+		size_t length = (size_t)MIN((unsigned long long)data.length, chunk->length - chunk->received);
+		if (!WAWriteFully(_fd, [data bytes], length, (off_t)(chunk->offset + chunk->received))) {
+			[self finishWithError:[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil]];
+			return;
+		}
+
+		chunk->received += length;
+		_bytesWritten += length;
+		if (_progressHandler) {
+			_progressHandler(_bytesWritten, _contentLength);
+		}
+	};
+
+	[chunk->request startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		[self chunk:chunk didCompleteWithResponse:response error:error];
+	}];
+}
+
+- (void)chunk:(WABlobDownloadChunk *)chunk didCompleteWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+	[chunk->request release];
+	chunk->request = nil;
+	_activeChunks--;
+
+	BOOL retriable = YES;
+	if (!error && response.statusCode >= 300) {
+		error = WAStorageErrorFromResponse(response, [chunk->errorBody contiguousData]);
+		retriable = response.statusCode >= 500;
+	} else if (!error && !chunk->accepting) {
+		error = WAToolkitError(response.statusCode, nil, @"The service did not honor the requested range.");
+		retriable = NO;
+	} else if (!error && chunk->received < chunk->length) {
+		error = WAToolkitError(-1, nil, @"The response ended before the whole range was received.");
+	}
+
+	if (error) {
+		if (!retriable || chunk->retries >= _maxRetriesPerChunk) {
+			[self finishWithError:error];
+			return;
+		}
+
+		// the next request picks up from the first byte not yet written
+		chunk->retries++;
+		LOG(@"Retrying range at %llu of %@ (%lu): %@", chunk->offset + chunk->received, _blob.name, (unsigned long)chunk->retries, error);
+	}
+
+	[self scheduleChunks];
+}
+
+- (void)stopRequests
+{
+	[_propertiesRequest cancel];
+	[_propertiesRequest release];
+	_propertiesRequest = nil;
+
+	for (WABlobDownloadChunk *chunk in _chunks) {
+		[chunk->request cancel];
+		[chunk->request release];
+		chunk->request = nil;
+		chunk->retries = 0;
+	}
+	_activeChunks = 0;
+
+	if (_fd >= 0) {
+		close(_fd);
+		_fd = -1;
+	}
+}
+
+- (void)finishWithError:(NSError *)error
+{
+	if (!_running) {
+		return;
+	}
+
+	[self stopRequests];
+	_running = NO;
+
+	void (^block)(NSError *) = [_completionHandler autorelease];
+	_completionHandler = nil;
+	if (block) {
+		block(error);
+	}
+
+	[self autorelease];
+}
+
+@end
+
+@implementation WACloudStorageClient (BlobDownload)
+
+- (WABlobDownload *)downloadBlob:(WABlob *)blob toFile:(NSString *)path withCompletionHandler:(void (^)(NSError *error))block
+{
+	WABlobDownload *download = [[[WABlobDownload alloc] initWithClient:self blob:blob destinationPath:path] autorelease];
+	[download startWithCompletionHandler:block];
+	return download;
+}
+
+@end
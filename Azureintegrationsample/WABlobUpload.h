@@ -0,0 +1,149 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WABlobContainer;
+@class WASharedKeySigner;
+
+/**
+ The default size, in bytes, of the blocks a WABlobUpload sends.
+ */
+#define WABlobUploadDefaultBlockSize (4 * 1024 * 1024)
+
+/**
+ The largest block the blob service accepts.
+ */
+#define WABlobUploadMaxBlockSize (4 * 1024 * 1024)
+
+/**
+ An upload that writes a block blob from a file descriptor or a stream using Put Block and Put Block List.
+
+ The source is read one block at a time, in order, and at most maxConcurrentBlocks blocks are uploaded at once; a block is kept in memory only until it has been accepted, so memory use stays around blockSize x maxConcurrentBlocks whatever the size of the source. Once every block is stored, the block list is committed and the blob appears atomically with its full content.
+
+ A block that fails with a transport error or a server error is sent again, up to maxRetriesPerBlock times, without restarting the others. When computesMD5 is set, every block carries a Content-MD5 the service checks, and the MD5 of the whole content is stored as the blob's Content-MD5.
+ */
+@interface WABlobUpload : NSObject {
+@private
+	WACloudStorageClient *_client;
+	NSString *_containerName;
+	NSString *_blobName;
+	int _fileDescriptor;
+	NSInputStream *_inputStream;
+	NSString *_contentType;
+	NSUInteger _blockSize;
+	NSUInteger _maxConcurrentBlocks;
+	NSUInteger _maxRetriesPerBlock;
+	BOOL _computesMD5;
+	unsigned long long _bytesUploaded;
+	WASharedKeySigner *_signer;
+	NSMutableArray *_blockIDs;
+	NSMutableArray *_blocks;
+	void *_digest;
+	BOOL _endOfSource;
+	BOOL _running;
+	void (^_progressHandler)(unsigned long long bytesUploaded);
+	void (^_completionHandler)(NSError *error);
+}
+
+/**
+ The name of the container the blob is written to.
+ */
+@property (readonly) NSString *containerName;
+
+/**
+ The name of the blob.
+ */
+@property (readonly) NSString *blobName;
+
+/**
+ The content type stored with the blob. The default is application/octet-stream.
+ */
+@property (copy) NSString *contentType;
+
+/**
+ The size of each block. The default is WABlobUploadDefaultBlockSize; values above WABlobUploadMaxBlockSize are clamped.
+ */
+@property (assign) NSUInteger blockSize;
+
+/**
+ The maximum number of blocks uploaded at the same time. The default is 4.
+ */
+@property (assign) NSUInteger maxConcurrentBlocks;
+
+/**
+ The number of times a failed block is sent again before the upload fails. The default is 3.
+ */
+@property (assign) NSUInteger maxRetriesPerBlock;
+
+/**
+ Whether blocks and the committed blob carry an MD5 checksum. The default is NO.
+ */
+@property (assign) BOOL computesMD5;
+
+/**
+ The number of bytes accepted by the service so far.
+ */
+@property (readonly) unsigned long long bytesUploaded;
+
+/**
+ Called on the thread that started the upload each time a block has been accepted.
+ */
+@property (copy) void (^progressHandler)(unsigned long long bytesUploaded);
+
+/**
+ Initializes a newly created upload that reads from a file descriptor.
+
+ The descriptor is read sequentially from its current offset up to the end of the file. It is not closed by the upload.
+
+ @param client The storage client whose credential is used for the requests.
+ @param container The container to write to.
+ @param blobName The name of the blob.
+ @param fileDescriptor A readable file descriptor.
+
+ @returns The newly initialized WABlobUpload object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName fileDescriptor:(int)fileDescriptor;
+
+/**
+ Initializes a newly created upload that reads from a stream.
+
+ The stream is opened if needed and read until its end. Reads happen on the thread that started the upload and may block it, so use streams that read from local storage.
+
+ @param client The storage client whose credential is used for the requests.
+ @param container The container to write to.
+ @param blobName The name of the blob.
+ @param inputStream The stream to read.
+
+ @returns The newly initialized WABlobUpload object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName inputStream:(NSInputStream *)inputStream;
+
+/**
+ Starts the upload.
+
+ @param block A block object called once the block list has been committed or the upload failed.
+ */
+- (void)startWithCompletionHandler:(void (^)(NSError *error))block;
+
+/**
+ Cancels the upload. The completion handler is not called, and blocks already uploaded are left uncommitted; the service discards them after a week.
+ */
+- (void)cancel;
+
+@end
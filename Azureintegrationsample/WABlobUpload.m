@@ -0,0 +1,397 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABlobUpload.h"
+
+#import <CommonCrypto/CommonDigest.h>
+#import <unistd.h>
+
+#import "WABufferChain.h"
+#import "WABufferPool.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WAToolkitPrivate.h"
+
+#define WABlobUploadMaxErrorBodySize (64 * 1024)
+
+static NSString *WAMD5String(const void *bytes, CC_LONG length)
+{
+	unsigned char digest[CC_MD5_DIGEST_LENGTH];
+	CC_MD5(bytes, length, digest);
+	return [[NSData dataWithBytes:digest length:sizeof(digest)] stringWithBase64EncodedData];
+}
+
+/*
+ A block read from the source that has not been accepted yet.
+ */
+@interface WABlobUploadBlock : NSObject {
+@public
+	NSString *blockID;
+	NSData *data;
+	NSUInteger retries;
+	WABufferChain *errorBody;
+	WAStreamingURLRequest *request;
+}
+
+@end
+
+@implementation WABlobUploadBlock
+
+- (void)dealloc
+{
+	[blockID release];
+	[data release];
+	[errorBody release];
+	[request release];
+	[super dealloc];
+}
+
+@end
+
+@interface WABlobUpload ()
+
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName;
+- (NSData *)readBlockWithError:(NSError **)error;
+- (void)scheduleBlocks;
+- (void)sendBlock:(WABlobUploadBlock *)block;
+- (void)block:(WABlobUploadBlock *)block didCompleteWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error;
+- (void)commitBlockList;
+- (void)finishWithError:(NSError *)error;
+
+@end
+
+@implementation WABlobUpload
+
+@synthesize containerName = _containerName;
+@synthesize blobName = _blobName;
+@synthesize contentType = _contentType;
+@synthesize blockSize = _blockSize;
+@synthesize maxConcurrentBlocks = _maxConcurrentBlocks;
+@synthesize maxRetriesPerBlock = _maxRetriesPerBlock;
+@synthesize computesMD5 = _computesMD5;
+@synthesize bytesUploaded = _bytesUploaded;
+@synthesize progressHandler = _progressHandler;
+
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_client = [client retain];
+	_containerName = [container.name copy];
+	_blobName = [blobName copy];
+	_contentType = @"application/octet-stream";
+	_blockSize = WABlobUploadDefaultBlockSize;
+	_maxConcurrentBlocks = 4;
+	_maxRetriesPerBlock = 3;
+	_fileDescriptor = -1;
+
+	return self;
+}
+
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName fileDescriptor:(int)fileDescriptor
+{
+	if(!(self = [self initWithClient:client container:container blobName:blobName])) {
+		return nil;
+	}
+
+	_fileDescriptor = fileDescriptor;
+
+	return self;
+}
+
+- (id)initWithClient:(WACloudStorageClient *)client container:(WABlobContainer *)container blobName:(NSString *)blobName inputStream:(NSInputStream *)inputStream
+{
+	if(!(self = [self initWithClient:client container:container blobName:blobName])) {
+		return nil;
+	}
+
+	_inputStream = [inputStream retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_client release];
+	[_containerName release];
+	[_blobName release];
+	[_inputStream release];
+	[_contentType release];
+	[_signer release];
+	[_blockIDs release];
+	[_blocks release];
+	free(_digest);
+	[_progressHandler release];
+	[_completionHandler release];
+	[super dealloc];
+}
+
+- (void)startWithCompletionHandler:(void (^)(NSError *error))block
+{
+	NSAssert(!_running && !_blockIDs, @"An upload can only be started once");
+
+	// balanced in finishWithError: or cancel
+	[self retain];
+	_running = YES;
+	_completionHandler = [block copy];
+
+	_signer = [[WASharedKeySigner signerForCredential:WAStorageClientCredential(_client)] retain];
+	if (!_signer) {
+		[self finishWithError:WAToolkitError(-1, nil, @"Block uploads require a credential with an account name and access key.")];
+		return;
+	}
+
+	_blockIDs = [[NSMutableArray alloc] init];
+	_blocks = [[NSMutableArray alloc] initWithCapacity:_maxConcurrentBlocks];
+	if (_computesMD5) {
+		_digest = malloc(sizeof(CC_MD5_CTX));
+		CC_MD5_Init(_digest);
+	}
+	if (_inputStream && [_inputStream streamStatus] == NSStreamStatusNotOpen) {
+		[_inputStream open];
+	}
+
+	[self scheduleBlocks];
+}
+
+- (void)cancel
+{
+	if (!_running) {
+		return;
+	}
+
+	for (WABlobUploadBlock *block in _blocks) {
+		[block->request cancel];
+		[block->request release];
+		block->request = nil;
+	}
+	[_blocks removeAllObjects];
+	_running = NO;
+	[_completionHandler release];
+	_completionHandler = nil;
+	[self autorelease];
+}
+
+#pragma mark - Private
+
+- (NSData *)readBlockWithError:(NSError **)error
+{
+	NSUInteger blockSize = MIN(MAX(_blockSize, 1), WABlobUploadMaxBlockSize);
+	WABufferPool *pool = _client.bufferPool;
+	size_t capacity = 0;
+	char *bytes = [pool allocateBytes:blockSize capacity:&capacity];
+	if (!bytes) {
+		*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:ENOMEM userInfo:nil];
+		return nil;
+	}
+	NSUInteger filled = 0;
+
+	while (filled < blockSize) {
+		NSInteger count;
+		if (_inputStream) {
+			count = [_inputStream read:(uint8_t *)bytes + filled maxLength:blockSize - filled];
+			if (count < 0) {
+				*error = [_inputStream streamError];
+				[pool recycleBytes:bytes capacity:capacity];
+				return nil;
+			}
+		} else {
+			count = read(_fileDescriptor, bytes + filled, blockSize - filled);
+			if (count < 0) {
+				if (errno == EINTR) {
+					continue;
+				}
+				*error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+				[pool recycleBytes:bytes capacity:capacity];
+				return nil;
+			}
+		}
+
+		if (count == 0) {
+			_endOfSource = YES;
+			break;
+		}
+		filled += count;
+	}
+
+	if (!filled) {
+		[pool recycleBytes:bytes capacity:capacity];
+		return nil;
+	}
+	if (_digest) {
+		CC_MD5_Update(_digest, bytes, (CC_LONG)filled);
+	}
+
+	// the block goes back to the pool once the request body is released
+	return [pool dataWithBytesNoCopy:bytes length:filled capacity:capacity];
+}
+
+- (void)scheduleBlocks
+{
+	while (!_endOfSource && _blocks.count < MAX(_maxConcurrentBlocks, 1)) {
+		NSError *error = nil;
+		NSData *data = [self readBlockWithError:&error];
+		if (error) {
+			[self finishWithError:error];
+			return;
+		}
+		if (!data) {
+			break;
+		}
+
+		// block IDs must all have the same length within a blob
+		NSString *name = [NSString stringWithFormat:@"block-%08lu", (unsigned long)_blockIDs.count];
+		WABlobUploadBlock *block = [[WABlobUploadBlock alloc] init];
+		block->blockID = [[[name dataUsingEncoding:NSUTF8StringEncoding] stringWithBase64EncodedData] retain];
+		block->data = [data retain];
+		[_blockIDs addObject:block->blockID];
+		[_blocks addObject:block];
+		[block release];
+
+		[self sendBlock:block];
+	}
+
+	if (_endOfSource && !_blocks.count) {
+		[self commitBlockList];
+	}
+}
+
+- (void)sendBlock:(WABlobUploadBlock *)block
+{
+	NSString *query = [NSString stringWithFormat:@"comp=block&blockid=%@", WAURLEncodedString(block->blockID)];
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeBlob path:WABlobResourcePath(_containerName, _blobName) query:query httpMethod:@"PUT"];
+	[request setHTTPBody:block->data];
+	// NSURLConnection adds a form content type to bodies that have none, which would break the signature
+	[request setValue:@"application/octet-stream" forHTTPHeaderField:@"Content-Type"];
+	if (_computesMD5) {
+		[request setValue:WAMD5String([block->data bytes], (CC_LONG)[block->data length]) forHTTPHeaderField:@"Content-MD5"];
+	}
+	WARequestMetrics *metrics = [_client metricsForOperation:@"PutBlock" resourceName:_containerName];
+	[_signer signRequest:request forStorageType:WAStorageTypeBlob metrics:metrics];
+
+	[block->errorBody release];
+	block->errorBody = nil;
+	[block->request release];
+	block->request = [[WAStreamingURLRequest alloc] initWithURLRequest:request];
+	block->request.retryPolicy = _client.retryPolicy;
+	block->request.metrics = metrics;
+	block->request.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForBlob(_signer.accountName, _containerName, _blobName)];
+	block->request.dataHandler = ^(NSData *data) {
+		if (!block->errorBody) {
+			block->errorBody = [[WABufferChain alloc] initWithCapacity:WABlobUploadMaxErrorBodySize];
+		}
+		[block->errorBody appendData:data];
+	};
+
+	[block->request startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		[self block:block didCompleteWithResponse:response error:error];
+	}];
+}
+
+- (void)block:(WABlobUploadBlock *)block didCompleteWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+	[block->request release];
+	block->request = nil;
+
+	BOOL retriable = YES;
+	if (!error && response.statusCode >= 300) {
+		error = WAStorageErrorFromResponse(response, [block->errorBody contiguousData]);
+		retriable = response.statusCode >= 500;
+	}
+
+	if (error) {
+		if (!retriable || block->retries >= _maxRetriesPerBlock) {
+			[self finishWithError:error];
+			return;
+		}
+
+		block->retries++;
+		LOG(@"Retrying block %@ of %@ (%lu): %@", block->blockID, _blobName, (unsigned long)block->retries, error);
+		[self sendBlock:block];
+		return;
+	}
+
+	_bytesUploaded += [block->data length];
+	[_blocks removeObjectIdenticalTo:block];
+	if (_progressHandler) {
+		_progressHandler(_bytesUploaded);
+	}
+
+	[self scheduleBlocks];
+}
+
+- (void)commitBlockList
+{
+	NSMutableString *body = [NSMutableString stringWithString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList>"];
+	for (NSString *blockID in _blockIDs) {
+		[body appendFormat:@"<Latest>%@</Latest>", blockID];
+	}
+	[body appendString:@"</BlockList>"];
+
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeBlob path:WABlobResourcePath(_containerName, _blobName) query:@"comp=blocklist" httpMethod:@"PUT"];
+	[request setHTTPBody:[body dataUsingEncoding:NSUTF8StringEncoding]];
+	[request setValue:@"application/xml" forHTTPHeaderField:@"Content-Type"];
+	[request setValue:_contentType forHTTPHeaderField:@"x-ms-blob-content-type"];
+	if (_digest) {
+		unsigned char digest[CC_MD5_DIGEST_LENGTH];
+		CC_MD5_Final(digest, _digest);
+		[request setValue:[[NSData dataWithBytes:digest length:sizeof(digest)] stringWithBase64EncodedData] forHTTPHeaderField:@"x-ms-blob-content-md5"];
+	}
+	WARequestMetrics *metrics = [_client metricsForOperation:@"PutBlockList" resourceName:_containerName];
+	[_signer signRequest:request forStorageType:WAStorageTypeBlob metrics:metrics];
+
+	WAStreamingURLRequest *commit = [WAStreamingURLRequest requestWithURLRequest:request];
+	commit.retryPolicy = _client.retryPolicy;
+	commit.metrics = metrics;
+	commit.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForBlob(_signer.accountName, _containerName, _blobName)];
+	commit.collectsResponseBody = YES;
+	[commit startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		if (!error && response.statusCode >= 300) {
+			error = WAStorageErrorFromResponse(response, [commit.responseBody contiguousData]);
+		}
+		[self finishWithError:error];
+	}];
+}
+
+- (void)finishWithError:(NSError *)error
+{
+	if (!_running) {
+		return;
+	}
+
+	for (WABlobUploadBlock *block in _blocks) {
+		[block->request cancel];
+		[block->request release];
+		block->request = nil;
+	}
+	[_blocks removeAllObjects];
+	_running = NO;
+
+	void (^block)(NSError *) = [_completionHandler autorelease];
+	_completionHandler = nil;
+	if (block) {
+		block(error);
+	}
+
+	[self autorelease];
+}
+
+@end
@@ -0,0 +1,98 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ A response body kept as the chunks it arrived in.
+
+ Appending retains a chunk instead of copying it into a growing buffer, so collecting a body of n chunks costs n retains rather than repeated reallocations and copies. Readers walk the segments in order; contiguousData joins them into a single buffer only when it is asked for.
+ */
+@interface WABufferChain : NSObject {
+@private
+	NSMutableArray *_segments;
+	NSUInteger _length;
+	NSUInteger _capacity;
+}
+
+/**
+ The number of bytes in the chain.
+ */
+@property (readonly) NSUInteger length;
+
+/**
+ The number of segments in the chain.
+ */
+@property (readonly) NSUInteger segmentCount;
+
+/**
+ The most bytes the chain keeps, or 0 for no limit. Bytes appended beyond it are dropped. The default is 0.
+ */
+@property (assign) NSUInteger capacity;
+
+/**
+ Initializes a newly created chain.
+
+ @param capacity The most bytes the chain keeps, or 0 for no limit.
+
+ @returns The newly initialized WABufferChain object.
+ */
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+/**
+ Appends a chunk to the chain. Immutable data is retained, not copied.
+
+ @param data The chunk.
+ */
+- (void)appendData:(NSData *)data;
+
+/**
+ Returns a segment of the chain.
+
+ @param index The index of the segment.
+ */
+- (NSData *)segmentAtIndex:(NSUInteger)index;
+
+/**
+ Calls a block with every segment in order.
+
+ @param block A block object called with each segment and the offset of its first byte in the chain. Setting stop to YES ends the enumeration.
+ */
+- (void)enumerateSegmentsUsingBlock:(void (^)(NSData *segment, NSUInteger offset, BOOL *stop))block;
+
+/**
+ Copies a range of the chain into a buffer.
+
+ @param buffer The buffer, at least range.length bytes long.
+ @param range The range of bytes to copy. It must lie within the chain.
+ */
+- (void)getBytes:(void *)buffer range:(NSRange)range;
+
+/**
+ Returns the whole chain as one buffer.
+
+ A chain of a single segment returns that segment. Otherwise the segments are copied once into a new buffer, which then replaces them, so asking again costs nothing.
+
+ @returns The bytes of the chain.
+ */
+- (NSData *)contiguousData;
+
+/**
+ Removes every segment.
+ */
+- (void)removeAllSegments;
+
+@end
@@ -0,0 +1,137 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABufferChain.h"
+
+@implementation WABufferChain
+
+@synthesize length = _length;
+@synthesize capacity = _capacity;
+
+- (id)init
+{
+	return [self initWithCapacity:0];
+}
+
+- (id)initWithCapacity:(NSUInteger)capacity
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_segments = [[NSMutableArray alloc] init];
+	_capacity = capacity;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_segments release];
+	[super dealloc];
+}
+
+- (NSUInteger)segmentCount
+{
+	return _segments.count;
+}
+
+- (void)appendData:(NSData *)data
+{
+	NSUInteger length = data.length;
+	if (_capacity) {
+		length = MIN(length, _capacity - MIN(_length, _capacity));
+	}
+	if (!length) {
+		return;
+	}
+
+	// copying an immutable NSData only retains it
+	NSData *segment = length == data.length ? [data copy] : [[data subdataWithRange:NSMakeRange(0, length)] retain];
+	[_segments addObject:segment];
+	[segment release];
+	_length += length;
+}
+
+- (NSData *)segmentAtIndex:(NSUInteger)index
+{
+	return [_segments objectAtIndex:index];
+}
+
+- (void)enumerateSegmentsUsingBlock:(void (^)(NSData *segment, NSUInteger offset, BOOL *stop))block
+{
+	NSUInteger offset = 0;
+	BOOL stop = NO;
+	for (NSData *segment in _segments) {
+		block(segment, offset, &stop);
+		if (stop) {
+			break;
+		}
+		offset += segment.length;
+	}
+}
+
+- (void)getBytes:(void *)buffer range:(NSRange)range
+{
+	NSParameterAssert(NSMaxRange(range) <= _length);
+
+	NSUInteger offset = 0;
+	char *destination = buffer;
+	for (NSData *segment in _segments) {
+		NSUInteger segmentLength = segment.length;
+		if (offset + segmentLength > range.location) {
+			NSUInteger start = range.location > offset ? range.location - offset : 0;
+			NSUInteger count = MIN(segmentLength - start, range.length);
+			memcpy(destination, (const char *)[segment bytes] + start, count);
+			destination += count;
+			range.location += count;
+			range.length -= count;
+			if (!range.length) {
+				break;
+			}
+		}
+		offset += segmentLength;
+	}
+}
+
+- (NSData *)contiguousData
+{
+	if (_segments.count == 0) {
+		return [NSData data];
+	}
+	if (_segments.count == 1) {
+		return [_segments objectAtIndex:0];
+	}
+
+	char *bytes = malloc(_length);
+	if (!bytes) {
+		return nil;
+	}
+	[self getBytes:bytes range:NSMakeRange(0, _length)];
+
+	NSData *data = [NSData dataWithBytesNoCopy:bytes length:_length freeWhenDone:YES];
+	[_segments removeAllObjects];
+	[_segments addObject:data];
+	return data;
+}
+
+- (void)removeAllSegments
+{
+	[_segments removeAllObjects];
+	_length = 0;
+}
+
+@end
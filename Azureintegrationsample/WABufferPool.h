@@ -0,0 +1,197 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+/**
+ The smallest buffer a pool hands out, in bytes. Larger buffers come in powers of two.
+ */
+#define WABufferPoolMinimumBufferSize 256
+
+/**
+ The largest buffer a pool keeps, in bytes. Larger requests are served from malloc and freed when recycled.
+ */
+#define WABufferPoolMaximumBufferSize (8 * 1024 * 1024)
+
+#define WABufferPoolSizeClassCount 16
+
+/**
+ The default limit on the bytes a pool keeps idle.
+ */
+#define WABufferPoolDefaultMaxIdleBytes (16 * 1024 * 1024)
+
+/**
+ The interval, in seconds, after which buffers that stayed idle the whole time are freed.
+ */
+#define WABufferPoolTrimInterval 30.0
+
+/**
+ A kind of reusable context, such as the state of a push parser. Declare one as a static constant per kind.
+ */
+typedef struct {
+	/** Creates a context when the pool has none idle. */
+	void *(*create)(void);
+	/** Frees a context the pool no longer keeps. */
+	void (*destroy)(void *context);
+} WABufferPoolContextKind;
+
+/**
+ The counters of a pool. Once the pool has warmed up, allocations and contextAllocations stay put on a steady workload: every buffer and context is a reuse. They only count what goes through the pool; the fixed-size state of each parser and the objects it creates are allocated as usual.
+ */
+typedef struct {
+	/** Buffers obtained from malloc. */
+	unsigned long long allocations;
+	/** Buffers handed out from the idle lists. */
+	unsigned long long reuses;
+	/** Buffers given back to the system by trimming, the idle limit or because they were too large to keep. */
+	unsigned long long releases;
+	/** Contexts created. */
+	unsigned long long contextAllocations;
+	/** Contexts handed out again. */
+	unsigned long long contextReuses;
+	/** Bytes in buffers handed out and not yet recycled. */
+	unsigned long long bytesInUse;
+	/** Bytes in buffers kept for reuse. */
+	unsigned long long bytesIdle;
+	/** The most bytes ever in use at once. */
+	unsigned long long peakBytesInUse;
+} WABufferPoolStatistics;
+
+#define WABufferPoolMaxContextKinds 8
+#define WABufferPoolMaxIdleContexts 8
+
+/**
+ A pool of reusable byte buffers and parser contexts, so that the buffers of request bodies and the state of response parsers are not allocated and freed for every request.
+
+ Buffers come in size classes, powers of two from WABufferPoolMinimumBufferSize to WABufferPoolMaximumBufferSize. Each class keeps the buffers recycled into it on a free list; a buffer that stays on its list through a whole WABufferPoolTrimInterval was not needed at the high-water mark of that interval and is freed, as are all idle buffers when the application receives a memory warning. A pool may be used from any thread.
+ */
+@interface WABufferPool : NSObject {
+@private
+	void *_idle[WABufferPoolSizeClassCount];
+	NSUInteger _idleCounts[WABufferPoolSizeClassCount];
+	NSUInteger _lowIdleCounts[WABufferPoolSizeClassCount];
+	struct {
+		const WABufferPoolContextKind *kind;
+		void *contexts[WABufferPoolMaxIdleContexts];
+		NSUInteger count;
+		NSUInteger lowCount;
+	} _contexts[WABufferPoolMaxContextKinds];
+	NSUInteger _maxIdleBytes;
+	CFAbsoluteTime _trimmedAt;
+	WABufferPoolStatistics _statistics;
+}
+
+/**
+ The most bytes the pool keeps idle. Buffers recycled beyond it are freed. The default is WABufferPoolDefaultMaxIdleBytes.
+ */
+@property (assign) NSUInteger maxIdleBytes;
+
+/**
+ The counters of the pool.
+ */
+@property (readonly) WABufferPoolStatistics statistics;
+
+/**
+ Returns the pool used by code that is not tied to a storage client.
+ */
++ (WABufferPool *)sharedPool;
+
+/**
+ Returns a buffer of at least the given length.
+
+ @param length The number of bytes needed.
+ @param capacity On return, the size of the buffer, to be passed back when it is recycled.
+
+ @returns The buffer, or NULL if there is not enough memory. Its content is undefined.
+ */
+- (void *)allocateBytes:(size_t)length capacity:(size_t *)capacity;
+
+/**
+ Makes room in a buffer from the pool, replacing it by one of a larger size class when needed.
+
+ @param bytes The buffer, or NULL.
+ @param usedLength The number of bytes of the buffer to keep.
+ @param length The number of bytes needed.
+ @param capacity The size of the buffer on entry, and of the returned buffer on return.
+
+ @returns The buffer, or NULL if there is not enough memory, in which case the original buffer is unchanged.
+ */
+- (void *)growBytes:(void *)bytes usedLength:(size_t)usedLength toLength:(size_t)length capacity:(size_t *)capacity;
+
+/**
+ Gives a buffer back to the pool.
+
+ @param bytes The buffer, or NULL.
+ @param capacity The size returned when the buffer was allocated.
+ */
+- (void)recycleBytes:(void *)bytes capacity:(size_t)capacity;
+
+/**
+ Wraps a buffer from the pool in an immutable data object, which recycles the buffer when it is deallocated.
+
+ @param bytes The buffer.
+ @param length The number of bytes of the buffer the data covers.
+ @param capacity The size returned when the buffer was allocated.
+
+ @returns The data object. Copying it does not copy the bytes.
+ */
+- (NSData *)dataWithBytesNoCopy:(void *)bytes length:(NSUInteger)length capacity:(size_t)capacity;
+
+/**
+ Returns an idle context of a kind, or a new one.
+
+ @param kind The kind of context.
+ */
+- (void *)contextOfKind:(const WABufferPoolContextKind *)kind;
+
+/**
+ Gives a context back to the pool. The caller resets it first, so it is ready for its next user.
+
+ @param context The context, or NULL.
+ @param kind The kind of context.
+ */
+- (void)recycleContext:(void *)context ofKind:(const WABufferPoolContextKind *)kind;
+
+/**
+ Frees the buffers and contexts that stayed idle since the last trim. Called as buffers are recycled, at most once per WABufferPoolTrimInterval.
+ */
+- (void)trim;
+
+/**
+ Frees every idle buffer and context.
+ */
+- (void)removeIdleBuffers;
+
+/**
+ Resets the allocation and reuse counters. The byte counts are kept.
+ */
+- (void)resetStatistics;
+
+@end
+
+/**
+ The buffer pool of the extensions working for a storage client.
+ */
+@interface WACloudStorageClient (BufferPool)
+
+/**
+ The pool used by the requests and parsers of the client. Each client gets its own pool when the property is first read.
+ */
+@property (retain) WABufferPool *bufferPool;
+
+@end
@@ -0,0 +1,376 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABufferPool.h"
+
+#import <UIKit/UIKit.h>
+#import <objc/runtime.h>
+
+static char WABufferPoolKey;
+
+/*
+ Returns the size class of the smallest buffer holding length bytes, or -1 if
+ it is larger than any class.
+ */
+static NSInteger WASizeClassForLength(size_t length)
+{
+	size_t size = WABufferPoolMinimumBufferSize;
+	NSInteger sizeClass = 0;
+	while (size < length) {
+		if (++sizeClass == WABufferPoolSizeClassCount) {
+			return -1;
+		}
+		size <<= 1;
+	}
+	return sizeClass;
+}
+
+static size_t WASizeOfClass(NSInteger sizeClass)
+{
+	return (size_t)WABufferPoolMinimumBufferSize << sizeClass;
+}
+
+/*
+ Immutable data over a pooled buffer, which goes back to its pool when the
+ data is deallocated.
+ */
+@interface WAPooledData : NSData {
+@public
+	WABufferPool *pool;
+	void *buffer;
+	NSUInteger bufferLength;
+	size_t capacity;
+}
+
+@end
+
+@implementation WAPooledData
+
+- (void)dealloc
+{
+	[pool recycleBytes:buffer capacity:capacity];
+	[pool release];
+	[super dealloc];
+}
+
+- (const void *)bytes
+{
+	return buffer;
+}
+
+- (NSUInteger)length
+{
+	return bufferLength;
+}
+
+- (id)copyWithZone:(NSZone *)zone
+{
+	return [self retain];
+}
+
+@end
+
+@interface WABufferPool ()
+
+- (void)freeIdleBuffersKeepingNeeded:(BOOL)keepNeeded;
+
+@end
+
+@implementation WABufferPool
+
+@synthesize maxIdleBytes = _maxIdleBytes;
+
++ (WABufferPool *)sharedPool
+{
+	static WABufferPool *pool = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		pool = [[WABufferPool alloc] init];
+	});
+	return pool;
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_maxIdleBytes = WABufferPoolDefaultMaxIdleBytes;
+	_trimmedAt = CFAbsoluteTimeGetCurrent();
+	[[NSNotificationCenter defaultCenter] addObserver:self selector:@selector(removeIdleBuffers) name:UIApplicationDidReceiveMemoryWarningNotification object:nil];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[self removeIdleBuffers];
+	[super dealloc];
+}
+
+- (WABufferPoolStatistics)statistics
+{
+	@synchronized(self) {
+		return _statistics;
+	}
+}
+
+- (void *)allocateBytes:(size_t)length capacity:(size_t *)capacity
+{
+	NSInteger sizeClass = WASizeClassForLength(length);
+	size_t size = sizeClass < 0 ? length : WASizeOfClass(sizeClass);
+	void *bytes = NULL;
+
+	@synchronized(self) {
+		if (sizeClass >= 0 && _idle[sizeClass]) {
+			bytes = _idle[sizeClass];
+			_idle[sizeClass] = *(void **)bytes;
+			_idleCounts[sizeClass]--;
+			_lowIdleCounts[sizeClass] = MIN(_lowIdleCounts[sizeClass], _idleCounts[sizeClass]);
+			_statistics.bytesIdle -= size;
+			_statistics.reuses++;
+		} else {
+			_statistics.allocations++;
+		}
+		_statistics.bytesInUse += size;
+		_statistics.peakBytesInUse = MAX(_statistics.peakBytesInUse, _statistics.bytesInUse);
+	}
+
+	if (!bytes) {
+		bytes = malloc(MAX(size, 1));
+		if (!bytes) {
+			@synchronized(self) {
+				_statistics.bytesInUse -= size;
+			}
+			return NULL;
+		}
+	}
+
+	*capacity = size;
+	return bytes;
+}
+
+- (void *)growBytes:(void *)bytes usedLength:(size_t)usedLength toLength:(size_t)length capacity:(size_t *)capacity
+{
+	if (bytes && length <= *capacity) {
+		return bytes;
+	}
+
+	// at least double, so a buffer grown a little at a time is not copied for every append
+	size_t newCapacity = 0;
+	void *grown = [self allocateBytes:MAX(length, bytes ? *capacity * 2 : 0) capacity:&newCapacity];
+	if (!grown) {
+		return NULL;
+	}
+
+	if (bytes) {
+		memcpy(grown, bytes, MIN(usedLength, *capacity));
+		[self recycleBytes:bytes capacity:*capacity];
+	}
+	*capacity = newCapacity;
+	return grown;
+}
+
+- (void)recycleBytes:(void *)bytes capacity:(size_t)capacity
+{
+	if (!bytes) {
+		return;
+	}
+
+	NSInteger sizeClass = WASizeClassForLength(capacity);
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+	BOOL kept = NO;
+	BOOL trimDue;
+
+	@synchronized(self) {
+		_statistics.bytesInUse -= MIN(_statistics.bytesInUse, capacity);
+		if (sizeClass >= 0 && WASizeOfClass(sizeClass) == capacity && _statistics.bytesIdle + capacity <= _maxIdleBytes) {
+			*(void **)bytes = _idle[sizeClass];
+			_idle[sizeClass] = bytes;
+			_idleCounts[sizeClass]++;
+			_statistics.bytesIdle += capacity;
+			kept = YES;
+		} else {
+			_statistics.releases++;
+		}
+		trimDue = now - _trimmedAt >= WABufferPoolTrimInterval;
+		if (trimDue) {
+			_trimmedAt = now;
+		}
+	}
+
+	if (!kept) {
+		free(bytes);
+	}
+	if (trimDue) {
+		[self trim];
+	}
+}
+
+- (NSData *)dataWithBytesNoCopy:(void *)bytes length:(NSUInteger)length capacity:(size_t)capacity
+{
+	NSParameterAssert(length <= capacity);
+
+	WAPooledData *data = [[WAPooledData alloc] init];
+	data->pool = [self retain];
+	data->buffer = bytes;
+	data->bufferLength = length;
+	data->capacity = capacity;
+	return [data autorelease];
+}
+
+- (void *)contextOfKind:(const WABufferPoolContextKind *)kind
+{
+	@synchronized(self) {
+		for (NSUInteger i = 0; i < WABufferPoolMaxContextKinds; i++) {
+			if (_contexts[i].kind == kind && _contexts[i].count) {
+				void *context = _contexts[i].contexts[--_contexts[i].count];
+				_contexts[i].lowCount = MIN(_contexts[i].lowCount, _contexts[i].count);
+				_statistics.contextReuses++;
+				return context;
+			}
+		}
+		_statistics.contextAllocations++;
+	}
+
+	return kind->create();
+}
+
+- (void)recycleContext:(void *)context ofKind:(const WABufferPoolContextKind *)kind
+{
+	if (!context) {
+		return;
+	}
+
+	@synchronized(self) {
+		NSUInteger slot = WABufferPoolMaxContextKinds;
+		for (NSUInteger i = 0; i < WABufferPoolMaxContextKinds; i++) {
+			if (_contexts[i].kind == kind) {
+				slot = i;
+				break;
+			}
+			if (!_contexts[i].kind && slot == WABufferPoolMaxContextKinds) {
+				slot = i;
+			}
+		}
+
+		if (slot < WABufferPoolMaxContextKinds && _contexts[slot].count < WABufferPoolMaxIdleContexts) {
+			_contexts[slot].kind = kind;
+			_contexts[slot].contexts[_contexts[slot].count++] = context;
+			context = NULL;
+		}
+	}
+
+	if (context) {
+		kind->destroy(context);
+	}
+}
+
+- (void)trim
+{
+	[self freeIdleBuffersKeepingNeeded:YES];
+}
+
+- (void)removeIdleBuffers
+{
+	[self freeIdleBuffersKeepingNeeded:NO];
+}
+
+- (void)resetStatistics
+{
+	@synchronized(self) {
+		_statistics.allocations = 0;
+		_statistics.reuses = 0;
+		_statistics.releases = 0;
+		_statistics.contextAllocations = 0;
+		_statistics.contextReuses = 0;
+		_statistics.peakBytesInUse = _statistics.bytesInUse;
+	}
+}
+
+#pragma mark - Private
+
+- (void)freeIdleBuffersKeepingNeeded:(BOOL)keepNeeded
+{
+	// unlinked under the lock, freed outside it
+	void *released = NULL;
+	void *releasedContexts[WABufferPoolMaxContextKinds * WABufferPoolMaxIdleContexts];
+	const WABufferPoolContextKind *releasedKinds[WABufferPoolMaxContextKinds * WABufferPoolMaxIdleContexts];
+	NSUInteger releasedContextCount = 0;
+
+	@synchronized(self) {
+		for (NSInteger sizeClass = 0; sizeClass < WABufferPoolSizeClassCount; sizeClass++) {
+			// buffers that never left the list since the last trim were beyond the high-water mark
+			NSUInteger count = keepNeeded ? _lowIdleCounts[sizeClass] : _idleCounts[sizeClass];
+			for (NSUInteger i = 0; i < count; i++) {
+				void *bytes = _idle[sizeClass];
+				_idle[sizeClass] = *(void **)bytes;
+				*(void **)bytes = released;
+				released = bytes;
+			}
+			_idleCounts[sizeClass] -= count;
+			_lowIdleCounts[sizeClass] = _idleCounts[sizeClass];
+			_statistics.bytesIdle -= count * WASizeOfClass(sizeClass);
+			_statistics.releases += count;
+		}
+
+		for (NSUInteger i = 0; i < WABufferPoolMaxContextKinds; i++) {
+			NSUInteger count = keepNeeded ? _contexts[i].lowCount : _contexts[i].count;
+			for (NSUInteger j = 0; j < count; j++) {
+				releasedKinds[releasedContextCount] = _contexts[i].kind;
+				releasedContexts[releasedContextCount++] = _contexts[i].contexts[--_contexts[i].count];
+			}
+			_contexts[i].lowCount = _contexts[i].count;
+		}
+		_trimmedAt = CFAbsoluteTimeGetCurrent();
+	}
+
+	while (released) {
+		void *next = *(void **)released;
+		free(released);
+		released = next;
+	}
+	for (NSUInteger i = 0; i < releasedContextCount; i++) {
+		releasedKinds[i]->destroy(releasedContexts[i]);
+	}
+}
+
+@end
+
+@implementation WACloudStorageClient (BufferPool)
+
+- (WABufferPool *)bufferPool
+{
+	@synchronized(self) {
+		WABufferPool *pool = objc_getAssociatedObject(self, &WABufferPoolKey);
+		if (!pool) {
+			pool = [[[WABufferPool alloc] init] autorelease];
+			objc_setAssociatedObject(self, &WABufferPoolKey, pool, OBJC_ASSOCIATION_RETAIN);
+		}
+		return pool;
+	}
+}
+
+- (void)setBufferPool:(WABufferPool *)bufferPool
+{
+	@synchronized(self) {
+		objc_setAssociatedObject(self, &WABufferPoolKey, bufferPool, OBJC_ASSOCIATION_RETAIN);
+	}
+}
+
+@end
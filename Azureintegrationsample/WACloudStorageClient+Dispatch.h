@@ -0,0 +1,57 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+/**
+ Calls a block on a dispatch queue, or right away if the queue is NULL.
+
+ @param queue The queue, or NULL.
+ @param block The block.
+ */
+extern void WAPerformCallback(dispatch_queue_t queue, void (^block)(void));
+
+/**
+ Where the extensions of a storage client do their work and deliver their results.
+
+ By default a request runs its connection, and the parsing of its response, on the run loop of the thread that started it, and its handlers are called there too; for an application that is the main thread. With a work queue, connections deliver their data to that queue instead, so responses are decoded off the thread that asked for them, and with a callback queue the entity, continuation and completion handlers are then called on that queue.
+
+ This applies to streaming fetches, to the cursors, scans and caches built on them, and to entity group transactions. With a callback queue, those objects receive their pages on it, so they should be used from it. With only a work queue, cursors and scans still call back on the thread that created them. Requests sent by the toolkit itself, such as fetchEntitiesWithRequest:usingCompletionHandler:, and the blob and queue extensions, which run timers, keep to the thread that started them. Their delegate callbacks are made there too.
+ */
+@interface WACloudStorageClient (Dispatch)
+
+/**
+ The queue connections deliver their responses to, and responses are parsed on, or nil to use the run loop of the thread that starts each request. The queue must be serial: set its maxConcurrentOperationCount to 1. The default is nil, unless a callbackQueue is set: requests are then also started from the callback queue, which has no run loop, so a private serial queue is used.
+
+ Give each client its own queue to spread the decoding of several clients over several cores.
+ */
+@property (retain) NSOperationQueue *workQueue;
+
+/**
+ The queue results are delivered on, or NULL to call the handlers wherever the response was processed: on the work queue, or on the thread that started the request. Setting a callback queue implies a work queue; see workQueue. The queue should be serial, so entities arrive before the completion of their page. The client retains the queue. The default is NULL.
+ */
+@property (assign) dispatch_queue_t callbackQueue;
+
+/**
+ Calls a block on the callback queue, or right away if there is none. Used by the extensions to deliver results.
+
+ @param block The block.
+ */
+- (void)performCallback:(void (^)(void))block;
+
+@end
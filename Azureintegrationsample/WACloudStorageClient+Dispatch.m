@@ -0,0 +1,106 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACloudStorageClient+Dispatch.h"
+
+#import <objc/runtime.h>
+
+static char WAWorkQueueKey;
+static char WADefaultWorkQueueKey;
+static char WACallbackQueueKey;
+
+/*
+ Holds a retain on a dispatch queue for as long as it is associated with a
+ client; dispatch objects are not Objective-C objects before iOS 6.
+ */
+@interface WADispatchQueueHolder : NSObject {
+@public
+	dispatch_queue_t queue;
+}
+
+@end
+
+@implementation WADispatchQueueHolder
+
+- (void)dealloc
+{
+	if (queue) {
+		dispatch_release(queue);
+	}
+	[super dealloc];
+}
+
+@end
+
+void WAPerformCallback(dispatch_queue_t queue, void (^block)(void))
+{
+	if (queue) {
+		dispatch_async(queue, block);
+	} else {
+		block();
+	}
+}
+
+@implementation WACloudStorageClient (Dispatch)
+
+- (NSOperationQueue *)workQueue
+{
+	NSOperationQueue *workQueue = objc_getAssociatedObject(self, &WAWorkQueueKey);
+	if (workQueue || !self.callbackQueue) {
+		return workQueue;
+	}
+
+	// requests issued from the callback queue have no run loop to schedule their connections on
+	@synchronized(self) {
+		workQueue = objc_getAssociatedObject(self, &WADefaultWorkQueueKey);
+		if (!workQueue) {
+			workQueue = [[[NSOperationQueue alloc] init] autorelease];
+			workQueue.maxConcurrentOperationCount = 1;
+			objc_setAssociatedObject(self, &WADefaultWorkQueueKey, workQueue, OBJC_ASSOCIATION_RETAIN);
+		}
+	}
+	return workQueue;
+}
+
+- (void)setWorkQueue:(NSOperationQueue *)workQueue
+{
+	NSAssert(!workQueue || workQueue.maxConcurrentOperationCount == 1, @"The work queue must be serial");
+	objc_setAssociatedObject(self, &WAWorkQueueKey, workQueue, OBJC_ASSOCIATION_RETAIN);
+}
+
+- (dispatch_queue_t)callbackQueue
+{
+	WADispatchQueueHolder *holder = objc_getAssociatedObject(self, &WACallbackQueueKey);
+	return holder ? holder->queue : NULL;
+}
+
+- (void)setCallbackQueue:(dispatch_queue_t)callbackQueue
+{
+	WADispatchQueueHolder *holder = nil;
+	if (callbackQueue) {
+		holder = [[[WADispatchQueueHolder alloc] init] autorelease];
+		dispatch_retain(callbackQueue);
+		holder->queue = callbackQueue;
+	}
+	objc_setAssociatedObject(self, &WACallbackQueueKey, holder, OBJC_ASSOCIATION_RETAIN);
+}
+
+- (void)performCallback:(void (^)(void))block
+{
+	WAPerformCallback(self.callbackQueue, block);
+}
+
+@end
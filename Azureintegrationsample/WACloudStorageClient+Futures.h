@@ -0,0 +1,317 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+#import "WAFuture.h"
+
+@class WATableEntityBatch;
+
+/**
+ A page of results returned by a future, with the continuation for the next page.
+ */
+@interface WAResultPage : NSObject {
+@private
+	id _items;
+	WAResultContinuation *_resultContinuation;
+}
+
+/**
+ The items of the page: an NSArray, or a WATableEntityBatch for futureFetchEntityBatchWithRequest:.
+ */
+@property (readonly) id items;
+
+/**
+ The continuation for the next page, or nil if this is the last page.
+ */
+@property (readonly) WAResultContinuation *resultContinuation;
+
+/**
+ Initializes a newly created page.
+
+ @param items The items.
+ @param resultContinuation The continuation for the next page, or nil.
+
+ @returns The newly initialized WAResultPage object.
+ */
+- (id)initWithItems:(id)items resultContinuation:(WAResultContinuation *)resultContinuation;
+
+@end
+
+/**
+ Future based variants of the operations of WACloudStorageClient.
+
+ Each method starts the operation of the same name without the future prefix and returns a WAFuture that finishes with its result. Operations that return a page finish with a WAResultPage; operations that only report an error finish with a nil result.
+
+ The operations are started on a thread shared by all clients, whose run loop runs the connections and calls the completion handlers of the toolkit, so they can be started from any thread or dispatch queue, and a thread may block on their futures without stalling them. The futures are finished where the responses are processed, never through the client's callbackQueue, so this holds even when that queue is the main queue and the main thread is the one waiting. Requests to the same host go through the shared WARequestExecutor, so a fan-out of many futures keeps a bounded number of requests in flight. Results are delivered through the completion handlers of WAFuture, on a concurrent queue, so dependent work runs in parallel.
+
+ @see WAFuture
+ */
+@interface WACloudStorageClient (Futures)
+
+///---------------------------------------------------------------------------------------
+/// @name Blob Operations
+///---------------------------------------------------------------------------------------
+
+/**
+ Fetches a page of blob containers.
+
+ @param fetchRequest The request to use to fetch the containers.
+
+ @returns A future whose result is a WAResultPage of WABlobContainer objects.
+ */
+- (WAFuture *)futureFetchBlobContainersWithRequest:(WABlobContainerFetchRequest *)fetchRequest;
+
+/**
+ Fetches a blob container by name.
+
+ @param containerName The name of the container.
+
+ @returns A future whose result is the WABlobContainer.
+ */
+- (WAFuture *)futureFetchBlobContainerNamed:(NSString *)containerName;
+
+/**
+ Adds a blob container.
+
+ @param container The container to add.
+ */
+- (WAFuture *)futureAddBlobContainer:(WABlobContainer *)container;
+
+/**
+ Deletes a blob container.
+
+ @param container The container to delete.
+ */
+- (WAFuture *)futureDeleteBlobContainer:(WABlobContainer *)container;
+
+/**
+ Fetches a page of blobs.
+
+ @param fetchRequest The request to use to fetch the blobs.
+
+ @returns A future whose result is a WAResultPage of WABlob objects.
+ */
+- (WAFuture *)futureFetchBlobsWithRequest:(WABlobFetchRequest *)fetchRequest;
+
+/**
+ Fetches the data of a blob.
+
+ @param blob The blob.
+
+ @returns A future whose result is the NSData of the blob.
+ */
+- (WAFuture *)futureFetchBlobData:(WABlob *)blob;
+
+/**
+ Fetches the data of a blob through the proxy service.
+
+ @param URL The URL of the blob.
+
+ @returns A future whose result is the NSData of the blob.
+ */
+- (WAFuture *)futureFetchBlobDataFromURL:(NSURL *)URL;
+
+/**
+ Adds a blob to a container.
+
+ @param blob The blob to add.
+ @param container The container.
+ */
+- (WAFuture *)futureAddBlob:(WABlob *)blob toContainer:(WABlobContainer *)container;
+
+/**
+ Deletes a blob.
+
+ @param blob The blob to delete.
+ */
+- (WAFuture *)futureDeleteBlob:(WABlob *)blob;
+
+///---------------------------------------------------------------------------------------
+/// @name Queue Operations
+///---------------------------------------------------------------------------------------
+
+/**
+ Fetches a page of queues.
+
+ @param fetchRequest The request to use to fetch the queues.
+
+ @returns A future whose result is a WAResultPage of WAQueue objects.
+ */
+- (WAFuture *)futureFetchQueuesWithRequest:(WAQueueFetchRequest *)fetchRequest;
+
+/**
+ Adds a queue.
+
+ @param queueName The name of the queue.
+ */
+- (WAFuture *)futureAddQueueNamed:(NSString *)queueName;
+
+/**
+ Deletes a queue.
+
+ @param queueName The name of the queue.
+ */
+- (WAFuture *)futureDeleteQueueNamed:(NSString *)queueName;
+
+/**
+ Fetches a message from a queue, making it invisible to other consumers.
+
+ @param queueName The name of the queue.
+
+ @returns A future whose result is the WAQueueMessage, or nil if the queue is empty.
+ */
+- (WAFuture *)futureFetchQueueMessage:(NSString *)queueName;
+
+/**
+ Fetches messages from a queue, making them invisible to other consumers.
+
+ @param fetchRequest The request to use to fetch the messages.
+
+ @returns A future whose result is an array of WAQueueMessage objects.
+ */
+- (WAFuture *)futureFetchQueueMessagesWithRequest:(WAQueueMessageFetchRequest *)fetchRequest;
+
+/**
+ Peeks at the message at the front of a queue.
+
+ @param queueName The name of the queue.
+
+ @returns A future whose result is the WAQueueMessage, or nil if the queue is empty.
+ */
+- (WAFuture *)futurePeekQueueMessage:(NSString *)queueName;
+
+/**
+ Peeks at the messages at the front of a queue.
+
+ @param queueName The name of the queue.
+ @param fetchCount The number of messages to peek at.
+
+ @returns A future whose result is an array of WAQueueMessage objects.
+ */
+- (WAFuture *)futurePeekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount;
+
+/**
+ Deletes a message from a queue.
+
+ @param queueMessage The message, as fetched from the queue.
+ @param queueName The name of the queue.
+ */
+- (WAFuture *)futureDeleteQueueMessage:(WAQueueMessage *)queueMessage queueName:(NSString *)queueName;
+
+/**
+ Adds a message to a queue.
+
+ @param message The text of the message.
+ @param queueName The name of the queue.
+ */
+- (WAFuture *)futureAddMessageToQueue:(NSString *)message queueName:(NSString *)queueName;
+
+///---------------------------------------------------------------------------------------
+/// @name Table Operations
+///---------------------------------------------------------------------------------------
+
+/**
+ Fetches the tables of the account.
+
+ @returns A future whose result is an array of table names.
+ */
+- (WAFuture *)futureFetchTables;
+
+/**
+ Fetches a page of the tables of the account.
+
+ @param resultContinuation The continuation returned with the previous page, or nil for the first page.
+
+ @returns A future whose result is a WAResultPage of table names.
+ */
+- (WAFuture *)futureFetchTablesWithContinuation:(WAResultContinuation *)resultContinuation;
+
+/**
+ Creates a table.
+
+ @param newTableName The name of the table.
+ */
+- (WAFuture *)futureCreateTableNamed:(NSString *)newTableName;
+
+/**
+ Deletes a table.
+
+ @param tableName The name of the table.
+ */
+- (WAFuture *)futureDeleteTableNamed:(NSString *)tableName;
+
+/**
+ Fetches a page of entities.
+
+ @param fetchRequest The request to use to fetch the entities.
+
+ @returns A future whose result is a WAResultPage of WATableEntity objects.
+ */
+- (WAFuture *)futureFetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest;
+
+/**
+ Fetches a page of entities into a columnar batch, decoding the response while it arrives.
+
+ @param fetchRequest The request to use to fetch the entities.
+
+ @returns A future whose result is a WAResultPage whose items are a WATableEntityBatch.
+
+ @see [WACloudStorageClient(Streaming) fetchEntityBatchWithRequest:usingCompletionHandler:]
+ */
+- (WAFuture *)futureFetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest;
+
+/**
+ Inserts an entity.
+
+ @param newEntity The entity to insert.
+ */
+- (WAFuture *)futureInsertEntity:(WATableEntity *)newEntity;
+
+/**
+ Updates an entity.
+
+ @param existingEntity The entity to update.
+ */
+- (WAFuture *)futureUpdateEntity:(WATableEntity *)existingEntity;
+
+/**
+ Merges an entity.
+
+ @param existingEntity The entity to merge.
+ */
+- (WAFuture *)futureMergeEntity:(WATableEntity *)existingEntity;
+
+/**
+ Deletes an entity.
+
+ @param existingEntity The entity to delete.
+ */
+- (WAFuture *)futureDeleteEntity:(WATableEntity *)existingEntity;
+
+/**
+ Executes table operations using entity group transactions.
+
+ @param operations The WATableOperation objects to execute.
+
+ @returns A future whose result is an array of WATableOperationResult objects, in the order of the operations. The future fails with the first error; use executeTableOperations:withCompletionHandler: to see the results of the operations that succeeded alongside the error.
+
+ @see [WACloudStorageClient(Batch) executeTableOperations:withCompletionHandler:]
+ */
+- (WAFuture *)futureExecuteTableOperations:(NSArray *)operations;
+
+@end
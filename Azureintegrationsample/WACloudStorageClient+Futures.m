@@ -0,0 +1,459 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACloudStorageClient+Futures.h"
+
+#import "WACloudStorageClient+Streaming.h"
+#import "WARequestExecutor.h"
+#import "WASharedKeySigner.h"
+#import "WATableBatch.h"
+#import "WAToolkitPrivate.h"
+
+static NSThread *WAFutureThreadInstance = nil;
+
+/*
+ The thread future based operations are started on. Its run loop is kept
+ alive by a port, so it runs for the life of the process.
+ */
+@interface WAFutureThread : NSObject
+
++ (void)performBlock:(void (^)(void))block;
+
+@end
+
+@implementation WAFutureThread
+
++ (void)threadMain:(dispatch_semaphore_t)started
+{
+	NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+	[[NSRunLoop currentRunLoop] addPort:[NSMachPort port] forMode:NSDefaultRunLoopMode];
+	dispatch_semaphore_signal(started);
+	[pool drain];
+
+	while (YES) {
+		pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate distantFuture]];
+		[pool drain];
+	}
+}
+
++ (NSThread *)thread
+{
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		// wait for the run loop, so blocks performed on the thread are not lost
+		dispatch_semaphore_t started = dispatch_semaphore_create(0);
+		WAFutureThreadInstance = [[NSThread alloc] initWithTarget:self selector:@selector(threadMain:) object:(id)started];
+		[WAFutureThreadInstance setName:@"com.microsoft.watoolkit.futures"];
+		[WAFutureThreadInstance start];
+		dispatch_semaphore_wait(started, DISPATCH_TIME_FOREVER);
+		dispatch_release(started);
+	});
+	return WAFutureThreadInstance;
+}
+
++ (void)runBlock:(void (^)(void))block
+{
+	block();
+}
+
++ (void)performBlock:(void (^)(void))block
+{
+	NSThread *thread = [self thread];
+	if ([NSThread currentThread] == thread) {
+		block();
+		return;
+	}
+
+	void (^copied)(void) = [block copy];
+	[self performSelector:@selector(runBlock:) onThread:thread withObject:copied waitUntilDone:NO];
+	[copied release];
+}
+
+@end
+
+@implementation WAResultPage
+
+@synthesize items = _items;
+@synthesize resultContinuation = _resultContinuation;
+
+- (id)initWithItems:(id)items resultContinuation:(WAResultContinuation *)resultContinuation
+{
+	if (!(self = [super init])) {
+		return nil;
+	}
+
+	_items = [items retain];
+	_resultContinuation = [resultContinuation retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_items release];
+	[_resultContinuation release];
+	[super dealloc];
+}
+
+@end
+
+static NSError *WANotStartedError(void)
+{
+	return WAToolkitError(-1, nil, @"The request could not be sent.");
+}
+
+@interface WACloudStorageClient (FuturesPrivate)
+
+- (WAFuture *)futureForStorageType:(WAStorageType)storageType usingBlock:(void (^)(WAFuture *future))block;
+- (WAFuture *)futureUsingBlock:(void (^)(WAFuture *future))block;
+
+@end
+
+@implementation WACloudStorageClient (Futures)
+
+#pragma mark - Blob Operations
+
+- (WAFuture *)futureFetchBlobContainersWithRequest:(WABlobContainerFetchRequest *)fetchRequest
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self fetchBlobContainersWithRequest:fetchRequest usingCompletionHandler:^(NSArray *containers, WAResultContinuation *resultContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:containers resultContinuation:resultContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchBlobContainerNamed:(NSString *)containerName
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self fetchBlobContainerNamed:containerName withCompletionHandler:^(WABlobContainer *container, NSError *error) {
+			[future finishWithResult:container error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureAddBlobContainer:(WABlobContainer *)container
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		BOOL sent = [self addBlobContainer:container withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureDeleteBlobContainer:(WABlobContainer *)container
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		BOOL sent = [self deleteBlobContainer:container withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureFetchBlobsWithRequest:(WABlobFetchRequest *)fetchRequest
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self fetchBlobsWithRequest:fetchRequest usingCompletionHandler:^(NSArray *blobs, WAResultContinuation *resultContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:blobs resultContinuation:resultContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchBlobData:(WABlob *)blob
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self fetchBlobData:blob withCompletionHandler:^(NSData *data, NSError *error) {
+			[future finishWithResult:data error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchBlobDataFromURL:(NSURL *)URL
+{
+	return [self futureUsingBlock:^(WAFuture *future) {
+		BOOL sent = [self fetchBlobDataFromURL:URL withCompletionHandler:^(NSData *data, NSError *error) {
+			[future finishWithResult:data error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureAddBlob:(WABlob *)blob toContainer:(WABlobContainer *)container
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self addBlob:blob toContainer:container withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureDeleteBlob:(WABlob *)blob
+{
+	return [self futureForStorageType:WAStorageTypeBlob usingBlock:^(WAFuture *future) {
+		[self deleteBlob:blob withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+#pragma mark - Queue Operations
+
+- (WAFuture *)futureFetchQueuesWithRequest:(WAQueueFetchRequest *)fetchRequest
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self fetchQueuesWithRequest:fetchRequest usingCompletionHandler:^(NSArray *queues, WAResultContinuation *resultContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:queues resultContinuation:resultContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureAddQueueNamed:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self addQueueNamed:queueName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureDeleteQueueNamed:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self deleteQueueNamed:queueName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchQueueMessage:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self fetchQueueMessage:queueName withCompletionHandler:^(WAQueueMessage *message, NSError *error) {
+			[future finishWithResult:message error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchQueueMessagesWithRequest:(WAQueueMessageFetchRequest *)fetchRequest
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self fetchQueueMessagesWithRequest:fetchRequest usingCompletionHandler:^(NSArray *messages, NSError *error) {
+			[future finishWithResult:messages error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futurePeekQueueMessage:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self peekQueueMessage:queueName withCompletionHandler:^(WAQueueMessage *message, NSError *error) {
+			[future finishWithResult:message error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futurePeekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self peekQueueMessages:queueName fetchCount:fetchCount withCompletionHandler:^(NSArray *messages, NSError *error) {
+			[future finishWithResult:messages error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureDeleteQueueMessage:(WAQueueMessage *)queueMessage queueName:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self deleteQueueMessage:queueMessage queueName:queueName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureAddMessageToQueue:(NSString *)message queueName:(NSString *)queueName
+{
+	return [self futureForStorageType:WAStorageTypeQueue usingBlock:^(WAFuture *future) {
+		[self addMessageToQueue:message queueName:queueName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+#pragma mark - Table Operations
+
+- (WAFuture *)futureFetchTables
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		[self fetchTablesWithCompletionHandler:^(NSArray *tables, NSError *error) {
+			[future finishWithResult:tables error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchTablesWithContinuation:(WAResultContinuation *)resultContinuation
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		[self fetchTablesWithContinuation:resultContinuation usingCompletionHandler:^(NSArray *tables, WAResultContinuation *nextContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:tables resultContinuation:nextContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureCreateTableNamed:(NSString *)newTableName
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		[self createTableNamed:newTableName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureDeleteTableNamed:(NSString *)tableName
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		[self deleteTableNamed:tableName withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		[self fetchEntitiesWithRequest:fetchRequest usingCompletionHandler:^(NSArray *entities, WAResultContinuation *resultContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:entities resultContinuation:resultContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureFetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest
+{
+	// streaming requests go through the executor themselves; the future is finished before any hop to the callback queue
+	return [self futureUsingBlock:^(WAFuture *future) {
+		[self fetchEntityBatchWithRequest:fetchRequest callbackQueue:NULL usingCompletionHandler:^(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error) {
+			WAResultPage *page = [[[WAResultPage alloc] initWithItems:batch resultContinuation:resultContinuation] autorelease];
+			[future finishWithResult:page error:error];
+		}];
+	}];
+}
+
+- (WAFuture *)futureInsertEntity:(WATableEntity *)newEntity
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		BOOL sent = [self insertEntity:newEntity withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureUpdateEntity:(WATableEntity *)existingEntity
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		BOOL sent = [self updateEntity:existingEntity withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureMergeEntity:(WATableEntity *)existingEntity
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		BOOL sent = [self mergeEntity:existingEntity withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureDeleteEntity:(WATableEntity *)existingEntity
+{
+	return [self futureForStorageType:WAStorageTypeTable usingBlock:^(WAFuture *future) {
+		BOOL sent = [self deleteEntity:existingEntity withCompletionHandler:^(NSError *error) {
+			[future finishWithResult:nil error:error];
+		}];
+		if (!sent) {
+			[future finishWithResult:nil error:WANotStartedError()];
+		}
+	}];
+}
+
+- (WAFuture *)futureExecuteTableOperations:(NSArray *)operations
+{
+	return [self futureUsingBlock:^(WAFuture *future) {
+		[self executeTableOperations:operations callbackQueue:NULL withCompletionHandler:^(NSArray *results, NSError *error) {
+			[future finishWithResult:results error:error];
+		}];
+	}];
+}
+
+@end
+
+@implementation WACloudStorageClient (FuturesPrivate)
+
+- (WAFuture *)futureForStorageType:(WAStorageType)storageType usingBlock:(void (^)(WAFuture *future))block
+{
+	// without a shared key the host is not known up front, so the request is not bounded
+	WASharedKeySigner *signer = [WASharedKeySigner signerForCredential:WAStorageClientCredential(self)];
+	NSString *host = [[signer serviceURLForStorageType:storageType] host];
+	if (!host) {
+		return [self futureUsingBlock:block];
+	}
+
+	WAFuture *future = [WAFuture future];
+	[[WARequestExecutor sharedExecutor] performOperationForHost:host usingBlock:^(WARequestExecutorDoneBlock done) {
+		[future addCompletionHandler:^(id result, NSError *error) {
+			done();
+		}];
+
+		// the slot may be handed over on any thread
+		[WAFutureThread performBlock:^{
+			block(future);
+		}];
+	}];
+	return future;
+}
+
+- (WAFuture *)futureUsingBlock:(void (^)(WAFuture *future))block
+{
+	WAFuture *future = [WAFuture future];
+	[WAFutureThread performBlock:^{
+		block(future);
+	}];
+	return future;
+}
+
+@end
@@ -0,0 +1,79 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACloudStorageClient.h"
+
+@class WATableEntity;
+@class WATableEntityBatch;
+@class WATableFetchRequest;
+@class WAResultContinuation;
+
+/**
+ Streaming variants of the table operations of WACloudStorageClient.
+
+ The responses are parsed on the client's work queue, and the handlers called on its callback queue, when those are set.
+
+ @see WACloudStorageClient(Dispatch)
+ */
+@interface WACloudStorageClient (Streaming)
+
+/**
+ Fetch entities from a table asynchronously, decoding them while the response is still arriving.
+
+ The response is fed through a WAEntityStreamParser, or a WAJSONEntityParser when the client's tableWireFormat is one of the JSON formats, as it is received, so each entity reaches the entity handler as soon as it has been read and the page is never held in memory as a whole. Use this instead of fetchEntitiesWithRequest:usingCompletionHandler: for large pages or wide entities. The client must have been created with an account name and access key.
+
+ @param fetchRequest The request to use to fetch the entities.
+ @param entityHandler A block object called for every entity, in the order returned by the service.
+ @param block A block object called once the page has been read. The block will contain the result continuation for the next page or an error if one occurs.
+
+ @see WAEntityStreamParser
+ */
+- (void)fetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingEntityHandler:(void (^)(WATableEntity *entity))entityHandler completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block;
+
+/**
+ Fetch entities from a table asynchronously, decoding them while the response is still arriving, and report the continuation as soon as it is known.
+
+ The continuation is sent in the response headers, so the continuation handler is called before the first entity is decoded. This lets a caller request the next page while the current one is still being read.
+
+ @param fetchRequest The request to use to fetch the entities.
+ @param entityHandler A block object called for every entity, in the order returned by the service.
+ @param continuationHandler A block object called once the response headers arrive, with the result continuation for the next page or nil if this is the last page. The block is not called if the request fails before a successful response is received.
+ @param block A block object called once the page has been read. The block will contain the result continuation for the next page or an error if one occurs.
+ */
+- (void)fetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingEntityHandler:(void (^)(WATableEntity *entity))entityHandler continuationHandler:(void (^)(WAResultContinuation *resultContinuation))continuationHandler completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block;
+
+/**
+ Fetch a page of entities from a table asynchronously into a columnar batch.
+
+ The response is decoded while it arrives, straight into the typed columns of a WATableEntityBatch, without creating a WATableEntity or a dictionary per row. Use this for large pages that are scanned rather than edited.
+
+ @param fetchRequest The request to use to fetch the entities.
+ @param block A block object called once the page has been read. The block will contain the batch and the result continuation for the next page, or an error if one occurs.
+
+ @see WATableEntityBatch
+ */
+- (void)fetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest usingCompletionHandler:(void (^)(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error))block;
+
+/**
+ Fetch a page of entities from a table asynchronously into a columnar batch, calling the block on a given queue instead of the client's callbackQueue.
+
+ @param fetchRequest The request to use to fetch the entities.
+ @param callbackQueue The queue to call the block on, or NULL to call it where the response was processed.
+ @param block A block object called once the page has been read. The block will contain the batch and the result continuation for the next page, or an error if one occurs.
+ */
+- (void)fetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest callbackQueue:(dispatch_queue_t)callbackQueue usingCompletionHandler:(void (^)(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error))block;
+
+@end
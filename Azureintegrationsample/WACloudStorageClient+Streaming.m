@@ -0,0 +1,196 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACloudStorageClient+Streaming.h"
+
+#import "WABufferPool.h"
+#import "WACloudStorageClient+Dispatch.h"
+#import "WAEntityStreamParser.h"
+#import "WAJSONEntityParser.h"
+#import "WAResultContinuation.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WATableEntityBatch.h"
+#import "WATableFetchRequest+Query.h"
+#import "WATableWireFormat.h"
+#import "WAToolkitPrivate.h"
+
+@interface WACloudStorageClient (StreamingPrivate)
+
+- (id<WAEntityParser>)parserForFetchRequest:(WATableFetchRequest *)fetchRequest wireFormat:(WATableWireFormat)wireFormat entityHandler:(void (^)(WATableEntity *entity))entityHandler entityBatch:(WATableEntityBatch *)batch;
+- (void)streamEntitiesWithRequest:(WATableFetchRequest *)fetchRequest wireFormat:(WATableWireFormat)wireFormat parser:(id<WAEntityParser>)parser continuationHandler:(void (^)(WAResultContinuation *resultContinuation))continuationHandler callbackQueue:(dispatch_queue_t)callbackQueue completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block;
+
+@end
+
+@implementation WACloudStorageClient (Streaming)
+
+- (void)fetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingEntityHandler:(void (^)(WATableEntity *entity))entityHandler completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block
+{
+	[self fetchEntitiesWithRequest:fetchRequest usingEntityHandler:entityHandler continuationHandler:nil completionHandler:block];
+}
+
+- (void)fetchEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingEntityHandler:(void (^)(WATableEntity *entity))entityHandler continuationHandler:(void (^)(WAResultContinuation *resultContinuation))continuationHandler completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block
+{
+	dispatch_queue_t callbackQueue = self.callbackQueue;
+	if (callbackQueue) {
+		void (^handler)(WATableEntity *entity) = entityHandler;
+		entityHandler = ^(WATableEntity *entity) {
+			WAPerformCallback(callbackQueue, ^{
+				handler(entity);
+			});
+		};
+	}
+
+	WATableWireFormat wireFormat = self.tableWireFormat;
+	id<WAEntityParser> parser = [self parserForFetchRequest:fetchRequest wireFormat:wireFormat entityHandler:entityHandler entityBatch:nil];
+	[self streamEntitiesWithRequest:fetchRequest wireFormat:wireFormat parser:parser continuationHandler:continuationHandler callbackQueue:callbackQueue completionHandler:block];
+}
+
+- (void)fetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest usingCompletionHandler:(void (^)(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error))block
+{
+	[self fetchEntityBatchWithRequest:fetchRequest callbackQueue:self.callbackQueue usingCompletionHandler:block];
+}
+
+- (void)fetchEntityBatchWithRequest:(WATableFetchRequest *)fetchRequest callbackQueue:(dispatch_queue_t)callbackQueue usingCompletionHandler:(void (^)(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error))block
+{
+	WATableEntityBatch *batch = [[[WATableEntityBatch alloc] initWithTableName:fetchRequest.tableName] autorelease];
+	WATableWireFormat wireFormat = self.tableWireFormat;
+	id<WAEntityParser> parser = [self parserForFetchRequest:fetchRequest wireFormat:wireFormat entityHandler:nil entityBatch:batch];
+	[self streamEntitiesWithRequest:fetchRequest wireFormat:wireFormat parser:parser continuationHandler:nil callbackQueue:callbackQueue completionHandler:^(WAResultContinuation *resultContinuation, NSError *error) {
+		block(error ? nil : batch, resultContinuation, error);
+	}];
+}
+
+@end
+
+@implementation WACloudStorageClient (StreamingPrivate)
+
+- (id<WAEntityParser>)parserForFetchRequest:(WATableFetchRequest *)fetchRequest wireFormat:(WATableWireFormat)wireFormat entityHandler:(void (^)(WATableEntity *entity))entityHandler entityBatch:(WATableEntityBatch *)batch
+{
+	if (!WATableWireFormatIsJSON(wireFormat)) {
+		WAEntityStreamParser *parser = nil;
+		if (batch) {
+			parser = [[[WAEntityStreamParser alloc] initWithTableName:fetchRequest.tableName entityBatch:batch] autorelease];
+		} else {
+			parser = [[[WAEntityStreamParser alloc] initWithTableName:fetchRequest.tableName entityHandler:entityHandler] autorelease];
+		}
+		parser.bufferPool = self.bufferPool;
+		return parser;
+	}
+
+	WAJSONEntityParser *parser = nil;
+	if (batch) {
+		parser = [[[WAJSONEntityParser alloc] initWithTableName:fetchRequest.tableName entityBatch:batch] autorelease];
+	} else {
+		parser = [[[WAJSONEntityParser alloc] initWithTableName:fetchRequest.tableName entityHandler:entityHandler] autorelease];
+	}
+	parser.propertyTypes = fetchRequest.propertyTypes;
+	parser.bufferPool = self.bufferPool;
+	return parser;
+}
+
+- (void)streamEntitiesWithRequest:(WATableFetchRequest *)fetchRequest wireFormat:(WATableWireFormat)wireFormat parser:(id<WAEntityParser>)parser continuationHandler:(void (^)(WAResultContinuation *resultContinuation))continuationHandler callbackQueue:(dispatch_queue_t)callbackQueue completionHandler:(void (^)(WAResultContinuation *resultContinuation, NSError *error))block
+{
+	WASharedKeySigner *signer = [WASharedKeySigner signerForCredential:WAStorageClientCredential(self)];
+	if (!signer) {
+		NSError *error = WAToolkitError(-1, nil, @"Streaming fetches require a credential with an account name and access key.");
+		WAPerformCallback(callbackQueue, ^{
+			block(nil, error);
+		});
+		return;
+	}
+
+	if (fetchRequest.selectedProperties && !parser.selectedProperties) {
+		parser.selectedProperties = [NSSet setWithArray:fetchRequest.selectedProperties];
+	}
+
+	NSMutableURLRequest *request = [signer requestForStorageType:WAStorageTypeTable path:[fetchRequest queryPath] query:[fetchRequest queryString] httpMethod:@"GET"];
+	WATableWireFormatPrepareRequest(request, wireFormat);
+	WARequestMetrics *metrics = [self metricsForOperation:@"QueryEntities" resourceName:fetchRequest.tableName];
+	metrics.pageIndex = fetchRequest.pageIndex;
+	[signer signRequest:request forStorageType:WAStorageTypeTable metrics:metrics];
+
+	WAStreamingURLRequest *streamingRequest = [WAStreamingURLRequest requestWithURLRequest:request];
+	streamingRequest.retryPolicy = self.retryPolicy;
+	streamingRequest.metrics = metrics;
+	streamingRequest.delegateQueue = self.workQueue;
+	if (fetchRequest.partitionKey) {
+		streamingRequest.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForPartition(signer.accountName, fetchRequest.tableName, fetchRequest.partitionKey)];
+	}
+
+	// __block variables are not retained by blocks; these are released in the completion handler
+	__block WAResultContinuation *continuation = nil;
+	__block NSError *parseError = nil;
+	__block BOOL receivedData = NO;
+
+	streamingRequest.responseHandler = ^(NSHTTPURLResponse *response) {
+		NSString *nextPartitionKey = WAHeaderValueForKey(response, @"x-ms-continuation-NextPartitionKey");
+		if (nextPartitionKey) {
+			continuation = [[WAResultContinuation alloc] initWithNextParitionKey:nextPartitionKey
+																	  nextRowKey:WAHeaderValueForKey(response, @"x-ms-continuation-NextRowKey")];
+		}
+
+		if (continuationHandler && response.statusCode < 300) {
+			WAResultContinuation *nextContinuation = continuation;
+			WAPerformCallback(callbackQueue, ^{
+				continuationHandler(nextContinuation);
+			});
+		}
+	};
+
+	streamingRequest.dataHandler = ^(NSData *data) {
+		if (parseError) {
+			return;
+		}
+
+		receivedData = YES;
+		NSError *error = nil;
+		if (![parser parseData:data error:&error]) {
+			parseError = [error retain];
+		}
+	};
+
+	[streamingRequest startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		NSError *finishError = nil;
+		if (!error && !parseError && receivedData && ![parser finishWithError:&finishError]) {
+			parseError = [finishError retain];
+		}
+
+		if (!error && response.statusCode >= 300) {
+			NSString *message = parser.errorMessage ? parser.errorMessage : [NSHTTPURLResponse localizedStringForStatusCode:response.statusCode];
+			error = WAToolkitError(response.statusCode, parser.errorCode, message);
+		}
+
+		if (!error) {
+			error = parseError;
+		}
+
+		LOGLINE(@"Streamed %lu entities from %@", (unsigned long)parser.entityCount, fetchRequest.tableName);
+		// the callback may run after this block returns, so it captures what it needs
+		WAResultContinuation *resultContinuation = error ? nil : continuation;
+		WAPerformCallback(callbackQueue, ^{
+			block(resultContinuation, error);
+		});
+
+		[continuation release];
+		[parseError release];
+	}];
+}
+
+@end
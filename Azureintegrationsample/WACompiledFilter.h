@@ -0,0 +1,107 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WATableFetchRequest.h"
+
+/**
+ A table query filter translated from a predicate once and then reused with different values.
+
+ The predicate is written with variables in place of the values that change between queries, for example PartitionKey == $customer AND Amount > $minimum. Compiling it walks the predicate tree once and produces the OData text around each variable; binding values only formats the values and joins them with that text.
+
+ Comparisons (==, !=, <, <=, >, >=) between a property name and a constant or variable are supported, combined with AND, OR and NOT. Values may be NSString, NSNumber (including booleans), NSDate and NSData objects.
+ */
+@interface WACompiledFilter : NSObject {
+@private
+	NSString *_predicateFormat;
+	NSUInteger _slotCount;
+	NSString **_literals;
+	NSUInteger *_slotVariables;
+	NSArray *_variableNames;
+	NSUInteger _literalLength;
+	NSUInteger _capacityHint;
+}
+
+/**
+ The predicate format the filter was compiled from.
+ */
+@property (readonly) NSString *predicateFormat;
+
+/**
+ The names of the variables of the filter, without the leading $, in the order they first appear.
+ */
+@property (readonly) NSArray *variableNames;
+
+/**
+ Returns the compiled filter for a predicate format, compiling it the first time the format is seen.
+
+ Compiled filters are kept in a cache shared by the whole process, so the format should contain variables rather than values. Values substituted into the format with %@ make every format distinct and defeat the cache.
+
+ @param format The predicate format.
+ @param error An NSError object that will be populated if the format is not valid or cannot be expressed as a table filter.
+
+ @returns The compiled filter, or nil on error.
+ */
++ (WACompiledFilter *)compiledFilterWithPredicateFormat:(NSString *)format error:(NSError **)error;
+
+/**
+ Empties the process wide cache of compiled filters.
+ */
++ (void)removeAllCachedFilters;
+
+/**
+ Initializes a newly created filter by compiling a predicate, without going through the cache.
+
+ @param predicate The predicate, which may contain variables.
+ @param error An NSError object that will be populated if the predicate cannot be expressed as a table filter.
+
+ @returns The newly initialized WACompiledFilter object, or nil on error.
+ */
+- (id)initWithPredicate:(NSPredicate *)predicate error:(NSError **)error;
+
+/**
+ Returns the filter string with values bound to the variables.
+
+ @param variables The values, keyed by variable name without the leading $.
+ @param error An NSError object that will be populated if a variable has no value or a value of an unsupported class.
+
+ @returns The OData filter string, not URL encoded, or nil on error.
+ */
+- (NSString *)filterStringWithVariables:(NSDictionary *)variables error:(NSError **)error;
+
+@end
+
+/**
+ Creates fetch requests from compiled filters.
+ */
+@interface WATableFetchRequest (CompiledFilter)
+
+/**
+ Create a new WATableFetchRequest with a table name and a predicate format whose variables are bound to values.
+
+ This is the cached equivalent of fetchRequestForTable:predicate:error: with a predicate made by predicateWithSubstitutionVariables:.
+
+ @param tableName The table name for the fetch request.
+ @param format The predicate format, with variables for the values.
+ @param variables The values, keyed by variable name without the leading $.
+ @param error An NSError object that will be populated if the format or a value is not valid.
+
+ @returns The newly initialized WATableFetchRequest object, or nil on error.
+ */
++ (WATableFetchRequest *)fetchRequestForTable:(NSString *)tableName predicateFormat:(NSString *)format variables:(NSDictionary *)variables error:(NSError **)error;
+
+@end
@@ -0,0 +1,440 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACompiledFilter.h"
+
+#import <time.h>
+
+#import "WAToolkitPrivate.h"
+
+// formats are expected to be few; a cache that grows past this is holding formats with values baked in
+#define WACompiledFilterCacheLimit 256
+
+static NSMutableDictionary *WACompiledFilterCache = nil;
+
+static NSError *WAFilterError(NSString *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	NSString *message = [[[NSString alloc] initWithFormat:format arguments:arguments] autorelease];
+	va_end(arguments);
+
+	return WAToolkitError(-1, nil, message);
+}
+
+static void WAAppendDouble(NSMutableString *string, double value)
+{
+	char buffer[32];
+	snprintf(buffer, sizeof(buffer), "%.15g", value);
+	if (strtod(buffer, NULL) != value) {
+		snprintf(buffer, sizeof(buffer), "%.17g", value);
+	}
+
+	// an integral double without a decimal point would be read back as an integer
+	BOOL integral = strpbrk(buffer, ".eEni") == NULL;
+	CFStringAppendCString((CFMutableStringRef)string, buffer, kCFStringEncodingASCII);
+	if (integral) {
+		[string appendString:@".0"];
+	}
+}
+
+static void WAAppendDate(NSMutableString *string, NSDate *date)
+{
+	NSTimeInterval interval = [date timeIntervalSince1970];
+	time_t seconds = (time_t)floor(interval);
+	long ticks = lround((interval - (double)seconds) * 1e7);
+	if (ticks >= 10000000) {
+		seconds++;
+		ticks -= 10000000;
+	}
+
+	struct tm parts;
+	gmtime_r(&seconds, &parts);
+
+	char buffer[64];
+	snprintf(buffer, sizeof(buffer), "datetime'%04d-%02d-%02dT%02d:%02d:%02d.%07ldZ'",
+			 parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday, parts.tm_hour, parts.tm_min, parts.tm_sec, ticks);
+	CFStringAppendCString((CFMutableStringRef)string, buffer, kCFStringEncodingASCII);
+}
+
+static void WAAppendBinary(NSMutableString *string, NSData *data)
+{
+	static const char digits[] = "0123456789abcdef";
+	const uint8_t *bytes = [data bytes];
+	NSUInteger length = [data length];
+
+	[string appendString:@"X'"];
+	char buffer[256];
+	NSUInteger used = 0;
+	for (NSUInteger i = 0; i < length; i++) {
+		buffer[used++] = digits[bytes[i] >> 4];
+		buffer[used++] = digits[bytes[i] & 0x0f];
+		if (used == sizeof(buffer) - 1 || i == length - 1) {
+			buffer[used] = '\0';
+			CFStringAppendCString((CFMutableStringRef)string, buffer, kCFStringEncodingASCII);
+			used = 0;
+		}
+	}
+	[string appendString:@"'"];
+}
+
+/*
+ Appends a value as an OData literal. Returns NO for a value of an unsupported class.
+ */
+static BOOL WAAppendLiteral(NSMutableString *string, id value)
+{
+	if ([value isKindOfClass:[NSString class]]) {
+		[string appendString:@"'"];
+		if ([value rangeOfString:@"'"].location == NSNotFound) {
+			[string appendString:value];
+		} else {
+			[string appendString:[value stringByReplacingOccurrencesOfString:@"'" withString:@"''"]];
+		}
+		[string appendString:@"'"];
+		return YES;
+	}
+
+	if ([value isKindOfClass:[NSNumber class]]) {
+		if (CFGetTypeID(value) == CFBooleanGetTypeID()) {
+			[string appendString:[value boolValue] ? @"true" : @"false"];
+			return YES;
+		}
+
+		const char *type = [value objCType];
+		if (*type == 'f' || *type == 'd') {
+			WAAppendDouble(string, [value doubleValue]);
+			return YES;
+		}
+
+		long long integer = [value longLongValue];
+		[string appendFormat:(integer < INT32_MIN || integer > INT32_MAX) ? @"%lldL" : @"%lld", integer];
+		return YES;
+	}
+
+	if ([value isKindOfClass:[NSDate class]]) {
+		WAAppendDate(string, value);
+		return YES;
+	}
+
+	if ([value isKindOfClass:[NSData class]]) {
+		WAAppendBinary(string, value);
+		return YES;
+	}
+
+	return NO;
+}
+
+/*
+ The state of a compilation: the literal text being built and the slots found so far.
+ */
+@interface WACompiledFilterBuilder : NSObject {
+@public
+	NSMutableArray *literals;
+	NSMutableArray *slotVariables;
+	NSMutableArray *variableNames;
+	NSMutableString *current;
+	NSError *error;
+}
+
+@end
+
+@implementation WACompiledFilterBuilder
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	literals = [[NSMutableArray alloc] init];
+	slotVariables = [[NSMutableArray alloc] init];
+	variableNames = [[NSMutableArray alloc] init];
+	current = [[NSMutableString alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[literals release];
+	[slotVariables release];
+	[variableNames release];
+	[current release];
+	[error release];
+	[super dealloc];
+}
+
+- (void)fail:(NSError *)failure
+{
+	if (!error) {
+		error = [failure retain];
+	}
+}
+
+- (void)appendVariable:(NSString *)name
+{
+	NSUInteger index = [variableNames indexOfObject:name];
+	if (index == NSNotFound) {
+		index = variableNames.count;
+		[variableNames addObject:name];
+	}
+
+	[literals addObject:[[current copy] autorelease]];
+	[current setString:@""];
+	[slotVariables addObject:[NSNumber numberWithUnsignedInteger:index]];
+}
+
+- (void)appendOperand:(NSExpression *)expression
+{
+	switch (expression.expressionType) {
+		case NSConstantValueExpressionType:
+			if (!WAAppendLiteral(current, expression.constantValue)) {
+				[self fail:WAFilterError(@"Values of class %@ cannot be used in a table filter.", [expression.constantValue class])];
+			}
+			break;
+		case NSVariableExpressionType:
+			[self appendVariable:expression.variable];
+			break;
+		default:
+			[self fail:WAFilterError(@"The expression %@ cannot be used as a value in a table filter.", expression)];
+			break;
+	}
+}
+
+- (void)appendComparison:(NSComparisonPredicate *)predicate
+{
+	static NSString *const operators[] = { @"lt", @"le", @"gt", @"ge", @"eq", @"ne" };
+	static NSString *const reversedOperators[] = { @"gt", @"ge", @"lt", @"le", @"eq", @"ne" };
+
+	NSPredicateOperatorType type = predicate.predicateOperatorType;
+	if (type > NSNotEqualToPredicateOperatorType || predicate.comparisonPredicateModifier != NSDirectPredicateModifier || predicate.options) {
+		[self fail:WAFilterError(@"The comparison %@ cannot be expressed as a table filter.", predicate)];
+		return;
+	}
+
+	NSExpression *left = predicate.leftExpression;
+	NSExpression *right = predicate.rightExpression;
+	BOOL reversed = left.expressionType != NSKeyPathExpressionType;
+	NSExpression *property = reversed ? right : left;
+	NSExpression *value = reversed ? left : right;
+	if (property.expressionType != NSKeyPathExpressionType) {
+		[self fail:WAFilterError(@"The comparison %@ does not compare a property.", predicate)];
+		return;
+	}
+
+	[current appendFormat:@"%@ %@ ", property.keyPath, reversed ? reversedOperators[type] : operators[type]];
+	[self appendOperand:value];
+}
+
+- (void)appendPredicate:(NSPredicate *)predicate
+{
+	if (error) {
+		return;
+	}
+
+	if ([predicate isKindOfClass:[NSComparisonPredicate class]]) {
+		[self appendComparison:(NSComparisonPredicate *)predicate];
+		return;
+	}
+
+	if ([predicate isKindOfClass:[NSCompoundPredicate class]]) {
+		NSCompoundPredicate *compound = (NSCompoundPredicate *)predicate;
+		NSArray *subpredicates = compound.subpredicates;
+		if (compound.compoundPredicateType == NSNotPredicateType) {
+			[current appendString:@"not ("];
+			[self appendPredicate:[subpredicates lastObject]];
+			[current appendString:@")"];
+			return;
+		}
+
+		NSString *separator = compound.compoundPredicateType == NSAndPredicateType ? @" and " : @" or ";
+		[subpredicates enumerateObjectsUsingBlock:^(NSPredicate *subpredicate, NSUInteger index, BOOL *stop) {
+			if (index) {
+				[current appendString:separator];
+			}
+			[current appendString:@"("];
+			[self appendPredicate:subpredicate];
+			[current appendString:@")"];
+		}];
+		return;
+	}
+
+	[self fail:WAFilterError(@"The predicate %@ cannot be expressed as a table filter.", predicate)];
+}
+
+@end
+
+@implementation WACompiledFilter
+
+@synthesize predicateFormat = _predicateFormat;
+@synthesize variableNames = _variableNames;
+
++ (WACompiledFilter *)compiledFilterWithPredicateFormat:(NSString *)format error:(NSError **)error
+{
+	@synchronized(self) {
+		WACompiledFilter *filter = [WACompiledFilterCache objectForKey:format];
+		if (filter) {
+			return [[filter retain] autorelease];
+		}
+	}
+
+	NSPredicate *predicate = nil;
+	@try {
+		predicate = [NSPredicate predicateWithFormat:format argumentArray:nil];
+	}
+	@catch (NSException *exception) {
+		if (error) {
+			*error = WAFilterError(@"The predicate format is not valid: %@", exception.reason);
+		}
+		return nil;
+	}
+
+	WACompiledFilter *filter = [[[WACompiledFilter alloc] initWithPredicate:predicate error:error] autorelease];
+	if (!filter) {
+		return nil;
+	}
+	[filter->_predicateFormat release];
+	filter->_predicateFormat = [format copy];
+
+	@synchronized(self) {
+		if (!WACompiledFilterCache) {
+			WACompiledFilterCache = [[NSMutableDictionary alloc] init];
+		}
+		if (WACompiledFilterCache.count >= WACompiledFilterCacheLimit) {
+			LOG(@"Compiled filter cache is full; formats should use variables instead of values");
+			[WACompiledFilterCache removeAllObjects];
+		}
+
+		// another thread may have compiled the same format meanwhile; either copy will do
+		[WACompiledFilterCache setObject:filter forKey:format];
+	}
+
+	return filter;
+}
+
++ (void)removeAllCachedFilters
+{
+	@synchronized(self) {
+		[WACompiledFilterCache removeAllObjects];
+	}
+}
+
+- (id)initWithPredicate:(NSPredicate *)predicate error:(NSError **)error
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	WACompiledFilterBuilder *builder = [[[WACompiledFilterBuilder alloc] init] autorelease];
+	[builder appendPredicate:predicate];
+	if (builder->error) {
+		if (error) {
+			*error = [[builder->error retain] autorelease];
+		}
+		[self release];
+		return nil;
+	}
+	[builder->literals addObject:[[builder->current copy] autorelease]];
+
+	_predicateFormat = [[predicate predicateFormat] copy];
+	_variableNames = [builder->variableNames copy];
+	_slotCount = builder->slotVariables.count;
+	_literals = calloc(_slotCount + 1, sizeof(NSString *));
+	_slotVariables = calloc(_slotCount + 1, sizeof(NSUInteger));
+	for (NSUInteger i = 0; i <= _slotCount; i++) {
+		_literals[i] = [[builder->literals objectAtIndex:i] retain];
+		_literalLength += _literals[i].length;
+		if (i < _slotCount) {
+			_slotVariables[i] = [[builder->slotVariables objectAtIndex:i] unsignedIntegerValue];
+		}
+	}
+	_capacityHint = _literalLength + _slotCount * 24;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	for (NSUInteger i = 0; _literals && i <= _slotCount; i++) {
+		[_literals[i] release];
+	}
+	free(_literals);
+	free(_slotVariables);
+	[_predicateFormat release];
+	[_variableNames release];
+	[super dealloc];
+}
+
+- (NSString *)filterStringWithVariables:(NSDictionary *)variables error:(NSError **)error
+{
+	NSUInteger variableCount = _variableNames.count;
+	id values[variableCount + 1];
+	for (NSUInteger i = 0; i < variableCount; i++) {
+		NSString *name = [_variableNames objectAtIndex:i];
+		values[i] = [variables objectForKey:name];
+		if (!values[i]) {
+			if (error) {
+				*error = WAFilterError(@"No value for the filter variable $%@.", name);
+			}
+			return nil;
+		}
+	}
+
+	NSMutableString *string = [NSMutableString stringWithCapacity:_capacityHint];
+	for (NSUInteger i = 0; i < _slotCount; i++) {
+		[string appendString:_literals[i]];
+		id value = values[_slotVariables[i]];
+		if (!WAAppendLiteral(string, value)) {
+			if (error) {
+				*error = WAFilterError(@"Values of class %@ cannot be used in a table filter.", [value class]);
+			}
+			return nil;
+		}
+	}
+	[string appendString:_literals[_slotCount]];
+
+	// the hint only ever grows, so a racing write loses nothing but a reallocation
+	if (string.length > _capacityHint) {
+		_capacityHint = string.length;
+	}
+
+	return string;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@: %p; %@>", [self class], self, _predicateFormat];
+}
+
+@end
+
+@implementation WATableFetchRequest (CompiledFilter)
+
++ (WATableFetchRequest *)fetchRequestForTable:(NSString *)tableName predicateFormat:(NSString *)format variables:(NSDictionary *)variables error:(NSError **)error
+{
+	WACompiledFilter *filter = [WACompiledFilter compiledFilterWithPredicateFormat:format error:error];
+	NSString *filterString = [filter filterStringWithVariables:variables error:error];
+	if (!filterString) {
+		return nil;
+	}
+
+	WATableFetchRequest *request = [WATableFetchRequest fetchRequestForTable:tableName];
+	request.filter = filterString;
+
+	return request;
+}
+
+@end
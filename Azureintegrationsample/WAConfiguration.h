@@ -16,6 +16,14 @@
 
 #import <Foundation/Foundation.h>
 
+/*
+ Request rates used when the configuration does not set them, per the published storage scalability targets.
+ */
+#define WAConfigurationDefaultAccountRequestsPerSecond 20000.0
+#define WAConfigurationDefaultPartitionRequestsPerSecond 2000.0
+#define WAConfigurationDefaultQueueRequestsPerSecond 2000.0
+#define WAConfigurationDefaultBlobRequestsPerSecond 500.0
+
 typedef enum {
 	WAConnectDirect = 0,
 	WAConnectProxyMembership = 1,
@@ -26,6 +34,7 @@ typedef enum {
 @private
 	WAConnectionType _type;
     NSDictionary *_values;
+	NSDictionary *_throttling;
 }
 
 @property (readonly) WAConnectionType connectionType;
@@ -36,6 +45,11 @@ typedef enum {
 // Proxy ACS
 @property (readonly) NSString *ACSNamespace;
 @property (readonly) NSString *ACSRealm;
+// Throttling, read from the optional Throttling dictionary of ToolkitConfig
+@property (readonly) double accountRequestsPerSecond;
+@property (readonly) double partitionRequestsPerSecond;
+@property (readonly) double queueRequestsPerSecond;
+@property (readonly) double blobRequestsPerSecond;
 
 + (WAConfiguration *)sharedConfiguration;
 
@@ -40,6 +40,8 @@
 		return nil;
 	}
 	
+	_throttling = [[values objectForKey:@"Throttling"] retain];
+
 	NSString *type = [values objectForKey:@"ConnectionType"];
 	if(!values) {
 		
@@ -75,6 +77,12 @@
 	return self;
 }
 
+- (void)dealloc
+{
+	[_values release];
+	[_throttling release];
+	[super dealloc];
+}
 
 - (WAConnectionType) connectionType
 {
@@ -106,6 +114,32 @@
 	return [_values objectForKey:@"ProxyService"];
 }
 
+- (double)requestsPerSecondForKey:(NSString *)key defaultValue:(double)defaultValue
+{
+	NSNumber *value = [_throttling objectForKey:key];
+	return [value doubleValue] > 0 ? [value doubleValue] : defaultValue;
+}
+
+- (double)accountRequestsPerSecond
+{
+	return [self requestsPerSecondForKey:@"AccountRequestsPerSecond" defaultValue:WAConfigurationDefaultAccountRequestsPerSecond];
+}
+
+- (double)partitionRequestsPerSecond
+{
+	return [self requestsPerSecondForKey:@"PartitionRequestsPerSecond" defaultValue:WAConfigurationDefaultPartitionRequestsPerSecond];
+}
+
+- (double)queueRequestsPerSecond
+{
+	return [self requestsPerSecondForKey:@"QueueRequestsPerSecond" defaultValue:WAConfigurationDefaultQueueRequestsPerSecond];
+}
+
+- (double)blobRequestsPerSecond
+{
+	return [self requestsPerSecondForKey:@"BlobRequestsPerSecond" defaultValue:WAConfigurationDefaultBlobRequestsPerSecond];
+}
+
 - (NSString *)proxyURL
 {
 	NSURL *absURL = [NSURL URLWithString:[NSString stringWithFormat:@"https://%@.cloudapp.net/", self.proxyNamespace]];	
@@ -0,0 +1,146 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The Entity Data Model types the table service uses for property values.
+ */
+typedef enum {
+	WAEdmTypeString = 0,
+	WAEdmTypeInt32,
+	WAEdmTypeInt64,
+	WAEdmTypeDouble,
+	WAEdmTypeBoolean,
+	WAEdmTypeDateTime,
+	WAEdmTypeBinary,
+	WAEdmTypeGuid
+} WAEdmType;
+
+/**
+ Returns the type named by an m:type attribute value, for example Edm.Int64.
+
+ @param name The attribute value, which need not be NUL terminated.
+ @param length The length of the value in bytes.
+
+ @returns The type. Unknown names and a missing attribute are Edm.String.
+ */
+static inline WAEdmType WAEdmTypeFromName(const char *name, size_t length)
+{
+	if (length < 5 || strncmp(name, "Edm.", 4) != 0) {
+		return WAEdmTypeString;
+	}
+
+	name += 4;
+	length -= 4;
+
+#define WAEdmTypeNameIs(literal) (length == sizeof(literal) - 1 && memcmp(name, literal, length) == 0)
+	if (WAEdmTypeNameIs("Int32")) {
+		return WAEdmTypeInt32;
+	} else if (WAEdmTypeNameIs("Int64")) {
+		return WAEdmTypeInt64;
+	} else if (WAEdmTypeNameIs("Double")) {
+		return WAEdmTypeDouble;
+	} else if (WAEdmTypeNameIs("Boolean")) {
+		return WAEdmTypeBoolean;
+	} else if (WAEdmTypeNameIs("DateTime")) {
+		return WAEdmTypeDateTime;
+	} else if (WAEdmTypeNameIs("Binary")) {
+		return WAEdmTypeBinary;
+	} else if (WAEdmTypeNameIs("Guid")) {
+		return WAEdmTypeGuid;
+	}
+#undef WAEdmTypeNameIs
+
+	return WAEdmTypeString;
+}
+
+/**
+ Parses an Edm.Int32 or Edm.Int64 value.
+
+ @param bytes The text of the value, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ @param value On success, the parsed value.
+
+ @returns YES if the whole text is a decimal integer in range.
+ */
+extern BOOL WAEdmParseInt64(const char *bytes, size_t length, int64_t *value);
+
+/**
+ Parses an Edm.Double value, including INF, -INF and NaN.
+
+ @param bytes The text of the value, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ @param value On success, the parsed value.
+
+ @returns YES if the whole text is a number.
+ */
+extern BOOL WAEdmParseDouble(const char *bytes, size_t length, double *value);
+
+/**
+ Parses an Edm.Boolean value: true, false, 1 or 0.
+
+ @param bytes The text of the value, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ @param value On success, the parsed value.
+
+ @returns YES if the text is a boolean.
+ */
+extern BOOL WAEdmParseBoolean(const char *bytes, size_t length, BOOL *value);
+
+/**
+ Parses an Edm.DateTime value in the ISO 8601 form the service sends, such as 2012-05-01T10:20:30.1234567Z, without going through NSDateFormatter. An offset such as +02:00 in place of the Z is honored; a missing zone is taken as UTC.
+
+ @param bytes The text of the value, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ @param value On success, the time interval since the reference date.
+
+ @returns YES if the text is a date and time.
+ */
+extern BOOL WAEdmParseDateTime(const char *bytes, size_t length, NSTimeInterval *value);
+
+/**
+ Formats a date as an Edm.DateTime value in UTC with millisecond precision, such as 2012-05-01T10:20:30.123Z.
+
+ @param date The date.
+
+ @returns The text of the value.
+ */
+extern NSString *WAEdmDateTimeString(NSDate *date);
+
+/**
+ Decodes base64 text and appends the bytes to data. Whitespace is skipped.
+
+ @param bytes The base64 text, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ @param data The data the decoded bytes are appended to.
+
+ @returns YES if the text is valid base64. On failure the data may have been partially appended to.
+ */
+extern BOOL WAEdmAppendBase64(const char *bytes, size_t length, NSMutableData *data);
+
+/**
+ Decodes a property value straight from its text into the object used to represent it: an NSNumber for Edm.Int32, Edm.Int64, Edm.Double and Edm.Boolean, an NSDate for Edm.DateTime, NSData for Edm.Binary and an NSString for Edm.String and Edm.Guid.
+
+ Only the final object is allocated. Text that does not match its declared type is returned as an NSString.
+
+ @param type The type from the m:type attribute.
+ @param bytes The UTF-8 text of the value, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+
+ @returns A new object, owned by the caller, or nil if the text is not valid UTF-8.
+ */
+extern id WAEdmCreateObject(WAEdmType type, const char *bytes, size_t length) NS_RETURNS_RETAINED;
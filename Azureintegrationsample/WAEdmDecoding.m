@@ -0,0 +1,294 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAEdmDecoding.h"
+
+// seconds between 1970-01-01 and 2001-01-01, the reference date of NSDate
+#define WAUnixToReferenceDateOffset 978307200.0
+
+static BOOL WAParseDigits(const char **cursor, const char *end, int count, int *value)
+{
+	int result = 0;
+	for (int i = 0; i < count; i++, (*cursor)++) {
+		if (*cursor >= end || **cursor < '0' || **cursor > '9') {
+			return NO;
+		}
+		result = result * 10 + (**cursor - '0');
+	}
+	*value = result;
+	return YES;
+}
+
+/*
+ Days since 1970-01-01 of a proleptic Gregorian date.
+ */
+static int64_t WADaysFromCivil(int64_t year, int month, int day)
+{
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yearOfEra = year - era * 400;
+	int64_t dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+	int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+	return era * 146097 + dayOfEra - 719468;
+}
+
+BOOL WAEdmParseInt64(const char *bytes, size_t length, int64_t *value)
+{
+	const char *cursor = bytes;
+	const char *end = bytes + length;
+	BOOL negative = NO;
+
+	if (cursor < end && (*cursor == '-' || *cursor == '+')) {
+		negative = *cursor == '-';
+		cursor++;
+	}
+	if (cursor == end) {
+		return NO;
+	}
+
+	uint64_t magnitude = 0;
+	uint64_t limit = negative ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+	for (; cursor < end; cursor++) {
+		if (*cursor < '0' || *cursor > '9') {
+			return NO;
+		}
+		unsigned digit = *cursor - '0';
+		if (magnitude > (limit - digit) / 10) {
+			return NO;
+		}
+		magnitude = magnitude * 10 + digit;
+	}
+
+	*value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+	return YES;
+}
+
+BOOL WAEdmParseDouble(const char *bytes, size_t length, double *value)
+{
+	// strtod needs a terminated string; doubles are short enough for the stack
+	char buffer[64];
+	if (!length || length >= sizeof(buffer)) {
+		return NO;
+	}
+	memcpy(buffer, bytes, length);
+	buffer[length] = '\0';
+
+	char *end = NULL;
+	double result = strtod(buffer, &end);
+	if (end != buffer + length) {
+		return NO;
+	}
+
+	*value = result;
+	return YES;
+}
+
+BOOL WAEdmParseBoolean(const char *bytes, size_t length, BOOL *value)
+{
+	if ((length == 4 && memcmp(bytes, "true", 4) == 0) || (length == 1 && *bytes == '1')) {
+		*value = YES;
+		return YES;
+	}
+	if ((length == 5 && memcmp(bytes, "false", 5) == 0) || (length == 1 && *bytes == '0')) {
+		*value = NO;
+		return YES;
+	}
+	return NO;
+}
+
+BOOL WAEdmParseDateTime(const char *bytes, size_t length, NSTimeInterval *value)
+{
+	const char *cursor = bytes;
+	const char *end = bytes + length;
+	int year, month, day, hour, minute, second;
+
+	if (!WAParseDigits(&cursor, end, 4, &year) || cursor >= end || *cursor++ != '-' ||
+		!WAParseDigits(&cursor, end, 2, &month) || cursor >= end || *cursor++ != '-' ||
+		!WAParseDigits(&cursor, end, 2, &day) || cursor >= end || (*cursor != 'T' && *cursor != ' ')) {
+		return NO;
+	}
+	cursor++;
+	if (!WAParseDigits(&cursor, end, 2, &hour) || cursor >= end || *cursor++ != ':' ||
+		!WAParseDigits(&cursor, end, 2, &minute)) {
+		return NO;
+	}
+
+	second = 0;
+	if (cursor < end && *cursor == ':') {
+		cursor++;
+		if (!WAParseDigits(&cursor, end, 2, &second)) {
+			return NO;
+		}
+	}
+
+	if (month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60) {
+		return NO;
+	}
+
+	double fraction = 0;
+	if (cursor < end && *cursor == '.') {
+		double scale = 0.1;
+		for (cursor++; cursor < end && *cursor >= '0' && *cursor <= '9'; cursor++) {
+			fraction += (*cursor - '0') * scale;
+			scale /= 10;
+		}
+	}
+
+	int offset = 0;
+	if (cursor < end) {
+		if (*cursor == 'Z') {
+			cursor++;
+		} else if (*cursor == '+' || *cursor == '-') {
+			int sign = *cursor++ == '-' ? -1 : 1;
+			int offsetHours, offsetMinutes = 0;
+			if (!WAParseDigits(&cursor, end, 2, &offsetHours)) {
+				return NO;
+			}
+			if (cursor < end && *cursor == ':') {
+				cursor++;
+			}
+			if (cursor < end && !WAParseDigits(&cursor, end, 2, &offsetMinutes)) {
+				return NO;
+			}
+			offset = sign * (offsetHours * 3600 + offsetMinutes * 60);
+		}
+	}
+	if (cursor != end) {
+		return NO;
+	}
+
+	int64_t seconds = WADaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+	*value = (double)seconds + fraction - WAUnixToReferenceDateOffset;
+	return YES;
+}
+
+NSString *WAEdmDateTimeString(NSDate *date)
+{
+	static NSDateFormatter *formatter = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		formatter = [[NSDateFormatter alloc] init];
+		[formatter setLocale:[[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease]];
+		[formatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"GMT"]];
+		[formatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'Z'"];
+	});
+
+	@synchronized(formatter) {
+		return [formatter stringFromDate:date];
+	}
+}
+
+BOOL WAEdmAppendBase64(const char *bytes, size_t length, NSMutableData *data)
+{
+	static int8_t table[256];
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		memset(table, -1, sizeof(table));
+		const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+		for (int i = 0; i < 64; i++) {
+			table[(unsigned char)alphabet[i]] = (int8_t)i;
+		}
+	});
+
+	// decode through a stack buffer so large values grow the data a chunk at a time
+	uint8_t buffer[768];
+	size_t used = 0;
+	uint32_t accumulator = 0;
+	int bits = 0;
+	BOOL padding = NO;
+
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = (unsigned char)bytes[i];
+		if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+			continue;
+		}
+		if (c == '=') {
+			padding = YES;
+			continue;
+		}
+		if (padding || table[c] < 0) {
+			return NO;
+		}
+
+		accumulator = (accumulator << 6) | (uint32_t)table[c];
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			buffer[used++] = (uint8_t)(accumulator >> bits);
+			if (used == sizeof(buffer)) {
+				[data appendBytes:buffer length:used];
+				used = 0;
+			}
+		}
+	}
+
+	[data appendBytes:buffer length:used];
+	return YES;
+}
+
+id WAEdmCreateObject(WAEdmType type, const char *bytes, size_t length)
+{
+	switch (type) {
+		case WAEdmTypeInt32:
+		case WAEdmTypeInt64: {
+			int64_t value;
+			if (!WAEdmParseInt64(bytes, length, &value)) {
+				break;
+			}
+			if (type == WAEdmTypeInt64) {
+				return [[NSNumber alloc] initWithLongLong:value];
+			}
+			// an out of range Edm.Int32 does not match its type, like any other malformed value
+			if (value >= INT32_MIN && value <= INT32_MAX) {
+				return [[NSNumber alloc] initWithInt:(int32_t)value];
+			}
+			break;
+		}
+		case WAEdmTypeDouble: {
+			double value;
+			if (WAEdmParseDouble(bytes, length, &value)) {
+				return [[NSNumber alloc] initWithDouble:value];
+			}
+			break;
+		}
+		case WAEdmTypeBoolean: {
+			BOOL value;
+			if (WAEdmParseBoolean(bytes, length, &value)) {
+				return [(NSNumber *)(value ? kCFBooleanTrue : kCFBooleanFalse) retain];
+			}
+			break;
+		}
+		case WAEdmTypeDateTime: {
+			NSTimeInterval value;
+			if (WAEdmParseDateTime(bytes, length, &value)) {
+				return [[NSDate alloc] initWithTimeIntervalSinceReferenceDate:value];
+			}
+			break;
+		}
+		case WAEdmTypeBinary: {
+			NSMutableData *data = [[NSMutableData alloc] initWithCapacity:length / 4 * 3];
+			if (WAEdmAppendBase64(bytes, length, data)) {
+				return data;
+			}
+			[data release];
+			break;
+		}
+		default:
+			break;
+	}
+
+	return [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+}
@@ -0,0 +1,84 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WAEdmDecoding.h"
+#import "WATableEntity.h"
+
+/**
+ Writes table entities in the formats accepted by the table service.
+
+ Property values are typed from their Objective-C class: NSString as Edm.String, NSNumber as Edm.Boolean, Edm.Double, Edm.Int32 for numbers of 32 bits or less and Edm.Int64 for wider ones, NSDate as Edm.DateTime, NSData as Edm.Binary and NSNull as a null value. A string whose property has the Edm.Guid type recorded on the entity is written as Edm.Guid. Doubles that are not finite are written as NaN, INF and -INF.
+ */
+@interface WAEntitySerializer : NSObject
+
+/**
+ Returns the Atom entry document for an entity, as sent with an insert, update or merge.
+
+ @param entity The entity to write.
+
+ @returns The UTF-8 encoded document.
+ */
++ (NSData *)atomEntryForEntity:(WATableEntity *)entity;
+
+/**
+ Returns the JSON document for an entity, as sent with an insert, update or merge in one of the JSON wire formats.
+
+ Values JSON has no type for are sent as strings with an odata.type annotation: Edm.Int64, Edm.DateTime, Edm.Binary and Edm.Guid. Doubles are annotated too, so that one with no fraction is not read back as an integer.
+
+ @param entity The entity to write.
+
+ @returns The UTF-8 encoded document.
+ */
++ (NSData *)JSONEntityForEntity:(WATableEntity *)entity;
+
+/**
+ Returns the URL encoded resource path addressing a single entity, for example /Customers(PartitionKey='a',RowKey='b').
+
+ @param entity The entity.
+
+ @returns The resource path.
+ */
++ (NSString *)resourcePathForEntity:(WATableEntity *)entity;
+
+@end
+
+/**
+ The Edm types of entity properties that cannot be told from the class of their values.
+
+ WAEntityStreamParser and WAJSONEntityParser record Edm.Guid for the GUIDs they decode to NSString, so that an entity read and written back keeps the type of those properties.
+ */
+@interface WATableEntity (EdmTypes)
+
+/**
+ Returns the type recorded for a property.
+
+ @param key The name of the property.
+
+ @returns The recorded type, or WAEdmTypeString if none was recorded.
+ */
+- (WAEdmType)edmTypeForKey:(NSString *)key;
+
+/**
+ Records the type of a property. The type only applies while the value of the property is an NSString.
+
+ @param type The type, or WAEdmTypeString to remove the recorded type.
+ @param key The name of the property.
+ */
+- (void)setEdmType:(WAEdmType)type forKey:(NSString *)key;
+
+@end
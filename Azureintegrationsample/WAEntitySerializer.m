@@ -0,0 +1,216 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAEntitySerializer.h"
+
+#import <objc/runtime.h>
+
+#import "WATableFetchRequest+Query.h"
+#import "WAToolkitPrivate.h"
+
+static char WAEdmTypesKey;
+
+/*
+ Numbers of 32 bits or less, such as those decoded from Edm.Int32, keep that
+ type; wider ones are Edm.Int64.
+ */
+static BOOL WAIsInt32Number(NSNumber *number)
+{
+	switch (CFNumberGetType((CFNumberRef)number)) {
+		case kCFNumberSInt8Type:
+		case kCFNumberSInt16Type:
+		case kCFNumberSInt32Type:
+		case kCFNumberCharType:
+		case kCFNumberShortType:
+		case kCFNumberIntType:
+			return YES;
+		default:
+			return NO;
+	}
+}
+
+/*
+ Returns the Edm.Double literal for a value that is not finite, or nil.
+ */
+static NSString *WAEdmNonFiniteDoubleString(double number)
+{
+	if (isnan(number)) {
+		return @"NaN";
+	} else if (isinf(number)) {
+		return number > 0 ? @"INF" : @"-INF";
+	}
+	return nil;
+}
+
+static void WAAppendProperty(NSMutableString *properties, NSString *name, id value, WAEdmType edmType)
+{
+	NSString *type = nil;
+	NSString *text = nil;
+
+	if ([value isKindOfClass:[NSNull class]]) {
+		[properties appendFormat:@"<d:%@ m:null=\"true\" />", name];
+		return;
+	} else if ([value isKindOfClass:[NSNumber class]]) {
+		if (CFGetTypeID((CFTypeRef)value) == CFBooleanGetTypeID()) {
+			type = @"Edm.Boolean";
+			text = [value boolValue] ? @"true" : @"false";
+		} else if (CFNumberIsFloatType((CFNumberRef)value)) {
+			type = @"Edm.Double";
+			text = WAEdmNonFiniteDoubleString([value doubleValue]);
+			if (!text) {
+				text = [NSString stringWithFormat:@"%.17g", [value doubleValue]];
+			}
+		} else if (WAIsInt32Number(value)) {
+			type = @"Edm.Int32";
+			text = [NSString stringWithFormat:@"%d", [value intValue]];
+		} else {
+			type = @"Edm.Int64";
+			text = [NSString stringWithFormat:@"%lld", [value longLongValue]];
+		}
+	} else if ([value isKindOfClass:[NSString class]] && edmType == WAEdmTypeGuid) {
+		type = @"Edm.Guid";
+		text = WAXMLEscapedString(value);
+	} else if ([value isKindOfClass:[NSDate class]]) {
+		type = @"Edm.DateTime";
+		text = WAEdmDateTimeString(value);
+	} else if ([value isKindOfClass:[NSData class]]) {
+		type = @"Edm.Binary";
+		text = [value stringWithBase64EncodedData];
+	} else {
+		text = WAXMLEscapedString([value description]);
+	}
+
+	if (type) {
+		[properties appendFormat:@"<d:%@ m:type=\"%@\">%@</d:%@>", name, type, text, name];
+	} else {
+		[properties appendFormat:@"<d:%@>%@</d:%@>", name, text, name];
+	}
+}
+
+static void WASetJSONProperty(NSMutableDictionary *properties, NSString *name, id value, WAEdmType edmType)
+{
+	NSString *type = nil;
+
+	if ([value isKindOfClass:[NSNumber class]]) {
+		if (CFGetTypeID((CFTypeRef)value) == CFBooleanGetTypeID()) {
+			// true and false need no annotation
+		} else if (CFNumberIsFloatType((CFNumberRef)value)) {
+			type = @"Edm.Double";
+			NSString *text = WAEdmNonFiniteDoubleString([value doubleValue]);
+			if (text) {
+				value = text;
+			}
+		} else if (WAIsInt32Number(value)) {
+			// an integer without an annotation is read as Edm.Int32
+		} else {
+			// JSON readers lose integers past 2^53, so the service takes Edm.Int64 as a string
+			type = @"Edm.Int64";
+			value = [NSString stringWithFormat:@"%lld", [value longLongValue]];
+		}
+	} else if ([value isKindOfClass:[NSString class]] && edmType == WAEdmTypeGuid) {
+		type = @"Edm.Guid";
+	} else if ([value isKindOfClass:[NSDate class]]) {
+		type = @"Edm.DateTime";
+		value = WAEdmDateTimeString(value);
+	} else if ([value isKindOfClass:[NSData class]]) {
+		type = @"Edm.Binary";
+		value = [value stringWithBase64EncodedData];
+	} else if (![value isKindOfClass:[NSNull class]] && ![value isKindOfClass:[NSString class]]) {
+		value = [value description];
+	}
+
+	[properties setObject:value forKey:name];
+	if (type) {
+		[properties setObject:type forKey:[name stringByAppendingString:@"@odata.type"]];
+	}
+}
+
+@implementation WAEntitySerializer
+
++ (NSData *)atomEntryForEntity:(WATableEntity *)entity
+{
+	NSMutableString *properties = [NSMutableString stringWithCapacity:512];
+	WAAppendProperty(properties, @"PartitionKey", entity.partitionKey, WAEdmTypeString);
+	WAAppendProperty(properties, @"RowKey", entity.rowKey, WAEdmTypeString);
+
+	for (NSString *key in [entity keys]) {
+		if ([key isEqualToString:@"PartitionKey"] || [key isEqualToString:@"RowKey"] || [key isEqualToString:@"Timestamp"]) {
+			continue;
+		}
+		WAAppendProperty(properties, key, [entity objectForKey:key], [entity edmTypeForKey:key]);
+	}
+
+	NSString *document = [NSString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>"
+						  @"<entry xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\">"
+						  @"<title /><updated>%@</updated><author><name /></author><id />"
+						  @"<content type=\"application/xml\"><m:properties>%@</m:properties></content></entry>",
+						  WAEdmDateTimeString([NSDate date]), properties];
+
+	return [document dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData *)JSONEntityForEntity:(WATableEntity *)entity
+{
+	NSMutableDictionary *properties = [NSMutableDictionary dictionaryWithCapacity:32];
+	[properties setObject:entity.partitionKey forKey:@"PartitionKey"];
+	[properties setObject:entity.rowKey forKey:@"RowKey"];
+
+	for (NSString *key in [entity keys]) {
+		if ([key isEqualToString:@"PartitionKey"] || [key isEqualToString:@"RowKey"] || [key isEqualToString:@"Timestamp"]) {
+			continue;
+		}
+		WASetJSONProperty(properties, key, [entity objectForKey:key], [entity edmTypeForKey:key]);
+	}
+
+	return [NSJSONSerialization dataWithJSONObject:properties options:0 error:NULL];
+}
+
++ (NSString *)resourcePathForEntity:(WATableEntity *)entity
+{
+	return [NSString stringWithFormat:@"/%@(PartitionKey=%@,RowKey=%@)",
+			WAURLEncodedString(entity.tableName),
+			WAURLEncodedString(WAODataStringLiteral(entity.partitionKey)),
+			WAURLEncodedString(WAODataStringLiteral(entity.rowKey))];
+}
+
+@end
+
+@implementation WATableEntity (EdmTypes)
+
+- (WAEdmType)edmTypeForKey:(NSString *)key
+{
+	NSDictionary *types = objc_getAssociatedObject(self, &WAEdmTypesKey);
+	NSNumber *type = [types objectForKey:key];
+	return type ? [type intValue] : WAEdmTypeString;
+}
+
+- (void)setEdmType:(WAEdmType)type forKey:(NSString *)key
+{
+	NSMutableDictionary *types = objc_getAssociatedObject(self, &WAEdmTypesKey);
+	if (type == WAEdmTypeString) {
+		[types removeObjectForKey:key];
+		return;
+	}
+
+	// only entities holding such properties carry the dictionary
+	if (!types) {
+		types = [NSMutableDictionary dictionaryWithCapacity:1];
+		objc_setAssociatedObject(self, &WAEdmTypesKey, types, OBJC_ASSOCIATION_RETAIN);
+	}
+	[types setObject:[NSNumber numberWithInt:type] forKey:key];
+}
+
+@end
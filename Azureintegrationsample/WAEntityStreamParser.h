@@ -0,0 +1,121 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class WABufferPool;
+@class WATableEntity;
+@class WATableEntityBatch;
+
+/**
+ The interface shared by the parsers that decode table query responses as they arrive: WAEntityStreamParser for Atom feeds and WAJSONEntityParser for JSON.
+ */
+@protocol WAEntityParser <NSObject>
+
+@property (readonly) NSUInteger entityCount;
+@property (readonly) NSString *errorCode;
+@property (readonly) NSString *errorMessage;
+@property (copy) NSSet *selectedProperties;
+@property (retain) WABufferPool *bufferPool;
+
+- (BOOL)parseData:(NSData *)data error:(NSError **)error;
+- (BOOL)finishWithError:(NSError **)error;
+
+@end
+
+/**
+ A push parser that decodes the entries of a table query Atom feed while the response is still arriving.
+
+ Unlike the document based parsing done by WACloudStorageClient, no tree is built: each entry is turned into a WATableEntity and handed to the entity handler as soon as its closing tag has been read, and then forgotten. Memory use is bounded by the size of a single entry, whatever the size of the page.
+
+ Property values are decoded from the raw text according to their m:type attribute, with no intermediate string: numbers and booleans become NSNumber, Edm.DateTime values NSDate, Edm.Binary values NSData, and strings and GUIDs NSString. Property names are created once per parser, and properties outside selectedProperties are not decoded at all.
+
+ The parser also recognizes the error document returned by the table service; after a failed request the errorCode and errorMessage properties describe the error.
+ */
+@interface WAEntityStreamParser : NSObject <WAEntityParser> {
+@private
+	struct WAEntityStreamContext *_context;
+}
+
+/**
+ The number of entities decoded so far.
+ */
+@property (readonly) NSUInteger entityCount;
+
+/**
+ The error code from a table service error document, or nil.
+ */
+@property (readonly) NSString *errorCode;
+
+/**
+ The message from a table service error document, or nil.
+ */
+@property (readonly) NSString *errorMessage;
+
+/**
+ The names of the properties to decode, or nil to decode every property. Other properties are skipped without their names or values being allocated; PartitionKey, RowKey and Timestamp are always decoded.
+
+ Set this before parsing the first chunk.
+ */
+@property (copy) NSSet *selectedProperties;
+
+/**
+ The pool the libxml2 parser context and the text buffer are taken from and given back to. The default is the shared pool.
+
+ Set this before parsing the first chunk.
+ */
+@property (retain) WABufferPool *bufferPool;
+
+/**
+ Initializes a newly created parser.
+
+ @param tableName The name of the table the entities belong to.
+ @param block A block object called for every entry, in document order.
+
+ @returns The newly initialized WAEntityStreamParser object.
+ */
+- (id)initWithTableName:(NSString *)tableName entityHandler:(void (^)(WATableEntity *entity))block;
+
+/**
+ Initializes a newly created parser that appends every entry to a columnar batch instead of creating WATableEntity objects.
+
+ @param tableName The name of the table the entities belong to.
+ @param batch The batch the rows are appended to.
+
+ @returns The newly initialized WAEntityStreamParser object.
+ */
+- (id)initWithTableName:(NSString *)tableName entityBatch:(WATableEntityBatch *)batch;
+
+/**
+ Parses the next chunk of the document.
+
+ @param data The bytes that follow the previously parsed chunk.
+ @param error An NSError object that will be populated if the document is not well formed.
+
+ @returns YES if the chunk was parsed.
+ */
+- (BOOL)parseData:(NSData *)data error:(NSError **)error;
+
+/**
+ Signals the end of the document.
+
+ @param error An NSError object that will be populated if the document is not well formed.
+
+ @returns YES if the whole document was parsed.
+ */
+- (BOOL)finishWithError:(NSError **)error;
+
+@end
@@ -0,0 +1,473 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAEntityStreamParser.h"
+
+#import <libxml/parser.h>
+
+#import "WABufferPool.h"
+#import "WAEntitySerializer.h"
+#import "WATableEntity.h"
+#import "WATableEntityBatch.h"
+#import "WAToolkitPrivate.h"
+
+static const char *WAAtomNamespace = "http://www.w3.org/2005/Atom";
+static const char *WADataNamespace = "http://schemas.microsoft.com/ado/2007/08/dataservices";
+static const char *WAMetadataNamespace = "http://schemas.microsoft.com/ado/2007/08/dataservices/metadata";
+
+typedef enum {
+	WAErrorFieldNone = 0,
+	WAErrorFieldCode,
+	WAErrorFieldMessage
+} WAErrorField;
+
+struct WAEntityStreamContext {
+	WABufferPool *pool;
+	xmlParserCtxtPtr parser;
+	NSString *tableName;
+	void (^entityHandler)(WATableEntity *entity);
+	WATableEntityBatch *batch;
+	NSUInteger entityCount;
+
+	int depth;
+	int entryDepth;
+	int propertiesDepth;
+	NSMutableDictionary *properties;
+	NSMutableArray *guidProperties;
+	CFMutableDictionaryRef propertyNames;
+	NSSet *selectedProperties;
+	NSString *propertyName;
+	BOOL inProperty;
+	BOOL propertyIsNull;
+	BOOL propertySkipped;
+	WAEdmType propertyType;
+
+	// text of the element being captured, kept as raw UTF-8 until the element closes
+	BOOL capturing;
+	char *text;
+	size_t textLength;
+	size_t textCapacity;
+
+	BOOL inErrorDocument;
+	WAErrorField errorField;
+	NSString *errorCode;
+	NSString *errorMessage;
+};
+
+static BOOL WAStringEquals(const xmlChar *value, const char *expected)
+{
+	return value && strcmp((const char *)value, expected) == 0;
+}
+
+static NSString *WACapturedText(struct WAEntityStreamContext *context)
+{
+	return [[[NSString alloc] initWithBytes:context->text length:context->textLength encoding:NSUTF8StringEncoding] autorelease];
+}
+
+static void WABeginCapture(struct WAEntityStreamContext *context)
+{
+	context->capturing = YES;
+	context->textLength = 0;
+}
+
+/*
+ Looks up the name of a property element, creating it the first time it is seen. libxml2 interns element names for the life of the parser, so the pointer identifies the name. Returns NO for a property outside the projection.
+ */
+static BOOL WAResolvePropertyName(struct WAEntityStreamContext *context, const xmlChar *localname)
+{
+	// a batch interns names itself, so without a projection it needs nothing from here
+	if (context->batch && !context->selectedProperties) {
+		return YES;
+	}
+
+	id name = (id)CFDictionaryGetValue(context->propertyNames, localname);
+	if (!name) {
+		NSString *string = [[NSString alloc] initWithUTF8String:(const char *)localname];
+		if (context->selectedProperties && ![context->selectedProperties containsObject:string] &&
+			!WAStringEquals(localname, "PartitionKey") && !WAStringEquals(localname, "RowKey") && !WAStringEquals(localname, "Timestamp")) {
+			name = [NSNull null];
+		} else {
+			name = string;
+		}
+		CFDictionarySetValue(context->propertyNames, localname, name);
+		[string release];
+	}
+
+	if (name == [NSNull null]) {
+		return NO;
+	}
+	if (!context->batch) {
+		context->propertyName = [name retain];
+	}
+	return YES;
+}
+
+static void WAStartElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI,
+						   int nb_namespaces, const xmlChar **namespaces,
+						   int nb_attributes, int nb_defaulted, const xmlChar **attributes)
+{
+	struct WAEntityStreamContext *context = ctx;
+	int depth = ++context->depth;
+
+	if (depth == 1 && WAStringEquals(localname, "error")) {
+		context->inErrorDocument = YES;
+		return;
+	}
+
+	if (context->inErrorDocument) {
+		if (depth == 2) {
+			context->errorField = WAStringEquals(localname, "code") ? WAErrorFieldCode : WAStringEquals(localname, "message") ? WAErrorFieldMessage : WAErrorFieldNone;
+			if (context->errorField != WAErrorFieldNone) {
+				WABeginCapture(context);
+			}
+		}
+		return;
+	}
+
+	if (!context->entryDepth) {
+		if (WAStringEquals(localname, "entry") && WAStringEquals(URI, WAAtomNamespace)) {
+			context->entryDepth = depth;
+			if (context->batch) {
+				[context->batch beginRow];
+			} else {
+				context->properties = [[NSMutableDictionary alloc] initWithCapacity:16];
+			}
+		}
+		return;
+	}
+
+	if (!context->propertiesDepth) {
+		if (WAStringEquals(localname, "properties") && WAStringEquals(URI, WAMetadataNamespace)) {
+			context->propertiesDepth = depth;
+		}
+		return;
+	}
+
+	if (depth == context->propertiesDepth + 1 && WAStringEquals(URI, WADataNamespace)) {
+		context->inProperty = YES;
+		context->propertyIsNull = NO;
+		context->propertySkipped = NO;
+		context->propertyType = WAEdmTypeString;
+
+		if (!WAResolvePropertyName(context, localname)) {
+			context->propertySkipped = YES;
+			return;
+		}
+
+		// attributes come in groups of five: localname, prefix, URI, value start, value end
+		for (int i = 0; i < nb_attributes; i++) {
+			const xmlChar **attribute = attributes + i * 5;
+			if (!WAStringEquals(attribute[2], WAMetadataNamespace)) {
+				continue;
+			}
+			if (WAStringEquals(attribute[0], "null")) {
+				context->propertyIsNull = (attribute[4] - attribute[3] == 4 && strncmp((const char *)attribute[3], "true", 4) == 0);
+			} else if (WAStringEquals(attribute[0], "type")) {
+				context->propertyType = WAEdmTypeFromName((const char *)attribute[3], attribute[4] - attribute[3]);
+			}
+		}
+
+		WABeginCapture(context);
+	}
+}
+
+static void WAEndElement(void *ctx, const xmlChar *localname, const xmlChar *prefix, const xmlChar *URI)
+{
+	struct WAEntityStreamContext *context = ctx;
+	int depth = context->depth--;
+
+	if (context->inErrorDocument) {
+		if (depth == 2 && context->errorField != WAErrorFieldNone) {
+			NSString *value = [WACapturedText(context) retain];
+			if (context->errorField == WAErrorFieldCode) {
+				[context->errorCode release];
+				context->errorCode = value;
+			} else {
+				[context->errorMessage release];
+				context->errorMessage = value;
+			}
+			context->errorField = WAErrorFieldNone;
+			context->capturing = NO;
+		}
+		return;
+	}
+
+	if (context->inProperty && depth == context->propertiesDepth + 1) {
+		if (!context->propertyIsNull && !context->propertySkipped) {
+			if (context->batch) {
+				[context->batch appendProperty:(const char *)localname type:context->propertyType bytes:context->text length:context->textLength];
+			} else {
+				id value = WAEdmCreateObject(context->propertyType, context->text, context->textLength);
+				if (value) {
+					[context->properties setObject:value forKey:context->propertyName];
+					// a GUID decodes to a string, so its type is recorded on the entity
+					if (context->propertyType == WAEdmTypeGuid && [value isKindOfClass:[NSString class]]) {
+						if (!context->guidProperties) {
+							context->guidProperties = [[NSMutableArray alloc] initWithCapacity:1];
+						}
+						[context->guidProperties addObject:context->propertyName];
+					}
+					[value release];
+				}
+			}
+		}
+		[context->propertyName release];
+		context->propertyName = nil;
+		context->inProperty = NO;
+		context->capturing = NO;
+		return;
+	}
+
+	if (depth == context->propertiesDepth) {
+		context->propertiesDepth = 0;
+		return;
+	}
+
+	if (depth == context->entryDepth && context->batch) {
+		[context->batch endRow];
+		context->entryDepth = 0;
+		context->entityCount++;
+		return;
+	}
+
+	if (depth == context->entryDepth) {
+		// the entity parses a Timestamp string with a date formatter; hand it the already decoded date instead
+		NSDate *timeStamp = [[[context->properties objectForKey:@"Timestamp"] retain] autorelease];
+		if ([timeStamp isKindOfClass:[NSDate class]]) {
+			[context->properties removeObjectForKey:@"Timestamp"];
+		} else {
+			timeStamp = nil;
+		}
+
+		WATableEntity *entity = [[WATableEntity alloc] initWithDictionary:context->properties fromTable:context->tableName];
+		if (timeStamp) {
+			[entity setValue:timeStamp forKey:@"timeStamp"];
+		}
+		for (NSString *name in context->guidProperties) {
+			[entity setEdmType:WAEdmTypeGuid forKey:name];
+		}
+		[context->guidProperties removeAllObjects];
+		[context->properties release];
+		context->properties = nil;
+		context->entryDepth = 0;
+
+		context->entityCount++;
+		if (context->entityHandler) {
+			context->entityHandler(entity);
+		}
+		[entity release];
+	}
+}
+
+static void WACharacters(void *ctx, const xmlChar *ch, int len)
+{
+	struct WAEntityStreamContext *context = ctx;
+	if (!context->capturing || len <= 0) {
+		return;
+	}
+
+	if (context->textLength + len > context->textCapacity) {
+		char *grown = [context->pool growBytes:context->text usedLength:context->textLength toLength:context->textLength + len capacity:&context->textCapacity];
+		if (!grown) {
+			context->textLength = 0;
+			context->capturing = NO;
+			return;
+		}
+		context->text = grown;
+	}
+
+	memcpy(context->text + context->textLength, ch, len);
+	context->textLength += len;
+}
+
+static NSError *WAParserError(struct WAEntityStreamContext *context)
+{
+	xmlErrorPtr xmlError = xmlCtxtGetLastError(context->parser);
+	NSString *message = xmlError && xmlError->message ? [NSString stringWithUTF8String:xmlError->message] : @"The response could not be parsed.";
+	return WAToolkitError(xmlError ? xmlError->code : -1, nil, message);
+}
+
+static void *WACreateParserContext(void)
+{
+	xmlSAXHandler handler;
+	memset(&handler, 0, sizeof(handler));
+	handler.initialized = XML_SAX2_MAGIC;
+	handler.startElementNs = WAStartElement;
+	handler.endElementNs = WAEndElement;
+	handler.characters = WACharacters;
+	handler.cdataBlock = WACharacters;
+
+	return xmlCreatePushParserCtxt(&handler, NULL, NULL, 0, NULL);
+}
+
+static void WADestroyParserContext(void *parser)
+{
+	xmlFreeParserCtxt(parser);
+}
+
+// every parser installs the same handlers, so a reset context can serve the next page
+static const WABufferPoolContextKind WAParserContextKind = { WACreateParserContext, WADestroyParserContext };
+
+/*
+ Takes a parser context from the pool when the first chunk arrives.
+ */
+static BOOL WABeginParsing(struct WAEntityStreamContext *context)
+{
+	if (!context->parser) {
+		context->parser = [context->pool contextOfKind:&WAParserContextKind];
+		if (!context->parser) {
+			return NO;
+		}
+		context->parser->userData = context;
+		xmlCtxtUseOptions(context->parser, XML_PARSE_NONET);
+	}
+	return YES;
+}
+
+@interface WAEntityStreamParser ()
+
+- (id)initWithTableName:(NSString *)tableName;
+
+@end
+
+@implementation WAEntityStreamParser
+
+- (id)initWithTableName:(NSString *)tableName entityHandler:(void (^)(WATableEntity *entity))block
+{
+	if(!(self = [self initWithTableName:tableName])) {
+		return nil;
+	}
+
+	_context->entityHandler = [block copy];
+
+	return self;
+}
+
+- (id)initWithTableName:(NSString *)tableName entityBatch:(WATableEntityBatch *)batch
+{
+	if(!(self = [self initWithTableName:tableName])) {
+		return nil;
+	}
+
+	_context->batch = [batch retain];
+
+	return self;
+}
+
+- (id)initWithTableName:(NSString *)tableName
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_context = calloc(1, sizeof(struct WAEntityStreamContext));
+	_context->tableName = [tableName copy];
+	_context->propertyNames = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	_context->pool = [[WABufferPool sharedPool] retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_context) {
+		if (_context->parser) {
+			xmlCtxtResetPush(_context->parser, NULL, 0, NULL, NULL);
+			[_context->pool recycleContext:_context->parser ofKind:&WAParserContextKind];
+		}
+		[_context->pool recycleBytes:_context->text capacity:_context->textCapacity];
+		[_context->pool release];
+		[_context->tableName release];
+		[_context->entityHandler release];
+		[_context->batch release];
+		[_context->properties release];
+		[_context->guidProperties release];
+		CFRelease(_context->propertyNames);
+		[_context->selectedProperties release];
+		[_context->propertyName release];
+		[_context->errorCode release];
+		[_context->errorMessage release];
+		free(_context);
+	}
+	[super dealloc];
+}
+
+- (NSUInteger)entityCount
+{
+	return _context->entityCount;
+}
+
+- (NSSet *)selectedProperties
+{
+	return _context->selectedProperties;
+}
+
+- (void)setSelectedProperties:(NSSet *)selectedProperties
+{
+	if (selectedProperties != _context->selectedProperties) {
+		[_context->selectedProperties release];
+		_context->selectedProperties = [selectedProperties copy];
+		CFDictionaryRemoveAllValues(_context->propertyNames);
+	}
+}
+
+- (WABufferPool *)bufferPool
+{
+	return _context->pool;
+}
+
+- (void)setBufferPool:(WABufferPool *)bufferPool
+{
+	NSAssert(!_context->parser && !_context->text, @"The pool cannot change once parsing has started");
+	[_context->pool autorelease];
+	_context->pool = [(bufferPool ? bufferPool : [WABufferPool sharedPool]) retain];
+}
+
+- (NSString *)errorCode
+{
+	return _context->errorCode;
+}
+
+- (NSString *)errorMessage
+{
+	return _context->errorMessage;
+}
+
+- (BOOL)parseData:(NSData *)data error:(NSError **)error
+{
+	if (!WABeginParsing(_context) || xmlParseChunk(_context->parser, [data bytes], (int)[data length], 0) != XML_ERR_OK) {
+		if (error) {
+			*error = WAParserError(_context);
+		}
+		return NO;
+	}
+
+	return YES;
+}
+
+- (BOOL)finishWithError:(NSError **)error
+{
+	if (!WABeginParsing(_context) || xmlParseChunk(_context->parser, NULL, 0, 1) != XML_ERR_OK) {
+		if (error) {
+			*error = WAParserError(_context);
+		}
+		return NO;
+	}
+
+	return YES;
+}
+
+@end
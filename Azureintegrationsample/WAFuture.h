@@ -0,0 +1,141 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The reason code of the error reported by waitWithTimeout:error: when the future has not finished in time.
+ */
+extern NSString * const WAFutureTimeoutReasonCode;
+
+/**
+ The eventual result of an asynchronous operation.
+
+ A future finishes exactly once, with a result or with an error. Completion handlers, and the blocks given to then:, are called on a concurrent global dispatch queue, so they may run at the same time as each other and as the thread that finished the future; a handler added after the future has finished is called all the same. Futures are thread safe.
+
+ Futures compose: then: chains a dependent operation, whenAll: joins several operations running in parallel and whenAny: races them. A thread that has nothing else to do can block on a future with waitWithTimeout:error:, but it must not be the thread or queue that will finish the future.
+
+ @see WACloudStorageClient(Futures)
+ */
+@interface WAFuture : NSObject {
+@private
+	NSCondition *_condition;
+	BOOL _finished;
+	id _result;
+	NSError *_error;
+	NSMutableArray *_completionHandlers;
+}
+
+/**
+ Whether the future has finished.
+ */
+@property (readonly, getter=isFinished) BOOL finished;
+
+/**
+ The result, or nil if the future has not finished, has failed, or finished without a result.
+ */
+@property (readonly) id result;
+
+/**
+ The error, or nil if the future has not finished or has succeeded.
+ */
+@property (readonly) NSError *error;
+
+/**
+ Returns a new future that is finished by calling finishWithResult:error:.
+ */
++ (WAFuture *)future;
+
+/**
+ Returns a future that has already succeeded.
+
+ @param result The result, or nil.
+ */
++ (WAFuture *)futureWithResult:(id)result;
+
+/**
+ Returns a future that has already failed.
+
+ @param error The error.
+ */
++ (WAFuture *)futureWithError:(NSError *)error;
+
+/**
+ Returns a future that succeeds once all the given futures have succeeded, or fails with the first error.
+
+ @param futures The WAFuture objects to wait for.
+
+ @returns A future whose result is an array of the results of the futures, in the same order, with NSNull for a nil result. The future succeeds with an empty array if the futures array is empty.
+ */
++ (WAFuture *)whenAll:(NSArray *)futures;
+
+/**
+ Returns a future that finishes when the first of the given futures finishes, whether it succeeded or failed.
+
+ @param futures The WAFuture objects to wait for.
+
+ @returns A future whose result is the first of the futures to finish. The future fails if the futures array is empty.
+ */
++ (WAFuture *)whenAny:(NSArray *)futures;
+
+/**
+ Finishes the future. Only the first call has an effect.
+
+ @param result The result, or nil. It is ignored if there is an error.
+ @param error The error if the operation failed, otherwise nil.
+
+ @returns YES if the future was finished by this call, NO if it had already finished.
+ */
+- (BOOL)finishWithResult:(id)result error:(NSError *)error;
+
+/**
+ Adds a block to call once the future has finished.
+
+ @param block A block object called with the result, or with the error if the operation failed.
+ */
+- (void)addCompletionHandler:(void (^)(id result, NSError *error))block;
+
+/**
+ Chains an operation that depends on the result of this one.
+
+ The block is called once this future succeeds; if it fails, the block is not called and the error is passed on.
+
+ @param block A block object called with the result, that starts the next operation and returns its future. It may return nil to succeed without a result.
+
+ @returns A future that finishes with the future returned by the block.
+ */
+- (WAFuture *)then:(WAFuture *(^)(id result))block;
+
+/**
+ Blocks the calling thread until the future has finished or a date has passed.
+
+ @param date The date to wait until. Use [NSDate distantFuture] to wait for as long as it takes.
+
+ @returns YES if the future has finished.
+ */
+- (BOOL)waitUntilDate:(NSDate *)date;
+
+/**
+ Blocks the calling thread until the future has finished and returns its result.
+
+ @param timeout The maximum number of seconds to wait.
+ @param error On return, the error if the future failed, or an error with the reason code WAFutureTimeoutReasonCode if it did not finish in time. Pass NULL to ignore it.
+
+ @returns The result, or nil if the future failed, did not finish in time or finished without a result.
+ */
+- (id)waitWithTimeout:(NSTimeInterval)timeout error:(NSError **)error;
+
+@end
@@ -0,0 +1,252 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAFuture.h"
+
+#import "WAToolkitPrivate.h"
+
+NSString * const WAFutureTimeoutReasonCode = @"OperationTimedOut";
+
+static void WACallCompletionHandler(void (^handler)(id result, NSError *error), id result, NSError *error)
+{
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		handler(result, error);
+		[pool drain];
+	});
+}
+
+@implementation WAFuture
+
++ (WAFuture *)future
+{
+	return [[[self alloc] init] autorelease];
+}
+
++ (WAFuture *)futureWithResult:(id)result
+{
+	WAFuture *future = [self future];
+	[future finishWithResult:result error:nil];
+	return future;
+}
+
++ (WAFuture *)futureWithError:(NSError *)error
+{
+	WAFuture *future = [self future];
+	[future finishWithResult:nil error:error];
+	return future;
+}
+
++ (WAFuture *)whenAll:(NSArray *)futures
+{
+	WAFuture *future = [self future];
+	NSUInteger count = futures.count;
+	if (!count) {
+		[future finishWithResult:[NSArray array] error:nil];
+		return future;
+	}
+
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity:count];
+	for (NSUInteger i = 0; i < count; i++) {
+		[results addObject:[NSNull null]];
+	}
+
+	// guarded by the results array
+	__block NSUInteger pending = count;
+
+	[futures enumerateObjectsUsingBlock:^(WAFuture *each, NSUInteger index, BOOL *stop) {
+		[each addCompletionHandler:^(id result, NSError *error) {
+			if (error) {
+				[future finishWithResult:nil error:error];
+				return;
+			}
+
+			BOOL done = NO;
+			@synchronized(results) {
+				if (result) {
+					[results replaceObjectAtIndex:index withObject:result];
+				}
+				done = (--pending == 0);
+			}
+
+			if (done) {
+				[future finishWithResult:[NSArray arrayWithArray:results] error:nil];
+			}
+		}];
+	}];
+
+	return future;
+}
+
++ (WAFuture *)whenAny:(NSArray *)futures
+{
+	if (!futures.count) {
+		return [self futureWithError:WAToolkitError(-1, nil, @"There are no futures to wait for.")];
+	}
+
+	WAFuture *future = [self future];
+	for (WAFuture *each in futures) {
+		[each addCompletionHandler:^(id result, NSError *error) {
+			[future finishWithResult:each error:nil];
+		}];
+	}
+	return future;
+}
+
+- (id)init
+{
+	if (!(self = [super init])) {
+		return nil;
+	}
+
+	_condition = [[NSCondition alloc] init];
+	_completionHandlers = [[NSMutableArray alloc] initWithCapacity:1];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_condition release];
+	[_result release];
+	[_error release];
+	[_completionHandlers release];
+	[super dealloc];
+}
+
+- (BOOL)isFinished
+{
+	[_condition lock];
+	BOOL finished = _finished;
+	[_condition unlock];
+	return finished;
+}
+
+- (id)result
+{
+	[_condition lock];
+	id result = [[_result retain] autorelease];
+	[_condition unlock];
+	return result;
+}
+
+- (NSError *)error
+{
+	[_condition lock];
+	NSError *error = [[_error retain] autorelease];
+	[_condition unlock];
+	return error;
+}
+
+- (BOOL)finishWithResult:(id)result error:(NSError *)error
+{
+	if (error) {
+		result = nil;
+	}
+
+	[_condition lock];
+	if (_finished) {
+		[_condition unlock];
+		return NO;
+	}
+
+	_finished = YES;
+	_result = [result retain];
+	_error = [error retain];
+	NSArray *handlers = _completionHandlers;
+	_completionHandlers = nil;
+	[_condition broadcast];
+	[_condition unlock];
+
+	for (void (^handler)(id, NSError *) in handlers) {
+		WACallCompletionHandler(handler, result, error);
+	}
+	[handlers release];
+
+	return YES;
+}
+
+- (void)addCompletionHandler:(void (^)(id result, NSError *error))block
+{
+	[_condition lock];
+	if (!_finished) {
+		void (^handler)(id, NSError *) = [block copy];
+		[_completionHandlers addObject:handler];
+		[handler release];
+		[_condition unlock];
+		return;
+	}
+
+	id result = [[_result retain] autorelease];
+	NSError *error = [[_error retain] autorelease];
+	[_condition unlock];
+
+	WACallCompletionHandler(block, result, error);
+}
+
+- (WAFuture *)then:(WAFuture *(^)(id result))block
+{
+	WAFuture *future = [WAFuture future];
+	[self addCompletionHandler:^(id result, NSError *error) {
+		if (error) {
+			[future finishWithResult:nil error:error];
+			return;
+		}
+
+		WAFuture *next = block(result);
+		if (!next) {
+			[future finishWithResult:nil error:nil];
+			return;
+		}
+
+		[next addCompletionHandler:^(id nextResult, NSError *nextError) {
+			[future finishWithResult:nextResult error:nextError];
+		}];
+	}];
+	return future;
+}
+
+- (BOOL)waitUntilDate:(NSDate *)date
+{
+	[_condition lock];
+	while (!_finished && [_condition waitUntilDate:date]) {
+	}
+	BOOL finished = _finished;
+	[_condition unlock];
+	return finished;
+}
+
+- (id)waitWithTimeout:(NSTimeInterval)timeout error:(NSError **)error
+{
+	if (![self waitUntilDate:[NSDate dateWithTimeIntervalSinceNow:timeout]]) {
+		if (error) {
+			*error = WAToolkitError(-1, WAFutureTimeoutReasonCode, @"The operation did not finish in time.");
+		}
+		return nil;
+	}
+
+	NSError *failure = self.error;
+	if (failure) {
+		if (error) {
+			*error = failure;
+		}
+		return nil;
+	}
+
+	return self.result;
+}
+
+@end
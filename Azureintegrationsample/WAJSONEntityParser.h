@@ -0,0 +1,110 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WAEntityStreamParser.h"
+
+/**
+ A push parser that decodes the entities of a table query response in the JSON formats while the response is still arriving.
+
+ The tokenizer works on the raw bytes, one chunk at a time, with no intermediate object tree: the members of each entity are gathered as UTF-8 text, and once the entity's closing brace has been read they are decoded straight into the values of a WATableEntity, or appended to a WATableEntityBatch, exactly as WAEntityStreamParser does for Atom.
+
+ Property types are taken, in order, from the odata.type annotations sent with minimal metadata, from the propertyTypes given to the parser, and from the JSON value itself: strings are Edm.String, numbers with a fraction or exponent Edm.Double, other numbers Edm.Int32 or Edm.Int64 depending on their size, and true and false Edm.Boolean. Timestamp is always decoded as Edm.DateTime. Null values are left out, as they are for Atom.
+
+ Both a feed, with its entities in a value array, and a single entity, as returned by a point query, are accepted, as is the odata.error document returned with a failed request.
+ */
+@interface WAJSONEntityParser : NSObject <WAEntityParser> {
+@private
+	struct WAJSONEntityContext *_context;
+}
+
+/**
+ The number of entities decoded so far.
+ */
+@property (readonly) NSUInteger entityCount;
+
+/**
+ The error code from a table service error document, or nil.
+ */
+@property (readonly) NSString *errorCode;
+
+/**
+ The message from a table service error document, or nil.
+ */
+@property (readonly) NSString *errorMessage;
+
+/**
+ The names of the properties to decode, or nil to decode every property. PartitionKey, RowKey and Timestamp are always decoded.
+
+ Set this before parsing the first chunk.
+ */
+@property (copy) NSSet *selectedProperties;
+
+/**
+ The types of properties, as NSNumber objects holding a WAEdmType keyed by property name, for responses that do not carry them. A type annotation in the response takes precedence.
+
+ Set this before parsing the first chunk.
+ */
+@property (copy) NSDictionary *propertyTypes;
+
+/**
+ The pool the token, value, member and name buffers are taken from and given back to. The default is the shared pool.
+
+ Set this before parsing the first chunk.
+ */
+@property (retain) WABufferPool *bufferPool;
+
+/**
+ Initializes a newly created parser.
+
+ @param tableName The name of the table the entities belong to.
+ @param block A block object called for every entity, in document order.
+
+ @returns The newly initialized WAJSONEntityParser object.
+ */
+- (id)initWithTableName:(NSString *)tableName entityHandler:(void (^)(WATableEntity *entity))block;
+
+/**
+ Initializes a newly created parser that appends every entity to a columnar batch instead of creating WATableEntity objects.
+
+ @param tableName The name of the table the entities belong to.
+ @param batch The batch the rows are appended to.
+
+ @returns The newly initialized WAJSONEntityParser object.
+ */
+- (id)initWithTableName:(NSString *)tableName entityBatch:(WATableEntityBatch *)batch;
+
+/**
+ Parses the next chunk of the document.
+
+ @param data The bytes that follow the previously parsed chunk.
+ @param error An NSError object that will be populated if the document is not well formed.
+
+ @returns YES if the chunk was parsed.
+ */
+- (BOOL)parseData:(NSData *)data error:(NSError **)error;
+
+/**
+ Signals the end of the document.
+
+ @param error An NSError object that will be populated if the document is not well formed.
+
+ @returns YES if the whole document was parsed.
+ */
+- (BOOL)finishWithError:(NSError **)error;
+
+@end
@@ -0,0 +1,813 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAJSONEntityParser.h"
+
+#import "WABufferPool.h"
+#import "WAEdmDecoding.h"
+#import "WAEntitySerializer.h"
+#import "WATableEntity.h"
+#import "WATableEntityBatch.h"
+#import "WAToolkitPrivate.h"
+
+// table responses nest three deep; anything much deeper is not a table response
+#define WAJSONMaxDepth 32
+
+typedef enum {
+	WAJSONLexBetween = 0,
+	WAJSONLexString,
+	WAJSONLexEscape,
+	WAJSONLexUnicode,
+	WAJSONLexScalar
+} WAJSONLexState;
+
+typedef enum {
+	WAJSONValueString = 0,
+	WAJSONValueNumber,
+	WAJSONValueBoolean,
+	WAJSONValueNull
+} WAJSONValueKind;
+
+typedef struct {
+	char *bytes;
+	size_t length;
+	size_t capacity;
+} WAJSONBuffer;
+
+/*
+ A member name seen in the document. Names live as long as the parser, so
+ each is created and looked up in the projection and type hints only once.
+ Their text is kept, NUL terminated, in the name buffer at offset.
+ */
+typedef struct {
+	size_t offset;
+	size_t length;
+	NSString *name;
+	BOOL skipped;
+	BOOL hasType;
+	WAEdmType type;
+	WAEdmType annotatedType;
+	NSUInteger annotatedEntity;
+} WAJSONName;
+
+/*
+ A member of the entity being read. Its text stays in the value buffer until
+ the entity closes, so that annotations may come before or after it.
+ */
+typedef struct {
+	NSUInteger name;
+	WAJSONValueKind kind;
+	size_t offset;
+	size_t length;
+} WAJSONMember;
+
+struct WAJSONEntityContext {
+	WABufferPool *pool;
+	NSString *tableName;
+	void (^entityHandler)(WATableEntity *entity);
+	WATableEntityBatch *batch;
+	NSUInteger entityCount;
+	NSSet *selectedProperties;
+	NSDictionary *propertyTypes;
+	NSString *failure;
+
+	WAJSONLexState lexState;
+	WAJSONBuffer token;
+	uint32_t codePoint;
+	int codePointDigits;
+	uint32_t highSurrogate;
+
+	int depth;
+	BOOL isArray[WAJSONMaxDepth + 1];
+	BOOL expectKey;
+	WAJSONBuffer key;
+
+	int entityDepth;
+	int feedDepth;
+	int errorDepth;
+	NSUInteger entitySerial;
+	NSString *errorCode;
+	NSString *errorMessage;
+
+	WAJSONName *names;
+	NSUInteger nameCount;
+	NSUInteger nameCapacity;
+	size_t namesSize;
+	WAJSONBuffer nameBytes;
+	NSUInteger nextName;
+
+	WAJSONMember *members;
+	NSUInteger memberCount;
+	NSUInteger memberCapacity;
+	size_t membersSize;
+	WAJSONBuffer values;
+};
+
+static void WAJSONFail(struct WAJSONEntityContext *context, NSString *reason)
+{
+	if (!context->failure) {
+		context->failure = [reason copy];
+	}
+}
+
+static void WAJSONAppend(struct WAJSONEntityContext *context, WAJSONBuffer *buffer, const char *bytes, size_t length)
+{
+	if (!buffer->bytes || buffer->length + length > buffer->capacity) {
+		char *grown = [context->pool growBytes:buffer->bytes usedLength:buffer->length toLength:buffer->length + length capacity:&buffer->capacity];
+		if (!grown) {
+			WAJSONFail(context, @"There is not enough memory to parse the response.");
+			return;
+		}
+		buffer->bytes = grown;
+	}
+
+	memcpy(buffer->bytes + buffer->length, bytes, length);
+	buffer->length += length;
+}
+
+static BOOL WAJSONKeyIs(struct WAJSONEntityContext *context, const char *expected)
+{
+	size_t length = strlen(expected);
+	return context->key.length == length && memcmp(context->key.bytes, expected, length) == 0;
+}
+
+static void WAJSONClearNames(struct WAJSONEntityContext *context)
+{
+	for (NSUInteger i = 0; i < context->nameCount; i++) {
+		[context->names[i].name release];
+	}
+	context->nameCount = 0;
+	context->nextName = 0;
+	context->nameBytes.length = 0;
+}
+
+static inline const char *WAJSONNameBytes(struct WAJSONEntityContext *context, NSUInteger index)
+{
+	return context->nameBytes.bytes + context->names[index].offset;
+}
+
+static NSUInteger WAJSONResolveName(struct WAJSONEntityContext *context, const char *bytes, size_t length)
+{
+	// entities of a page usually list their members in the same order, and an annotation comes right before its member
+	NSUInteger count = context->nameCount;
+	NSUInteger candidates[2] = { context->nextName, context->nextName - 1 };
+	for (int i = 0; i < 2; i++) {
+		if (candidates[i] < count && context->names[candidates[i]].length == length && memcmp(WAJSONNameBytes(context, candidates[i]), bytes, length) == 0) {
+			context->nextName = candidates[i] + 1;
+			return candidates[i];
+		}
+	}
+	for (NSUInteger i = 0; i < count; i++) {
+		if (context->names[i].length == length && memcmp(WAJSONNameBytes(context, i), bytes, length) == 0) {
+			context->nextName = i + 1;
+			return i;
+		}
+	}
+
+	if (count == context->nameCapacity) {
+		WAJSONName *grown = [context->pool growBytes:context->names usedLength:count * sizeof(WAJSONName)
+											toLength:MAX(context->nameCapacity * 2, 16) * sizeof(WAJSONName) capacity:&context->namesSize];
+		if (!grown) {
+			WAJSONFail(context, @"There is not enough memory to parse the response.");
+			return NSNotFound;
+		}
+		context->names = grown;
+		context->nameCapacity = context->namesSize / sizeof(WAJSONName);
+	}
+
+	size_t offset = context->nameBytes.length;
+	WAJSONAppend(context, &context->nameBytes, bytes, length);
+	WAJSONAppend(context, &context->nameBytes, "", 1);
+	if (context->nameBytes.length != offset + length + 1) {
+		return NSNotFound;
+	}
+
+	WAJSONName *name = &context->names[count];
+	memset(name, 0, sizeof(WAJSONName));
+	name->offset = offset;
+	name->length = length;
+	name->name = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+
+	BOOL isKey = [name->name isEqualToString:@"PartitionKey"] || [name->name isEqualToString:@"RowKey"];
+	BOOL isTimestamp = [name->name isEqualToString:@"Timestamp"];
+	name->skipped = !name->name || (context->selectedProperties && !isKey && !isTimestamp && ![context->selectedProperties containsObject:name->name]);
+	if (isKey || isTimestamp) {
+		name->hasType = YES;
+		name->type = isTimestamp ? WAEdmTypeDateTime : WAEdmTypeString;
+	} else if (name->name && [context->propertyTypes objectForKey:name->name]) {
+		name->hasType = YES;
+		name->type = [[context->propertyTypes objectForKey:name->name] intValue];
+	}
+
+	context->nameCount++;
+	context->nextName = count + 1;
+	return count;
+}
+
+static WAEdmType WAJSONMemberType(struct WAJSONEntityContext *context, WAJSONMember *member)
+{
+	WAJSONName *name = &context->names[member->name];
+	const char *bytes = context->values.bytes + member->offset;
+
+	if (name->annotatedEntity == context->entitySerial) {
+		return name->annotatedType;
+	}
+
+	switch (member->kind) {
+		case WAJSONValueBoolean:
+			return WAEdmTypeBoolean;
+
+		case WAJSONValueNumber: {
+			if (name->hasType && name->type != WAEdmTypeString) {
+				return name->type;
+			}
+			for (size_t i = 0; i < member->length; i++) {
+				if (bytes[i] == '.' || bytes[i] == 'e' || bytes[i] == 'E') {
+					return WAEdmTypeDouble;
+				}
+			}
+			int64_t value;
+			if (WAEdmParseInt64(bytes, member->length, &value) && value >= INT32_MIN && value <= INT32_MAX) {
+				return WAEdmTypeInt32;
+			}
+			return WAEdmTypeInt64;
+		}
+
+		default:
+			return name->hasType ? name->type : WAEdmTypeString;
+	}
+}
+
+static void WAJSONResetEntity(struct WAJSONEntityContext *context)
+{
+	context->memberCount = 0;
+	context->values.length = 0;
+}
+
+static void WAJSONBeginEntity(struct WAJSONEntityContext *context, int depth)
+{
+	context->entityDepth = depth;
+	context->entitySerial++;
+	WAJSONResetEntity(context);
+}
+
+static void WAJSONEndEntity(struct WAJSONEntityContext *context)
+{
+	if (context->batch) {
+		[context->batch beginRow];
+		for (NSUInteger i = 0; i < context->memberCount; i++) {
+			WAJSONMember *member = &context->members[i];
+			[context->batch appendProperty:WAJSONNameBytes(context, member->name) type:WAJSONMemberType(context, member)
+									 bytes:context->values.bytes + member->offset length:member->length];
+		}
+		[context->batch endRow];
+	} else {
+		NSMutableDictionary *properties = [[NSMutableDictionary alloc] initWithCapacity:context->memberCount];
+		NSMutableArray *guidProperties = nil;
+		NSDate *timeStamp = nil;
+		for (NSUInteger i = 0; i < context->memberCount; i++) {
+			WAJSONMember *member = &context->members[i];
+			NSString *name = context->names[member->name].name;
+			WAEdmType type = WAJSONMemberType(context, member);
+			id value = WAEdmCreateObject(type, context->values.bytes + member->offset, member->length);
+			if (!value) {
+				continue;
+			}
+			// a GUID decodes to a string, so its type is recorded on the entity
+			if (type == WAEdmTypeGuid && [value isKindOfClass:[NSString class]]) {
+				if (!guidProperties) {
+					guidProperties = [NSMutableArray arrayWithCapacity:1];
+				}
+				[guidProperties addObject:name];
+			}
+			// the entity parses a Timestamp string with a date formatter; hand it the already decoded date instead
+			if ([value isKindOfClass:[NSDate class]] && [name isEqualToString:@"Timestamp"]) {
+				timeStamp = [value autorelease];
+				continue;
+			}
+			[properties setObject:value forKey:name];
+			[value release];
+		}
+
+		WATableEntity *entity = [[WATableEntity alloc] initWithDictionary:properties fromTable:context->tableName];
+		if (timeStamp) {
+			[entity setValue:timeStamp forKey:@"timeStamp"];
+		}
+		for (NSString *name in guidProperties) {
+			[entity setEdmType:WAEdmTypeGuid forKey:name];
+		}
+		[properties release];
+
+		if (context->entityHandler) {
+			context->entityHandler(entity);
+		}
+		[entity release];
+	}
+
+	context->entityCount++;
+	WAJSONResetEntity(context);
+}
+
+static void WAJSONEntityMember(struct WAJSONEntityContext *context, WAJSONValueKind kind, const char *bytes, size_t length)
+{
+	static const char annotation[] = "@odata.type";
+	const size_t annotationLength = sizeof(annotation) - 1;
+	const char *key = context->key.bytes;
+	size_t keyLength = context->key.length;
+
+	if (keyLength > annotationLength && memcmp(key + keyLength - annotationLength, annotation, annotationLength) == 0) {
+		NSUInteger index = WAJSONResolveName(context, key, keyLength - annotationLength);
+		if (kind == WAJSONValueString && index != NSNotFound) {
+			context->names[index].annotatedType = WAEdmTypeFromName(bytes, length);
+			context->names[index].annotatedEntity = context->entitySerial;
+		}
+		return;
+	}
+
+	// odata.etag, odata.id, odata.metadata and the like describe the entity rather than belong to it
+	if (kind == WAJSONValueNull || (keyLength > 6 && memcmp(key, "odata.", 6) == 0)) {
+		return;
+	}
+
+	NSUInteger index = WAJSONResolveName(context, key, keyLength);
+	if (index == NSNotFound || context->names[index].skipped) {
+		return;
+	}
+
+	if (context->memberCount == context->memberCapacity) {
+		WAJSONMember *grown = [context->pool growBytes:context->members usedLength:context->memberCount * sizeof(WAJSONMember)
+											  toLength:(context->memberCount + 1) * sizeof(WAJSONMember) capacity:&context->membersSize];
+		if (!grown) {
+			WAJSONFail(context, @"There is not enough memory to parse the response.");
+			return;
+		}
+		context->members = grown;
+		context->memberCapacity = context->membersSize / sizeof(WAJSONMember);
+	}
+
+	WAJSONMember *member = &context->members[context->memberCount++];
+	member->name = index;
+	member->kind = kind;
+	member->offset = context->values.length;
+	member->length = length;
+	WAJSONAppend(context, &context->values, bytes, length);
+}
+
+static void WAJSONValue(struct WAJSONEntityContext *context, WAJSONValueKind kind, const char *bytes, size_t length)
+{
+	int depth = context->depth;
+	if (!depth || context->isArray[depth]) {
+		return;
+	}
+
+	if (depth == context->entityDepth) {
+		WAJSONEntityMember(context, kind, bytes, length);
+	} else if (context->errorDepth && kind == WAJSONValueString && depth >= context->errorDepth) {
+		// {"odata.error":{"code":"...","message":{"lang":"en-US","value":"..."}}}
+		NSString *value = [[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding];
+		if (depth == context->errorDepth && WAJSONKeyIs(context, "code")) {
+			[context->errorCode release];
+			context->errorCode = value;
+		} else if ((depth == context->errorDepth && WAJSONKeyIs(context, "message")) || (depth == context->errorDepth + 1 && WAJSONKeyIs(context, "value"))) {
+			[context->errorMessage release];
+			context->errorMessage = value;
+		} else {
+			[value release];
+		}
+	}
+}
+
+static void WAJSONBeginContainer(struct WAJSONEntityContext *context, BOOL array)
+{
+	if (context->depth == WAJSONMaxDepth) {
+		WAJSONFail(context, @"The response is nested too deeply to be a table response.");
+		return;
+	}
+
+	int parent = context->depth;
+	int depth = ++context->depth;
+	context->isArray[depth] = array;
+
+	if (depth == 1) {
+		// a point query returns the entity itself, with no feed around it
+		if (!array) {
+			WAJSONBeginEntity(context, 1);
+		}
+	} else if (parent == 1 && !context->isArray[1] && array && WAJSONKeyIs(context, "value")) {
+		context->feedDepth = depth;
+		context->entityDepth = 0;
+		WAJSONResetEntity(context);
+	} else if (parent == 1 && !context->isArray[1] && !array && WAJSONKeyIs(context, "odata.error")) {
+		context->errorDepth = depth;
+		context->entityDepth = 0;
+		WAJSONResetEntity(context);
+	} else if (context->feedDepth && parent == context->feedDepth && !array) {
+		WAJSONBeginEntity(context, depth);
+	}
+
+	context->expectKey = !array;
+}
+
+static void WAJSONEndContainer(struct WAJSONEntityContext *context, BOOL array)
+{
+	if (!context->depth || context->isArray[context->depth] != array) {
+		WAJSONFail(context, [NSString stringWithFormat:@"Unexpected '%c' in the response.", array ? ']' : '}']);
+		return;
+	}
+
+	int depth = context->depth--;
+	if (depth == context->entityDepth) {
+		// an empty document is not an entity
+		if (depth > 1 || context->memberCount) {
+			WAJSONEndEntity(context);
+		}
+		context->entityDepth = 0;
+	} else if (depth == context->feedDepth) {
+		context->feedDepth = 0;
+	} else if (depth == context->errorDepth) {
+		context->errorDepth = 0;
+	}
+
+	context->expectKey = NO;
+}
+
+static void WAJSONEndString(struct WAJSONEntityContext *context)
+{
+	if (context->depth && !context->isArray[context->depth] && context->expectKey) {
+		context->key.length = 0;
+		WAJSONAppend(context, &context->key, context->token.bytes, context->token.length);
+		context->expectKey = NO;
+		return;
+	}
+
+	WAJSONValue(context, WAJSONValueString, context->token.bytes, context->token.length);
+}
+
+static void WAJSONEndScalar(struct WAJSONEntityContext *context)
+{
+	const char *bytes = context->token.bytes;
+	size_t length = context->token.length;
+	WAJSONValueKind kind;
+
+	if ((length == 4 && memcmp(bytes, "true", 4) == 0) || (length == 5 && memcmp(bytes, "false", 5) == 0)) {
+		kind = WAJSONValueBoolean;
+	} else if (length == 4 && memcmp(bytes, "null", 4) == 0) {
+		kind = WAJSONValueNull;
+	} else if (bytes[0] == '-' || (bytes[0] >= '0' && bytes[0] <= '9')) {
+		kind = WAJSONValueNumber;
+	} else {
+		WAJSONFail(context, [NSString stringWithFormat:@"Unexpected '%.*s' in the response.", (int)MIN(length, 16), bytes]);
+		return;
+	}
+
+	context->lexState = WAJSONLexBetween;
+	WAJSONValue(context, kind, bytes, length);
+}
+
+static void WAJSONAppendCodePoint(struct WAJSONEntityContext *context, uint32_t codePoint)
+{
+	if (codePoint >= 0xD800 && codePoint <= 0xDBFF) {
+		context->highSurrogate = codePoint;
+		return;
+	}
+	if (codePoint >= 0xDC00 && codePoint <= 0xDFFF) {
+		codePoint = context->highSurrogate ? 0x10000 + ((context->highSurrogate - 0xD800) << 10) + (codePoint - 0xDC00) : 0xFFFD;
+	}
+	context->highSurrogate = 0;
+
+	char bytes[4];
+	size_t length;
+	if (codePoint < 0x80) {
+		bytes[0] = (char)codePoint;
+		length = 1;
+	} else if (codePoint < 0x800) {
+		bytes[0] = (char)(0xC0 | (codePoint >> 6));
+		bytes[1] = (char)(0x80 | (codePoint & 0x3F));
+		length = 2;
+	} else if (codePoint < 0x10000) {
+		bytes[0] = (char)(0xE0 | (codePoint >> 12));
+		bytes[1] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		bytes[2] = (char)(0x80 | (codePoint & 0x3F));
+		length = 3;
+	} else {
+		bytes[0] = (char)(0xF0 | (codePoint >> 18));
+		bytes[1] = (char)(0x80 | ((codePoint >> 12) & 0x3F));
+		bytes[2] = (char)(0x80 | ((codePoint >> 6) & 0x3F));
+		bytes[3] = (char)(0x80 | (codePoint & 0x3F));
+		length = 4;
+	}
+	WAJSONAppend(context, &context->token, bytes, length);
+}
+
+static BOOL WAJSONIsScalarCharacter(char c)
+{
+	return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c == '-' || c == '+' || c == '.' || c == 'E';
+}
+
+/*
+ Tokenizes a chunk. A token cut by the end of the chunk is kept in the token
+ buffer, with the lexer state saying how to carry on with the next chunk.
+ */
+static void WAJSONParse(struct WAJSONEntityContext *context, const char *bytes, size_t length)
+{
+	const char *p = bytes;
+	const char *end = bytes + length;
+
+	while (p < end && !context->failure) {
+		switch (context->lexState) {
+			case WAJSONLexBetween: {
+				char c = *p++;
+				switch (c) {
+					case ' ':
+					case '\t':
+					case '\r':
+					case '\n':
+					case ':':
+						break;
+					case ',':
+						context->expectKey = context->depth && !context->isArray[context->depth];
+						break;
+					case '{':
+					case '[':
+						WAJSONBeginContainer(context, c == '[');
+						break;
+					case '}':
+					case ']':
+						WAJSONEndContainer(context, c == ']');
+						break;
+					case '"':
+						context->token.length = 0;
+						context->lexState = WAJSONLexString;
+						break;
+					default:
+						if (!WAJSONIsScalarCharacter(c)) {
+							WAJSONFail(context, [NSString stringWithFormat:@"Unexpected character 0x%02x in the response.", (unsigned char)c]);
+							break;
+						}
+						context->token.length = 0;
+						WAJSONAppend(context, &context->token, &c, 1);
+						context->lexState = WAJSONLexScalar;
+						break;
+				}
+				break;
+			}
+
+			case WAJSONLexString: {
+				const char *run = p;
+				while (p < end && *p != '"' && *p != '\\') {
+					p++;
+				}
+				WAJSONAppend(context, &context->token, run, p - run);
+				if (p < end) {
+					context->lexState = *p == '"' ? WAJSONLexBetween : WAJSONLexEscape;
+					if (*p++ == '"') {
+						WAJSONEndString(context);
+					}
+				}
+				break;
+			}
+
+			case WAJSONLexEscape: {
+				char c = *p++;
+				char decoded;
+				switch (c) {
+					case '"':
+					case '\\':
+					case '/':
+						decoded = c;
+						break;
+					case 'b':
+						decoded = '\b';
+						break;
+					case 'f':
+						decoded = '\f';
+						break;
+					case 'n':
+						decoded = '\n';
+						break;
+					case 'r':
+						decoded = '\r';
+						break;
+					case 't':
+						decoded = '\t';
+						break;
+					case 'u':
+						context->codePoint = 0;
+						context->codePointDigits = 0;
+						context->lexState = WAJSONLexUnicode;
+						continue;
+					default:
+						WAJSONFail(context, [NSString stringWithFormat:@"Invalid escape '\\%c' in the response.", c]);
+						continue;
+				}
+				WAJSONAppend(context, &context->token, &decoded, 1);
+				context->lexState = WAJSONLexString;
+				break;
+			}
+
+			case WAJSONLexUnicode: {
+				char c = *p++;
+				int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+				if (digit < 0) {
+					WAJSONFail(context, @"Invalid \\u escape in the response.");
+					break;
+				}
+				context->codePoint = context->codePoint * 16 + digit;
+				if (++context->codePointDigits == 4) {
+					WAJSONAppendCodePoint(context, context->codePoint);
+					context->lexState = WAJSONLexString;
+				}
+				break;
+			}
+
+			case WAJSONLexScalar: {
+				const char *run = p;
+				while (p < end && WAJSONIsScalarCharacter(*p)) {
+					p++;
+				}
+				WAJSONAppend(context, &context->token, run, p - run);
+				// the delimiter is left for the next state to handle
+				if (p < end) {
+					WAJSONEndScalar(context);
+				}
+				break;
+			}
+		}
+	}
+}
+
+@interface WAJSONEntityParser ()
+
+- (id)initWithTableName:(NSString *)tableName;
+- (NSError *)failureError;
+
+@end
+
+@implementation WAJSONEntityParser
+
+- (id)initWithTableName:(NSString *)tableName entityHandler:(void (^)(WATableEntity *entity))block
+{
+	if(!(self = [self initWithTableName:tableName])) {
+		return nil;
+	}
+
+	_context->entityHandler = [block copy];
+
+	return self;
+}
+
+- (id)initWithTableName:(NSString *)tableName entityBatch:(WATableEntityBatch *)batch
+{
+	if(!(self = [self initWithTableName:tableName])) {
+		return nil;
+	}
+
+	_context->batch = [batch retain];
+
+	return self;
+}
+
+- (id)initWithTableName:(NSString *)tableName
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_context = calloc(1, sizeof(struct WAJSONEntityContext));
+	_context->tableName = [tableName copy];
+	_context->pool = [[WABufferPool sharedPool] retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	if (_context) {
+		WAJSONClearNames(_context);
+		[_context->pool recycleBytes:_context->names capacity:_context->namesSize];
+		[_context->pool recycleBytes:_context->nameBytes.bytes capacity:_context->nameBytes.capacity];
+		[_context->pool recycleBytes:_context->members capacity:_context->membersSize];
+		[_context->pool recycleBytes:_context->values.bytes capacity:_context->values.capacity];
+		[_context->pool recycleBytes:_context->token.bytes capacity:_context->token.capacity];
+		[_context->pool recycleBytes:_context->key.bytes capacity:_context->key.capacity];
+		[_context->pool release];
+		[_context->tableName release];
+		[_context->entityHandler release];
+		[_context->batch release];
+		[_context->selectedProperties release];
+		[_context->propertyTypes release];
+		[_context->failure release];
+		[_context->errorCode release];
+		[_context->errorMessage release];
+		free(_context);
+	}
+	[super dealloc];
+}
+
+- (NSUInteger)entityCount
+{
+	return _context->entityCount;
+}
+
+- (NSString *)errorCode
+{
+	return _context->errorCode;
+}
+
+- (NSString *)errorMessage
+{
+	return _context->errorMessage;
+}
+
+- (NSSet *)selectedProperties
+{
+	return _context->selectedProperties;
+}
+
+- (void)setSelectedProperties:(NSSet *)selectedProperties
+{
+	if (selectedProperties != _context->selectedProperties) {
+		[_context->selectedProperties release];
+		_context->selectedProperties = [selectedProperties copy];
+		WAJSONClearNames(_context);
+	}
+}
+
+- (NSDictionary *)propertyTypes
+{
+	return _context->propertyTypes;
+}
+
+- (void)setPropertyTypes:(NSDictionary *)propertyTypes
+{
+	if (propertyTypes != _context->propertyTypes) {
+		[_context->propertyTypes release];
+		_context->propertyTypes = [propertyTypes copy];
+		WAJSONClearNames(_context);
+	}
+}
+
+- (WABufferPool *)bufferPool
+{
+	return _context->pool;
+}
+
+- (void)setBufferPool:(WABufferPool *)bufferPool
+{
+	NSAssert(!_context->names && !_context->nameBytes.bytes && !_context->members && !_context->values.bytes && !_context->token.bytes && !_context->key.bytes, @"The pool cannot change once parsing has started");
+	[_context->pool autorelease];
+	_context->pool = [(bufferPool ? bufferPool : [WABufferPool sharedPool]) retain];
+}
+
+- (BOOL)parseData:(NSData *)data error:(NSError **)error
+{
+	WAJSONParse(_context, [data bytes], [data length]);
+
+	if (_context->failure) {
+		if (error) {
+			*error = [self failureError];
+		}
+		return NO;
+	}
+
+	return YES;
+}
+
+- (BOOL)finishWithError:(NSError **)error
+{
+	if (!_context->failure && _context->lexState == WAJSONLexScalar) {
+		WAJSONEndScalar(_context);
+	}
+	if (!_context->failure && (_context->lexState != WAJSONLexBetween || _context->depth)) {
+		WAJSONFail(_context, @"The response ended before the end of the document.");
+	}
+
+	if (_context->failure) {
+		if (error) {
+			*error = [self failureError];
+		}
+		return NO;
+	}
+
+	return YES;
+}
+
+- (NSError *)failureError
+{
+	return WAToolkitError(-1, nil, _context->failure);
+}
+
+@end
@@ -0,0 +1,59 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+/**
+ The maximum size, in bytes, of the text of one queue message, after any base64 encoding.
+ */
+#define WAQueueBatchMaxMessageSize (64 * 1024)
+
+/**
+ The number of Put Message requests addMessages:toQueue:withCompletionHandler: keeps in flight at once.
+ */
+#define WAQueueBatchDefaultConcurrentRequests 16
+
+/**
+ Adding many messages to a queue at once for WACloudStorageClient.
+ */
+@interface WACloudStorageClient (QueueBatch)
+
+/**
+ Adds messages to a queue using up to WAQueueBatchDefaultConcurrentRequests requests at once.
+
+ @param messages The messages to add.
+ @param queueName The name of the queue.
+ @param block A block object called once every message has been added or has failed.
+
+ @see addMessages:toQueue:maxConcurrentRequests:withCompletionHandler:
+ */
+- (void)addMessages:(NSArray *)messages toQueue:(NSString *)queueName withCompletionHandler:(void (^)(NSArray *errors, NSError *error))block;
+
+/**
+ Adds messages to a queue, sending them over several requests at once.
+
+ The queue service takes one message per request, so a burst of messages is bound by round trips rather than bandwidth when it is sent one message at a time. The messages are sent in the order given, with at most maxConcurrentRequests requests in flight; they may therefore arrive in the queue slightly out of order. A failed request is retried as the retry policy of the client allows, and does not stop the other messages from being sent.
+
+ @param messages The messages to add. Each is an NSString, sent as it is, or an NSData, sent base64 encoded. A message larger than WAQueueBatchMaxMessageSize once encoded fails without being sent.
+ @param queueName The name of the queue.
+ @param maxConcurrentRequests The number of requests that may be in flight at once.
+ @param block A block object called on the calling thread once every message has been added or has failed. The errors array holds, in the order of the messages array, NSNull for a message that was added and the NSError of one that was not. The error is nil if every message was added, otherwise it is the first error that occurred.
+ */
+- (void)addMessages:(NSArray *)messages toQueue:(NSString *)queueName maxConcurrentRequests:(NSUInteger)maxConcurrentRequests withCompletionHandler:(void (^)(NSArray *errors, NSError *error))block;
+
+@end
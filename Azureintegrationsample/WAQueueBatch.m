@@ -0,0 +1,161 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAQueueBatch.h"
+
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WAToolkitPrivate.h"
+
+/*
+ Sends the messages of one addMessages: call, keeping a window of requests in
+ flight. Lives until the last request has completed.
+ */
+@interface WAQueueBatchSender : NSObject {
+@public
+	WACloudStorageClient *client;
+	WASharedKeySigner *signer;
+	WARetryPolicy *retryPolicy;
+	NSString *queueName;
+	NSArray *texts;
+	NSMutableArray *errors;
+	NSError *firstError;
+	NSUInteger maxConcurrentRequests;
+	NSUInteger nextIndex;
+	NSUInteger activeRequests;
+	void (^completionHandler)(NSArray *errors, NSError *error);
+}
+
+- (void)sendMessages;
+- (void)sendMessageAtIndex:(NSUInteger)index;
+- (void)message:(NSUInteger)index didFailWithError:(NSError *)error;
+
+@end
+
+@implementation WAQueueBatchSender
+
+- (void)dealloc
+{
+	[client release];
+	[signer release];
+	[retryPolicy release];
+	[queueName release];
+	[texts release];
+	[errors release];
+	[firstError release];
+	[completionHandler release];
+	[super dealloc];
+}
+
+- (void)sendMessages
+{
+	while (nextIndex < texts.count && activeRequests < maxConcurrentRequests) {
+		[self sendMessageAtIndex:nextIndex++];
+	}
+
+	if (!activeRequests && nextIndex == texts.count && completionHandler) {
+		void (^block)(NSArray *, NSError *) = [completionHandler autorelease];
+		completionHandler = nil;
+		block(errors, firstError);
+		[self autorelease];
+	}
+}
+
+- (void)sendMessageAtIndex:(NSUInteger)index
+{
+	NSString *text = [texts objectAtIndex:index];
+	if ([text lengthOfBytesUsingEncoding:NSUTF8StringEncoding] > WAQueueBatchMaxMessageSize) {
+		[self message:index didFailWithError:WAToolkitError(400, @"RequestBodyTooLarge", @"The message is larger than the queue service accepts.")];
+		return;
+	}
+
+	NSMutableURLRequest *request = [signer requestForStorageType:WAStorageTypeQueue path:[NSString stringWithFormat:@"/%@/messages", WAURLEncodedString(queueName)] query:nil httpMethod:@"POST"];
+	[request setValue:@"application/xml" forHTTPHeaderField:@"Content-Type"];
+	[request setHTTPBody:WAQueueMessageBody(text)];
+	WARequestMetrics *metrics = [client metricsForOperation:@"PutMessage" resourceName:queueName];
+	[signer signRequest:request forStorageType:WAStorageTypeQueue metrics:metrics];
+
+	WAStreamingURLRequest *streamingRequest = [WAStreamingURLRequest requestWithURLRequest:request];
+	streamingRequest.retryPolicy = retryPolicy;
+	streamingRequest.retryOperationKind = WARetryOperationNonIdempotentWrite;
+	streamingRequest.metrics = metrics;
+	streamingRequest.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForQueue(signer.accountName, queueName)];
+	streamingRequest.collectsResponseBody = YES;
+
+	activeRequests++;
+	[streamingRequest startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		activeRequests--;
+
+		if (!error && response.statusCode >= 300) {
+			error = WAStorageErrorFromResponse(response, [streamingRequest.responseBody contiguousData]);
+		}
+		if (error) {
+			[self message:index didFailWithError:error];
+		}
+
+		[self sendMessages];
+	}];
+}
+
+- (void)message:(NSUInteger)index didFailWithError:(NSError *)error
+{
+	[errors replaceObjectAtIndex:index withObject:error];
+	if (!firstError) {
+		firstError = [error retain];
+	}
+}
+
+@end
+
+@implementation WACloudStorageClient (QueueBatch)
+
+- (void)addMessages:(NSArray *)messages toQueue:(NSString *)queueName withCompletionHandler:(void (^)(NSArray *errors, NSError *error))block
+{
+	[self addMessages:messages toQueue:queueName maxConcurrentRequests:WAQueueBatchDefaultConcurrentRequests withCompletionHandler:block];
+}
+
+- (void)addMessages:(NSArray *)messages toQueue:(NSString *)queueName maxConcurrentRequests:(NSUInteger)maxConcurrentRequests withCompletionHandler:(void (^)(NSArray *errors, NSError *error))block
+{
+	WASharedKeySigner *signer = [WASharedKeySigner signerForCredential:WAStorageClientCredential(self)];
+	if (!signer) {
+		block(nil, WAToolkitError(-1, nil, @"Batch operations require a credential with an account name and access key."));
+		return;
+	}
+
+	NSMutableArray *texts = [NSMutableArray arrayWithCapacity:messages.count];
+	NSMutableArray *errors = [NSMutableArray arrayWithCapacity:messages.count];
+	for (id message in messages) {
+		[texts addObject:[message isKindOfClass:[NSData class]] ? [message stringWithBase64EncodedData] : message];
+		[errors addObject:[NSNull null]];
+	}
+
+	// balanced once the last request has completed
+	WAQueueBatchSender *sender = [[WAQueueBatchSender alloc] init];
+	sender->client = [self retain];
+	sender->signer = [signer retain];
+	sender->retryPolicy = [self.retryPolicy retain];
+	sender->queueName = [queueName copy];
+	sender->texts = [texts copy];
+	sender->errors = [errors retain];
+	sender->maxConcurrentRequests = MAX(maxConcurrentRequests, 1);
+	sender->completionHandler = [block copy];
+	[sender sendMessages];
+}
+
+@end
@@ -0,0 +1,182 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WAQueueMessage;
+@class WASharedKeySigner;
+
+/**
+ The largest number of messages the queue service returns for one request.
+ */
+#define WAQueueConsumerMaxBatchSize 32
+
+/**
+ Called by a message handler once it is done with a message.
+
+ @param processed YES to delete the message from the queue, NO to make it visible again right away so it is delivered again.
+ */
+typedef void (^WAQueueConsumerCompletion)(BOOL processed);
+
+/**
+ Called with the polling state of a consumer.
+
+ @param pollInterval The time, in seconds, the consumer currently waits between polls of an empty queue, or 0 while messages keep arriving and the queue is fetched from continuously.
+ @param approximateMessageCount The approximate number of messages in the queue as last reported by the service, or -1 if it has not been fetched yet.
+ */
+typedef void (^WAQueueConsumerMetricsHandler)(NSTimeInterval pollInterval, NSInteger approximateMessageCount);
+
+/**
+ Drains a queue by fetching messages in batches and handing them to a bounded pool of concurrent handlers.
+
+ Messages are fetched up to batchSize at a time and kept invisible to other consumers for visibilityTimeout. Up to maxConcurrentFetches requests for messages are kept in flight while handlers have room for more messages. Once the queue is found empty it is polled again after idlePollInterval, and the wait doubles with every poll that comes back empty, up to maxIdlePollInterval, so an idle queue costs few transactions; the first message received returns the consumer to fetching continuously. A message whose handler is still running when its visibility is about to run out has its visibility extended, so a slow handler does not cause the message to be delivered twice.
+
+ When a handler completes, the message is deleted or released. Deletions are collected and sent together in a short burst, instead of as one request after each message.
+
+ The consumer sends its own requests, signed with the credential of its storage client, and must be started and stopped on the main thread. Handlers are called on a background queue.
+ */
+@interface WAQueueConsumer : NSObject {
+@private
+	WACloudStorageClient *_client;
+	NSString *_queueName;
+	NSUInteger _batchSize;
+	NSTimeInterval _visibilityTimeout;
+	NSUInteger _maxConcurrentHandlers;
+	NSUInteger _maxConcurrentFetches;
+	NSTimeInterval _idlePollInterval;
+	NSTimeInterval _maxIdlePollInterval;
+	NSTimeInterval _metricsInterval;
+	WAQueueConsumerMetricsHandler _metricsHandler;
+	NSUInteger _processedCount;
+	NSUInteger _releasedCount;
+	void (^_errorHandler)(NSError *error);
+
+	WASharedKeySigner *_signer;
+	void (^_handler)(WAQueueMessage *message, WAQueueConsumerCompletion completion);
+	BOOL _running;
+	BOOL _pollScheduled;
+	NSTimeInterval _pollInterval;
+	NSInteger _approximateMessageCount;
+	CFAbsoluteTime _metricsFetchedAt;
+	BOOL _fetchingMetrics;
+	NSUInteger _activeFetches;
+	NSUInteger _activeHandlers;
+	NSMutableArray *_buffered;
+	NSMutableArray *_handling;
+	NSMutableArray *_pendingDeletes;
+	NSTimer *_timer;
+}
+
+/**
+ The name of the queue.
+ */
+@property (readonly) NSString *queueName;
+
+/**
+ The number of messages asked for by each request, from 1 to WAQueueConsumerMaxBatchSize. The default is WAQueueConsumerMaxBatchSize.
+ */
+@property (assign) NSUInteger batchSize;
+
+/**
+ The time, in seconds, fetched messages stay invisible to other consumers before they are extended. The default is 30.
+ */
+@property (assign) NSTimeInterval visibilityTimeout;
+
+/**
+ The number of handlers that may run at once. The default is 8.
+ */
+@property (assign) NSUInteger maxConcurrentHandlers;
+
+/**
+ The number of requests for messages that may be in flight at once. The default is 2.
+ */
+@property (assign) NSUInteger maxConcurrentFetches;
+
+/**
+ The time, in seconds, to wait before polling again after the queue was first found empty. The default is 1.
+ */
+@property (assign) NSTimeInterval idlePollInterval;
+
+/**
+ The longest time, in seconds, to wait between polls of a queue that stays empty. The default is 30.
+ */
+@property (assign) NSTimeInterval maxIdlePollInterval;
+
+/**
+ The time, in seconds, the consumer currently waits between polls, or 0 while it fetches continuously.
+ */
+@property (readonly) NSTimeInterval pollInterval;
+
+/**
+ The approximate number of messages in the queue as last reported by the service, or -1 if it has not been fetched. It is only fetched while a metricsHandler is set.
+ */
+@property (readonly) NSInteger approximateMessageCount;
+
+/**
+ The shortest time, in seconds, between two fetches of the approximate message count. While the queue is polled less often than this, the count is fetched no more often than the queue. The default is 30.
+ */
+@property (assign) NSTimeInterval metricsInterval;
+
+/**
+ Called on the main thread when the poll interval changes and when a new approximate message count has been fetched.
+ */
+@property (copy) WAQueueConsumerMetricsHandler metricsHandler;
+
+/**
+ The number of messages handled and deleted.
+ */
+@property (readonly) NSUInteger processedCount;
+
+/**
+ The number of messages handed back to the queue by their handler.
+ */
+@property (readonly) NSUInteger releasedCount;
+
+/**
+ Called on the main thread when a request fails. The consumer keeps running; a failed fetch counts as an empty poll and is tried again after the poll interval.
+ */
+@property (copy) void (^errorHandler)(NSError *error);
+
+/**
+ Whether the consumer is running.
+ */
+@property (readonly, getter=isRunning) BOOL running;
+
+/**
+ Initializes a newly created consumer.
+
+ @param client The storage client whose credential is used. It must have been created with an account name and access key.
+ @param queueName The name of the queue to drain.
+
+ @returns The newly initialized WAQueueConsumer object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client queueName:(NSString *)queueName;
+
+/**
+ Starts fetching messages and handing them to a handler.
+
+ @param handler A block object called on a background queue for every message. It must call the completion block exactly once, on any thread, when it is done with the message.
+ */
+- (void)startWithHandler:(void (^)(WAQueueMessage *message, WAQueueConsumerCompletion completion))handler;
+
+/**
+ Stops fetching messages. Messages not yet handed to a handler are released to the queue; handlers that are running finish, and their messages are still deleted or released.
+ */
+- (void)stop;
+
+@end
@@ -0,0 +1,543 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAQueueConsumer.h"
+
+#import <libxml/parser.h>
+#import <libxml/tree.h>
+
+#import "WABufferChain.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WAToolkitPrivate.h"
+
+// how often visibility and pending deletions are looked at
+#define WAQueueConsumerTickInterval 1.0
+
+// idle polls are spread by up to this fraction either way, so consumers started together do not poll together
+#define WAQueueConsumerPollJitter 0.1
+
+// messages closer than this to becoming visible again are not handed to a handler
+#define WAQueueConsumerMinimumRemainingVisibility 2.0
+
+/*
+ A fetched message and the state of its lease on the queue. Touched on the main thread only.
+ */
+@interface WAQueueConsumerEntry : NSObject {
+@public
+	WAQueueMessage *message;
+	NSString *popReceipt;
+	CFAbsoluteTime visibleAt;
+	BOOL updating;
+	BOOL completed;
+}
+
+@end
+
+@implementation WAQueueConsumerEntry
+
+- (void)dealloc
+{
+	[message release];
+	[popReceipt release];
+	[super dealloc];
+}
+
+@end
+
+static NSString *WAChildText(xmlNodePtr parent, const char *name)
+{
+	for (xmlNodePtr child = parent->children; child; child = child->next) {
+		if (child->type == XML_ELEMENT_NODE && strcmp((const char *)child->name, name) == 0) {
+			xmlChar *content = xmlNodeGetContent(child);
+			NSString *text = content ? [NSString stringWithUTF8String:(const char *)content] : nil;
+			xmlFree(content);
+			return text;
+		}
+	}
+	return nil;
+}
+
+/*
+ Parses the QueueMessagesList document returned by Get Messages. The segments
+ of the body are pushed to the parser as they are, without joining them.
+ */
+static NSArray *WAParseQueueMessages(WABufferChain *body)
+{
+	xmlParserCtxtPtr context = xmlCreatePushParserCtxt(NULL, NULL, NULL, 0, NULL);
+	if (!context) {
+		return nil;
+	}
+	xmlCtxtUseOptions(context, XML_PARSE_NONET | XML_PARSE_NOBLANKS);
+	[body enumerateSegmentsUsingBlock:^(NSData *segment, NSUInteger offset, BOOL *stop) {
+		*stop = xmlParseChunk(context, [segment bytes], (int)[segment length], 0) != 0;
+	}];
+	xmlParseChunk(context, NULL, 0, 1);
+
+	xmlDocPtr document = context->myDoc;
+	if (!context->wellFormed) {
+		xmlFreeDoc(document);
+		document = NULL;
+	}
+	xmlFreeParserCtxt(context);
+	if (!document) {
+		return nil;
+	}
+
+	NSMutableArray *messages = [NSMutableArray arrayWithCapacity:WAQueueConsumerMaxBatchSize];
+	xmlNodePtr root = xmlDocGetRootElement(document);
+	for (xmlNodePtr node = root ? root->children : NULL; node; node = node->next) {
+		if (node->type != XML_ELEMENT_NODE || strcmp((const char *)node->name, "QueueMessage") != 0) {
+			continue;
+		}
+
+		WAQueueMessage *message = [[WAQueueMessage alloc] initQueueMessageWithMessageId:WAChildText(node, "MessageId")
+																		  insertionTime:WAChildText(node, "InsertionTime")
+																		 expirationTime:WAChildText(node, "ExpirationTime")
+																			 popReceipt:WAChildText(node, "PopReceipt")
+																		timeNextVisible:WAChildText(node, "TimeNextVisible")
+																			messageText:WAChildText(node, "MessageText")
+																		   dequeueCount:[WAChildText(node, "DequeueCount") integerValue]];
+		[messages addObject:message];
+		[message release];
+	}
+
+	xmlFreeDoc(document);
+	return messages;
+}
+
+@interface WAQueueConsumer ()
+
+- (void)sendRequest:(NSMutableURLRequest *)request operation:(NSString *)operation completionHandler:(void (^)(NSHTTPURLResponse *response, WABufferChain *body, NSError *error))block;
+- (void)fillPipeline;
+- (void)fetchMessages;
+- (void)schedulePoll;
+- (void)poll;
+- (void)setPollInterval:(NSTimeInterval)pollInterval;
+- (void)fetchMetrics;
+- (void)reportMetrics;
+- (void)handleEntry:(WAQueueConsumerEntry *)entry;
+- (void)entry:(WAQueueConsumerEntry *)entry didCompleteProcessing:(BOOL)processed;
+- (void)setVisibilityTimeout:(NSTimeInterval)timeout ofEntry:(WAQueueConsumerEntry *)entry completionHandler:(void (^)(BOOL succeeded))block;
+- (void)flushDeletes;
+- (void)tick:(NSTimer *)timer;
+
+@end
+
+@implementation WAQueueConsumer
+
+@synthesize queueName = _queueName;
+@synthesize batchSize = _batchSize;
+@synthesize visibilityTimeout = _visibilityTimeout;
+@synthesize maxConcurrentHandlers = _maxConcurrentHandlers;
+@synthesize maxConcurrentFetches = _maxConcurrentFetches;
+@synthesize idlePollInterval = _idlePollInterval;
+@synthesize maxIdlePollInterval = _maxIdlePollInterval;
+@synthesize pollInterval = _pollInterval;
+@synthesize approximateMessageCount = _approximateMessageCount;
+@synthesize metricsInterval = _metricsInterval;
+@synthesize metricsHandler = _metricsHandler;
+@synthesize processedCount = _processedCount;
+@synthesize releasedCount = _releasedCount;
+@synthesize errorHandler = _errorHandler;
+@synthesize running = _running;
+
+- (id)initWithClient:(WACloudStorageClient *)client queueName:(NSString *)queueName
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_client = [client retain];
+	_queueName = [queueName copy];
+	_batchSize = WAQueueConsumerMaxBatchSize;
+	_visibilityTimeout = 30;
+	_maxConcurrentHandlers = 8;
+	_maxConcurrentFetches = 2;
+	_idlePollInterval = 1;
+	_maxIdlePollInterval = 30;
+	_metricsInterval = 30;
+	_approximateMessageCount = -1;
+	_buffered = [[NSMutableArray alloc] init];
+	_handling = [[NSMutableArray alloc] init];
+	_pendingDeletes = [[NSMutableArray alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_client release];
+	[_queueName release];
+	[_errorHandler release];
+	[_metricsHandler release];
+	[_signer release];
+	[_handler release];
+	[_buffered release];
+	[_handling release];
+	[_pendingDeletes release];
+	[super dealloc];
+}
+
+- (void)startWithHandler:(void (^)(WAQueueMessage *message, WAQueueConsumerCompletion completion))handler
+{
+	if (_running) {
+		return;
+	}
+
+	if (!_signer) {
+		_signer = [[WASharedKeySigner signerForCredential:WAStorageClientCredential(_client)] retain];
+		if (!_signer) {
+			if (_errorHandler) {
+				_errorHandler(WAToolkitError(-1, nil, @"Queue consumers require a credential with an account name and access key."));
+			}
+			return;
+		}
+	}
+
+	_running = YES;
+	_pollInterval = 0;
+	[_handler release];
+	_handler = [handler copy];
+
+	if (!_timer) {
+		// the timer keeps the consumer alive until it has stopped and settled its messages
+		_timer = [NSTimer scheduledTimerWithTimeInterval:WAQueueConsumerTickInterval target:self selector:@selector(tick:) userInfo:nil repeats:YES];
+	}
+
+	[self fillPipeline];
+}
+
+- (void)stop
+{
+	if (!_running) {
+		return;
+	}
+
+	_running = NO;
+	_pollScheduled = NO;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(poll) object:nil];
+
+	for (WAQueueConsumerEntry *entry in _buffered) {
+		[self setVisibilityTimeout:0 ofEntry:entry completionHandler:nil];
+	}
+	[_buffered removeAllObjects];
+
+	[self flushDeletes];
+}
+
+#pragma mark - Private
+
+- (void)sendRequest:(NSMutableURLRequest *)request operation:(NSString *)operation completionHandler:(void (^)(NSHTTPURLResponse *response, WABufferChain *body, NSError *error))block
+{
+	WARequestMetrics *metrics = [_client metricsForOperation:operation resourceName:_queueName];
+	[_signer signRequest:request forStorageType:WAStorageTypeQueue metrics:metrics];
+
+	WAStreamingURLRequest *streamingRequest = [WAStreamingURLRequest requestWithURLRequest:request];
+	streamingRequest.retryPolicy = _client.retryPolicy;
+	streamingRequest.metrics = metrics;
+	streamingRequest.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForQueue(_signer.accountName, _queueName)];
+	streamingRequest.collectsResponseBody = YES;
+
+	[streamingRequest startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+		WABufferChain *body = streamingRequest.responseBody;
+		if (!error && response.statusCode >= 300) {
+			error = WAStorageErrorFromResponse(response, [body contiguousData]);
+		}
+		block(response, body, error);
+	}];
+}
+
+- (void)fillPipeline
+{
+	while (_buffered.count && _activeHandlers < MAX(_maxConcurrentHandlers, 1)) {
+		WAQueueConsumerEntry *entry = [[[_buffered objectAtIndex:0] retain] autorelease];
+		[_buffered removeObjectAtIndex:0];
+		[self handleEntry:entry];
+	}
+
+	// keep one batch beyond the free handlers on hand, so handlers do not wait for a round trip
+	NSUInteger batchSize = MIN(MAX(_batchSize, 1), WAQueueConsumerMaxBatchSize);
+	NSUInteger wanted = MAX(_maxConcurrentHandlers, 1) - _activeHandlers + batchSize;
+	while (_running && !_pollScheduled && _activeFetches < MAX(_maxConcurrentFetches, 1) &&
+		   _buffered.count + _activeFetches * batchSize < wanted) {
+		[self fetchMessages];
+	}
+}
+
+- (void)fetchMessages
+{
+	NSUInteger batchSize = MIN(MAX(_batchSize, 1), WAQueueConsumerMaxBatchSize);
+	NSString *query = [NSString stringWithFormat:@"numofmessages=%lu&visibilitytimeout=%d", (unsigned long)batchSize, (int)MAX(ceil(_visibilityTimeout), 1)];
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeQueue path:[NSString stringWithFormat:@"/%@/messages", WAURLEncodedString(_queueName)] query:query httpMethod:@"GET"];
+
+	// the lease starts when the service receives the request, so time it from before sending
+	CFAbsoluteTime sentAt = CFAbsoluteTimeGetCurrent();
+	_activeFetches++;
+
+	[self sendRequest:request operation:@"GetMessages" completionHandler:^(NSHTTPURLResponse *response, WABufferChain *body, NSError *error) {
+		_activeFetches--;
+
+		NSArray *messages = error ? nil : WAParseQueueMessages(body);
+		if (!error && !messages) {
+			error = WAToolkitError(response.statusCode, nil, @"The message list could not be parsed.");
+		}
+		if (error) {
+			LOG(@"Fetching messages from %@ failed: %@", _queueName, error);
+			if (_errorHandler) {
+				_errorHandler(error);
+			}
+		}
+
+		for (WAQueueMessage *message in messages) {
+			WAQueueConsumerEntry *entry = [[WAQueueConsumerEntry alloc] init];
+			entry->message = [message retain];
+			entry->popReceipt = [message.popReceipt copy];
+			entry->visibleAt = sentAt + _visibilityTimeout;
+			if (_running) {
+				[_buffered addObject:entry];
+			} else {
+				[self setVisibilityTimeout:0 ofEntry:entry completionHandler:nil];
+			}
+			[entry release];
+		}
+
+		if (messages.count) {
+			// a poll waiting out a long idle interval would only delay the messages behind these
+			if (_pollScheduled) {
+				_pollScheduled = NO;
+				[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(poll) object:nil];
+			}
+			[self setPollInterval:0];
+		} else {
+			[self schedulePoll];
+		}
+		[self fillPipeline];
+	}];
+}
+
+- (void)schedulePoll
+{
+	if (!_running || _pollScheduled) {
+		return;
+	}
+
+	// every poll that finds the queue empty doubles the wait before the next one
+	NSTimeInterval pollInterval = _pollInterval > 0 ? _pollInterval * 2 : _idlePollInterval;
+	[self setPollInterval:MAX(MIN(pollInterval, _maxIdlePollInterval), _idlePollInterval)];
+
+	double jitter = 1 + WAQueueConsumerPollJitter * (2 * ((double)arc4random() / UINT32_MAX) - 1);
+	_pollScheduled = YES;
+	[self performSelector:@selector(poll) withObject:nil afterDelay:_pollInterval * jitter];
+}
+
+- (void)poll
+{
+	_pollScheduled = NO;
+	[self fillPipeline];
+}
+
+- (void)setPollInterval:(NSTimeInterval)pollInterval
+{
+	if (pollInterval == _pollInterval) {
+		return;
+	}
+
+	_pollInterval = pollInterval;
+	[self reportMetrics];
+}
+
+- (void)fetchMetrics
+{
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeQueue path:[NSString stringWithFormat:@"/%@", WAURLEncodedString(_queueName)] query:@"comp=metadata" httpMethod:@"GET"];
+
+	_fetchingMetrics = YES;
+	_metricsFetchedAt = CFAbsoluteTimeGetCurrent();
+
+	[self sendRequest:request operation:@"GetQueueMetadata" completionHandler:^(NSHTTPURLResponse *response, WABufferChain *body, NSError *error) {
+		_fetchingMetrics = NO;
+
+		NSString *count = WAHeaderValueForKey(response, @"x-ms-approximate-messages-count");
+		if (error || !count) {
+			LOG(@"Fetching the message count of %@ failed: %@", _queueName, error);
+			return;
+		}
+
+		_approximateMessageCount = [count integerValue];
+		[self reportMetrics];
+	}];
+}
+
+- (void)reportMetrics
+{
+	if (_metricsHandler) {
+		_metricsHandler(_pollInterval, _approximateMessageCount);
+	}
+}
+
+- (void)handleEntry:(WAQueueConsumerEntry *)entry
+{
+	if (entry->visibleAt - CFAbsoluteTimeGetCurrent() < WAQueueConsumerMinimumRemainingVisibility) {
+		// another consumer may already have it; handling it here as well would duplicate the work
+		return;
+	}
+
+	_activeHandlers++;
+	[_handling addObject:entry];
+
+	void (^handler)(WAQueueMessage *, WAQueueConsumerCompletion) = [[_handler retain] autorelease];
+	WAQueueConsumerCompletion completion = ^(BOOL processed) {
+		dispatch_async(dispatch_get_main_queue(), ^{
+			[self entry:entry didCompleteProcessing:processed];
+		});
+	};
+
+	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		@autoreleasepool {
+			handler(entry->message, completion);
+		}
+	});
+}
+
+- (void)entry:(WAQueueConsumerEntry *)entry didCompleteProcessing:(BOOL)processed
+{
+	if (entry->completed) {
+		return;
+	}
+
+	entry->completed = YES;
+	_activeHandlers--;
+	[[entry retain] autorelease];
+	[_handling removeObjectIdenticalTo:entry];
+
+	if (processed) {
+		[_pendingDeletes addObject:entry];
+		if (_pendingDeletes.count >= MIN(MAX(_batchSize, 1), WAQueueConsumerMaxBatchSize) || !_running) {
+			[self flushDeletes];
+		}
+	} else {
+		_releasedCount++;
+		[self setVisibilityTimeout:0 ofEntry:entry completionHandler:nil];
+	}
+
+	[self fillPipeline];
+}
+
+- (void)setVisibilityTimeout:(NSTimeInterval)timeout ofEntry:(WAQueueConsumerEntry *)entry completionHandler:(void (^)(BOOL succeeded))block
+{
+	NSString *path = [NSString stringWithFormat:@"/%@/messages/%@", WAURLEncodedString(_queueName), WAURLEncodedString(entry->message.messageId)];
+	NSString *query = [NSString stringWithFormat:@"popreceipt=%@&visibilitytimeout=%d", WAURLEncodedString(entry->popReceipt), (int)ceil(timeout)];
+	NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeQueue path:path query:query httpMethod:@"PUT"];
+
+	// Update Message replaces the text, so the original is sent back
+	[request setHTTPBody:WAQueueMessageBody(entry->message.messageText)];
+	[request setValue:@"application/xml" forHTTPHeaderField:@"Content-Type"];
+
+	CFAbsoluteTime sentAt = CFAbsoluteTimeGetCurrent();
+	entry->updating = YES;
+	[entry retain];
+
+	[self sendRequest:request operation:@"UpdateMessage" completionHandler:^(NSHTTPURLResponse *response, WABufferChain *responseBody, NSError *error) {
+		entry->updating = NO;
+
+		NSString *popReceipt = WAHeaderValueForKey(response, @"x-ms-popreceipt");
+		if (!error && popReceipt) {
+			[entry->popReceipt release];
+			entry->popReceipt = [popReceipt copy];
+			entry->visibleAt = sentAt + timeout;
+
+			// handlers see the receipt that is current, should they talk to the queue themselves
+			[entry->message setValue:popReceipt forKey:@"popReceipt"];
+		} else if (error) {
+			LOG(@"Updating the visibility of message %@ failed: %@", entry->message.messageId, error);
+		}
+
+		if (block) {
+			block(!error);
+		}
+
+		// a deletion that waited for the new receipt can go now
+		if ([_pendingDeletes indexOfObjectIdenticalTo:entry] != NSNotFound) {
+			[self flushDeletes];
+		}
+		[entry release];
+	}];
+}
+
+- (void)flushDeletes
+{
+	NSArray *entries = [[_pendingDeletes copy] autorelease];
+	for (WAQueueConsumerEntry *entry in entries) {
+		if (entry->updating) {
+			continue;
+		}
+
+		[[entry retain] autorelease];
+		[_pendingDeletes removeObjectIdenticalTo:entry];
+
+		NSString *path = [NSString stringWithFormat:@"/%@/messages/%@", WAURLEncodedString(_queueName), WAURLEncodedString(entry->message.messageId)];
+		NSString *query = [NSString stringWithFormat:@"popreceipt=%@", WAURLEncodedString(entry->popReceipt)];
+		NSMutableURLRequest *request = [_signer requestForStorageType:WAStorageTypeQueue path:path query:query httpMethod:@"DELETE"];
+
+		[self sendRequest:request operation:@"DeleteMessage" completionHandler:^(NSHTTPURLResponse *response, WABufferChain *body, NSError *error) {
+			if (!error) {
+				_processedCount++;
+			} else {
+				// the lease was lost; the message will be delivered again
+				LOG(@"Deleting message %@ failed: %@", entry->message.messageId, error);
+				if (_errorHandler) {
+					_errorHandler(error);
+				}
+			}
+		}];
+	}
+}
+
+- (void)tick:(NSTimer *)timer
+{
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+	// extend leases a third of the way before they run out, which leaves time for a retry
+	NSTimeInterval margin = MAX(_visibilityTimeout / 3, WAQueueConsumerMinimumRemainingVisibility + WAQueueConsumerTickInterval);
+	for (WAQueueConsumerEntry *entry in _handling) {
+		if (!entry->updating && entry->visibleAt - now < margin) {
+			[self setVisibilityTimeout:_visibilityTimeout ofEntry:entry completionHandler:nil];
+		}
+	}
+
+	// buffered messages whose lease is nearly over are left for whoever gets them next
+	NSIndexSet *expired = [_buffered indexesOfObjectsPassingTest:^BOOL(WAQueueConsumerEntry *entry, NSUInteger index, BOOL *stop) {
+		return entry->visibleAt - now < WAQueueConsumerMinimumRemainingVisibility;
+	}];
+	[_buffered removeObjectsAtIndexes:expired];
+
+	[self flushDeletes];
+
+	// the count costs a transaction too, so an idle queue is not asked for it more often than it is polled
+	if (_running && _metricsHandler && !_fetchingMetrics && now - _metricsFetchedAt >= MAX(_metricsInterval, _pollInterval)) {
+		[self fetchMetrics];
+	}
+
+	if (!_running && !_handling.count && !_pendingDeletes.count) {
+		[_timer invalidate];
+		_timer = nil;
+	}
+}
+
+@end
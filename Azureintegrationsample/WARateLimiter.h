@@ -0,0 +1,107 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ Returns the rate limiter key of a storage account.
+
+ @param accountName The account name.
+ */
+extern NSString *WARateLimiterKeyForAccount(NSString *accountName);
+
+/**
+ Returns the rate limiter key of a table partition.
+
+ @param accountName The account name.
+ @param tableName The table name.
+ @param partitionKey The partition key.
+ */
+extern NSString *WARateLimiterKeyForPartition(NSString *accountName, NSString *tableName, NSString *partitionKey);
+
+/**
+ Returns the rate limiter key of a queue.
+
+ @param accountName The account name.
+ @param queueName The queue name.
+ */
+extern NSString *WARateLimiterKeyForQueue(NSString *accountName, NSString *queueName);
+
+/**
+ Returns the rate limiter key of a blob.
+
+ @param accountName The account name.
+ @param containerName The container name.
+ @param blobName The blob name.
+ */
+extern NSString *WARateLimiterKeyForBlob(NSString *accountName, NSString *containerName, NSString *blobName);
+
+/**
+ Paces requests so that they stay within the scalability targets of the storage service instead of being throttled by it.
+
+ Every key, made with one of the WARateLimiterKeyFor functions, has a token bucket holding up to one second of requests at the rate configured for its kind in WAConfiguration. A request takes a token from each of its keys; when a bucket is empty the request waits in line for the bucket to refill instead of failing.
+
+ The rate of a key adapts to the service: a 503 response halves it, at most once a second, and each success raises it again by a hundredth of the configured rate, up to the configured rate.
+
+ A rate limiter is safe to use from several threads.
+ */
+@interface WARateLimiter : NSObject {
+@private
+	NSMutableDictionary *_buckets;
+	BOOL _enabled;
+}
+
+/**
+ Whether requests are paced. When NO, acquireKeys:usingBlock: runs its block at once. The default is YES.
+ */
+@property (assign) BOOL enabled;
+
+/**
+ Returns the rate limiter used by the requests of the extensions.
+ */
++ (WARateLimiter *)sharedLimiter;
+
+/**
+ Takes a token for each key, waiting in line as needed, then calls a block.
+
+ @param keys The keys the request counts against.
+ @param block A block object called once a token of every key has been taken, on the calling thread if no wait was needed and on a background thread otherwise.
+ */
+- (void)acquireKeys:(NSArray *)keys usingBlock:(void (^)(void))block;
+
+/**
+ Adapts the rates of keys to the status of a response: lowered after a 503, raised after a success.
+
+ @param statusCode The HTTP status code of the response.
+ @param keys The keys the request counted against.
+ */
+- (void)recordStatusCode:(NSInteger)statusCode forKeys:(NSArray *)keys;
+
+/**
+ Returns the current rate of a key, in requests per second.
+
+ @param key The key.
+ */
+- (double)rateForKey:(NSString *)key;
+
+/**
+ Returns the number of requests waiting for a token of a key.
+
+ @param key The key.
+ */
+- (NSUInteger)waitingCountForKey:(NSString *)key;
+
+@end
@@ -0,0 +1,286 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WARateLimiter.h"
+
+#import "WAConfiguration.h"
+
+// idle buckets are swept once there are more than this many, so per blob and per partition keys do not pile up
+#define WARateLimiterBucketSweepThreshold 1024
+
+// a burst of 503s is one signal, not many
+#define WARateLimiterDecreaseInterval 1.0
+
+NSString *WARateLimiterKeyForAccount(NSString *accountName)
+{
+	return [NSString stringWithFormat:@"account\n%@", accountName];
+}
+
+NSString *WARateLimiterKeyForPartition(NSString *accountName, NSString *tableName, NSString *partitionKey)
+{
+	return [NSString stringWithFormat:@"partition\n%@\n%@\n%@", accountName, tableName, partitionKey];
+}
+
+NSString *WARateLimiterKeyForQueue(NSString *accountName, NSString *queueName)
+{
+	return [NSString stringWithFormat:@"queue\n%@\n%@", accountName, queueName];
+}
+
+NSString *WARateLimiterKeyForBlob(NSString *accountName, NSString *containerName, NSString *blobName)
+{
+	return [NSString stringWithFormat:@"blob\n%@\n%@\n%@", accountName, containerName, blobName];
+}
+
+static double WAConfiguredRateForKey(NSString *key)
+{
+	WAConfiguration *configuration = [WAConfiguration sharedConfiguration];
+
+	if ([key hasPrefix:@"partition\n"]) {
+		return configuration ? configuration.partitionRequestsPerSecond : WAConfigurationDefaultPartitionRequestsPerSecond;
+	} else if ([key hasPrefix:@"queue\n"]) {
+		return configuration ? configuration.queueRequestsPerSecond : WAConfigurationDefaultQueueRequestsPerSecond;
+	} else if ([key hasPrefix:@"blob\n"]) {
+		return configuration ? configuration.blobRequestsPerSecond : WAConfigurationDefaultBlobRequestsPerSecond;
+	}
+	return configuration ? configuration.accountRequestsPerSecond : WAConfigurationDefaultAccountRequestsPerSecond;
+}
+
+/*
+ The token bucket of one key. Guarded by the limiter.
+ */
+@interface WARateLimiterBucket : NSObject {
+@public
+	double maxRate;
+	double rate;
+	double tokens;
+	CFAbsoluteTime refilledAt;
+	CFAbsoluteTime decreasedAt;
+	NSMutableArray *waiting;
+	BOOL drainScheduled;
+}
+
+- (void)refillAt:(CFAbsoluteTime)now;
+
+@end
+
+@implementation WARateLimiterBucket
+
+- (void)dealloc
+{
+	[waiting release];
+	[super dealloc];
+}
+
+- (void)refillAt:(CFAbsoluteTime)now
+{
+	// the bucket holds a second of requests at the current rate
+	double capacity = MAX(rate, 1);
+	tokens = MIN(capacity, tokens + (now - refilledAt) * rate);
+	refilledAt = now;
+}
+
+@end
+
+@interface WARateLimiter ()
+
+- (WARateLimiterBucket *)bucketForKey:(NSString *)key;
+- (void)acquireKeys:(NSArray *)keys fromIndex:(NSUInteger)index usingBlock:(void (^)(void))block;
+- (void)drainBucket:(WARateLimiterBucket *)bucket;
+- (void)scheduleDrainOfBucket:(WARateLimiterBucket *)bucket;
+
+@end
+
+@implementation WARateLimiter
+
+@synthesize enabled = _enabled;
+
++ (WARateLimiter *)sharedLimiter
+{
+	static WARateLimiter *limiter = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		limiter = [[WARateLimiter alloc] init];
+	});
+	return limiter;
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_buckets = [[NSMutableDictionary alloc] init];
+	_enabled = YES;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_buckets release];
+	[super dealloc];
+}
+
+- (void)acquireKeys:(NSArray *)keys usingBlock:(void (^)(void))block
+{
+	if (!_enabled) {
+		block();
+		return;
+	}
+
+	[self acquireKeys:keys fromIndex:0 usingBlock:block];
+}
+
+- (void)recordStatusCode:(NSInteger)statusCode forKeys:(NSArray *)keys
+{
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+	@synchronized(self) {
+		for (NSString *key in keys) {
+			WARateLimiterBucket *bucket = [self bucketForKey:key];
+			[bucket refillAt:now];
+
+			if (statusCode == 503) {
+				if (now - bucket->decreasedAt >= WARateLimiterDecreaseInterval) {
+					bucket->rate = MAX(bucket->rate / 2, MIN(bucket->maxRate, 1));
+					bucket->decreasedAt = now;
+					LOG(@"Throttled; lowering the rate of %@ to %.1f/s", [key stringByReplacingOccurrencesOfString:@"\n" withString:@"/"], bucket->rate);
+				}
+			} else if (statusCode < 300 && bucket->rate < bucket->maxRate) {
+				bucket->rate = MIN(bucket->maxRate, bucket->rate + bucket->maxRate / 100);
+			}
+		}
+	}
+}
+
+- (double)rateForKey:(NSString *)key
+{
+	@synchronized(self) {
+		return [self bucketForKey:key]->rate;
+	}
+}
+
+- (NSUInteger)waitingCountForKey:(NSString *)key
+{
+	@synchronized(self) {
+		WARateLimiterBucket *bucket = [_buckets objectForKey:key];
+		return bucket ? bucket->waiting.count : 0;
+	}
+}
+
+#pragma mark - Private
+
+- (WARateLimiterBucket *)bucketForKey:(NSString *)key
+{
+	WARateLimiterBucket *bucket = [_buckets objectForKey:key];
+	if (bucket) {
+		return bucket;
+	}
+
+	if (_buckets.count >= WARateLimiterBucketSweepThreshold) {
+		// a bucket that is full and has nobody waiting behaves exactly like a new one
+		CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+		NSMutableArray *idleKeys = [NSMutableArray array];
+		[_buckets enumerateKeysAndObjectsUsingBlock:^(NSString *idleKey, WARateLimiterBucket *idle, BOOL *stop) {
+			[idle refillAt:now];
+			if (!idle->waiting.count && !idle->drainScheduled && idle->rate >= idle->maxRate && idle->tokens >= MAX(idle->rate, 1)) {
+				[idleKeys addObject:idleKey];
+			}
+		}];
+		[_buckets removeObjectsForKeys:idleKeys];
+	}
+
+	bucket = [[[WARateLimiterBucket alloc] init] autorelease];
+	bucket->maxRate = WAConfiguredRateForKey(key);
+	bucket->rate = bucket->maxRate;
+	bucket->tokens = MAX(bucket->rate, 1);
+	bucket->refilledAt = CFAbsoluteTimeGetCurrent();
+	bucket->waiting = [[NSMutableArray alloc] init];
+	[_buckets setObject:bucket forKey:key];
+
+	return bucket;
+}
+
+- (void)acquireKeys:(NSArray *)keys fromIndex:(NSUInteger)index usingBlock:(void (^)(void))block
+{
+	// tokens are taken one key at a time and never held while waiting, so two requests cannot wait on each other
+	for (; index < keys.count; index++) {
+		BOOL acquired = NO;
+
+		@synchronized(self) {
+			WARateLimiterBucket *bucket = [self bucketForKey:[keys objectAtIndex:index]];
+			[bucket refillAt:CFAbsoluteTimeGetCurrent()];
+
+			if (!bucket->waiting.count && bucket->tokens >= 1) {
+				bucket->tokens -= 1;
+				acquired = YES;
+			} else {
+				NSUInteger next = index + 1;
+				void (^continuation)(void) = ^{
+					[self acquireKeys:keys fromIndex:next usingBlock:block];
+				};
+				[bucket->waiting addObject:[[continuation copy] autorelease]];
+				[self scheduleDrainOfBucket:bucket];
+			}
+		}
+
+		if (!acquired) {
+			return;
+		}
+	}
+
+	block();
+}
+
+- (void)scheduleDrainOfBucket:(WARateLimiterBucket *)bucket
+{
+	if (bucket->drainScheduled) {
+		return;
+	}
+
+	bucket->drainScheduled = YES;
+	NSTimeInterval wait = MAX((1 - bucket->tokens) / MAX(bucket->rate, 0.001), 0);
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(wait * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		[self drainBucket:bucket];
+	});
+}
+
+- (void)drainBucket:(WARateLimiterBucket *)bucket
+{
+	NSMutableArray *ready = [NSMutableArray array];
+
+	@synchronized(self) {
+		bucket->drainScheduled = NO;
+		[bucket refillAt:CFAbsoluteTimeGetCurrent()];
+
+		while (bucket->waiting.count && bucket->tokens >= 1) {
+			bucket->tokens -= 1;
+			[ready addObject:[bucket->waiting objectAtIndex:0]];
+			[bucket->waiting removeObjectAtIndex:0];
+		}
+
+		if (bucket->waiting.count) {
+			[self scheduleDrainOfBucket:bucket];
+		}
+	}
+
+	for (void (^continuation)(void) in ready) {
+		continuation();
+	}
+}
+
+@end
@@ -0,0 +1,76 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The default maximum number of requests in flight to one host.
+ */
+#define WARequestExecutorDefaultMaxConcurrentRequestsPerHost 6
+
+/**
+ Called by an operation of a WARequestExecutor once it has finished, to release its slot.
+ */
+typedef void (^WARequestExecutorDoneBlock)(void);
+
+/**
+ An executor that bounds the number of requests in flight to each storage host.
+
+ Operations for a host start in the order they were submitted; once maxConcurrentRequestsPerHost of them are running, the rest wait until one finishes. Keeping the number of concurrent requests small lets the URL loading system reuse its keep-alive connections to the host instead of opening, and negotiating TLS on, a new socket for every request.
+
+ Every request sent by WAStreamingURLRequest goes through an executor. Calls made through the block based methods of WACloudStorageClient can be bounded the same way by wrapping them in performOperationForHost:usingBlock: and calling the done block from their completion handler.
+ */
+@interface WARequestExecutor : NSObject {
+@private
+	NSUInteger _maxConcurrentRequestsPerHost;
+	NSMutableDictionary *_hosts;
+}
+
+/**
+ The maximum number of operations running at the same time for one host. The default is WARequestExecutorDefaultMaxConcurrentRequestsPerHost.
+ */
+@property (assign) NSUInteger maxConcurrentRequestsPerHost;
+
+/**
+ Returns the executor shared by all the extensions in the process.
+ */
++ (WARequestExecutor *)sharedExecutor;
+
+/**
+ Runs an operation once a slot for the host is free.
+
+ The block is called immediately on the calling thread if a slot is free, otherwise on the thread that releases the slot.
+
+ @param host The host the operation talks to.
+ @param block A block object that starts the operation. It must call the done block exactly once, when the operation has finished or failed. The done block is already on the heap, so completion handlers may capture it or the block retain it, and it may be called from any thread.
+ */
+- (void)performOperationForHost:(NSString *)host usingBlock:(void (^)(WARequestExecutorDoneBlock done))block;
+
+/**
+ Returns the number of operations running for a host.
+
+ @param host The host.
+ */
+- (NSUInteger)activeOperationCountForHost:(NSString *)host;
+
+/**
+ Returns the number of operations waiting for a slot for a host.
+
+ @param host The host.
+ */
+- (NSUInteger)pendingOperationCountForHost:(NSString *)host;
+
+@end
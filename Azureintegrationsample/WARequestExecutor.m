@@ -0,0 +1,171 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WARequestExecutor.h"
+
+/*
+ The running count and FIFO of waiting operations for one host.
+ */
+@interface WARequestExecutorHost : NSObject {
+@public
+	NSUInteger active;
+	NSMutableArray *pending;
+}
+
+@end
+
+@implementation WARequestExecutorHost
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	pending = [[NSMutableArray alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[pending release];
+	[super dealloc];
+}
+
+@end
+
+@interface WARequestExecutor ()
+
+- (WARequestExecutorHost *)stateForHost:(NSString *)host;
+- (void)runOperation:(void (^)(WARequestExecutorDoneBlock done))block forHost:(NSString *)host;
+
+@end
+
+@implementation WARequestExecutor
+
+@synthesize maxConcurrentRequestsPerHost = _maxConcurrentRequestsPerHost;
+
++ (WARequestExecutor *)sharedExecutor
+{
+	static dispatch_once_t once;
+	static WARequestExecutor *sharedExecutor;
+	dispatch_once(&once, ^ { sharedExecutor = [self new]; });
+	return sharedExecutor;
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_maxConcurrentRequestsPerHost = WARequestExecutorDefaultMaxConcurrentRequestsPerHost;
+	_hosts = [[NSMutableDictionary alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_hosts release];
+	[super dealloc];
+}
+
+- (void)performOperationForHost:(NSString *)host usingBlock:(void (^)(WARequestExecutorDoneBlock done))block
+{
+	NSString *key = host ? [host lowercaseString] : @"";
+	BOOL start = NO;
+
+	@synchronized(self) {
+		WARequestExecutorHost *state = [self stateForHost:key];
+		if (state->active < MAX(_maxConcurrentRequestsPerHost, 1) && !state->pending.count) {
+			state->active++;
+			start = YES;
+		} else {
+			void (^queued)(WARequestExecutorDoneBlock) = [block copy];
+			[state->pending addObject:queued];
+			[queued release];
+		}
+	}
+
+	if (start) {
+		[self runOperation:block forHost:key];
+	}
+}
+
+- (NSUInteger)activeOperationCountForHost:(NSString *)host
+{
+	@synchronized(self) {
+		return [self stateForHost:[host lowercaseString]]->active;
+	}
+}
+
+- (NSUInteger)pendingOperationCountForHost:(NSString *)host
+{
+	@synchronized(self) {
+		return [self stateForHost:[host lowercaseString]]->pending.count;
+	}
+}
+
+#pragma mark - Private
+
+- (WARequestExecutorHost *)stateForHost:(NSString *)host
+{
+	WARequestExecutorHost *state = [_hosts objectForKey:host];
+	if (!state) {
+		state = [[WARequestExecutorHost alloc] init];
+		[_hosts setObject:state forKey:host];
+		[state release];
+	}
+	return state;
+}
+
+- (void)runOperation:(void (^)(WARequestExecutorDoneBlock done))block forHost:(NSString *)host
+{
+	__block BOOL finished = NO;
+
+	// copied here so operations can keep it until their asynchronous completion without copying it themselves
+	WARequestExecutorDoneBlock done = [^{
+		void (^next)(WARequestExecutorDoneBlock) = nil;
+
+		@synchronized(self) {
+			if (finished) {
+				LOG(@"Operation for %@ released its slot twice", host);
+				return;
+			}
+			finished = YES;
+
+			// hand the slot straight to the next waiting operation, if any
+			WARequestExecutorHost *state = [self stateForHost:host];
+			if (state->pending.count) {
+				next = [[[state->pending objectAtIndex:0] retain] autorelease];
+				[state->pending removeObjectAtIndex:0];
+			} else {
+				state->active--;
+			}
+		}
+
+		if (next) {
+			[self runOperation:next forHost:host];
+		}
+	} copy];
+
+	block(done);
+	[done release];
+}
+
+@end
@@ -0,0 +1,237 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WARequestMetrics;
+
+/**
+ Called with the record of every completed request.
+ */
+typedef void (^WARequestMetricsHandler)(WARequestMetrics *metrics);
+
+/**
+ A part of the time a request took.
+ */
+typedef enum {
+	/** From the start of the request to its completion. */
+	WARequestPhaseTotal = 0,
+	/** Waiting for a rate limiter token and a connection slot, and the earlier attempts of a retried request with the delays between them. */
+	WARequestPhaseWait,
+	/** Computing the shared key signature. */
+	WARequestPhaseSigning,
+	/** From opening the connection to receiving the response headers of the last attempt. This includes name resolution, connecting and the TLS handshake, which NSURLConnection does not report separately. */
+	WARequestPhaseFirstByte,
+	/** From the response headers to the end of the body, including processing. */
+	WARequestPhaseTransfer,
+	/** Handling the body as it arrived, such as parsing entities. */
+	WARequestPhaseProcessing
+} WARequestPhase;
+
+#define WARequestPhaseCount 6
+
+/**
+ The record of one request sent by the extensions: what it addressed, how it ended, how many bytes it moved and where its time went.
+
+ Records are only made while the storage client has a metricsHandler, so requests cost nothing extra otherwise.
+ */
+@interface WARequestMetrics : NSObject {
+@private
+	NSString *_operation;
+	NSString *_resourceName;
+	WARequestMetricsHandler _handler;
+	NSInteger _statusCode;
+	NSError *_error;
+	NSUInteger _attempts;
+	NSInteger _pageIndex;
+	long long _requestBytes;
+	long long _responseBytes;
+	NSTimeInterval _durations[WARequestPhaseCount];
+}
+
+/**
+ The storage operation, for example QueryEntities, PutMessage or PutBlock.
+ */
+@property (readonly) NSString *operation;
+
+/**
+ The table, queue or container addressed.
+ */
+@property (readonly) NSString *resourceName;
+
+/**
+ The HTTP status code of the last attempt, or 0 if no response was received.
+ */
+@property (assign) NSInteger statusCode;
+
+/**
+ The transport error of the last attempt, or nil.
+ */
+@property (retain) NSError *error;
+
+/**
+ The number of times the request was sent. Retries are one less.
+ */
+@property (assign) NSUInteger attempts;
+
+/**
+ The position of the page in a sequence of table query pages, starting at 0, or -1 for requests that are not query pages.
+ */
+@property (assign) NSInteger pageIndex;
+
+/**
+ The size of the request body, in bytes, of the last attempt.
+ */
+@property (assign) long long requestBytes;
+
+/**
+ The size of the response body, in bytes, of the last attempt.
+ */
+@property (assign) long long responseBytes;
+
+/**
+ Creates a record.
+
+ @param operation The storage operation.
+ @param resourceName The table, queue or container addressed.
+ @param handler A block object called with the record when report is sent.
+
+ @returns The newly initialized WARequestMetrics object.
+ */
+- (id)initWithOperation:(NSString *)operation resourceName:(NSString *)resourceName handler:(WARequestMetricsHandler)handler;
+
+/**
+ Returns the time, in seconds, spent in a phase.
+
+ @param phase The phase.
+ */
+- (NSTimeInterval)durationOfPhase:(WARequestPhase)phase;
+
+/**
+ Sets the time, in seconds, spent in a phase.
+
+ @param duration The time.
+ @param phase The phase.
+ */
+- (void)setDuration:(NSTimeInterval)duration ofPhase:(WARequestPhase)phase;
+
+/**
+ Adds time, in seconds, to a phase.
+
+ @param duration The time to add.
+ @param phase The phase.
+ */
+- (void)addDuration:(NSTimeInterval)duration toPhase:(WARequestPhase)phase;
+
+/**
+ Hands the record to its handler. Called once by the request when it completes.
+ */
+- (void)report;
+
+@end
+
+/**
+ Collects request records into latency histograms per operation and phase.
+
+ Histogram buckets grow by 5% from 0.1 milliseconds to 100 seconds, so percentiles are accurate to within 5% and a histogram takes the same memory whatever the number of requests. An aggregator is safe to use from several threads.
+
+ To collect the records of a client:
+
+	WARequestMetricsAggregator *aggregator = [WARequestMetricsAggregator sharedAggregator];
+	client.metricsHandler = ^(WARequestMetrics *metrics) {
+		[aggregator recordMetrics:metrics];
+	};
+ */
+@interface WARequestMetricsAggregator : NSObject {
+@private
+	NSMutableDictionary *_histograms;
+}
+
+/**
+ Returns an aggregator for the application to share.
+ */
++ (WARequestMetricsAggregator *)sharedAggregator;
+
+/**
+ Adds a record to the histograms of its operation.
+
+ @param metrics The record.
+ */
+- (void)recordMetrics:(WARequestMetrics *)metrics;
+
+/**
+ Returns the operations with records, sorted by name.
+ */
+- (NSArray *)operations;
+
+/**
+ Returns the number of records of an operation.
+
+ @param operation The operation.
+ */
+- (NSUInteger)countForOperation:(NSString *)operation;
+
+/**
+ Returns the number of records of an operation whose request failed, with an error or a status code of 400 or more.
+
+ @param operation The operation.
+ */
+- (NSUInteger)failureCountForOperation:(NSString *)operation;
+
+/**
+ Returns a percentile of the time spent in a phase.
+
+ @param percentile The percentile, from 0 to 100; for example 50, 95 or 99.
+ @param phase The phase.
+ @param operation The operation.
+
+ @returns The time in seconds, or 0 if the operation has no records.
+ */
+- (NSTimeInterval)percentile:(double)percentile ofPhase:(WARequestPhase)phase forOperation:(NSString *)operation;
+
+/**
+ Returns a one line per operation summary of request counts and the p50, p95 and p99 of each phase, for logging.
+ */
+- (NSString *)summary;
+
+/**
+ Discards every record.
+ */
+- (void)reset;
+
+@end
+
+/**
+ Request metrics for WACloudStorageClient, covering the requests sent by the extensions: streaming fetches, entity group transactions, blob transfers and queue consumers and batches. Requests sent by the toolkit itself are not covered.
+ */
+@interface WACloudStorageClient (Metrics)
+
+/**
+ Called on the thread that started each request, once the request has completed. The default is nil, which disables metrics.
+ */
+@property (copy) WARequestMetricsHandler metricsHandler;
+
+/**
+ Returns a new record for a request, reporting to the metricsHandler, or nil if there is no metricsHandler.
+
+ @param operation The storage operation.
+ @param resourceName The table, queue or container addressed.
+ */
+- (WARequestMetrics *)metricsForOperation:(NSString *)operation resourceName:(NSString *)resourceName;
+
+@end
@@ -0,0 +1,278 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WARequestMetrics.h"
+
+#import <objc/runtime.h>
+
+#import "WAToolkitPrivate.h"
+
+#define WAHistogramMinimum 0.0001
+#define WAHistogramGrowth 1.05
+
+// enough buckets to reach 100 seconds from the minimum
+#define WAHistogramBucketCount 285
+
+static char WAMetricsHandlerKey;
+
+static NSString *WAPhaseNames[WARequestPhaseCount] = { @"total", @"wait", @"sign", @"ttfb", @"transfer", @"process" };
+
+static NSUInteger WAHistogramBucket(NSTimeInterval duration)
+{
+	if (duration <= WAHistogramMinimum) {
+		return 0;
+	}
+	NSUInteger bucket = (NSUInteger)(log(duration / WAHistogramMinimum) / log(WAHistogramGrowth)) + 1;
+	return MIN(bucket, WAHistogramBucketCount - 1);
+}
+
+static NSTimeInterval WAHistogramBucketValue(NSUInteger bucket)
+{
+	if (bucket == 0) {
+		return WAHistogramMinimum;
+	}
+	// the geometric middle of the bucket
+	return WAHistogramMinimum * pow(WAHistogramGrowth, bucket - 0.5);
+}
+
+@implementation WARequestMetrics
+
+@synthesize operation = _operation;
+@synthesize resourceName = _resourceName;
+@synthesize statusCode = _statusCode;
+@synthesize error = _error;
+@synthesize attempts = _attempts;
+@synthesize pageIndex = _pageIndex;
+@synthesize requestBytes = _requestBytes;
+@synthesize responseBytes = _responseBytes;
+
+- (id)initWithOperation:(NSString *)operation resourceName:(NSString *)resourceName handler:(WARequestMetricsHandler)handler
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_operation = [operation copy];
+	_resourceName = [resourceName copy];
+	_handler = [handler copy];
+	_pageIndex = -1;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_operation release];
+	[_resourceName release];
+	[_handler release];
+	[_error release];
+	[super dealloc];
+}
+
+- (NSTimeInterval)durationOfPhase:(WARequestPhase)phase
+{
+	return _durations[phase];
+}
+
+- (void)setDuration:(NSTimeInterval)duration ofPhase:(WARequestPhase)phase
+{
+	_durations[phase] = duration;
+}
+
+- (void)addDuration:(NSTimeInterval)duration toPhase:(WARequestPhase)phase
+{
+	_durations[phase] += duration;
+}
+
+- (void)report
+{
+	WARequestMetricsHandler handler = [_handler autorelease];
+	_handler = nil;
+	if (handler) {
+		handler(self);
+	}
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"<%@ %@ %@ status=%ld attempts=%lu page=%ld bytes=%lld/%lld total=%.1fms wait=%.1fms sign=%.1fms ttfb=%.1fms transfer=%.1fms process=%.1fms>",
+			NSStringFromClass([self class]), _operation, _resourceName, (long)_statusCode, (unsigned long)_attempts, (long)_pageIndex, _requestBytes, _responseBytes,
+			_durations[WARequestPhaseTotal] * 1000, _durations[WARequestPhaseWait] * 1000, _durations[WARequestPhaseSigning] * 1000,
+			_durations[WARequestPhaseFirstByte] * 1000, _durations[WARequestPhaseTransfer] * 1000, _durations[WARequestPhaseProcessing] * 1000];
+}
+
+@end
+
+/*
+ The histograms of one operation. Guarded by the aggregator.
+ */
+@interface WARequestHistogram : NSObject {
+@public
+	NSUInteger count;
+	NSUInteger failures;
+	uint32_t buckets[WARequestPhaseCount][WAHistogramBucketCount];
+}
+
+@end
+
+@implementation WARequestHistogram
+
+@end
+
+@implementation WARequestMetricsAggregator
+
++ (WARequestMetricsAggregator *)sharedAggregator
+{
+	static WARequestMetricsAggregator *aggregator = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		aggregator = [[WARequestMetricsAggregator alloc] init];
+	});
+	return aggregator;
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_histograms = [[NSMutableDictionary alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_histograms release];
+	[super dealloc];
+}
+
+- (void)recordMetrics:(WARequestMetrics *)metrics
+{
+	NSString *operation = metrics.operation ? metrics.operation : @"Unknown";
+
+	@synchronized(self) {
+		WARequestHistogram *histogram = [_histograms objectForKey:operation];
+		if (!histogram) {
+			histogram = [[[WARequestHistogram alloc] init] autorelease];
+			[_histograms setObject:histogram forKey:operation];
+		}
+
+		histogram->count++;
+		if (metrics.error || metrics.statusCode >= 400) {
+			histogram->failures++;
+		}
+		for (int phase = 0; phase < WARequestPhaseCount; phase++) {
+			histogram->buckets[phase][WAHistogramBucket([metrics durationOfPhase:phase])]++;
+		}
+	}
+}
+
+- (NSArray *)operations
+{
+	@synchronized(self) {
+		return [[_histograms allKeys] sortedArrayUsingSelector:@selector(compare:)];
+	}
+}
+
+- (NSUInteger)countForOperation:(NSString *)operation
+{
+	@synchronized(self) {
+		WARequestHistogram *histogram = [_histograms objectForKey:operation];
+		return histogram ? histogram->count : 0;
+	}
+}
+
+- (NSUInteger)failureCountForOperation:(NSString *)operation
+{
+	@synchronized(self) {
+		WARequestHistogram *histogram = [_histograms objectForKey:operation];
+		return histogram ? histogram->failures : 0;
+	}
+}
+
+- (NSTimeInterval)percentile:(double)percentile ofPhase:(WARequestPhase)phase forOperation:(NSString *)operation
+{
+	@synchronized(self) {
+		WARequestHistogram *histogram = [_histograms objectForKey:operation];
+		if (!histogram || !histogram->count) {
+			return 0;
+		}
+
+		// the smallest bucket at or below which the percentile of the records fall
+		NSUInteger rank = (NSUInteger)ceil(MIN(MAX(percentile, 0), 100) / 100 * histogram->count);
+		NSUInteger seen = 0;
+		for (NSUInteger bucket = 0; bucket < WAHistogramBucketCount; bucket++) {
+			seen += histogram->buckets[phase][bucket];
+			if (seen >= MAX(rank, 1)) {
+				return WAHistogramBucketValue(bucket);
+			}
+		}
+		return WAHistogramBucketValue(WAHistogramBucketCount - 1);
+	}
+}
+
+- (NSString *)summary
+{
+	NSMutableString *summary = [NSMutableString string];
+
+	for (NSString *operation in [self operations]) {
+		[summary appendFormat:@"%@: %lu requests, %lu failed", operation, (unsigned long)[self countForOperation:operation], (unsigned long)[self failureCountForOperation:operation]];
+		for (int phase = 0; phase < WARequestPhaseCount; phase++) {
+			[summary appendFormat:@"; %@ %.1f/%.1f/%.1fms", WAPhaseNames[phase],
+			 [self percentile:50 ofPhase:phase forOperation:operation] * 1000,
+			 [self percentile:95 ofPhase:phase forOperation:operation] * 1000,
+			 [self percentile:99 ofPhase:phase forOperation:operation] * 1000];
+		}
+		[summary appendString:@"\n"];
+	}
+
+	return summary;
+}
+
+- (void)reset
+{
+	@synchronized(self) {
+		[_histograms removeAllObjects];
+	}
+}
+
+@end
+
+@implementation WACloudStorageClient (Metrics)
+
+- (WARequestMetricsHandler)metricsHandler
+{
+	return objc_getAssociatedObject(self, &WAMetricsHandlerKey);
+}
+
+- (void)setMetricsHandler:(WARequestMetricsHandler)metricsHandler
+{
+	objc_setAssociatedObject(self, &WAMetricsHandlerKey, metricsHandler, OBJC_ASSOCIATION_COPY);
+}
+
+- (WARequestMetrics *)metricsForOperation:(NSString *)operation resourceName:(NSString *)resourceName
+{
+	WARequestMetricsHandler handler = self.metricsHandler;
+	if (!handler) {
+		return nil;
+	}
+
+	return [[[WARequestMetrics alloc] initWithOperation:operation resourceName:resourceName handler:handler] autorelease];
+}
+
+@end
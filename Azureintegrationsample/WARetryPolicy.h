@@ -0,0 +1,126 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+/**
+ How safe an operation is to send again after a failure whose outcome is unknown.
+ */
+typedef enum {
+	/** Reading has no effect on the service; any transient failure may be retried. */
+	WARetryOperationRead = 0,
+	/** Replacing, merging and deleting leave the same state when applied twice. */
+	WARetryOperationIdempotentWrite,
+	/** Inserting and appending fail or duplicate when applied twice; only failures where the service certainly did not apply the operation are retried. */
+	WARetryOperationNonIdempotentWrite
+} WARetryOperationKind;
+
+/**
+ Decides whether and when a failed storage request is sent again.
+
+ Transient failures are 408, 500, 503 and 504 responses and connection failures and timeouts. Retries are spaced by exponential backoff with decorrelated jitter, so that clients that failed together do not retry together, and a Retry-After header sent by the service is honored. A retry budget shared by all the requests using the policy stops retries from multiplying the load on a service that is already failing: every retry spends a token, every success earns back a fraction of one, and retries stop while fewer than half the tokens are left.
+
+ A policy is safe to use from several threads.
+ */
+@interface WARetryPolicy : NSObject {
+@private
+	NSUInteger _maxAttempts;
+	NSTimeInterval _baseDelay;
+	NSTimeInterval _maxDelay;
+	double _budgetCapacity;
+	double _budgetRefillRatio;
+	double _budgetTokens;
+}
+
+/**
+ The number of times a request is sent, including the first. The default is 4; 1 disables retries.
+ */
+@property (assign) NSUInteger maxAttempts;
+
+/**
+ The smallest delay, in seconds, before a retry. The default is 0.5.
+ */
+@property (assign) NSTimeInterval baseDelay;
+
+/**
+ The largest delay, in seconds, before a retry. A Retry-After longer than this fails the request instead. The default is 30.
+ */
+@property (assign) NSTimeInterval maxDelay;
+
+/**
+ The number of tokens in the retry budget. The default is 20. Lowering it discards the tokens above the new capacity.
+ */
+@property (assign) double budgetCapacity;
+
+/**
+ The fraction of a token a successful request returns to the budget. The default is 0.1, which allows about one retry for every ten successes under sustained failure.
+ */
+@property (assign) double budgetRefillRatio;
+
+/**
+ The number of tokens currently in the retry budget.
+ */
+@property (readonly) double budgetTokens;
+
+/**
+ Returns the policy shared by storage clients that have not been given one.
+ */
++ (WARetryPolicy *)defaultPolicy;
+
+/**
+ Decides whether a failed attempt is retried.
+
+ @param kind The idempotency of the operation.
+ @param attempt The number of the attempt that failed, starting at 1.
+ @param response The response, or nil if none was received.
+ @param error The transport error, or nil if a response was received.
+ @param delay On input, the delay before the failed attempt, or 0 after the first attempt. On output, the delay before the retry.
+
+ @returns YES if the operation should be sent again after the delay. A YES spends a token of the retry budget.
+ */
+- (BOOL)shouldRetryOperation:(WARetryOperationKind)kind attempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response error:(NSError *)error delay:(NSTimeInterval *)delay;
+
+/**
+ Records a successful request, returning part of a token to the retry budget.
+ */
+- (void)recordSuccess;
+
+/**
+ Calls an asynchronous operation, calling it again as the policy allows until it succeeds or fails for good.
+
+ Use this to retry calls whose requests are not sent through WAStreamingURLRequest, such as the completion handler methods of WACloudStorageClient. Failures are classified by their error alone: errors in the toolkit error domain carry the HTTP status code, and errors in the URL loading domain are transport errors.
+
+ @param kind The idempotency of the operation.
+ @param operation A block object that starts one attempt and calls the completion block it is given, with nil on success, once the attempt is over.
+ @param block A block object called on the main thread with the error of the last attempt, or nil once an attempt succeeds.
+ */
+- (void)performOperation:(WARetryOperationKind)kind usingBlock:(void (^)(void (^completion)(NSError *error)))operation completionHandler:(void (^)(NSError *error))block;
+
+@end
+
+/**
+ The retry policy of a storage client, used by the extensions that send their own requests: streaming fetches, entity group transactions and blob transfers.
+ */
+@interface WACloudStorageClient (RetryPolicy)
+
+/**
+ The retry policy. The default is the shared WARetryPolicy defaultPolicy.
+ */
+@property (retain) WARetryPolicy *retryPolicy;
+
+@end
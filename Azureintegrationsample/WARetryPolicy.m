@@ -0,0 +1,278 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WARetryPolicy.h"
+
+#import <objc/runtime.h>
+
+#import "WAToolkitPrivate.h"
+
+static char WARetryPolicyKey;
+
+/*
+ Returns whether a failure is worth retrying. notApplied is set to whether the service certainly did not apply the request, which is what makes retrying a non idempotent write safe.
+ */
+static BOOL WAIsTransientFailure(NSInteger statusCode, NSError *error, BOOL *notApplied)
+{
+	*notApplied = NO;
+
+	if (error) {
+		if (![error.domain isEqualToString:NSURLErrorDomain]) {
+			return NO;
+		}
+		switch (error.code) {
+			case NSURLErrorCannotFindHost:
+			case NSURLErrorCannotConnectToHost:
+			case NSURLErrorDNSLookupFailed:
+			case NSURLErrorNotConnectedToInternet:
+				// the request never left the device
+				*notApplied = YES;
+				return YES;
+			case NSURLErrorTimedOut:
+			case NSURLErrorNetworkConnectionLost:
+				return YES;
+			default:
+				return NO;
+		}
+	}
+
+	switch (statusCode) {
+		case 503:
+			// ServerBusy and throttling responses are sent before the request is processed
+			*notApplied = YES;
+			return YES;
+		case 408:
+		case 500:
+		case 504:
+			return YES;
+		default:
+			return NO;
+	}
+}
+
+static double WARandomFraction(void)
+{
+	return (double)arc4random() / (double)UINT32_MAX;
+}
+
+/*
+ One call of performOperation:usingBlock:completionHandler:, kept alive until it completes.
+ */
+@interface WARetryPolicyCall : NSObject {
+@public
+	WARetryPolicy *policy;
+	WARetryOperationKind kind;
+	void (^operation)(void (^completion)(NSError *error));
+	void (^completionHandler)(NSError *error);
+	NSUInteger attempt;
+	NSTimeInterval delay;
+}
+
+- (void)start;
+- (void)attemptDidCompleteWithError:(NSError *)error;
+
+@end
+
+@interface WARetryPolicy ()
+
+- (BOOL)shouldRetryOperation:(WARetryOperationKind)kind attempt:(NSUInteger)attempt statusCode:(NSInteger)statusCode error:(NSError *)error retryAfter:(NSTimeInterval)retryAfter delay:(NSTimeInterval *)delay;
+
+@end
+
+@implementation WARetryPolicyCall
+
+- (void)dealloc
+{
+	[policy release];
+	[operation release];
+	[completionHandler release];
+	[super dealloc];
+}
+
+- (void)start
+{
+	attempt++;
+
+	// balanced once the attempt completes
+	[self retain];
+	operation(^(NSError *error) {
+		[self attemptDidCompleteWithError:error];
+		[self release];
+	});
+}
+
+- (void)attemptDidCompleteWithError:(NSError *)error
+{
+	if (!error) {
+		[policy recordSuccess];
+	} else {
+		// toolkit errors carry the HTTP status code; anything else is a transport error
+		BOOL httpError = [error.domain isEqualToString:WAToolkitErrorDomain] && error.code >= 100;
+		if ([policy shouldRetryOperation:kind attempt:attempt statusCode:httpError ? error.code : 0 error:httpError ? nil : error retryAfter:0 delay:&delay]) {
+			LOG(@"Retrying operation in %.2fs (attempt %lu): %@", delay, (unsigned long)attempt, error);
+			dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_main_queue(), ^{
+				[self start];
+			});
+			return;
+		}
+	}
+
+	void (^block)(NSError *) = completionHandler;
+	if (!block) {
+		return;
+	}
+	if ([NSThread isMainThread]) {
+		block(error);
+	} else {
+		dispatch_async(dispatch_get_main_queue(), ^{
+			block(error);
+		});
+	}
+}
+
+@end
+
+@implementation WARetryPolicy
+
+@synthesize maxAttempts = _maxAttempts;
+@synthesize baseDelay = _baseDelay;
+@synthesize maxDelay = _maxDelay;
+@synthesize budgetRefillRatio = _budgetRefillRatio;
+
++ (WARetryPolicy *)defaultPolicy
+{
+	static WARetryPolicy *policy = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		policy = [[WARetryPolicy alloc] init];
+	});
+	return policy;
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_maxAttempts = 4;
+	_baseDelay = 0.5;
+	_maxDelay = 30;
+	_budgetCapacity = 20;
+	_budgetRefillRatio = 0.1;
+	_budgetTokens = _budgetCapacity;
+
+	return self;
+}
+
+- (double)budgetCapacity
+{
+	@synchronized(self) {
+		return _budgetCapacity;
+	}
+}
+
+- (void)setBudgetCapacity:(double)budgetCapacity
+{
+	@synchronized(self) {
+		_budgetCapacity = budgetCapacity;
+		_budgetTokens = MIN(_budgetTokens, budgetCapacity);
+	}
+}
+
+- (double)budgetTokens
+{
+	@synchronized(self) {
+		return _budgetTokens;
+	}
+}
+
+- (BOOL)shouldRetryOperation:(WARetryOperationKind)kind attempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response error:(NSError *)error delay:(NSTimeInterval *)delay
+{
+	// only the delta-seconds form of Retry-After is sent by the storage services
+	NSTimeInterval retryAfter = [WAHeaderValueForKey(response, @"Retry-After") doubleValue];
+	return [self shouldRetryOperation:kind attempt:attempt statusCode:response.statusCode error:error retryAfter:retryAfter delay:delay];
+}
+
+- (void)recordSuccess
+{
+	@synchronized(self) {
+		_budgetTokens = MIN(_budgetCapacity, _budgetTokens + _budgetRefillRatio);
+	}
+}
+
+- (void)performOperation:(WARetryOperationKind)kind usingBlock:(void (^)(void (^completion)(NSError *error)))operation completionHandler:(void (^)(NSError *error))block
+{
+	WARetryPolicyCall *call = [[WARetryPolicyCall alloc] init];
+	call->policy = [self retain];
+	call->kind = kind;
+	call->operation = [operation copy];
+	call->completionHandler = [block copy];
+	[call start];
+	[call release];
+}
+
+#pragma mark - Private
+
+- (BOOL)shouldRetryOperation:(WARetryOperationKind)kind attempt:(NSUInteger)attempt statusCode:(NSInteger)statusCode error:(NSError *)error retryAfter:(NSTimeInterval)retryAfter delay:(NSTimeInterval *)delay
+{
+	if (attempt >= _maxAttempts) {
+		return NO;
+	}
+
+	BOOL notApplied;
+	if (!WAIsTransientFailure(statusCode, error, &notApplied)) {
+		return NO;
+	}
+	if (kind == WARetryOperationNonIdempotentWrite && !notApplied) {
+		return NO;
+	}
+	if (retryAfter > _maxDelay) {
+		return NO;
+	}
+
+	@synchronized(self) {
+		if (_budgetTokens <= _budgetCapacity / 2) {
+			LOG(@"Retry budget exhausted (%.1f of %.1f tokens left)", _budgetTokens, _budgetCapacity);
+			return NO;
+		}
+		_budgetTokens -= 1;
+	}
+
+	// decorrelated jitter: anywhere between the base delay and three times the previous delay
+	NSTimeInterval previous = MAX(*delay, _baseDelay);
+	NSTimeInterval next = _baseDelay + WARandomFraction() * (previous * 3 - _baseDelay);
+	*delay = MAX(MIN(next, _maxDelay), retryAfter);
+
+	return YES;
+}
+
+@end
+
+@implementation WACloudStorageClient (RetryPolicy)
+
+- (WARetryPolicy *)retryPolicy
+{
+	WARetryPolicy *policy = objc_getAssociatedObject(self, &WARetryPolicyKey);
+	return policy ? policy : [WARetryPolicy defaultPolicy];
+}
+
+- (void)setRetryPolicy:(WARetryPolicy *)retryPolicy
+{
+	objc_setAssociatedObject(self, &WARetryPolicyKey, retryPolicy, OBJC_ASSOCIATION_RETAIN);
+}
+
+@end
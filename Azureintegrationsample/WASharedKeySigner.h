@@ -0,0 +1,113 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import <CommonCrypto/CommonHMAC.h>
+
+@class WAAuthenticationCredential;
+@class WARequestMetrics;
+
+/**
+ The storage service a request is addressed to. The service determines the host name and the SharedKey canonicalization rules.
+ */
+typedef enum {
+	WAStorageTypeBlob = 0,
+	WAStorageTypeQueue = 1,
+	WAStorageTypeTable = 2
+} WAStorageType;
+
+/**
+ The x-ms-version sent with every request built by the signer.
+ */
+extern NSString * const WAStorageServiceVersion;
+
+/**
+ A class that builds and signs Windows Azure storage requests using the SharedKey scheme.
+
+ The extensions in this project use the signer when they talk to storage directly instead of going through WACloudStorageClient. Only credentials created with an account name and access key can be used; proxy credentials are rejected.
+
+ A signer decodes the account key once and keeps an HMAC state already keyed with it. Signing a request clones that state and feeds the canonicalized headers and resource into it piece by piece, so no string-to-sign is built.
+ */
+@interface WASharedKeySigner : NSObject {
+@private
+	NSString *_accountName;
+	CCHmacContext _keyedContext;
+	NSString *_serviceURLStrings[3];
+}
+
+/**
+ The storage account name.
+ */
+@property (readonly) NSString *accountName;
+
+/**
+ Returns the signer for the account of the given credential. Signers are cached, so every request for the same account shares one.
+
+ @param credential A credential created with credentialWithAzureServiceAccount:accessKey:.
+
+ @returns A signer, or nil if the credential uses a proxy service.
+ */
++ (WASharedKeySigner *)signerForCredential:(WAAuthenticationCredential *)credential;
+
+/**
+ Initializes a newly created signer with an account name and the base64 encoded access key.
+
+ @param accountName The Windows Azure storage account name.
+ @param accessKey The access key for the given account.
+
+ @returns The newly initialized WASharedKeySigner object.
+ */
+- (id)initWithAccountName:(NSString *)accountName accessKey:(NSString *)accessKey;
+
+/**
+ Returns the service endpoint for the given storage type, for example https://account.table.core.windows.net/.
+
+ @param storageType The storage service.
+
+ @returns The base URL of the service.
+ */
+- (NSURL *)serviceURLForStorageType:(WAStorageType)storageType;
+
+/**
+ Creates an unsigned request with the standard storage headers already set.
+
+ @param storageType The storage service.
+ @param path The URL encoded resource path, starting with a slash.
+ @param query The URL encoded query string without the leading question mark, or nil.
+ @param httpMethod The HTTP method.
+
+ @returns A new request. Add any additional headers and the body, then call signRequest:forStorageType:.
+ */
+- (NSMutableURLRequest *)requestForStorageType:(WAStorageType)storageType path:(NSString *)path query:(NSString *)query httpMethod:(NSString *)httpMethod;
+
+/**
+ Computes the SharedKey signature for the request and sets the Authorization header.
+
+ @param request The request to sign. Its headers must not change afterwards.
+ @param storageType The storage service the request is addressed to.
+ */
+- (void)signRequest:(NSMutableURLRequest *)request forStorageType:(WAStorageType)storageType;
+
+/**
+ Signs a request as signRequest:forStorageType: does, recording the time spent in a request metrics record.
+
+ @param request The request to sign. Its headers must not change afterwards.
+ @param storageType The storage service the request is addressed to.
+ @param metrics The record of the request, or nil.
+ */
+- (void)signRequest:(NSMutableURLRequest *)request forStorageType:(WAStorageType)storageType metrics:(WARequestMetrics *)metrics;
+
+@end
@@ -0,0 +1,360 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WASharedKeySigner.h"
+
+#import "WAAuthenticationCredential.h"
+#import "WARequestMetrics.h"
+#import "WAToolkitPrivate.h"
+
+NSString * const WAStorageServiceVersion = @"2011-08-18";
+
+static NSString *WARFC1123DateString(NSDate *date)
+{
+	static NSDateFormatter *formatter = nil;
+	static NSString *lastString = nil;
+	static long long lastSecond = 0;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		formatter = [[NSDateFormatter alloc] init];
+		[formatter setLocale:[[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease]];
+		[formatter setTimeZone:[NSTimeZone timeZoneWithAbbreviation:@"GMT"]];
+		[formatter setDateFormat:@"EEE, dd MMM yyyy HH:mm:ss 'GMT'"];
+	});
+
+	// the header has a resolution of one second, so consecutive requests share the string
+	long long second = (long long)floor([date timeIntervalSinceReferenceDate]);
+	@synchronized(formatter) {
+		if (!lastString || second != lastSecond) {
+			[lastString release];
+			lastString = [[formatter stringFromDate:date] retain];
+			lastSecond = second;
+		}
+		return [[lastString retain] autorelease];
+	}
+}
+
+/*
+ Feeds part of a string to the HMAC as UTF-8, through a stack buffer.
+ */
+static void WAHmacUpdateRange(CCHmacContext *context, CFStringRef string, CFRange range, BOOL lowercase)
+{
+	UInt8 buffer[256];
+	while (range.length > 0) {
+		CFIndex used = 0;
+		CFIndex converted = CFStringGetBytes(string, range, kCFStringEncodingUTF8, 0, false, buffer, sizeof(buffer), &used);
+		if (!converted) {
+			break;
+		}
+		if (lowercase) {
+			for (CFIndex i = 0; i < used; i++) {
+				if (buffer[i] >= 'A' && buffer[i] <= 'Z') {
+					buffer[i] += 'a' - 'A';
+				}
+			}
+		}
+		CCHmacUpdate(context, buffer, used);
+		range.location += converted;
+		range.length -= converted;
+	}
+}
+
+static void WAHmacUpdateString(CCHmacContext *context, NSString *string)
+{
+	if (!string) {
+		return;
+	}
+
+	const char *bytes = CFStringGetCStringPtr((CFStringRef)string, kCFStringEncodingUTF8);
+	if (bytes) {
+		CCHmacUpdate(context, bytes, strlen(bytes));
+	} else {
+		WAHmacUpdateRange(context, (CFStringRef)string, CFRangeMake(0, [string length]), NO);
+	}
+}
+
+static void WAHmacUpdateHeaderLine(CCHmacContext *context, NSURLRequest *request, NSString *name)
+{
+	WAHmacUpdateString(context, [request valueForHTTPHeaderField:name]);
+	CCHmacUpdate(context, "\n", 1);
+}
+
+@interface WASharedKeySigner ()
+
+- (void)updateContext:(CCHmacContext *)context withCanonicalizedResourceForURL:(NSURL *)URL storageType:(WAStorageType)storageType;
+- (void)updateContext:(CCHmacContext *)context withCanonicalizedHeadersForRequest:(NSURLRequest *)request;
+
+@end
+
+@implementation WASharedKeySigner
+
+@synthesize accountName = _accountName;
+
++ (WASharedKeySigner *)signerForCredential:(WAAuthenticationCredential *)credential
+{
+	if (credential.usesProxy || !credential.accountName || !credential.accessKey) {
+		return nil;
+	}
+
+	static NSMutableDictionary *signers = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		signers = [[NSMutableDictionary alloc] init];
+	});
+
+	NSString *cacheKey = [NSString stringWithFormat:@"%@\n%@", credential.accountName, credential.accessKey];
+	@synchronized(signers) {
+		WASharedKeySigner *signer = [signers objectForKey:cacheKey];
+		if (!signer) {
+			signer = [[self alloc] initWithAccountName:credential.accountName accessKey:credential.accessKey];
+			[signers setObject:signer forKey:cacheKey];
+			[signer release];
+		}
+		return [[signer retain] autorelease];
+	}
+}
+
+- (id)initWithAccountName:(NSString *)accountName accessKey:(NSString *)accessKey
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_accountName = [accountName copy];
+
+	// the endpoints are built once, not for every request
+	for (WAStorageType storageType = WAStorageTypeBlob; storageType <= WAStorageTypeTable; storageType++) {
+		_serviceURLStrings[storageType] = [[[self serviceURLForStorageType:storageType] absoluteString] copy];
+	}
+
+	NSData *key = [accessKey dataWithBase64DecodedString];
+	CCHmacInit(&_keyedContext, kCCHmacAlgSHA256, [key bytes], [key length]);
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_accountName release];
+	for (WAStorageType storageType = WAStorageTypeBlob; storageType <= WAStorageTypeTable; storageType++) {
+		[_serviceURLStrings[storageType] release];
+	}
+	[super dealloc];
+}
+
+- (NSURL *)serviceURLForStorageType:(WAStorageType)storageType
+{
+	NSString *service;
+	switch (storageType) {
+		case WAStorageTypeBlob:
+			service = @"blob";
+			break;
+		case WAStorageTypeQueue:
+			service = @"queue";
+			break;
+		default:
+			service = @"table";
+			break;
+	}
+
+	return [NSURL URLWithString:[NSString stringWithFormat:@"https://%@.%@.core.windows.net/", _accountName, service]];
+}
+
+- (NSMutableURLRequest *)requestForStorageType:(WAStorageType)storageType path:(NSString *)path query:(NSString *)query httpMethod:(NSString *)httpMethod
+{
+	NSString *base = _serviceURLStrings[storageType <= WAStorageTypeTable ? storageType : WAStorageTypeTable];
+	NSString *resource = [path hasPrefix:@"/"] ? [path substringFromIndex:1] : path;
+	NSString *urlString = query.length ? [NSString stringWithFormat:@"%@%@?%@", base, resource, query] : [base stringByAppendingString:resource];
+
+	NSMutableURLRequest *request = [NSMutableURLRequest requestWithURL:[NSURL URLWithString:urlString]];
+	[request setHTTPMethod:httpMethod];
+	[request setValue:WARFC1123DateString([NSDate date]) forHTTPHeaderField:@"x-ms-date"];
+	[request setValue:WAStorageServiceVersion forHTTPHeaderField:@"x-ms-version"];
+
+	if (storageType == WAStorageTypeTable) {
+		[request setValue:@"1.0;NetFx" forHTTPHeaderField:@"DataServiceVersion"];
+		[request setValue:@"2.0;NetFx" forHTTPHeaderField:@"MaxDataServiceVersion"];
+		[request setValue:@"application/atom+xml,application/xml" forHTTPHeaderField:@"Accept"];
+	}
+
+	return request;
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request forStorageType:(WAStorageType)storageType metrics:(WARequestMetrics *)metrics
+{
+	if (!metrics) {
+		[self signRequest:request forStorageType:storageType];
+		return;
+	}
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	[self signRequest:request forStorageType:storageType];
+	[metrics setDuration:CFAbsoluteTimeGetCurrent() - start ofPhase:WARequestPhaseSigning];
+}
+
+- (void)signRequest:(NSMutableURLRequest *)request forStorageType:(WAStorageType)storageType
+{
+	// the keyed state is a plain struct; copying it skips rehashing the key for every request
+	CCHmacContext context = _keyedContext;
+
+	WAHmacUpdateString(&context, [request HTTPMethod]);
+	CCHmacUpdate(&context, "\n", 1);
+
+	if (storageType == WAStorageTypeTable) {
+		WAHmacUpdateHeaderLine(&context, request, @"Content-MD5");
+		WAHmacUpdateHeaderLine(&context, request, @"Content-Type");
+		WAHmacUpdateHeaderLine(&context, request, @"x-ms-date");
+	} else {
+		WAHmacUpdateHeaderLine(&context, request, @"Content-Encoding");
+		WAHmacUpdateHeaderLine(&context, request, @"Content-Language");
+
+		NSString *contentLength = [request valueForHTTPHeaderField:@"Content-Length"];
+		if (contentLength.length) {
+			WAHmacUpdateString(&context, contentLength);
+		} else if ([request HTTPBody]) {
+			char length[24];
+			int count = snprintf(length, sizeof(length), "%lu", (unsigned long)[[request HTTPBody] length]);
+			CCHmacUpdate(&context, length, count);
+		}
+		CCHmacUpdate(&context, "\n", 1);
+
+		WAHmacUpdateHeaderLine(&context, request, @"Content-MD5");
+		WAHmacUpdateHeaderLine(&context, request, @"Content-Type");
+		// Date is always empty because x-ms-date is set
+		CCHmacUpdate(&context, "\n", 1);
+		WAHmacUpdateHeaderLine(&context, request, @"If-Modified-Since");
+		WAHmacUpdateHeaderLine(&context, request, @"If-Match");
+		WAHmacUpdateHeaderLine(&context, request, @"If-None-Match");
+		WAHmacUpdateHeaderLine(&context, request, @"If-Unmodified-Since");
+		WAHmacUpdateHeaderLine(&context, request, @"Range");
+		[self updateContext:&context withCanonicalizedHeadersForRequest:request];
+	}
+
+	[self updateContext:&context withCanonicalizedResourceForURL:[request URL] storageType:storageType];
+
+	unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+	CCHmacFinal(&context, digest);
+
+	NSString *signature = [[NSData dataWithBytes:digest length:sizeof(digest)] stringWithBase64EncodedData];
+	[request setValue:[NSString stringWithFormat:@"SharedKey %@:%@", _accountName, signature] forHTTPHeaderField:@"Authorization"];
+}
+
+#pragma mark - Canonicalization
+
+- (void)updateContext:(CCHmacContext *)context withCanonicalizedResourceForURL:(NSURL *)URL storageType:(WAStorageType)storageType
+{
+	CCHmacUpdate(context, "/", 1);
+	WAHmacUpdateString(context, _accountName);
+
+	// CFURLCopyPath keeps the percent escapes, which is what the service signs
+	CFStringRef path = CFURLCopyPath((CFURLRef)URL);
+	if (path && CFStringGetLength(path)) {
+		WAHmacUpdateString(context, (NSString *)path);
+	} else {
+		CCHmacUpdate(context, "/", 1);
+	}
+	if (path) {
+		CFRelease(path);
+	}
+
+	NSString *query = [URL query];
+	if (!query.length) {
+		return;
+	}
+
+	NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+	for (NSString *pair in [query componentsSeparatedByString:@"&"]) {
+		NSRange separator = [pair rangeOfString:@"="];
+		NSString *name = separator.location == NSNotFound ? pair : [pair substringToIndex:separator.location];
+		NSString *value = separator.location == NSNotFound ? @"" : [pair substringFromIndex:separator.location + 1];
+		name = [[name stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding] lowercaseString];
+		value = [value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+
+		NSMutableArray *values = [parameters objectForKey:name];
+		if (!values) {
+			values = [NSMutableArray arrayWithCapacity:1];
+			[parameters setObject:values forKey:name];
+		}
+		[values addObject:value ? value : @""];
+	}
+
+	if (storageType == WAStorageTypeTable) {
+		// tables only sign the comp parameter
+		NSString *comp = [[parameters objectForKey:@"comp"] lastObject];
+		if (comp) {
+			CCHmacUpdate(context, "?comp=", 6);
+			WAHmacUpdateString(context, comp);
+		}
+		return;
+	}
+
+	for (NSString *name in [[parameters allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		NSArray *values = [[parameters objectForKey:name] sortedArrayUsingSelector:@selector(compare:)];
+		CCHmacUpdate(context, "\n", 1);
+		WAHmacUpdateString(context, name);
+		CCHmacUpdate(context, ":", 1);
+		WAHmacUpdateString(context, [values componentsJoinedByString:@","]);
+	}
+}
+
+- (void)updateContext:(CCHmacContext *)context withCanonicalizedHeadersForRequest:(NSURLRequest *)request
+{
+	// requests carry a handful of x-ms-* headers, so they are gathered and sorted on the stack
+	enum { WAMaxSignedHeaders = 32 };
+	NSString *names[WAMaxSignedHeaders];
+	NSString *values[WAMaxSignedHeaders];
+	NSUInteger count = 0;
+
+	NSDictionary *headers = [request allHTTPHeaderFields];
+	for (NSString *name in headers) {
+		if (name.length <= 5 || [name compare:@"x-ms-" options:NSCaseInsensitiveSearch range:NSMakeRange(0, 5)] != NSOrderedSame) {
+			continue;
+		}
+		if (count == WAMaxSignedHeaders) {
+			LOG(@"Too many x-ms- headers to sign, ignoring %@", name);
+			continue;
+		}
+
+		NSUInteger i = count++;
+		while (i > 0 && [names[i - 1] caseInsensitiveCompare:name] == NSOrderedDescending) {
+			names[i] = names[i - 1];
+			values[i] = values[i - 1];
+			i--;
+		}
+		names[i] = name;
+		values[i] = [headers objectForKey:name];
+	}
+
+	for (NSUInteger i = 0; i < count; i++) {
+		WAHmacUpdateRange(context, (CFStringRef)names[i], CFRangeMake(0, names[i].length), YES);
+		CCHmacUpdate(context, ":", 1);
+
+		// trim the value without copying it
+		CFStringRef value = (CFStringRef)values[i];
+		CFIndex start = 0;
+		CFIndex end = CFStringGetLength(value);
+		while (start < end && CFStringGetCharacterAtIndex(value, start) == ' ') {
+			start++;
+		}
+		while (end > start && CFStringGetCharacterAtIndex(value, end - 1) == ' ') {
+			end--;
+		}
+		WAHmacUpdateRange(context, value, CFRangeMake(start, end - start), NO);
+		CCHmacUpdate(context, "\n", 1);
+	}
+}
+
+@end
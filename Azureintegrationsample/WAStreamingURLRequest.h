@@ -0,0 +1,149 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WABufferChain.h"
+#import "WARateLimiter.h"
+#import "WARequestExecutor.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+
+/**
+ A URL request that hands the response body to its data handler as each chunk arrives instead of accumulating it. Requests that do need the whole body can keep it as a WABufferChain of the received chunks.
+
+ The request runs on the run loop of the thread that starts it, like the requests made by WACloudStorageClient, unless it is given a delegate queue. It is paced by a WARateLimiter and sent through a WARequestExecutor, so it may wait for a token and a free slot before the connection is opened.
+ */
+@interface WAStreamingURLRequest : NSObject {
+@private
+	NSURLRequest *_request;
+	NSURLConnection *_connection;
+	NSHTTPURLResponse *_response;
+	void (^_responseHandler)(NSHTTPURLResponse *response);
+	void (^_dataHandler)(NSData *data);
+	BOOL _collectsResponseBody;
+	WABufferChain *_responseBody;
+	void (^_completionHandler)(NSHTTPURLResponse *response, NSError *error);
+	WARequestExecutor *_executor;
+	WARequestExecutorDoneBlock _done;
+	NSThread *_thread;
+	NSOperationQueue *_delegateQueue;
+	BOOL _active;
+	WARetryPolicy *_retryPolicy;
+	WARetryOperationKind _retryOperationKind;
+	NSUInteger _attempt;
+	NSTimeInterval _retryDelay;
+	BOOL _retrying;
+	BOOL _deliveredData;
+	WARateLimiter *_rateLimiter;
+	NSArray *_rateLimiterKeys;
+	WARequestMetrics *_metrics;
+	CFAbsoluteTime _startedAt;
+	CFAbsoluteTime _connectedAt;
+	CFAbsoluteTime _respondedAt;
+}
+
+/**
+ The request being sent.
+ */
+@property (readonly) NSURLRequest *request;
+
+/**
+ Called once when the response headers arrive, before any body data.
+ */
+@property (copy) void (^responseHandler)(NSHTTPURLResponse *response);
+
+/**
+ Called for every chunk of the response body. The data is only valid for the duration of the call.
+ */
+@property (copy) void (^dataHandler)(NSData *data);
+
+/**
+ Whether the response body is also kept in responseBody. The default is NO.
+ */
+@property (assign) BOOL collectsResponseBody;
+
+/**
+ The body of the response, as the chunks it arrived in, or nil unless collectsResponseBody is set. It is complete once the completion handler is called. Use contiguousData only for readers that need a single buffer.
+ */
+@property (readonly) WABufferChain *responseBody;
+
+/**
+ The queue the connection delivers the response to, and the response, data and completion handlers are called on, or nil to use the run loop of the thread that starts the request. The queue must be serial. The default is nil. Changing it after the request has started has no effect.
+ */
+@property (retain) NSOperationQueue *delegateQueue;
+
+/**
+ The executor the request is sent through. The default is the shared executor. Changing it after the request has started has no effect.
+ */
+@property (retain) WARequestExecutor *executor;
+
+/**
+ The rate limiter pacing the request. The default is the shared limiter; nil sends the request without pacing.
+ */
+@property (retain) WARateLimiter *rateLimiter;
+
+/**
+ The rate limiter keys the request counts against besides its storage account, which is taken from the host name. Set the partition, queue or blob key the request addresses.
+ */
+@property (copy) NSArray *rateLimiterKeys;
+
+/**
+ The policy deciding whether the request is sent again after a transient failure, or nil to send it once. Only failures seen before any body data has been handed to the data handler are retried: a retried attempt is invisible to the response and data handlers.
+ */
+@property (retain) WARetryPolicy *retryPolicy;
+
+/**
+ The idempotency of the request, used by the retry policy. The default follows the HTTP method: GET and HEAD requests are reads, PUT, MERGE and DELETE requests idempotent writes, and other requests non idempotent writes.
+ */
+@property (assign) WARetryOperationKind retryOperationKind;
+
+/**
+ The record the request fills in and reports once it completes, or nil to collect no metrics. Timings are only taken while there is a record. Get one from metricsForOperation:resourceName: of the storage client; a cancelled request does not report it.
+ */
+@property (retain) WARequestMetrics *metrics;
+
+/**
+ Creates a new streaming request.
+
+ @param request The URL request to send.
+
+ @returns The newly initialized WAStreamingURLRequest object.
+ */
++ (WAStreamingURLRequest *)requestWithURLRequest:(NSURLRequest *)request;
+
+/**
+ Initializes a newly created streaming request.
+
+ @param request The URL request to send.
+
+ @returns The newly initialized WAStreamingURLRequest object.
+ */
+- (id)initWithURLRequest:(NSURLRequest *)request;
+
+/**
+ Starts the request once its executor has a free slot for the host. The request keeps itself alive until the completion handler has been called.
+
+ @param block A block object called once the body has been delivered or the request failed. The error is nil on a transport level success, whatever the HTTP status code.
+ */
+- (void)startWithCompletionHandler:(void (^)(NSHTTPURLResponse *response, NSError *error))block;
+
+/**
+ Cancels the request, whether it is waiting for a slot or already running. The completion handler is not called.
+ */
+- (void)cancel;
+
+@end
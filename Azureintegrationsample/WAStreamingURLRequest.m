@@ -0,0 +1,369 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAStreamingURLRequest.h"
+
+#import "WAToolkitPrivate.h"
+
+/*
+ The network activity indicator belongs to the main thread; requests running
+ on a delegate queue update it from there.
+ */
+static void WASetNetworkActivity(BOOL active)
+{
+	void (^update)(void) = ^{
+		if (active) {
+			[[UIApplication sharedApplication] wa_pushNetworkActivity];
+		} else {
+			[[UIApplication sharedApplication] wa_popNetworkActivity];
+		}
+	};
+
+	if ([NSThread isMainThread]) {
+		update();
+	} else {
+		dispatch_async(dispatch_get_main_queue(), update);
+	}
+}
+
+@interface WAStreamingURLRequest ()
+
+- (void)enqueue;
+- (void)startConnectionWithDoneBlock:(WARequestExecutorDoneBlock)done;
+- (void)startConnection;
+- (void)releaseSlot;
+- (BOOL)shouldRetryWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error;
+- (void)retry;
+- (void)finishWithError:(NSError *)error;
+
+@end
+
+@implementation WAStreamingURLRequest
+
+@synthesize request = _request;
+@synthesize responseHandler = _responseHandler;
+@synthesize dataHandler = _dataHandler;
+@synthesize collectsResponseBody = _collectsResponseBody;
+@synthesize responseBody = _responseBody;
+@synthesize executor = _executor;
+@synthesize delegateQueue = _delegateQueue;
+@synthesize retryPolicy = _retryPolicy;
+@synthesize retryOperationKind = _retryOperationKind;
+@synthesize rateLimiter = _rateLimiter;
+@synthesize rateLimiterKeys = _rateLimiterKeys;
+@synthesize metrics = _metrics;
+
++ (WAStreamingURLRequest *)requestWithURLRequest:(NSURLRequest *)request
+{
+	return [[[self alloc] initWithURLRequest:request] autorelease];
+}
+
+- (id)initWithURLRequest:(NSURLRequest *)request
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_request = [request copy];
+	_executor = [[WARequestExecutor sharedExecutor] retain];
+	_rateLimiter = [[WARateLimiter sharedLimiter] retain];
+
+	NSString *method = [[request HTTPMethod] uppercaseString];
+	if (!method || [method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"]) {
+		_retryOperationKind = WARetryOperationRead;
+	} else if ([method isEqualToString:@"PUT"] || [method isEqualToString:@"MERGE"] || [method isEqualToString:@"DELETE"]) {
+		_retryOperationKind = WARetryOperationIdempotentWrite;
+	} else {
+		_retryOperationKind = WARetryOperationNonIdempotentWrite;
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_request release];
+	[_connection release];
+	[_response release];
+	[_responseHandler release];
+	[_dataHandler release];
+	[_responseBody release];
+	[_completionHandler release];
+	[_executor release];
+	[_done release];
+	[_thread release];
+	[_delegateQueue release];
+	[_retryPolicy release];
+	[_rateLimiter release];
+	[_rateLimiterKeys release];
+	[_metrics release];
+	[super dealloc];
+}
+
+- (void)startWithCompletionHandler:(void (^)(NSHTTPURLResponse *response, NSError *error))block
+{
+	// balanced in finishWithError: or cancel
+	[self retain];
+
+	_active = YES;
+	_attempt = 1;
+	_completionHandler = [block copy];
+	_thread = [[NSThread currentThread] retain];
+	if (_collectsResponseBody) {
+		_responseBody = [[WABufferChain alloc] init];
+	}
+	if (_metrics) {
+		_startedAt = CFAbsoluteTimeGetCurrent();
+	}
+
+	// the account is the first label of the host name
+	if (_rateLimiter) {
+		NSString *accountName = [[[[_request URL] host] componentsSeparatedByString:@"."] objectAtIndex:0];
+		NSArray *keys = [NSArray arrayWithObject:WARateLimiterKeyForAccount(accountName)];
+		if (_rateLimiterKeys) {
+			keys = [keys arrayByAddingObjectsFromArray:_rateLimiterKeys];
+		}
+		[_rateLimiterKeys release];
+		_rateLimiterKeys = [keys copy];
+	}
+
+	[self enqueue];
+}
+
+- (void)cancel
+{
+	if (!_active) {
+		return;
+	}
+
+	_active = NO;
+	[_completionHandler release];
+	_completionHandler = nil;
+
+	// a request still waiting for its slot gives it back as soon as it gets it
+	if (_connection) {
+		[_connection cancel];
+		[_connection release];
+		_connection = nil;
+		WASetNetworkActivity(NO);
+		[self releaseSlot];
+	}
+
+	[self autorelease];
+}
+
+#pragma mark - Private
+
+- (void)enqueue
+{
+	void (^perform)(void) = ^{
+		[_executor performOperationForHost:[[_request URL] host] usingBlock:^(WARequestExecutorDoneBlock done) {
+			[self startConnectionWithDoneBlock:done];
+		}];
+	};
+
+	// a token is taken before the slot, so requests waiting on the rate do not hold connections
+	if (_rateLimiter) {
+		[_rateLimiter acquireKeys:_rateLimiterKeys usingBlock:perform];
+	} else {
+		perform();
+	}
+}
+
+- (void)startConnectionWithDoneBlock:(WARequestExecutorDoneBlock)done
+{
+	_done = [done copy];
+
+	// a connection with a delegate queue needs no run loop, so it can be opened on any thread
+	if (_delegateQueue || [NSThread currentThread] == _thread) {
+		[self startConnection];
+	} else {
+		// the slot was released on another thread; open the connection where the request was started
+		[self performSelector:@selector(startConnection) onThread:_thread withObject:nil waitUntilDone:NO modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	}
+}
+
+- (void)startConnection
+{
+	if (!_active) {
+		[self releaseSlot];
+		return;
+	}
+
+	if (_metrics) {
+		_connectedAt = CFAbsoluteTimeGetCurrent();
+		_respondedAt = 0;
+		_metrics.attempts = _attempt;
+		_metrics.requestBytes = [[_request HTTPBody] length];
+		_metrics.responseBytes = 0;
+	}
+
+	_connection = [[NSURLConnection alloc] initWithRequest:_request delegate:self startImmediately:NO];
+	if (_delegateQueue) {
+		[_connection setDelegateQueue:_delegateQueue];
+	} else {
+		[_connection scheduleInRunLoop:[NSRunLoop currentRunLoop] forMode:NSRunLoopCommonModes];
+	}
+	WASetNetworkActivity(YES);
+	[_connection start];
+}
+
+- (void)releaseSlot
+{
+	WARequestExecutorDoneBlock done = [_done autorelease];
+	_done = nil;
+	if (done) {
+		done();
+	}
+}
+
+- (BOOL)shouldRetryWithResponse:(NSHTTPURLResponse *)response error:(NSError *)error
+{
+	if (!_retryPolicy || _deliveredData) {
+		return NO;
+	}
+
+	return [_retryPolicy shouldRetryOperation:_retryOperationKind attempt:_attempt response:response error:error delay:&_retryDelay];
+}
+
+- (void)retry
+{
+	LOG(@"Retrying %@ in %.2fs (attempt %lu)", [_request URL], _retryDelay, (unsigned long)_attempt);
+
+	// the slot is given up while waiting so other requests to the host are not held back
+	[_connection cancel];
+	[_connection release];
+	_connection = nil;
+	[_response release];
+	_response = nil;
+	_retrying = NO;
+	_attempt++;
+	WASetNetworkActivity(NO);
+	[self releaseSlot];
+
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(_retryDelay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		if (_active) {
+			[self enqueue];
+		}
+	});
+}
+
+- (void)finishWithError:(NSError *)error
+{
+	if (!_connection) {
+		return;
+	}
+
+	_active = NO;
+	[_connection release];
+	_connection = nil;
+	WASetNetworkActivity(NO);
+	[self releaseSlot];
+
+	void (^block)(NSHTTPURLResponse *, NSError *) = [_completionHandler autorelease];
+	_completionHandler = nil;
+	if (block) {
+		block(_response, error);
+	}
+
+	// after the completion handler, so the processing of a body finished there is counted
+	if (_metrics) {
+		CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+		NSTimeInterval firstByte = _respondedAt ? _respondedAt - _connectedAt : now - _connectedAt;
+		NSTimeInterval transfer = _respondedAt ? now - _respondedAt : 0;
+		[_metrics setDuration:now - _startedAt ofPhase:WARequestPhaseTotal];
+		[_metrics setDuration:firstByte ofPhase:WARequestPhaseFirstByte];
+		[_metrics setDuration:transfer ofPhase:WARequestPhaseTransfer];
+		[_metrics setDuration:MAX(now - _startedAt - firstByte - transfer, 0) ofPhase:WARequestPhaseWait];
+		_metrics.statusCode = _response.statusCode;
+		_metrics.error = error;
+		[_metrics report];
+	}
+
+	[self autorelease];
+}
+
+#pragma mark - NSURLConnection delegate
+
+- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+{
+	[_response release];
+	_response = [(NSHTTPURLResponse *)response retain];
+	if (_metrics) {
+		_respondedAt = CFAbsoluteTimeGetCurrent();
+	}
+	[_rateLimiter recordStatusCode:_response.statusCode forKeys:_rateLimiterKeys];
+
+	// the body of a response that will be retried is an error document nobody needs to see
+	if (_response.statusCode >= 300 && [self shouldRetryWithResponse:_response error:nil]) {
+		_retrying = YES;
+		return;
+	}
+	if (_response.statusCode < 300) {
+		[_retryPolicy recordSuccess];
+	}
+
+	if (_responseHandler) {
+		_responseHandler(_response);
+	}
+}
+
+- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+{
+	if (_retrying) {
+		return;
+	}
+
+	_deliveredData = YES;
+	if (_metrics) {
+		_metrics.responseBytes += data.length;
+	}
+	[_responseBody appendData:data];
+	if (_dataHandler) {
+		CFAbsoluteTime handlerStart = _metrics ? CFAbsoluteTimeGetCurrent() : 0;
+		@autoreleasepool {
+			_dataHandler(data);
+		}
+		if (_metrics) {
+			[_metrics addDuration:CFAbsoluteTimeGetCurrent() - handlerStart toPhase:WARequestPhaseProcessing];
+		}
+	}
+}
+
+- (void)connectionDidFinishLoading:(NSURLConnection *)connection
+{
+	if (_retrying) {
+		[self retry];
+		return;
+	}
+
+	[self finishWithError:nil];
+}
+
+- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+{
+	LOGLINE(@"Request failed: %@ %@", [_request URL], error);
+
+	// once the headers of a successful response have been handed over, the attempt cannot be replayed
+	if (_retrying || (!_response && [self shouldRetryWithResponse:nil error:error])) {
+		[self retry];
+		return;
+	}
+
+	[self finishWithError:error];
+}
+
+@end
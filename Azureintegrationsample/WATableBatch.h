@@ -0,0 +1,149 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WATableEntity;
+
+/**
+ The maximum number of operations the table service accepts in one entity group transaction.
+ */
+#define WATableBatchMaxOperations 100
+
+/**
+ The maximum payload size, in bytes, the table service accepts for one entity group transaction.
+ */
+#define WATableBatchMaxPayloadSize (4 * 1024 * 1024)
+
+/**
+ The kind of change made by a WATableOperation.
+ */
+typedef enum {
+	WATableOperationInsert = 0,
+	WATableOperationUpdate = 1,
+	WATableOperationMerge = 2,
+	WATableOperationDelete = 3
+} WATableOperationType;
+
+/**
+ A single insert, update, merge or delete of a table entity, for use with executeTableOperations:withCompletionHandler:.
+ */
+@interface WATableOperation : NSObject {
+@private
+	WATableOperationType _type;
+	WATableEntity *_entity;
+}
+
+/**
+ The kind of change.
+ */
+@property (readonly) WATableOperationType type;
+
+/**
+ The entity to change.
+ */
+@property (readonly) WATableEntity *entity;
+
+/**
+ Creates an operation that inserts a new entity.
+ */
++ (WATableOperation *)insertOperationWithEntity:(WATableEntity *)entity;
+
+/**
+ Creates an operation that replaces an existing entity.
+ */
++ (WATableOperation *)updateOperationWithEntity:(WATableEntity *)entity;
+
+/**
+ Creates an operation that merges properties into an existing entity.
+ */
++ (WATableOperation *)mergeOperationWithEntity:(WATableEntity *)entity;
+
+/**
+ Creates an operation that deletes an existing entity.
+ */
++ (WATableOperation *)deleteOperationWithEntity:(WATableEntity *)entity;
+
+/**
+ Initializes a newly created operation.
+
+ @param type The kind of change.
+ @param entity The entity to change. The entity must have a partition key and a row key.
+
+ @returns The newly initialized WATableOperation object.
+ */
+- (id)initWithType:(WATableOperationType)type entity:(WATableEntity *)entity;
+
+@end
+
+/**
+ The outcome of one WATableOperation.
+ */
+@interface WATableOperationResult : NSObject {
+@private
+	WATableOperation *_operation;
+	NSInteger _statusCode;
+	NSError *_error;
+}
+
+/**
+ The operation.
+ */
+@property (readonly) WATableOperation *operation;
+
+/**
+ The HTTP status code returned for the operation, or 0 if the batch could not be sent.
+ */
+@property (readonly) NSInteger statusCode;
+
+/**
+ The error, or nil if the operation succeeded. When one operation of a transaction fails, none of the operations in that transaction are applied, and each of them carries an error.
+ */
+@property (readonly) NSError *error;
+
+- (id)initWithOperation:(WATableOperation *)operation statusCode:(NSInteger)statusCode error:(NSError *)error;
+
+@end
+
+/**
+ Entity group transactions for WACloudStorageClient.
+
+ The toolkit writes every property of an entity as untyped, unescaped text, which suits the strings it reads back but not the NSNumber, NSDate and NSData values and the GUIDs decoded by WAEntityStreamParser and WAJSONEntityParser. When an entity holds any value other than an NSString, or a string with a recorded Edm type, insertEntity:, updateEntity: and mergeEntity:, and their block based variants, therefore send it as a single operation through executeTableOperations:withCompletionHandler:, which writes each value with its Edm type. The block, or the delegate, is called as it would be by the toolkit, where the response was processed rather than on the client's callbackQueue. Entities holding only untyped strings, and clients without an account name and access key, are written by the toolkit as before.
+ */
+@interface WACloudStorageClient (Batch)
+
+/**
+ Executes table operations using entity group transactions.
+
+ The operations are grouped by table and partition key, keeping their relative order, and each group is sent as one or more $batch requests of at most WATableBatchMaxOperations operations and WATableBatchMaxPayloadSize bytes. A new request is also started where an entity repeats, since a transaction may change each entity only once. Each request is an atomic transaction; separate requests are not atomic with respect to each other. The requests of a group are sent one after another, so its operations are applied in order, while different groups are sent in parallel. Entities are sent in the client's tableWireFormat. The responses are read on the client's workQueue and the block is called on its callbackQueue when those are set.
+
+ @param operations The WATableOperation objects to execute.
+ @param block A block object called once every request has completed. The results array holds one WATableOperationResult per operation, in the order of the operations array. The error is nil if every operation succeeded, otherwise it is the first error that occurred.
+ */
+- (void)executeTableOperations:(NSArray *)operations withCompletionHandler:(void (^)(NSArray *results, NSError *error))block;
+
+/**
+ Executes table operations using entity group transactions, calling the block on a given queue instead of the client's callbackQueue.
+
+ @param operations The WATableOperation objects to execute.
+ @param callbackQueue The queue to call the block on, or NULL to call it where the responses were processed.
+ @param block A block object called once every request has completed, as with executeTableOperations:withCompletionHandler:.
+ */
+- (void)executeTableOperations:(NSArray *)operations callbackQueue:(dispatch_queue_t)callbackQueue withCompletionHandler:(void (^)(NSArray *results, NSError *error))block;
+
+@end
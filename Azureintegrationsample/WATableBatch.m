@@ -0,0 +1,612 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableBatch.h"
+
+#import <objc/runtime.h>
+
+#import "WACloudStorageClient+Dispatch.h"
+#import "WACloudStorageClientDelegate.h"
+#import "WAEntitySerializer.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WARetryPolicy.h"
+#import "WASharedKeySigner.h"
+#import "WAStreamingURLRequest.h"
+#import "WATableEntity.h"
+#import "WATableEntityCache.h"
+#import "WATableWireFormat.h"
+#import "WAToolkitPrivate.h"
+
+// room for the batch and changeset envelopes around the operation parts
+#define WATableBatchEnvelopeAllowance 1024
+
+static NSString *WANewBoundary(NSString *prefix)
+{
+	CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+	NSString *identifier = [(NSString *)CFUUIDCreateString(kCFAllocatorDefault, uuid) autorelease];
+	CFRelease(uuid);
+	return [NSString stringWithFormat:@"%@_%@", prefix, [identifier lowercaseString]];
+}
+
+static NSString *WABoundaryFromContentType(NSString *contentType)
+{
+	NSRange range = [contentType rangeOfString:@"boundary="];
+	if (range.location == NSNotFound) {
+		return nil;
+	}
+	NSString *boundary = [contentType substringFromIndex:NSMaxRange(range)];
+	NSRange end = [boundary rangeOfString:@";"];
+	if (end.location != NSNotFound) {
+		boundary = [boundary substringToIndex:end.location];
+	}
+	return [boundary stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"\" "]];
+}
+
+static NSString *WAHeaderInPart(NSString *part, NSString *name)
+{
+	NSRange range = [part rangeOfString:[name stringByAppendingString:@":"] options:NSCaseInsensitiveSearch];
+	if (range.location == NSNotFound) {
+		return nil;
+	}
+	NSRange lineEnd = [part rangeOfString:@"\r\n" options:0 range:NSMakeRange(NSMaxRange(range), part.length - NSMaxRange(range))];
+	NSUInteger end = lineEnd.location == NSNotFound ? part.length : lineEnd.location;
+	return [[part substringWithRange:NSMakeRange(NSMaxRange(range), end - NSMaxRange(range))] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+}
+
+static NSString *WAErrorMessageInPart(NSString *part)
+{
+	NSRange start = [part rangeOfString:@"<message"];
+	if (start.location == NSNotFound) {
+		// {"odata.error":{"code":"...","message":{"lang":"en-US","value":"..."}}}
+		NSRange open = [part rangeOfString:@"{\"odata.error\""];
+		NSRange close = [part rangeOfString:@"}" options:NSBackwardsSearch];
+		if (open.location == NSNotFound || close.location == NSNotFound || close.location < open.location) {
+			return nil;
+		}
+		NSData *JSON = [[part substringWithRange:NSMakeRange(open.location, NSMaxRange(close) - open.location)] dataUsingEncoding:NSUTF8StringEncoding];
+		id message = [[[NSJSONSerialization JSONObjectWithData:JSON options:0 error:NULL] objectForKey:@"odata.error"] objectForKey:@"message"];
+		return [message isKindOfClass:[NSDictionary class]] ? [message objectForKey:@"value"] : message;
+	}
+	NSRange open = [part rangeOfString:@">" options:0 range:NSMakeRange(start.location, part.length - start.location)];
+	NSRange close = [part rangeOfString:@"</message>" options:0 range:NSMakeRange(NSMaxRange(open), part.length - NSMaxRange(open))];
+	if (open.location == NSNotFound || close.location == NSNotFound) {
+		return nil;
+	}
+	return [part substringWithRange:NSMakeRange(NSMaxRange(open), close.location - NSMaxRange(open))];
+}
+
+/*
+ Returns the operation responses of a $batch response as dictionaries with
+ "status", "contentID" and "message" entries, in response order.
+ */
+static NSArray *WAParseBatchResponse(NSData *body, NSString *contentType)
+{
+	NSString *boundary = WABoundaryFromContentType(contentType);
+	NSString *text = [[[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding] autorelease];
+	if (!boundary || !text) {
+		return nil;
+	}
+
+	NSMutableArray *responses = [NSMutableArray array];
+	NSMutableArray *parts = [NSMutableArray array];
+	for (NSString *part in [text componentsSeparatedByString:[@"--" stringByAppendingString:boundary]]) {
+		NSString *changesetBoundary = WABoundaryFromContentType(WAHeaderInPart(part, @"Content-Type"));
+		if (changesetBoundary && [WAHeaderInPart(part, @"Content-Type") hasPrefix:@"multipart/mixed"]) {
+			[parts addObjectsFromArray:[part componentsSeparatedByString:[@"--" stringByAppendingString:changesetBoundary]]];
+		} else {
+			[parts addObject:part];
+		}
+	}
+
+	for (NSString *part in parts) {
+		NSRange statusLine = [part rangeOfString:@"HTTP/1.1 "];
+		if (statusLine.location == NSNotFound) {
+			continue;
+		}
+
+		NSInteger status = [[part substringFromIndex:NSMaxRange(statusLine)] integerValue];
+		NSMutableDictionary *response = [NSMutableDictionary dictionaryWithObject:[NSNumber numberWithInteger:status] forKey:@"status"];
+		NSString *contentID = WAHeaderInPart([part substringFromIndex:statusLine.location], @"Content-ID");
+		if (contentID) {
+			[response setObject:contentID forKey:@"contentID"];
+		}
+		NSString *message = WAErrorMessageInPart(part);
+		if (message) {
+			[response setObject:message forKey:@"message"];
+		}
+		[responses addObject:response];
+	}
+
+	return responses;
+}
+
+@implementation WATableOperation
+
+@synthesize type = _type;
+@synthesize entity = _entity;
+
++ (WATableOperation *)insertOperationWithEntity:(WATableEntity *)entity
+{
+	return [[[self alloc] initWithType:WATableOperationInsert entity:entity] autorelease];
+}
+
++ (WATableOperation *)updateOperationWithEntity:(WATableEntity *)entity
+{
+	return [[[self alloc] initWithType:WATableOperationUpdate entity:entity] autorelease];
+}
+
++ (WATableOperation *)mergeOperationWithEntity:(WATableEntity *)entity
+{
+	return [[[self alloc] initWithType:WATableOperationMerge entity:entity] autorelease];
+}
+
++ (WATableOperation *)deleteOperationWithEntity:(WATableEntity *)entity
+{
+	return [[[self alloc] initWithType:WATableOperationDelete entity:entity] autorelease];
+}
+
+- (id)initWithType:(WATableOperationType)type entity:(WATableEntity *)entity
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_type = type;
+	_entity = [entity retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_entity release];
+	[super dealloc];
+}
+
+@end
+
+@implementation WATableOperationResult
+
+@synthesize operation = _operation;
+@synthesize statusCode = _statusCode;
+@synthesize error = _error;
+
+- (id)initWithOperation:(WATableOperation *)operation statusCode:(NSInteger)statusCode error:(NSError *)error
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_operation = [operation retain];
+	_statusCode = statusCode;
+	_error = [error retain];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_operation release];
+	[_error release];
+	[super dealloc];
+}
+
+@end
+
+static NSData *WABatchPartForOperation(WATableOperation *operation, NSUInteger contentID, NSURL *serviceURL, WATableWireFormat wireFormat)
+{
+	WATableEntity *entity = operation.entity;
+	NSString *base = [[serviceURL absoluteString] stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"/"]];
+	NSString *method;
+	NSString *URL;
+
+	switch (operation.type) {
+		case WATableOperationInsert:
+			method = @"POST";
+			URL = [NSString stringWithFormat:@"%@/%@", base, WAURLEncodedString(entity.tableName)];
+			break;
+		case WATableOperationUpdate:
+			method = @"PUT";
+			URL = [base stringByAppendingString:[WAEntitySerializer resourcePathForEntity:entity]];
+			break;
+		case WATableOperationMerge:
+			method = @"MERGE";
+			URL = [base stringByAppendingString:[WAEntitySerializer resourcePathForEntity:entity]];
+			break;
+		default:
+			method = @"DELETE";
+			URL = [base stringByAppendingString:[WAEntitySerializer resourcePathForEntity:entity]];
+			break;
+	}
+
+	NSMutableString *headers = [NSMutableString stringWithFormat:@"Content-Type: application/http\r\nContent-Transfer-Encoding: binary\r\n\r\n%@ %@ HTTP/1.1\r\nContent-ID: %lu\r\n",
+								method, URL, (unsigned long)contentID];
+	NSData *entry = nil;
+	if (operation.type != WATableOperationDelete && WATableWireFormatIsJSON(wireFormat)) {
+		entry = [WAEntitySerializer JSONEntityForEntity:entity];
+		[headers appendFormat:@"Content-Type: application/json\r\nContent-Length: %lu\r\n", (unsigned long)entry.length];
+	} else if (operation.type != WATableOperationDelete) {
+		entry = [WAEntitySerializer atomEntryForEntity:entity];
+		[headers appendFormat:@"Content-Type: application/atom+xml;type=entry\r\nContent-Length: %lu\r\n", (unsigned long)entry.length];
+	}
+	if (operation.type == WATableOperationInsert && WATableWireFormatIsJSON(wireFormat)) {
+		// the results only need the status, so spare the service echoing every inserted entity
+		[headers appendString:@"Prefer: return-no-content\r\n"];
+	}
+	if (operation.type != WATableOperationInsert) {
+		[headers appendString:@"If-Match: *\r\n"];
+	}
+	[headers appendString:@"\r\n"];
+
+	NSMutableData *part = [NSMutableData dataWithData:[headers dataUsingEncoding:NSUTF8StringEncoding]];
+	if (entry) {
+		[part appendData:entry];
+	}
+	[part appendData:[@"\r\n" dataUsingEncoding:NSUTF8StringEncoding]];
+
+	return part;
+}
+
+/*
+ The service prefixes the message of a failed transaction with the index of
+ the failed operation, e.g. "1:The specified entity already exists.".
+ */
+static NSInteger WAFailedOperationIndex(NSString *message)
+{
+	NSScanner *scanner = [NSScanner scannerWithString:message ? message : @""];
+	NSInteger index;
+	if ([scanner scanInteger:&index] && [scanner scanString:@":" intoString:NULL]) {
+		return index;
+	}
+	return -1;
+}
+
+@implementation WACloudStorageClient (Batch)
+
+- (void)executeTableOperations:(NSArray *)operations withCompletionHandler:(void (^)(NSArray *results, NSError *error))block
+{
+	[self executeTableOperations:operations callbackQueue:self.callbackQueue withCompletionHandler:block];
+}
+
+- (void)executeTableOperations:(NSArray *)operations callbackQueue:(dispatch_queue_t)callbackQueue withCompletionHandler:(void (^)(NSArray *results, NSError *error))block
+{
+	WASharedKeySigner *signer = [WASharedKeySigner signerForCredential:WAStorageClientCredential(self)];
+	if (!signer) {
+		NSError *error = WAToolkitError(-1, nil, @"Batch operations require a credential with an account name and access key.");
+		WAPerformCallback(callbackQueue, ^{
+			block(nil, error);
+		});
+		return;
+	}
+
+	NSURL *serviceURL = [signer serviceURLForStorageType:WAStorageTypeTable];
+	WATableWireFormat wireFormat = self.tableWireFormat;
+	WATableEntityCache *cache = self.entityCache;
+	NSMutableArray *results = [NSMutableArray arrayWithCapacity:operations.count];
+	__block NSError *firstError = nil;
+
+	// group by table and partition, keeping the order operations were given in
+	NSMutableDictionary *groups = [NSMutableDictionary dictionary];
+	NSMutableArray *groupKeys = [NSMutableArray array];
+	[operations enumerateObjectsUsingBlock:^(WATableOperation *operation, NSUInteger index, BOOL *stop) {
+		[results addObject:[NSNull null]];
+
+		WATableEntity *entity = operation.entity;
+		if (!entity.tableName || !entity.partitionKey || !entity.rowKey) {
+			NSError *error = WAToolkitError(400, @"InvalidInput", @"Batch operations require entities with a table name, partition key and row key.");
+			WATableOperationResult *result = [[WATableOperationResult alloc] initWithOperation:operation statusCode:0 error:error];
+			[results replaceObjectAtIndex:index withObject:result];
+			[result release];
+			if (!firstError) {
+				firstError = [error retain];
+			}
+			return;
+		}
+
+		[cache invalidateEntity:entity];
+
+		NSString *key = [NSString stringWithFormat:@"%@\n%@", entity.tableName, entity.partitionKey];
+		NSMutableArray *group = [groups objectForKey:key];
+		if (!group) {
+			group = [NSMutableArray array];
+			[groups setObject:group forKey:key];
+			[groupKeys addObject:key];
+		}
+		[group addObject:[NSNumber numberWithUnsignedInteger:index]];
+	}];
+
+	// split each group at the operation count and payload size limits, and where an entity repeats, which the service rejects within a changeset
+	NSMutableArray *chains = [NSMutableArray arrayWithCapacity:groupKeys.count];
+	for (NSString *key in groupKeys) {
+		NSMutableArray *batches = [NSMutableArray array];
+		NSMutableArray *indexes = nil;
+		NSMutableArray *parts = nil;
+		NSMutableSet *rowKeys = nil;
+		NSUInteger payloadSize = 0;
+
+		for (NSNumber *index in [groups objectForKey:key]) {
+			WATableOperation *operation = [operations objectAtIndex:[index unsignedIntegerValue]];
+			NSData *part = WABatchPartForOperation(operation, indexes.count + 1, serviceURL, wireFormat);
+
+			if (!indexes || indexes.count == WATableBatchMaxOperations || payloadSize + part.length > WATableBatchMaxPayloadSize - WATableBatchEnvelopeAllowance ||
+				[rowKeys containsObject:operation.entity.rowKey]) {
+				indexes = [NSMutableArray arrayWithCapacity:WATableBatchMaxOperations];
+				parts = [NSMutableArray arrayWithCapacity:WATableBatchMaxOperations];
+				rowKeys = [NSMutableSet setWithCapacity:WATableBatchMaxOperations];
+				payloadSize = 0;
+				[batches addObject:[NSArray arrayWithObjects:indexes, parts, nil]];
+				part = WABatchPartForOperation(operation, 1, serviceURL, wireFormat);
+			}
+
+			[indexes addObject:index];
+			[parts addObject:part];
+			[rowKeys addObject:operation.entity.rowKey];
+			payloadSize += part.length;
+		}
+		[chains addObject:batches];
+	}
+
+	__block NSUInteger pendingChains = chains.count;
+	__block void (^sendBatch)(NSArray *chain, NSUInteger position) = nil;
+	void (^finish)(void) = ^{
+		// the callback block retains the error until it has run
+		NSError *error = [firstError autorelease];
+		WAPerformCallback(callbackQueue, ^{
+			block(results, error);
+		});
+	};
+
+	if (!pendingChains) {
+		finish();
+		return;
+	}
+
+	// the changesets of a partition are sent one after another, so its operations are applied in the order given; partitions are sent in parallel
+	sendBatch = [^(NSArray *chain, NSUInteger position) {
+		NSArray *batch = [chain objectAtIndex:position];
+		NSArray *indexes = [batch objectAtIndex:0];
+		NSArray *parts = [batch objectAtIndex:1];
+
+		NSString *batchBoundary = WANewBoundary(@"batch");
+		NSString *changesetBoundary = WANewBoundary(@"changeset");
+		NSMutableData *body = [NSMutableData dataWithCapacity:WATableBatchEnvelopeAllowance];
+		[body appendData:[[NSString stringWithFormat:@"--%@\r\nContent-Type: multipart/mixed; boundary=%@\r\n\r\n", batchBoundary, changesetBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+		for (NSData *part in parts) {
+			[body appendData:[[NSString stringWithFormat:@"--%@\r\n", changesetBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+			[body appendData:part];
+		}
+		[body appendData:[[NSString stringWithFormat:@"--%@--\r\n--%@--\r\n", changesetBoundary, batchBoundary] dataUsingEncoding:NSUTF8StringEncoding]];
+
+		NSMutableURLRequest *request = [signer requestForStorageType:WAStorageTypeTable path:@"/$batch" query:nil httpMethod:@"POST"];
+		WATableWireFormatPrepareRequest(request, wireFormat);
+		[request setValue:[NSString stringWithFormat:@"multipart/mixed; boundary=%@", batchBoundary] forHTTPHeaderField:@"Content-Type"];
+		[request setHTTPBody:body];
+		WATableEntity *firstEntity = [[operations objectAtIndex:[[indexes objectAtIndex:0] unsignedIntegerValue]] entity];
+		WARequestMetrics *metrics = [self metricsForOperation:@"EntityGroupTransaction" resourceName:firstEntity.tableName];
+		[signer signRequest:request forStorageType:WAStorageTypeTable metrics:metrics];
+
+		WAStreamingURLRequest *streamingRequest = [WAStreamingURLRequest requestWithURLRequest:request];
+		streamingRequest.retryPolicy = self.retryPolicy;
+		streamingRequest.metrics = metrics;
+		streamingRequest.delegateQueue = self.workQueue;
+
+		// every operation of a changeset is in the same partition
+		streamingRequest.rateLimiterKeys = [NSArray arrayWithObject:WARateLimiterKeyForPartition(signer.accountName, firstEntity.tableName, firstEntity.partitionKey)];
+
+		// a changeset is applied atomically, so it is as safe to replay as its least safe operation
+		streamingRequest.retryOperationKind = WARetryOperationIdempotentWrite;
+		for (NSNumber *index in indexes) {
+			if ([[operations objectAtIndex:[index unsignedIntegerValue]] type] == WATableOperationInsert) {
+				streamingRequest.retryOperationKind = WARetryOperationNonIdempotentWrite;
+				break;
+			}
+		}
+		streamingRequest.collectsResponseBody = YES;
+
+		[streamingRequest startWithCompletionHandler:^(NSHTTPURLResponse *response, NSError *error) {
+			NSArray *responses = error ? nil : WAParseBatchResponse([streamingRequest.responseBody contiguousData], WAHeaderValueForKey(response, @"Content-Type"));
+			BOOL succeeded = responses.count == indexes.count;
+			NSInteger failedIndex = -1;
+			NSInteger failedStatus = response.statusCode;
+			NSString *failedMessage = nil;
+
+			for (NSDictionary *operationResponse in responses) {
+				NSInteger status = [[operationResponse objectForKey:@"status"] integerValue];
+				if (status >= 300) {
+					succeeded = NO;
+					failedStatus = status;
+					failedMessage = [operationResponse objectForKey:@"message"];
+					failedIndex = WAFailedOperationIndex(failedMessage);
+				}
+			}
+
+			if (!succeeded && !error) {
+				error = WAToolkitError(failedStatus, nil, failedMessage ? failedMessage : [NSHTTPURLResponse localizedStringForStatusCode:failedStatus]);
+			}
+
+			[indexes enumerateObjectsUsingBlock:^(NSNumber *index, NSUInteger position, BOOL *stop) {
+				WATableOperation *operation = [operations objectAtIndex:[index unsignedIntegerValue]];
+				[cache invalidateEntity:operation.entity];
+				NSInteger status = succeeded ? [[[responses objectAtIndex:position] objectForKey:@"status"] integerValue] : failedStatus;
+				NSError *operationError = nil;
+				if (!succeeded) {
+					operationError = (failedIndex < 0 || (NSUInteger)failedIndex == position) ? error :
+						WAToolkitError(failedStatus, nil, @"The operation was not applied because another operation in the same transaction failed.");
+				}
+
+				WATableOperationResult *result = [[WATableOperationResult alloc] initWithOperation:operation statusCode:(error && !response) ? 0 : status error:operationError];
+				[results replaceObjectAtIndex:[index unsignedIntegerValue] withObject:result];
+				[result release];
+			}];
+
+			if (error && !firstError) {
+				firstError = [error retain];
+			}
+
+			if (position + 1 < chain.count) {
+				sendBatch(chain, position + 1);
+			} else if (--pendingChains == 0) {
+				[sendBatch release];
+				finish();
+			}
+		}];
+	} copy];
+
+	for (NSArray *chain in chains) {
+		sendBatch(chain, 0);
+	}
+}
+
+@end
+
+static BOOL WAEntityNeedsSerializer(WACloudStorageClient *client, WATableEntity *entity)
+{
+	if (![WASharedKeySigner signerForCredential:WAStorageClientCredential(client)]) {
+		return NO;
+	}
+
+	for (NSString *key in [entity keys]) {
+		if (![[entity objectForKey:key] isKindOfClass:[NSString class]] || [entity edmTypeForKey:key] != WAEdmTypeString) {
+			return YES;
+		}
+	}
+	return NO;
+}
+
+/*
+ Reroutes toolkit writes of entities holding typed values through the
+ serializer; see the documentation of the Batch category.
+ */
+@interface WACloudStorageClient (TypedEntityWrites)
+
+- (BOOL)wa_executeTypedOperation:(WATableOperation *)operation completionHandler:(void (^)(NSError *error))block;
+
+@end
+
+@implementation WACloudStorageClient (TypedEntityWrites)
+
++ (void)load
+{
+	SEL selectors[][2] = {
+		{ @selector(insertEntity:), @selector(wa_typedInsertEntity:) },
+		{ @selector(updateEntity:), @selector(wa_typedUpdateEntity:) },
+		{ @selector(mergeEntity:), @selector(wa_typedMergeEntity:) },
+		{ @selector(insertEntity:withCompletionHandler:), @selector(wa_typedInsertEntity:withCompletionHandler:) },
+		{ @selector(updateEntity:withCompletionHandler:), @selector(wa_typedUpdateEntity:withCompletionHandler:) },
+		{ @selector(mergeEntity:withCompletionHandler:), @selector(wa_typedMergeEntity:withCompletionHandler:) }
+	};
+
+	for (size_t i = 0; i < sizeof(selectors) / sizeof(selectors[0]); i++) {
+		Method original = class_getInstanceMethod(self, selectors[i][0]);
+		Method replacement = class_getInstanceMethod(self, selectors[i][1]);
+		if (original && replacement) {
+			method_exchangeImplementations(original, replacement);
+		}
+	}
+}
+
+- (BOOL)wa_typedInsertEntity:(WATableEntity *)newEntity
+{
+	if (WAEntityNeedsSerializer(self, newEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation insertOperationWithEntity:newEntity] completionHandler:nil];
+	}
+	return [self wa_typedInsertEntity:newEntity];
+}
+
+- (BOOL)wa_typedUpdateEntity:(WATableEntity *)existingEntity
+{
+	if (WAEntityNeedsSerializer(self, existingEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation updateOperationWithEntity:existingEntity] completionHandler:nil];
+	}
+	return [self wa_typedUpdateEntity:existingEntity];
+}
+
+- (BOOL)wa_typedMergeEntity:(WATableEntity *)existingEntity
+{
+	if (WAEntityNeedsSerializer(self, existingEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation mergeOperationWithEntity:existingEntity] completionHandler:nil];
+	}
+	return [self wa_typedMergeEntity:existingEntity];
+}
+
+- (BOOL)wa_typedInsertEntity:(WATableEntity *)newEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	if (WAEntityNeedsSerializer(self, newEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation insertOperationWithEntity:newEntity] completionHandler:block];
+	}
+	return [self wa_typedInsertEntity:newEntity withCompletionHandler:block];
+}
+
+- (BOOL)wa_typedUpdateEntity:(WATableEntity *)existingEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	if (WAEntityNeedsSerializer(self, existingEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation updateOperationWithEntity:existingEntity] completionHandler:block];
+	}
+	return [self wa_typedUpdateEntity:existingEntity withCompletionHandler:block];
+}
+
+- (BOOL)wa_typedMergeEntity:(WATableEntity *)existingEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	if (WAEntityNeedsSerializer(self, existingEntity)) {
+		return [self wa_executeTypedOperation:[WATableOperation mergeOperationWithEntity:existingEntity] completionHandler:block];
+	}
+	return [self wa_typedMergeEntity:existingEntity withCompletionHandler:block];
+}
+
+- (BOOL)wa_executeTypedOperation:(WATableOperation *)operation completionHandler:(void (^)(NSError *error))block
+{
+	// the toolkit calls its handlers where the response arrives, not on the callback queue
+	[self executeTableOperations:[NSArray arrayWithObject:operation] callbackQueue:NULL withCompletionHandler:^(NSArray *results, NSError *error) {
+		if (block) {
+			block(error);
+			return;
+		}
+
+		// like the toolkit, report to the delegate when there is no block
+		id<WACloudStorageClientDelegate> delegate = self.delegate;
+		if (error) {
+			if ([delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)]) {
+				[delegate storageClient:self didFailRequest:nil withError:error];
+			}
+			return;
+		}
+
+		WATableEntity *entity = operation.entity;
+		switch (operation.type) {
+			case WATableOperationInsert:
+				if ([delegate respondsToSelector:@selector(storageClient:didInsertEntity:)]) {
+					[delegate storageClient:self didInsertEntity:entity];
+				}
+				break;
+			case WATableOperationUpdate:
+				if ([delegate respondsToSelector:@selector(storageClient:didUpdateEntity:)]) {
+					[delegate storageClient:self didUpdateEntity:entity];
+				}
+				break;
+			case WATableOperationMerge:
+				if ([delegate respondsToSelector:@selector(storageClient:didMergeEntity:)]) {
+					[delegate storageClient:self didMergeEntity:entity];
+				}
+				break;
+			default:
+				break;
+		}
+	}];
+	return YES;
+}
+
+@end
@@ -0,0 +1,185 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WAEdmDecoding.h"
+
+@class WATableEntityRow;
+
+/**
+ A page of table entities stored column by column.
+
+ Every property name is stored once, in the schema shared by all the rows. Numbers, booleans and dates are kept in typed arrays with one slot per row, strings, GUIDs and binary values in one byte buffer per column addressed through an offsets array, and missing or null values in a bitmap per column. A page of many small entities takes a fraction of the memory of the same page as WATableEntity objects, and scanning a column touches contiguous memory.
+
+ Values are typed by their m:type attribute. If a property has different types in different rows, its column is stored as strings.
+ */
+@interface WATableEntityBatch : NSObject {
+@private
+	NSString *_tableName;
+	NSMutableArray *_columns;
+	NSUInteger _count;
+	NSUInteger _nextColumn;
+	BOOL _inRow;
+}
+
+/**
+ The name of the table the entities belong to.
+ */
+@property (readonly) NSString *tableName;
+
+/**
+ The number of rows.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ The names of the columns, in the order they were first seen.
+ */
+@property (readonly) NSArray *columnNames;
+
+/**
+ Initializes a newly created, empty batch.
+
+ @param tableName The name of the table the entities belong to.
+
+ @returns The newly initialized WATableEntityBatch object.
+ */
+- (id)initWithTableName:(NSString *)tableName;
+
+/**
+ Returns the index of a column.
+
+ @param name The property name.
+
+ @returns The index, or NSNotFound if no row has the property.
+ */
+- (NSUInteger)indexOfColumnNamed:(NSString *)name;
+
+/**
+ Returns the type of the values in a column.
+
+ @param column The column index.
+ */
+- (WAEdmType)typeOfColumnAtIndex:(NSUInteger)column;
+
+/**
+ Returns the typed values of a fixed width column, one per row: int32_t for Edm.Int32, int64_t for Edm.Int64, double for Edm.Double, uint8_t for Edm.Boolean, and an NSTimeInterval since the reference date for Edm.DateTime. Slots of null values hold 0.
+
+ @param column The column index.
+
+ @returns The values, valid as long as the batch is alive and not appended to, or NULL for a variable width column.
+ */
+- (const void *)valuesOfColumnAtIndex:(NSUInteger)column;
+
+/**
+ Returns whether a value is missing or null.
+
+ @param row The row index.
+ @param column The column index.
+ */
+- (BOOL)isNullAtRow:(NSUInteger)row column:(NSUInteger)column;
+
+/**
+ Returns a value as an object: an NSString for strings and GUIDs, an NSNumber for numbers and booleans, an NSDate for dates and NSData for binary values.
+
+ @param row The row index.
+ @param column The column index.
+
+ @returns The value, or nil if it is missing or null.
+ */
+- (id)objectAtRow:(NSUInteger)row column:(NSUInteger)column;
+
+/**
+ Returns a lightweight view of one row.
+
+ @param row The row index.
+ */
+- (WATableEntityRow *)rowAtIndex:(NSUInteger)row;
+
+@end
+
+/**
+ Appends rows to a batch. Used by WAEntityStreamParser as it decodes a feed.
+ */
+@interface WATableEntityBatch (Building)
+
+/**
+ Starts a new row.
+ */
+- (void)beginRow;
+
+/**
+ Appends a property value to the current row.
+
+ @param name The NUL terminated property name.
+ @param type The type of the value.
+ @param bytes The text of the value as sent by the service, which need not be NUL terminated.
+ @param length The length of the text in bytes.
+ */
+- (void)appendProperty:(const char *)name type:(WAEdmType)type bytes:(const char *)bytes length:(size_t)length;
+
+/**
+ Ends the current row. Properties not appended to it are null.
+ */
+- (void)endRow;
+
+@end
+
+/**
+ A view of one row of a WATableEntityBatch that answers the same questions as a WATableEntity. The view keeps the batch alive.
+ */
+@interface WATableEntityRow : NSObject {
+@private
+	WATableEntityBatch *_batch;
+	NSUInteger _index;
+}
+
+/**
+ The index of the row in the batch.
+ */
+@property (readonly) NSUInteger index;
+
+/**
+ The partition key of the entity.
+ */
+@property (readonly) NSString *partitionKey;
+
+/**
+ The row key of the entity.
+ */
+@property (readonly) NSString *rowKey;
+
+/**
+ The timestamp of the entity.
+ */
+@property (readonly) NSDate *timeStamp;
+
+/**
+ Returns the names of the properties of the row that are not null.
+ */
+- (NSArray *)keys;
+
+/**
+ Returns the value of a property.
+
+ @param key The property name.
+
+ @returns The value, or nil if the row does not have the property.
+ */
+- (id)objectForKey:(NSString *)key;
+
+@end
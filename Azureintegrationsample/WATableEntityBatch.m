@@ -0,0 +1,486 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableEntityBatch.h"
+
+#import "WAToolkitPrivate.h"
+
+static size_t WAEdmTypeWidth(WAEdmType type)
+{
+	switch (type) {
+		case WAEdmTypeInt32:
+			return sizeof(int32_t);
+		case WAEdmTypeInt64:
+			return sizeof(int64_t);
+		case WAEdmTypeDouble:
+		case WAEdmTypeDateTime:
+			return sizeof(double);
+		case WAEdmTypeBoolean:
+			return sizeof(uint8_t);
+		default:
+			return 0;
+	}
+}
+
+/*
+ The values of one property across the rows of a batch. Fixed width types use
+ values; strings, GUIDs and binary values use bytes plus the end offset of
+ every row in offsets.
+ */
+@interface WATableEntityBatchColumn : NSObject {
+@public
+	NSString *name;
+	char *cName;
+	WAEdmType type;
+	size_t width;
+	NSUInteger count;
+	NSMutableData *values;
+	NSMutableData *offsets;
+	NSMutableData *bytes;
+	NSMutableData *nulls;
+	BOOL appendedInRow;
+}
+
+- (id)initWithName:(const char *)name type:(WAEdmType)type;
+- (void)appendSlotAsNull:(BOOL)isNull;
+- (void)appendNull;
+- (BOOL)appendBytes:(const char *)text length:(size_t)length;
+- (BOOL)isNullAtRow:(NSUInteger)row;
+- (id)objectAtRow:(NSUInteger)row;
+- (NSRange)byteRangeAtRow:(NSUInteger)row;
+- (void)convertToStrings;
+
+@end
+
+@interface WATableEntityRow ()
+
+- (id)initWithBatch:(WATableEntityBatch *)batch index:(NSUInteger)index;
+
+@end
+
+@implementation WATableEntityBatchColumn
+
+- (id)initWithName:(const char *)aName type:(WAEdmType)aType
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	name = [[NSString alloc] initWithUTF8String:aName];
+	cName = strdup(aName);
+	type = aType;
+	width = WAEdmTypeWidth(aType);
+	nulls = [[NSMutableData alloc] init];
+	if (width) {
+		values = [[NSMutableData alloc] init];
+	} else {
+		offsets = [[NSMutableData alloc] init];
+		bytes = [[NSMutableData alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[name release];
+	free(cName);
+	[values release];
+	[offsets release];
+	[bytes release];
+	[nulls release];
+	[super dealloc];
+}
+
+- (void)appendSlotAsNull:(BOOL)isNull
+{
+	NSUInteger row = count++;
+	if ((row >> 3) >= nulls.length) {
+		[nulls increaseLengthBy:64];
+	}
+	if (isNull) {
+		((uint8_t *)[nulls mutableBytes])[row >> 3] |= (uint8_t)(1 << (row & 7));
+	}
+}
+
+- (void)appendNull
+{
+	[self appendSlotAsNull:YES];
+	if (width) {
+		[values increaseLengthBy:width];
+	} else {
+		uint32_t end = (uint32_t)bytes.length;
+		[offsets appendBytes:&end length:sizeof(end)];
+	}
+}
+
+- (BOOL)appendBytes:(const char *)text length:(size_t)length
+{
+	union {
+		int32_t int32;
+		int64_t int64;
+		double real;
+		uint8_t boolean;
+	} value;
+	memset(&value, 0, sizeof(value));
+
+	switch (type) {
+		case WAEdmTypeInt32:
+		case WAEdmTypeInt64:
+			if (!WAEdmParseInt64(text, length, &value.int64)) {
+				return NO;
+			}
+			if (type == WAEdmTypeInt32) {
+				if (value.int64 < INT32_MIN || value.int64 > INT32_MAX) {
+					return NO;
+				}
+				value.int32 = (int32_t)value.int64;
+			}
+			break;
+		case WAEdmTypeDouble:
+			if (!WAEdmParseDouble(text, length, &value.real)) {
+				return NO;
+			}
+			break;
+		case WAEdmTypeBoolean: {
+			BOOL flag;
+			if (!WAEdmParseBoolean(text, length, &flag)) {
+				return NO;
+			}
+			value.boolean = flag ? 1 : 0;
+			break;
+		}
+		case WAEdmTypeDateTime:
+			if (!WAEdmParseDateTime(text, length, &value.real)) {
+				return NO;
+			}
+			break;
+		case WAEdmTypeBinary: {
+			NSUInteger start = bytes.length;
+			if (!WAEdmAppendBase64(text, length, bytes)) {
+				[bytes setLength:start];
+				return NO;
+			}
+			break;
+		}
+		default:
+			[bytes appendBytes:text length:length];
+			break;
+	}
+
+	[self appendSlotAsNull:NO];
+	if (width) {
+		[values appendBytes:&value length:width];
+	} else {
+		uint32_t end = (uint32_t)bytes.length;
+		[offsets appendBytes:&end length:sizeof(end)];
+	}
+	return YES;
+}
+
+- (BOOL)isNullAtRow:(NSUInteger)row
+{
+	return row >= count || (((const uint8_t *)[nulls bytes])[row >> 3] & (1 << (row & 7))) != 0;
+}
+
+- (NSRange)byteRangeAtRow:(NSUInteger)row
+{
+	const uint32_t *ends = [offsets bytes];
+	uint32_t start = row ? ends[row - 1] : 0;
+	return NSMakeRange(start, ends[row] - start);
+}
+
+- (id)objectAtRow:(NSUInteger)row
+{
+	if ([self isNullAtRow:row]) {
+		return nil;
+	}
+
+	const void *slot = (const char *)[values bytes] + row * width;
+	switch (type) {
+		case WAEdmTypeInt32:
+			return [NSNumber numberWithInt:*(const int32_t *)slot];
+		case WAEdmTypeInt64:
+			return [NSNumber numberWithLongLong:*(const int64_t *)slot];
+		case WAEdmTypeDouble:
+			return [NSNumber numberWithDouble:*(const double *)slot];
+		case WAEdmTypeBoolean:
+			return [NSNumber numberWithBool:*(const uint8_t *)slot != 0];
+		case WAEdmTypeDateTime:
+			return [NSDate dateWithTimeIntervalSinceReferenceDate:*(const double *)slot];
+		case WAEdmTypeBinary:
+			return [bytes subdataWithRange:[self byteRangeAtRow:row]];
+		default: {
+			NSRange range = [self byteRangeAtRow:row];
+			return [[[NSString alloc] initWithBytes:(const char *)[bytes bytes] + range.location length:range.length encoding:NSUTF8StringEncoding] autorelease];
+		}
+	}
+}
+
+- (void)convertToStrings
+{
+	if (type == WAEdmTypeString) {
+		return;
+	}
+
+	NSMutableData *newOffsets = [[NSMutableData alloc] initWithCapacity:count * sizeof(uint32_t)];
+	NSMutableData *newBytes = [[NSMutableData alloc] init];
+
+	for (NSUInteger row = 0; row < count; row++) {
+		id object = [self objectAtRow:row];
+		NSString *text = nil;
+		if ([object isKindOfClass:[NSData class]]) {
+			text = [object stringWithBase64EncodedData];
+		} else if ([object isKindOfClass:[NSDate class]]) {
+			text = WAEdmDateTimeString(object);
+		} else if (type == WAEdmTypeBoolean) {
+			text = [object boolValue] ? @"true" : @"false";
+		} else {
+			text = [object description];
+		}
+
+		const char *utf8 = [text UTF8String];
+		if (utf8) {
+			[newBytes appendBytes:utf8 length:strlen(utf8)];
+		}
+		uint32_t end = (uint32_t)newBytes.length;
+		[newOffsets appendBytes:&end length:sizeof(end)];
+	}
+
+	[values release];
+	values = nil;
+	[offsets release];
+	offsets = newOffsets;
+	[bytes release];
+	bytes = newBytes;
+	type = WAEdmTypeString;
+	width = 0;
+}
+
+@end
+
+@implementation WATableEntityBatch
+
+@synthesize tableName = _tableName;
+@synthesize count = _count;
+
+- (id)initWithTableName:(NSString *)tableName
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_tableName = [tableName copy];
+	_columns = [[NSMutableArray alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_tableName release];
+	[_columns release];
+	[super dealloc];
+}
+
+- (NSArray *)columnNames
+{
+	NSMutableArray *names = [NSMutableArray arrayWithCapacity:_columns.count];
+	for (WATableEntityBatchColumn *column in _columns) {
+		[names addObject:column->name];
+	}
+	return names;
+}
+
+- (NSUInteger)indexOfColumnNamed:(NSString *)name
+{
+	NSUInteger index = 0;
+	for (WATableEntityBatchColumn *column in _columns) {
+		if ([column->name isEqualToString:name]) {
+			return index;
+		}
+		index++;
+	}
+	return NSNotFound;
+}
+
+- (WAEdmType)typeOfColumnAtIndex:(NSUInteger)column
+{
+	return ((WATableEntityBatchColumn *)[_columns objectAtIndex:column])->type;
+}
+
+- (const void *)valuesOfColumnAtIndex:(NSUInteger)column
+{
+	WATableEntityBatchColumn *entry = [_columns objectAtIndex:column];
+	return entry->width ? [entry->values bytes] : NULL;
+}
+
+- (BOOL)isNullAtRow:(NSUInteger)row column:(NSUInteger)column
+{
+	return [(WATableEntityBatchColumn *)[_columns objectAtIndex:column] isNullAtRow:row];
+}
+
+- (id)objectAtRow:(NSUInteger)row column:(NSUInteger)column
+{
+	return [(WATableEntityBatchColumn *)[_columns objectAtIndex:column] objectAtRow:row];
+}
+
+- (WATableEntityRow *)rowAtIndex:(NSUInteger)row
+{
+	NSParameterAssert(row < _count);
+
+	return [[[WATableEntityRow alloc] initWithBatch:self index:row] autorelease];
+}
+
+@end
+
+@implementation WATableEntityBatch (Building)
+
+- (void)beginRow
+{
+	NSAssert(!_inRow, @"The previous row was not ended");
+	_inRow = YES;
+	_nextColumn = 0;
+}
+
+- (void)appendProperty:(const char *)name type:(WAEdmType)type bytes:(const char *)bytes length:(size_t)length
+{
+	NSAssert(_inRow, @"Properties must be appended inside a row");
+
+	// rows of a page usually list their properties in the same order, so the expected column is tried first
+	WATableEntityBatchColumn *column = nil;
+	NSUInteger columnCount = _columns.count;
+	if (_nextColumn < columnCount) {
+		WATableEntityBatchColumn *candidate = [_columns objectAtIndex:_nextColumn];
+		if (strcmp(candidate->cName, name) == 0) {
+			column = candidate;
+		}
+	}
+	for (NSUInteger i = 0; !column && i < columnCount; i++) {
+		WATableEntityBatchColumn *candidate = [_columns objectAtIndex:i];
+		if (strcmp(candidate->cName, name) == 0) {
+			column = candidate;
+			_nextColumn = i;
+		}
+	}
+
+	if (!column) {
+		column = [[WATableEntityBatchColumn alloc] initWithName:name type:type];
+		for (NSUInteger row = 0; row < _count; row++) {
+			[column appendNull];
+		}
+		[_columns addObject:column];
+		[column release];
+		_nextColumn = columnCount;
+	}
+	_nextColumn++;
+
+	if (column->appendedInRow) {
+		return;
+	}
+	column->appendedInRow = YES;
+
+	if (column->type != type && column->type != WAEdmTypeString) {
+		[column convertToStrings];
+	}
+	if (![column appendBytes:bytes length:length]) {
+		// the text does not match its declared type; keep it as text
+		[column convertToStrings];
+		[column appendBytes:bytes length:length];
+	}
+}
+
+- (void)endRow
+{
+	NSAssert(_inRow, @"No row was begun");
+
+	for (WATableEntityBatchColumn *column in _columns) {
+		if (!column->appendedInRow) {
+			[column appendNull];
+		}
+		column->appendedInRow = NO;
+	}
+	_count++;
+	_inRow = NO;
+}
+
+@end
+
+@implementation WATableEntityRow
+
+@synthesize index = _index;
+
+- (id)initWithBatch:(WATableEntityBatch *)batch index:(NSUInteger)index
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_batch = [batch retain];
+	_index = index;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_batch release];
+	[super dealloc];
+}
+
+- (NSString *)partitionKey
+{
+	return [self objectForKey:@"PartitionKey"];
+}
+
+- (NSString *)rowKey
+{
+	return [self objectForKey:@"RowKey"];
+}
+
+- (NSDate *)timeStamp
+{
+	return [self objectForKey:@"Timestamp"];
+}
+
+- (NSArray *)keys
+{
+	NSArray *names = _batch.columnNames;
+	NSMutableArray *keys = [NSMutableArray arrayWithCapacity:names.count];
+	[names enumerateObjectsUsingBlock:^(NSString *name, NSUInteger column, BOOL *stop) {
+		if (![_batch isNullAtRow:_index column:column]) {
+			[keys addObject:name];
+		}
+	}];
+	return keys;
+}
+
+- (id)objectForKey:(NSString *)key
+{
+	NSUInteger column = [_batch indexOfColumnNamed:key];
+	return column == NSNotFound ? nil : [_batch objectAtRow:_index column:column];
+}
+
+- (NSString *)description
+{
+	NSMutableDictionary *properties = [NSMutableDictionary dictionary];
+	for (NSString *key in [self keys]) {
+		[properties setObject:[self objectForKey:key] forKey:key];
+	}
+	return [NSString stringWithFormat:@"WATableEntityRow { table: %@, index: %lu, properties: %@ }", _batch.tableName, (unsigned long)_index, properties];
+}
+
+@end
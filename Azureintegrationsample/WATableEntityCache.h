@@ -0,0 +1,150 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WATableEntity;
+@class WAResultContinuation;
+
+/**
+ The default time, in seconds, an entity stays in a WATableEntityCache.
+ */
+#define WATableEntityCacheDefaultTimeToLive 60.0
+
+/**
+ An in-memory cache of table entities, keyed by table name, partition key and row key.
+
+ Entries are evicted in least recently used order once the estimated size of the cached entities exceeds the byte budget, and are dropped when they are older than timeToLive. The cache is safe to use from several threads.
+ */
+@interface WATableEntityCache : NSObject {
+@private
+	NSUInteger _byteBudget;
+	NSTimeInterval _timeToLive;
+	NSUInteger _totalBytes;
+	NSUInteger _hitCount;
+	NSUInteger _missCount;
+	NSMutableDictionary *_entries;
+	id _head;
+	id _tail;
+}
+
+/**
+ The maximum estimated size, in bytes, of the cached entities.
+ */
+@property (readonly) NSUInteger byteBudget;
+
+/**
+ The time, in seconds, an entity is served from the cache after it was stored. Pass 0 to keep entities until they are evicted or invalidated. The default is WATableEntityCacheDefaultTimeToLive.
+ */
+@property (assign) NSTimeInterval timeToLive;
+
+/**
+ The estimated size, in bytes, of the cached entities.
+ */
+@property (readonly) NSUInteger totalBytes;
+
+/**
+ The number of cached entities.
+ */
+@property (readonly) NSUInteger count;
+
+/**
+ The number of lookups answered from the cache.
+ */
+@property (readonly) NSUInteger hitCount;
+
+/**
+ The number of lookups that found no live entry.
+ */
+@property (readonly) NSUInteger missCount;
+
+/**
+ Initializes a newly created cache.
+
+ @param byteBudget The maximum estimated size, in bytes, of the cached entities.
+
+ @returns The newly initialized WATableEntityCache object.
+ */
+- (id)initWithByteBudget:(NSUInteger)byteBudget;
+
+/**
+ Returns a cached entity.
+
+ @param tableName The table name.
+ @param partitionKey The partition key.
+ @param rowKey The row key.
+
+ @returns A copy of the cached entity, or nil if it is not cached or has expired. The copy belongs to the caller, who may change it without affecting the cache.
+ */
+- (WATableEntity *)entityForTable:(NSString *)tableName partitionKey:(NSString *)partitionKey rowKey:(NSString *)rowKey;
+
+/**
+ Adds a copy of an entity to the cache, replacing any cached version with an older or equal timestamp. Changes made to the entity afterwards do not reach the cache.
+
+ @param entity The entity, which must have a table name, partition key and row key.
+ */
+- (void)storeEntity:(WATableEntity *)entity;
+
+/**
+ Removes the cached version of an entity.
+
+ @param entity The entity.
+ */
+- (void)invalidateEntity:(WATableEntity *)entity;
+
+/**
+ Removes the cached version of an entity.
+
+ @param tableName The table name.
+ @param partitionKey The partition key.
+ @param rowKey The row key.
+ */
+- (void)invalidateEntityForTable:(NSString *)tableName partitionKey:(NSString *)partitionKey rowKey:(NSString *)rowKey;
+
+/**
+ Removes every entity from the cache.
+ */
+- (void)removeAllEntities;
+
+@end
+
+/**
+ Read-through entity caching for WACloudStorageClient.
+
+ Once a cache is set, updateEntity:, mergeEntity: and deleteEntity: and their block based variants, as well as executeTableOperations:withCompletionHandler:, invalidate the entities they change when they are issued. The block based variants, when given a block, and executeTableOperations:withCompletionHandler: invalidate them again when they complete, in case a read that was in flight stored the old version. The delegate forms are not observed on completion; the delegate is notified as usual.
+ */
+@interface WACloudStorageClient (EntityCache)
+
+/**
+ The cache used by fetchCachedEntitiesWithRequest:usingCompletionHandler:, or nil. The default is nil.
+ */
+@property (retain) WATableEntityCache *entityCache;
+
+/**
+ Fetches entities, answering point reads from the entity cache.
+
+ A request with both a partition key and a row key, no filter and no continuation is a point read: it is answered from the cache if the entity is there, and the fetched entity is stored otherwise. Any other request, or any request when no cache is set, is passed to fetchEntitiesWithRequest:usingCompletionHandler: unchanged.
+
+ @param fetchRequest The fetch request.
+ @param block A block object called with the entities. When the entity comes from the cache, the block is called before this method returns.
+
+ @see fetchEntitiesWithRequest:usingCompletionHandler:
+ */
+- (void)fetchCachedEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingCompletionHandler:(void (^)(NSArray *entities, WAResultContinuation *resultContinuation, NSError *error))block;
+
+@end
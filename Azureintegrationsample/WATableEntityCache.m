@@ -0,0 +1,408 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableEntityCache.h"
+
+#import <objc/runtime.h>
+
+#import "WAEntitySerializer.h"
+#import "WATableEntity.h"
+#import "WATableFetchRequest.h"
+
+static char WAEntityCacheKey;
+
+static NSString *WAEntityCacheKeyFor(NSString *tableName, NSString *partitionKey, NSString *rowKey)
+{
+	return [NSString stringWithFormat:@"%@\n%@\n%@", tableName, partitionKey, rowKey];
+}
+
+/*
+ A rough estimate of the memory held by an entity, used against the byte budget.
+ */
+static NSUInteger WAEstimatedEntitySize(WATableEntity *entity)
+{
+	NSUInteger size = 128;
+	for (NSString *key in [entity keys]) {
+		id value = [entity objectForKey:key];
+		size += 32 + key.length * sizeof(unichar);
+		if ([value isKindOfClass:[NSString class]]) {
+			size += [value length] * sizeof(unichar);
+		} else if ([value isKindOfClass:[NSData class]]) {
+			size += [value length];
+		} else {
+			size += 16;
+		}
+	}
+	return size;
+}
+
+/*
+ Returns an entity with the same keys, timestamp, recorded Edm types and
+ values as another. Mutable values, such as decoded binary data, are copied.
+ */
+static WATableEntity *WACopyEntity(WATableEntity *entity)
+{
+	WATableEntity *copy = [WATableEntity createEntityForTable:entity.tableName];
+	copy.partitionKey = entity.partitionKey;
+	copy.rowKey = entity.rowKey;
+	if (entity.timeStamp) {
+		[copy setValue:entity.timeStamp forKey:@"timeStamp"];
+	}
+
+	for (NSString *key in [entity keys]) {
+		if ([key isEqualToString:@"PartitionKey"] || [key isEqualToString:@"RowKey"] || [key isEqualToString:@"Timestamp"]) {
+			continue;
+		}
+		id value = [[entity objectForKey:key] copy];
+		[copy setObject:value forKey:key];
+		[value release];
+
+		WAEdmType type = [entity edmTypeForKey:key];
+		if (type != WAEdmTypeString) {
+			[copy setEdmType:type forKey:key];
+		}
+	}
+
+	return copy;
+}
+
+/*
+ A cached entity, linked into the recency list of the cache.
+ */
+@interface WATableEntityCacheEntry : NSObject {
+@public
+	NSString *key;
+	WATableEntity *entity;
+	NSUInteger size;
+	CFAbsoluteTime storedAt;
+	WATableEntityCacheEntry *previous;
+	WATableEntityCacheEntry *next;
+}
+
+@end
+
+@implementation WATableEntityCacheEntry
+
+- (void)dealloc
+{
+	[key release];
+	[entity release];
+	[super dealloc];
+}
+
+@end
+
+@interface WATableEntityCache ()
+
+- (void)unlinkEntry:(WATableEntityCacheEntry *)entry;
+- (void)linkEntryAtHead:(WATableEntityCacheEntry *)entry;
+- (void)removeEntry:(WATableEntityCacheEntry *)entry;
+
+@end
+
+@implementation WATableEntityCache
+
+@synthesize byteBudget = _byteBudget;
+@synthesize timeToLive = _timeToLive;
+@synthesize totalBytes = _totalBytes;
+@synthesize hitCount = _hitCount;
+@synthesize missCount = _missCount;
+
+- (id)initWithByteBudget:(NSUInteger)byteBudget
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_byteBudget = byteBudget;
+	_timeToLive = WATableEntityCacheDefaultTimeToLive;
+	_entries = [[NSMutableDictionary alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_entries release];
+	[super dealloc];
+}
+
+- (NSUInteger)count
+{
+	@synchronized(self) {
+		return _entries.count;
+	}
+}
+
+- (WATableEntity *)entityForTable:(NSString *)tableName partitionKey:(NSString *)partitionKey rowKey:(NSString *)rowKey
+{
+	NSString *key = WAEntityCacheKeyFor(tableName, partitionKey, rowKey);
+	WATableEntity *cached = nil;
+
+	@synchronized(self) {
+		WATableEntityCacheEntry *entry = [_entries objectForKey:key];
+		if (entry && _timeToLive > 0 && CFAbsoluteTimeGetCurrent() - entry->storedAt > _timeToLive) {
+			[self removeEntry:entry];
+			entry = nil;
+		}
+
+		if (!entry) {
+			_missCount++;
+			return nil;
+		}
+
+		_hitCount++;
+		[self unlinkEntry:entry];
+		[self linkEntryAtHead:entry];
+		cached = [[entry->entity retain] autorelease];
+	}
+
+	// the cached entity is never handed out, so a caller changing its copy does not change what other readers see
+	return WACopyEntity(cached);
+}
+
+- (void)storeEntity:(WATableEntity *)entity
+{
+	if (!entity.tableName || !entity.partitionKey || !entity.rowKey) {
+		return;
+	}
+
+	NSString *key = WAEntityCacheKeyFor(entity.tableName, entity.partitionKey, entity.rowKey);
+	NSUInteger size = WAEstimatedEntitySize(entity);
+	if (size > _byteBudget) {
+		return;
+	}
+
+	// the caller keeps its entity, and may go on changing it
+	entity = WACopyEntity(entity);
+
+	@synchronized(self) {
+		WATableEntityCacheEntry *existing = [_entries objectForKey:key];
+		if (existing) {
+			// a response that raced with a newer one must not replace it
+			NSDate *cachedStamp = existing->entity.timeStamp;
+			if (cachedStamp && entity.timeStamp && [entity.timeStamp compare:cachedStamp] == NSOrderedAscending) {
+				return;
+			}
+			[self removeEntry:existing];
+		}
+
+		WATableEntityCacheEntry *entry = [[WATableEntityCacheEntry alloc] init];
+		entry->key = [key copy];
+		entry->entity = [entity retain];
+		entry->size = size;
+		entry->storedAt = CFAbsoluteTimeGetCurrent();
+		[_entries setObject:entry forKey:key];
+		[self linkEntryAtHead:entry];
+		_totalBytes += size;
+		[entry release];
+
+		while (_totalBytes > _byteBudget && _tail) {
+			[self removeEntry:_tail];
+		}
+	}
+}
+
+- (void)invalidateEntity:(WATableEntity *)entity
+{
+	[self invalidateEntityForTable:entity.tableName partitionKey:entity.partitionKey rowKey:entity.rowKey];
+}
+
+- (void)invalidateEntityForTable:(NSString *)tableName partitionKey:(NSString *)partitionKey rowKey:(NSString *)rowKey
+{
+	NSString *key = WAEntityCacheKeyFor(tableName, partitionKey, rowKey);
+
+	@synchronized(self) {
+		WATableEntityCacheEntry *entry = [_entries objectForKey:key];
+		if (entry) {
+			[self removeEntry:entry];
+		}
+	}
+}
+
+- (void)removeAllEntities
+{
+	@synchronized(self) {
+		[_entries removeAllObjects];
+		_head = nil;
+		_tail = nil;
+		_totalBytes = 0;
+	}
+}
+
+#pragma mark - Private
+
+- (void)unlinkEntry:(WATableEntityCacheEntry *)entry
+{
+	if (entry->previous) {
+		entry->previous->next = entry->next;
+	} else {
+		_head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->previous = entry->previous;
+	} else {
+		_tail = entry->previous;
+	}
+	entry->previous = nil;
+	entry->next = nil;
+}
+
+- (void)linkEntryAtHead:(WATableEntityCacheEntry *)entry
+{
+	WATableEntityCacheEntry *head = _head;
+	entry->next = head;
+	if (head) {
+		head->previous = entry;
+	}
+	_head = entry;
+	if (!_tail) {
+		_tail = entry;
+	}
+}
+
+- (void)removeEntry:(WATableEntityCacheEntry *)entry
+{
+	// the list does not retain its entries; the dictionary does
+	[[entry retain] autorelease];
+	[self unlinkEntry:entry];
+	_totalBytes -= entry->size;
+	[_entries removeObjectForKey:entry->key];
+}
+
+@end
+
+@implementation WACloudStorageClient (EntityCache)
+
++ (void)load
+{
+	// the storage client cannot be subclassed by its users, so writes are observed by exchanging implementations
+	SEL selectors[][2] = {
+		{ @selector(updateEntity:), @selector(wa_cacheUpdateEntity:) },
+		{ @selector(mergeEntity:), @selector(wa_cacheMergeEntity:) },
+		{ @selector(deleteEntity:), @selector(wa_cacheDeleteEntity:) },
+		{ @selector(updateEntity:withCompletionHandler:), @selector(wa_cacheUpdateEntity:withCompletionHandler:) },
+		{ @selector(mergeEntity:withCompletionHandler:), @selector(wa_cacheMergeEntity:withCompletionHandler:) },
+		{ @selector(deleteEntity:withCompletionHandler:), @selector(wa_cacheDeleteEntity:withCompletionHandler:) }
+	};
+
+	for (size_t i = 0; i < sizeof(selectors) / sizeof(selectors[0]); i++) {
+		Method original = class_getInstanceMethod(self, selectors[i][0]);
+		Method replacement = class_getInstanceMethod(self, selectors[i][1]);
+		if (original && replacement) {
+			method_exchangeImplementations(original, replacement);
+		}
+	}
+}
+
+- (WATableEntityCache *)entityCache
+{
+	return objc_getAssociatedObject(self, &WAEntityCacheKey);
+}
+
+- (void)setEntityCache:(WATableEntityCache *)entityCache
+{
+	objc_setAssociatedObject(self, &WAEntityCacheKey, entityCache, OBJC_ASSOCIATION_RETAIN);
+}
+
+- (void)fetchCachedEntitiesWithRequest:(WATableFetchRequest *)fetchRequest usingCompletionHandler:(void (^)(NSArray *entities, WAResultContinuation *resultContinuation, NSError *error))block
+{
+	WATableEntityCache *cache = self.entityCache;
+	BOOL pointRead = cache && fetchRequest.partitionKey && fetchRequest.rowKey && !fetchRequest.filter.length && !fetchRequest.resultContinuation;
+	if (!pointRead) {
+		[self fetchEntitiesWithRequest:fetchRequest usingCompletionHandler:block];
+		return;
+	}
+
+	WATableEntity *entity = [cache entityForTable:fetchRequest.tableName partitionKey:fetchRequest.partitionKey rowKey:fetchRequest.rowKey];
+	if (entity) {
+		block([NSArray arrayWithObject:entity], nil, nil);
+		return;
+	}
+
+	[self fetchEntitiesWithRequest:fetchRequest usingCompletionHandler:^(NSArray *entities, WAResultContinuation *resultContinuation, NSError *error) {
+		if (!error && entities.count == 1) {
+			[cache storeEntity:[entities objectAtIndex:0]];
+		}
+		block(entities, resultContinuation, error);
+	}];
+}
+
+#pragma mark - Write invalidation
+
+- (BOOL)wa_cacheUpdateEntity:(WATableEntity *)existingEntity
+{
+	[self.entityCache invalidateEntity:existingEntity];
+	return [self wa_cacheUpdateEntity:existingEntity];
+}
+
+- (BOOL)wa_cacheMergeEntity:(WATableEntity *)existingEntity
+{
+	[self.entityCache invalidateEntity:existingEntity];
+	return [self wa_cacheMergeEntity:existingEntity];
+}
+
+- (BOOL)wa_cacheDeleteEntity:(WATableEntity *)existingEntity
+{
+	[self.entityCache invalidateEntity:existingEntity];
+	return [self wa_cacheDeleteEntity:existingEntity];
+}
+
+- (BOOL)wa_cacheUpdateEntity:(WATableEntity *)existingEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	WATableEntityCache *cache = self.entityCache;
+	[cache invalidateEntity:existingEntity];
+	// the library only notifies the delegate when the block is nil, so a nil block is passed through
+	if (!cache || !block) {
+		return [self wa_cacheUpdateEntity:existingEntity withCompletionHandler:block];
+	}
+
+	return [self wa_cacheUpdateEntity:existingEntity withCompletionHandler:^(NSError *error) {
+		// a read that was in flight during the write may have stored the old version again
+		[cache invalidateEntity:existingEntity];
+		block(error);
+	}];
+}
+
+- (BOOL)wa_cacheMergeEntity:(WATableEntity *)existingEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	WATableEntityCache *cache = self.entityCache;
+	[cache invalidateEntity:existingEntity];
+	if (!cache || !block) {
+		return [self wa_cacheMergeEntity:existingEntity withCompletionHandler:block];
+	}
+
+	return [self wa_cacheMergeEntity:existingEntity withCompletionHandler:^(NSError *error) {
+		[cache invalidateEntity:existingEntity];
+		block(error);
+	}];
+}
+
+- (BOOL)wa_cacheDeleteEntity:(WATableEntity *)existingEntity withCompletionHandler:(void (^)(NSError *error))block
+{
+	WATableEntityCache *cache = self.entityCache;
+	[cache invalidateEntity:existingEntity];
+	if (!cache || !block) {
+		return [self wa_cacheDeleteEntity:existingEntity withCompletionHandler:block];
+	}
+
+	return [self wa_cacheDeleteEntity:existingEntity withCompletionHandler:^(NSError *error) {
+		[cache invalidateEntity:existingEntity];
+		block(error);
+	}];
+}
+
+@end
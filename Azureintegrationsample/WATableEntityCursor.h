@@ -0,0 +1,119 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+@class WATableFetchRequest;
+@class WAResultContinuation;
+
+/**
+ The default number of pages a cursor keeps in flight or buffered ahead of the consumer.
+ */
+#define WATableEntityCursorDefaultPrefetchDepth 2
+
+/**
+ The reason code of the error reported by nextPageWithCompletionHandler: when a page is already being waited for.
+ */
+extern NSString * const WATableEntityCursorBusyReasonCode;
+
+/**
+ A cursor that walks all the pages of a table query, following the result continuations automatically.
+
+ The next page is requested as soon as the continuation of the current one arrives in the response headers, so network and parse time of consecutive pages overlap. At most prefetchDepth pages are in flight or waiting to be consumed at any time; once that many are outstanding the cursor stops requesting pages until the consumer catches up.
+
+ Pages are always delivered in order. All callbacks are made on the client's callbackQueue if it has one, otherwise on the run loop of the thread that created the cursor, even when the responses are processed on the client's workQueue; the cursor should be used from that queue or thread.
+ */
+@interface WATableEntityCursor : NSObject {
+@private
+	WACloudStorageClient *_client;
+	NSThread *_thread;
+	WATableFetchRequest *_fetchRequest;
+	NSUInteger _prefetchDepth;
+	WAResultContinuation *_pendingContinuation;
+	BOOL _hasPendingPage;
+	BOOL _exhausted;
+	BOOL _cancelled;
+	NSUInteger _issuedPages;
+	NSUInteger _deliveredPages;
+	NSMutableDictionary *_completedPages;
+	NSError *_error;
+	NSUInteger _errorPage;
+	BOOL _errorDelivered;
+	void (^_pageHandler)(NSArray *entities, NSError *error);
+}
+
+/**
+ The maximum number of pages in flight or buffered ahead of the consumer.
+ */
+@property (readonly) NSUInteger prefetchDepth;
+
+/**
+ The zero-based index of the page last handed to the consumer, so 0 in the completion handler that receives the first page, or NSNotFound before any page has been handed over.
+ */
+@property (readonly) NSUInteger pageIndex;
+
+/**
+ Determines whether the cursor has nothing more to return, because all the pages or an error have been handed to the consumer.
+ */
+@property (readonly) BOOL isFinished;
+
+/**
+ Initializes a newly created cursor. The first page is requested immediately.
+
+ @param client The storage client whose credential is used for the requests.
+ @param fetchRequest The request for the first page. Its result continuation, if any, is where the cursor starts.
+ @param prefetchDepth The maximum number of pages in flight or buffered ahead of the consumer. Must be at least 1.
+
+ @returns The newly initialized WATableEntityCursor object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client fetchRequest:(WATableFetchRequest *)fetchRequest prefetchDepth:(NSUInteger)prefetchDepth;
+
+/**
+ Returns the next page of entities.
+
+ Only one request for a page may be outstanding at a time. While one is, further requests are rejected: their block is called immediately with an error with the reason code WATableEntityCursorBusyReasonCode, and the outstanding request is unaffected.
+
+ @param block A block object called with the next page of WATableEntity objects. The array is nil once all the pages have been returned, or if an error occurs; no further pages are returned after an error, and the cursor is finished.
+ */
+- (void)nextPageWithCompletionHandler:(void (^)(NSArray *entities, NSError *error))block;
+
+/**
+ Stops requesting pages and discards any that are buffered. Pending completion handlers are not called.
+ */
+- (void)cancel;
+
+@end
+
+/**
+ Cursor based fetching for WACloudStorageClient.
+ */
+@interface WACloudStorageClient (Cursor)
+
+/**
+ Creates a cursor that walks all the pages of a table query.
+
+ @param fetchRequest The request for the first page.
+ @param prefetchDepth The maximum number of pages in flight or buffered ahead of the consumer.
+
+ @returns A new cursor that has already requested the first page.
+
+ @see WATableEntityCursor
+ */
+- (WATableEntityCursor *)entityCursorWithRequest:(WATableFetchRequest *)fetchRequest prefetchDepth:(NSUInteger)prefetchDepth;
+
+@end
@@ -0,0 +1,230 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableEntityCursor.h"
+
+#import "WACloudStorageClient+Dispatch.h"
+#import "WACloudStorageClient+Streaming.h"
+#import "WAResultContinuation.h"
+#import "WATableFetchRequest+Query.h"
+#import "WAToolkitPrivate.h"
+
+NSString * const WATableEntityCursorBusyReasonCode = @"CursorBusy";
+
+@interface WATableEntityCursor ()
+
+- (void)performBlock:(void (^)(void))block;
+- (void)runBlock:(void (^)(void))block;
+- (void)issuePages;
+- (void)deliverPage;
+- (void)didReceiveContinuation:(WAResultContinuation *)resultContinuation;
+- (void)didCompletePage:(NSUInteger)page entities:(NSArray *)entities error:(NSError *)error;
+
+@end
+
+@implementation WATableEntityCursor
+
+@synthesize prefetchDepth = _prefetchDepth;
+
+- (id)initWithClient:(WACloudStorageClient *)client fetchRequest:(WATableFetchRequest *)fetchRequest prefetchDepth:(NSUInteger)prefetchDepth
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_client = [client retain];
+	_thread = [[NSThread currentThread] retain];
+	_fetchRequest = [fetchRequest retain];
+	_prefetchDepth = MAX(prefetchDepth, 1);
+	_completedPages = [[NSMutableDictionary alloc] initWithCapacity:_prefetchDepth];
+	_pendingContinuation = [fetchRequest.resultContinuation retain];
+	_hasPendingPage = YES;
+
+	[self issuePages];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_client release];
+	[_thread release];
+	[_fetchRequest release];
+	[_pendingContinuation release];
+	[_completedPages release];
+	[_error release];
+	[_pageHandler release];
+	[super dealloc];
+}
+
+- (NSUInteger)pageIndex
+{
+	return _deliveredPages ? _deliveredPages - 1 : NSNotFound;
+}
+
+- (BOOL)isFinished
+{
+	return _errorDelivered || (_exhausted && _deliveredPages == _issuedPages);
+}
+
+- (void)nextPageWithCompletionHandler:(void (^)(NSArray *entities, NSError *error))block
+{
+	if (_pageHandler) {
+		block(nil, WAToolkitError(-1, WATableEntityCursorBusyReasonCode, @"A page is already being fetched."));
+		return;
+	}
+
+	_pageHandler = [block copy];
+
+	[self deliverPage];
+}
+
+- (void)cancel
+{
+	_cancelled = YES;
+	_hasPendingPage = NO;
+	[_completedPages removeAllObjects];
+	[_pageHandler release];
+	_pageHandler = nil;
+}
+
+#pragma mark - Private
+
+- (void)performBlock:(void (^)(void))block
+{
+	// with only a work queue the handlers arrive there; the cursor's state belongs to its thread
+	if (_client.callbackQueue || [NSThread currentThread] == _thread) {
+		block();
+		return;
+	}
+
+	void (^copied)(void) = [block copy];
+	[self performSelector:@selector(runBlock:) onThread:_thread withObject:copied waitUntilDone:NO modes:[NSArray arrayWithObject:NSRunLoopCommonModes]];
+	[copied release];
+}
+
+- (void)runBlock:(void (^)(void))block
+{
+	block();
+}
+
+- (void)issuePages
+{
+	// a page can only be requested once the continuation of the previous one is known
+	if (_cancelled || _error || !_hasPendingPage || _issuedPages - _deliveredPages >= _prefetchDepth) {
+		return;
+	}
+
+	NSUInteger page = _issuedPages++;
+	WATableFetchRequest *request = [_fetchRequest fetchRequestWithResultContinuation:_pendingContinuation];
+	NSMutableArray *entities = [NSMutableArray arrayWithCapacity:MAX(request.topRows, 0)];
+
+	_hasPendingPage = NO;
+	[_pendingContinuation release];
+	_pendingContinuation = nil;
+
+	// the blocks retain the cursor until the page completes
+	[_client fetchEntitiesWithRequest:request usingEntityHandler:^(WATableEntity *entity) {
+		[entities addObject:entity];
+	} continuationHandler:^(WAResultContinuation *resultContinuation) {
+		[self performBlock:^{
+			[self didReceiveContinuation:resultContinuation];
+		}];
+	} completionHandler:^(WAResultContinuation *resultContinuation, NSError *error) {
+		// the entities array is only touched where the page is parsed until here
+		[self performBlock:^{
+			[self didCompletePage:page entities:entities error:error];
+		}];
+	}];
+}
+
+- (void)didReceiveContinuation:(WAResultContinuation *)resultContinuation
+{
+	if (_cancelled) {
+		return;
+	}
+
+	if (resultContinuation.hasContinuation) {
+		[_pendingContinuation release];
+		_pendingContinuation = [resultContinuation retain];
+		_hasPendingPage = YES;
+	} else {
+		_exhausted = YES;
+	}
+
+	[self issuePages];
+}
+
+- (void)didCompletePage:(NSUInteger)page entities:(NSArray *)entities error:(NSError *)error
+{
+	if (_cancelled) {
+		return;
+	}
+
+	if (error) {
+		LOGLINE(@"Page %lu of %@ failed: %@", (unsigned long)page, _fetchRequest.tableName, error);
+		if (!_error || page < _errorPage) {
+			[_error release];
+			_error = [error retain];
+			_errorPage = page;
+		}
+		_hasPendingPage = NO;
+	} else {
+		[_completedPages setObject:entities forKey:[NSNumber numberWithUnsignedInteger:page]];
+	}
+
+	[self deliverPage];
+}
+
+- (void)deliverPage
+{
+	if (!_pageHandler) {
+		return;
+	}
+
+	NSNumber *key = [NSNumber numberWithUnsignedInteger:_deliveredPages];
+	NSArray *entities = [[[_completedPages objectForKey:key] retain] autorelease];
+	void (^block)(NSArray *, NSError *) = [_pageHandler autorelease];
+
+	if (entities) {
+		_pageHandler = nil;
+		[_completedPages removeObjectForKey:key];
+		_deliveredPages++;
+		[self issuePages];
+		block(entities, nil);
+	} else if (_error && _errorPage == _deliveredPages) {
+		_pageHandler = nil;
+		_errorDelivered = YES;
+		block(nil, _error);
+	} else if (self.isFinished) {
+		_pageHandler = nil;
+		block(nil, nil);
+	} else {
+		// still waiting for the page; keep the handler
+		[_pageHandler retain];
+	}
+}
+
+@end
+
+@implementation WACloudStorageClient (Cursor)
+
+- (WATableEntityCursor *)entityCursorWithRequest:(WATableFetchRequest *)fetchRequest prefetchDepth:(NSUInteger)prefetchDepth
+{
+	return [[[WATableEntityCursor alloc] initWithClient:self fetchRequest:fetchRequest prefetchDepth:prefetchDepth] autorelease];
+}
+
+@end
@@ -0,0 +1,69 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableFetchRequest.h"
+
+/**
+ Builds the table service query for a fetch request, for use by requests that are sent without going through WACloudStorageClient.
+ */
+@interface WATableFetchRequest (Query)
+
+/**
+ The names of the properties to return, or nil for all of them.
+
+ The request asks the service for these properties only, with $select, and entities decoded from the response have only the selected properties that are not null. PartitionKey, RowKey and Timestamp are always returned, as entities cannot be identified without them. The projection is honored by the fetches of WACloudStorageClient (Streaming) and by the cursors and scans built on them; fetches made through the document based methods of WACloudStorageClient return every property.
+ */
+@property (copy) NSArray *selectedProperties;
+
+/**
+ The types of properties, as NSNumber objects holding a WAEdmType keyed by property name, for decoding responses that do not carry types: those in WATableWireFormatJSONNoMetadata. Without a type, a string value is decoded as Edm.String, so Edm.DateTime, Edm.Int64, Edm.Binary and Edm.Guid properties need one. Other formats ignore it.
+ */
+@property (copy) NSDictionary *propertyTypes;
+
+/**
+ The position of the page the request fetches in a sequence of pages: 0 for a request made directly, and one more than the request it was made from for one made with fetchRequestWithResultContinuation:. Reported in request metrics.
+ */
+@property (assign) NSUInteger pageIndex;
+
+/**
+ The URL encoded resource path of the query, for example /Customers() or /Customers(PartitionKey='a',RowKey='b').
+ */
+- (NSString *)queryPath;
+
+/**
+ The URL encoded query string with the filter, projection, row limit and continuation of the request, without the leading question mark.
+ */
+- (NSString *)queryString;
+
+/**
+ Returns a copy of the request that fetches the page identified by a result continuation.
+
+ @param resultContinuation The continuation returned with the previous page.
+
+ @returns A new WATableFetchRequest with the same table, keys, filter, projection and row limit, and the next page index.
+ */
+- (WATableFetchRequest *)fetchRequestWithResultContinuation:(WAResultContinuation *)resultContinuation;
+
+@end
+
+/**
+ Returns value quoted as an OData string literal, with embedded quotes escaped.
+
+ @param value The string value.
+
+ @returns The quoted literal, for example 'O''Brien'.
+ */
+extern NSString *WAODataStringLiteral(NSString *value);
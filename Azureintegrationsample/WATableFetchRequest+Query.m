@@ -0,0 +1,141 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableFetchRequest+Query.h"
+
+#import <objc/runtime.h>
+
+#import "WAResultContinuation.h"
+#import "WAToolkitPrivate.h"
+
+static char WASelectedPropertiesKey;
+static char WAPropertyTypesKey;
+static char WAPageIndexKey;
+
+NSString *WAODataStringLiteral(NSString *value)
+{
+	return [NSString stringWithFormat:@"'%@'", [value stringByReplacingOccurrencesOfString:@"'" withString:@"''"]];
+}
+
+@implementation WATableFetchRequest (Query)
+
+- (NSArray *)selectedProperties
+{
+	return objc_getAssociatedObject(self, &WASelectedPropertiesKey);
+}
+
+- (void)setSelectedProperties:(NSArray *)selectedProperties
+{
+	objc_setAssociatedObject(self, &WASelectedPropertiesKey, selectedProperties, OBJC_ASSOCIATION_COPY);
+}
+
+- (NSDictionary *)propertyTypes
+{
+	return objc_getAssociatedObject(self, &WAPropertyTypesKey);
+}
+
+- (void)setPropertyTypes:(NSDictionary *)propertyTypes
+{
+	objc_setAssociatedObject(self, &WAPropertyTypesKey, propertyTypes, OBJC_ASSOCIATION_COPY);
+}
+
+- (NSUInteger)pageIndex
+{
+	return [objc_getAssociatedObject(self, &WAPageIndexKey) unsignedIntegerValue];
+}
+
+- (void)setPageIndex:(NSUInteger)pageIndex
+{
+	objc_setAssociatedObject(self, &WAPageIndexKey, pageIndex ? [NSNumber numberWithUnsignedInteger:pageIndex] : nil, OBJC_ASSOCIATION_RETAIN);
+}
+
+- (NSString *)queryPath
+{
+	NSString *table = WAURLEncodedString(self.tableName);
+
+	// a point query needs both keys; a single key becomes part of the filter instead
+	if (self.partitionKey && self.rowKey) {
+		return [NSString stringWithFormat:@"/%@(PartitionKey=%@,RowKey=%@)", table,
+				WAURLEncodedString(WAODataStringLiteral(self.partitionKey)),
+				WAURLEncodedString(WAODataStringLiteral(self.rowKey))];
+	}
+
+	return [NSString stringWithFormat:@"/%@()", table];
+}
+
+- (NSString *)queryString
+{
+	NSMutableArray *clauses = [NSMutableArray arrayWithCapacity:3];
+	if (self.filter.length) {
+		[clauses addObject:[NSString stringWithFormat:@"(%@)", self.filter]];
+	}
+	if (!(self.partitionKey && self.rowKey)) {
+		if (self.partitionKey) {
+			[clauses addObject:[NSString stringWithFormat:@"(PartitionKey eq %@)", WAODataStringLiteral(self.partitionKey)]];
+		}
+		if (self.rowKey) {
+			[clauses addObject:[NSString stringWithFormat:@"(RowKey eq %@)", WAODataStringLiteral(self.rowKey)]];
+		}
+	}
+
+	NSMutableArray *parameters = [NSMutableArray arrayWithCapacity:5];
+	if (clauses.count) {
+		[parameters addObject:[NSString stringWithFormat:@"$filter=%@", WAURLEncodedString([clauses componentsJoinedByString:@" and "])]];
+	}
+
+	NSArray *selectedProperties = self.selectedProperties;
+	if (selectedProperties) {
+		NSMutableArray *names = [NSMutableArray arrayWithObjects:@"PartitionKey", @"RowKey", @"Timestamp", nil];
+		for (NSString *name in selectedProperties) {
+			if (![names containsObject:name]) {
+				[names addObject:name];
+			}
+		}
+		[parameters addObject:[NSString stringWithFormat:@"$select=%@", WAURLEncodedString([names componentsJoinedByString:@","])]];
+	}
+	if (self.topRows > 0) {
+		[parameters addObject:[NSString stringWithFormat:@"$top=%ld", (long)self.topRows]];
+	}
+
+	WAResultContinuation *continuation = self.resultContinuation;
+	if (continuation.continuationType == WAContinuationEntity) {
+		if (continuation.nextPartitionKey) {
+			[parameters addObject:[NSString stringWithFormat:@"NextPartitionKey=%@", WAURLEncodedString(continuation.nextPartitionKey)]];
+		}
+		if (continuation.nextRowKey) {
+			[parameters addObject:[NSString stringWithFormat:@"NextRowKey=%@", WAURLEncodedString(continuation.nextRowKey)]];
+		}
+	}
+
+	return [parameters componentsJoinedByString:@"&"];
+}
+
+- (WATableFetchRequest *)fetchRequestWithResultContinuation:(WAResultContinuation *)resultContinuation
+{
+	WATableFetchRequest *request = [WATableFetchRequest fetchRequestForTable:self.tableName];
+	request.partitionKey = self.partitionKey;
+	request.rowKey = self.rowKey;
+	request.filter = self.filter;
+	request.topRows = self.topRows;
+	request.selectedProperties = self.selectedProperties;
+	request.propertyTypes = self.propertyTypes;
+	request.resultContinuation = resultContinuation;
+	request.pageIndex = self.pageIndex + 1;
+
+	return request;
+}
+
+@end
@@ -0,0 +1,189 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class WACloudStorageClient;
+
+/**
+ The characters used to split a partition key range when no prefixes are given: digits, then upper and lower case letters.
+ */
+extern NSString * const WAPartitionKeyDefaultPrefixes;
+
+/**
+ A half open range of partition keys, [lowerBound, upperBound).
+ */
+@interface WAPartitionKeyRange : NSObject {
+@private
+	NSString *_lowerBound;
+	NSString *_upperBound;
+}
+
+/**
+ The first partition key in the range, or nil if the range is unbounded below.
+ */
+@property (readonly) NSString *lowerBound;
+
+/**
+ The partition key just past the end of the range, or nil if the range is unbounded above.
+ */
+@property (readonly) NSString *upperBound;
+
+/**
+ Creates a new range.
+
+ @param lowerBound The first partition key in the range, or nil.
+ @param upperBound The partition key just past the end of the range, or nil.
+
+ @returns The newly initialized WAPartitionKeyRange object.
+ */
++ (WAPartitionKeyRange *)rangeWithLowerBound:(NSString *)lowerBound upperBound:(NSString *)upperBound;
+
+/**
+ Splits a range at every single character prefix that falls inside it.
+
+ For example splitting the unbounded range at "0123456789" gives [nil, "0"), ["0", "1"), ... ["9", nil).
+
+ @param range The range to split.
+ @param prefixes The characters to split at. Pass nil to use WAPartitionKeyDefaultPrefixes.
+
+ @returns An array of WAPartitionKeyRange objects covering the same keys, in key order.
+ */
++ (NSArray *)rangesBySplittingRange:(WAPartitionKeyRange *)range atPrefixes:(NSString *)prefixes;
+
+/**
+ Initializes a newly created range.
+
+ @param lowerBound The first partition key in the range, or nil.
+ @param upperBound The partition key just past the end of the range, or nil.
+
+ @returns The newly initialized WAPartitionKeyRange object.
+ */
+- (id)initWithLowerBound:(NSString *)lowerBound upperBound:(NSString *)upperBound;
+
+/**
+ The table query filter selecting the keys of the range, or nil for the unbounded range.
+ */
+- (NSString *)filterString;
+
+@end
+
+/**
+ Determines how a WATableScan merges the pages of its ranges.
+ */
+typedef enum {
+	WATableScanUnordered = 0,
+	WATableScanOrdered = 1
+} WATableScanOrdering;
+
+/**
+ A scan engine that reads a table by querying several partition key ranges at the same time.
+
+ Each range is read with its own WATableEntityCursor and a filter restricting it to the range, so the ranges do not wait on each other's continuations. At most maxConcurrentRanges ranges are read at once; the rest start as earlier ones finish.
+
+ With WATableScanUnordered, pages are handed to the page handler as soon as they arrive from any range. With WATableScanOrdered, pages are handed over in partition key order: pages of later ranges are held back until the earlier ranges are complete, and a held back range stops reading once its cursor's prefetch window is full.
+ */
+@interface WATableScan : NSObject {
+@private
+	WACloudStorageClient *_client;
+	NSString *_tableName;
+	NSArray *_ranges;
+	NSString *_filter;
+	NSArray *_selectedProperties;
+	NSDictionary *_propertyTypes;
+	NSInteger _topRows;
+	NSUInteger _maxConcurrentRanges;
+	NSUInteger _prefetchDepth;
+	WATableScanOrdering _ordering;
+	NSMutableArray *_states;
+	NSUInteger _nextRange;
+	NSUInteger _headRange;
+	NSUInteger _activeRanges;
+	BOOL _running;
+	void (^_pageHandler)(NSArray *entities);
+	void (^_completionHandler)(NSError *error);
+}
+
+/**
+ The table to scan.
+ */
+@property (readonly) NSString *tableName;
+
+/**
+ The WAPartitionKeyRange objects to scan, in key order.
+ */
+@property (readonly) NSArray *ranges;
+
+/**
+ An additional filter applied to every range, or nil.
+ */
+@property (copy) NSString *filter;
+
+/**
+ The names of the properties to return, or nil for all of them. See WATableFetchRequest (Query).
+ */
+@property (copy) NSArray *selectedProperties;
+
+/**
+ The types of properties for responses that do not carry them, or nil. See WATableFetchRequest (Query).
+ */
+@property (copy) NSDictionary *propertyTypes;
+
+/**
+ The number of rows to request per page. The default is 1000.
+ */
+@property (assign) NSInteger topRows;
+
+/**
+ The maximum number of ranges read at the same time. The default is 4.
+ */
+@property (assign) NSUInteger maxConcurrentRanges;
+
+/**
+ The prefetch depth of the cursor of each range. The default is WATableEntityCursorDefaultPrefetchDepth.
+ */
+@property (assign) NSUInteger prefetchDepth;
+
+/**
+ How the pages of the ranges are merged. The default is WATableScanUnordered.
+ */
+@property (assign) WATableScanOrdering ordering;
+
+/**
+ Initializes a newly created scan.
+
+ @param client The storage client whose credential is used for the requests.
+ @param tableName The table to scan.
+ @param ranges The WAPartitionKeyRange objects to scan, in key order. The ranges must not overlap.
+
+ @returns The newly initialized WATableScan object.
+ */
+- (id)initWithClient:(WACloudStorageClient *)client tableName:(NSString *)tableName ranges:(NSArray *)ranges;
+
+/**
+ Starts the scan.
+
+ @param pageHandler A block object called with each page of WATableEntity objects.
+ @param block A block object called once every range has been read, or with the first error that occurs. No pages are handed over after an error.
+ */
+- (void)startWithPageHandler:(void (^)(NSArray *entities))pageHandler completionHandler:(void (^)(NSError *error))block;
+
+/**
+ Stops the scan. The completion handler is not called.
+ */
+- (void)cancel;
+
+@end
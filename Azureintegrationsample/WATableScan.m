@@ -0,0 +1,334 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableScan.h"
+
+#import "WATableEntityCursor.h"
+#import "WATableFetchRequest.h"
+#import "WATableFetchRequest+Query.h"
+
+NSString * const WAPartitionKeyDefaultPrefixes = @"0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+@implementation WAPartitionKeyRange
+
+@synthesize lowerBound = _lowerBound;
+@synthesize upperBound = _upperBound;
+
++ (WAPartitionKeyRange *)rangeWithLowerBound:(NSString *)lowerBound upperBound:(NSString *)upperBound
+{
+	return [[[self alloc] initWithLowerBound:lowerBound upperBound:upperBound] autorelease];
+}
+
++ (NSArray *)rangesBySplittingRange:(WAPartitionKeyRange *)range atPrefixes:(NSString *)prefixes
+{
+	if (!prefixes.length) {
+		prefixes = WAPartitionKeyDefaultPrefixes;
+	}
+
+	NSMutableArray *boundaries = [NSMutableArray arrayWithCapacity:prefixes.length];
+	for (NSUInteger i = 0; i < prefixes.length; i++) {
+		NSString *boundary = [prefixes substringWithRange:NSMakeRange(i, 1)];
+		BOOL aboveLower = !range.lowerBound || [boundary compare:range.lowerBound options:NSLiteralSearch] == NSOrderedDescending;
+		BOOL belowUpper = !range.upperBound || [boundary compare:range.upperBound options:NSLiteralSearch] == NSOrderedAscending;
+		if (aboveLower && belowUpper && ![boundaries containsObject:boundary]) {
+			[boundaries addObject:boundary];
+		}
+	}
+	[boundaries sortUsingComparator:^NSComparisonResult(NSString *a, NSString *b) {
+		return [a compare:b options:NSLiteralSearch];
+	}];
+
+	NSMutableArray *ranges = [NSMutableArray arrayWithCapacity:boundaries.count + 1];
+	NSString *lower = range.lowerBound;
+	for (NSString *boundary in boundaries) {
+		[ranges addObject:[WAPartitionKeyRange rangeWithLowerBound:lower upperBound:boundary]];
+		lower = boundary;
+	}
+	[ranges addObject:[WAPartitionKeyRange rangeWithLowerBound:lower upperBound:range.upperBound]];
+
+	return ranges;
+}
+
+- (id)initWithLowerBound:(NSString *)lowerBound upperBound:(NSString *)upperBound
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_lowerBound = [lowerBound copy];
+	_upperBound = [upperBound copy];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_lowerBound release];
+	[_upperBound release];
+	[super dealloc];
+}
+
+- (NSString *)filterString
+{
+	if (_lowerBound && _upperBound) {
+		return [NSString stringWithFormat:@"PartitionKey ge %@ and PartitionKey lt %@", WAODataStringLiteral(_lowerBound), WAODataStringLiteral(_upperBound)];
+	} else if (_lowerBound) {
+		return [NSString stringWithFormat:@"PartitionKey ge %@", WAODataStringLiteral(_lowerBound)];
+	} else if (_upperBound) {
+		return [NSString stringWithFormat:@"PartitionKey lt %@", WAODataStringLiteral(_upperBound)];
+	}
+
+	return nil;
+}
+
+- (NSString *)description
+{
+	return [NSString stringWithFormat:@"PartitionKeyRange { [%@, %@) }", _lowerBound, _upperBound];
+}
+
+@end
+
+/*
+ The progress of a single range of a scan.
+ */
+@interface WATableScanRangeState : NSObject {
+@public
+	NSUInteger index;
+	WAPartitionKeyRange *range;
+	WATableEntityCursor *cursor;
+	NSMutableArray *heldPages;
+	BOOL reading;
+	BOOL finished;
+}
+
+@end
+
+@implementation WATableScanRangeState
+
+- (void)dealloc
+{
+	[range release];
+	[cursor release];
+	[heldPages release];
+	[super dealloc];
+}
+
+@end
+
+@interface WATableScan ()
+
+- (void)startRanges;
+- (void)readRange:(WATableScanRangeState *)state;
+- (void)range:(WATableScanRangeState *)state didReadPage:(NSArray *)entities error:(NSError *)error;
+- (void)advanceHead;
+- (void)finishWithError:(NSError *)error;
+
+@end
+
+@implementation WATableScan
+
+@synthesize tableName = _tableName;
+@synthesize ranges = _ranges;
+@synthesize filter = _filter;
+@synthesize selectedProperties = _selectedProperties;
+@synthesize propertyTypes = _propertyTypes;
+@synthesize topRows = _topRows;
+@synthesize maxConcurrentRanges = _maxConcurrentRanges;
+@synthesize prefetchDepth = _prefetchDepth;
+@synthesize ordering = _ordering;
+
+- (id)initWithClient:(WACloudStorageClient *)client tableName:(NSString *)tableName ranges:(NSArray *)ranges
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_client = [client retain];
+	_tableName = [tableName copy];
+	_ranges = [ranges copy];
+	_topRows = 1000;
+	_maxConcurrentRanges = 4;
+	_prefetchDepth = WATableEntityCursorDefaultPrefetchDepth;
+	_ordering = WATableScanUnordered;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_client release];
+	[_tableName release];
+	[_ranges release];
+	[_filter release];
+	[_selectedProperties release];
+	[_propertyTypes release];
+	[_states release];
+	[_pageHandler release];
+	[_completionHandler release];
+	[super dealloc];
+}
+
+- (void)startWithPageHandler:(void (^)(NSArray *entities))pageHandler completionHandler:(void (^)(NSError *error))block
+{
+	NSAssert(!_running, @"The scan has already been started.");
+
+	_pageHandler = [pageHandler copy];
+	_completionHandler = [block copy];
+	_states = [[NSMutableArray alloc] initWithCapacity:_ranges.count];
+
+	NSUInteger index = 0;
+	for (WAPartitionKeyRange *range in _ranges) {
+		WATableScanRangeState *state = [[WATableScanRangeState alloc] init];
+		state->index = index++;
+		state->range = [range retain];
+		state->heldPages = [[NSMutableArray alloc] init];
+		[_states addObject:state];
+		[state release];
+	}
+
+	_running = YES;
+	[self startRanges];
+
+	if (!_ranges.count) {
+		[self finishWithError:nil];
+	}
+}
+
+- (void)cancel
+{
+	_running = NO;
+	for (WATableScanRangeState *state in _states) {
+		[state->cursor cancel];
+	}
+
+	[_pageHandler release];
+	_pageHandler = nil;
+	[_completionHandler release];
+	_completionHandler = nil;
+}
+
+#pragma mark - Private
+
+- (void)startRanges
+{
+	while (_running && _activeRanges < MAX(_maxConcurrentRanges, 1) && _nextRange < _states.count) {
+		WATableScanRangeState *state = [_states objectAtIndex:_nextRange++];
+
+		NSString *rangeFilter = [state->range filterString];
+		WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:_tableName];
+		fetchRequest.topRows = _topRows;
+		fetchRequest.selectedProperties = _selectedProperties;
+		fetchRequest.propertyTypes = _propertyTypes;
+		if (rangeFilter && _filter.length) {
+			fetchRequest.filter = [NSString stringWithFormat:@"(%@) and (%@)", rangeFilter, _filter];
+		} else {
+			fetchRequest.filter = rangeFilter ? rangeFilter : _filter;
+		}
+
+		state->cursor = [[_client entityCursorWithRequest:fetchRequest prefetchDepth:_prefetchDepth] retain];
+		_activeRanges++;
+		[self readRange:state];
+	}
+}
+
+- (void)readRange:(WATableScanRangeState *)state
+{
+	state->reading = YES;
+	[state->cursor nextPageWithCompletionHandler:^(NSArray *entities, NSError *error) {
+		[self range:state didReadPage:entities error:error];
+	}];
+}
+
+- (void)range:(WATableScanRangeState *)state didReadPage:(NSArray *)entities error:(NSError *)error
+{
+	state->reading = NO;
+	if (!_running) {
+		return;
+	}
+
+	if (error) {
+		LOGLINE(@"Scan of %@ failed in %@: %@", _tableName, state->range, error);
+		[self finishWithError:error];
+		return;
+	}
+
+	if (!entities) {
+		state->finished = YES;
+		_activeRanges--;
+
+		if (_ordering == WATableScanOrdered) {
+			[self advanceHead];
+		}
+		[self startRanges];
+
+		if (_running && _activeRanges == 0 && _nextRange == _states.count) {
+			[self finishWithError:nil];
+		}
+		return;
+	}
+
+	if (_ordering == WATableScanUnordered || state->index == _headRange) {
+		// the handler may cancel the scan, which releases it while it runs
+		void (^pageHandler)(NSArray *) = [[_pageHandler retain] autorelease];
+		pageHandler(entities);
+		if (_running) {
+			[self readRange:state];
+		}
+	} else {
+		// hold the page back until the earlier ranges are complete; the cursor keeps prefetching meanwhile
+		[state->heldPages addObject:entities];
+	}
+}
+
+- (void)advanceHead
+{
+	// the handler may cancel the scan, which releases it while it runs
+	void (^pageHandler)(NSArray *) = [[_pageHandler retain] autorelease];
+
+	while (_running && _headRange < _states.count) {
+		WATableScanRangeState *state = [_states objectAtIndex:_headRange];
+
+		while (_running && state->heldPages.count) {
+			NSArray *entities = [[[state->heldPages objectAtIndex:0] retain] autorelease];
+			[state->heldPages removeObjectAtIndex:0];
+			pageHandler(entities);
+		}
+		if (!_running) {
+			return;
+		}
+
+		if (!state->finished) {
+			if (state->cursor && !state->reading) {
+				[self readRange:state];
+			}
+			return;
+		}
+
+		_headRange++;
+	}
+}
+
+- (void)finishWithError:(NSError *)error
+{
+	void (^block)(NSError *) = [[_completionHandler retain] autorelease];
+	[self cancel];
+
+	if (block) {
+		block(error);
+	}
+}
+
+@end
@@ -0,0 +1,66 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+#import "WACloudStorageClient.h"
+
+/**
+ The format table entities are exchanged in.
+ */
+typedef enum {
+	/** Atom entries, as sent by the toolkit. */
+	WATableWireFormatAtom = 0,
+	/** JSON with no metadata: property values only, with no type annotations. Smallest on the wire; property types other than string, number and boolean are lost unless the fetch request declares them. */
+	WATableWireFormatJSONNoMetadata,
+	/** JSON with minimal metadata: property values with type annotations for the types JSON cannot express, such as Edm.DateTime and Edm.Int64. */
+	WATableWireFormatJSONMinimalMetadata
+} WATableWireFormat;
+
+/**
+ The x-ms-version sent with table requests in a JSON format, the first version of the service that accepts JSON.
+ */
+extern NSString * const WAStorageJSONServiceVersion;
+
+/**
+ Sets the headers that negotiate a wire format on a table request built by WASharedKeySigner. Call before signing the request.
+
+ @param request The request.
+ @param wireFormat The format.
+ */
+extern void WATableWireFormatPrepareRequest(NSMutableURLRequest *request, WATableWireFormat wireFormat);
+
+/**
+ Returns whether a format is one of the JSON formats.
+ */
+static inline BOOL WATableWireFormatIsJSON(WATableWireFormat wireFormat)
+{
+	return wireFormat == WATableWireFormatJSONNoMetadata || wireFormat == WATableWireFormatJSONMinimalMetadata;
+}
+
+/**
+ The wire format of the table requests sent by the extensions: streaming fetches, and the cursors, scans and caches built on them, and entity group transactions. Requests sent by the toolkit itself, such as insertEntity:, always use Atom.
+ */
+@interface WACloudStorageClient (WireFormat)
+
+/**
+ The format entities are exchanged in. The default is WATableWireFormatAtom.
+
+ The JSON formats are typically a half to a quarter of the size of Atom and are much cheaper to parse.
+ */
+@property (assign) WATableWireFormat tableWireFormat;
+
+@end
@@ -0,0 +1,49 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableWireFormat.h"
+
+#import <objc/runtime.h>
+
+NSString * const WAStorageJSONServiceVersion = @"2013-08-15";
+
+static char WATableWireFormatKey;
+
+void WATableWireFormatPrepareRequest(NSMutableURLRequest *request, WATableWireFormat wireFormat)
+{
+	if (!WATableWireFormatIsJSON(wireFormat)) {
+		return;
+	}
+
+	[request setValue:WAStorageJSONServiceVersion forHTTPHeaderField:@"x-ms-version"];
+	[request setValue:@"3.0;NetFx" forHTTPHeaderField:@"DataServiceVersion"];
+	[request setValue:@"3.0;NetFx" forHTTPHeaderField:@"MaxDataServiceVersion"];
+	[request setValue:wireFormat == WATableWireFormatJSONNoMetadata ? @"application/json;odata=nometadata" : @"application/json;odata=minimalmetadata" forHTTPHeaderField:@"Accept"];
+}
+
+@implementation WACloudStorageClient (WireFormat)
+
+- (WATableWireFormat)tableWireFormat
+{
+	return [objc_getAssociatedObject(self, &WATableWireFormatKey) intValue];
+}
+
+- (void)setTableWireFormat:(WATableWireFormat)tableWireFormat
+{
+	objc_setAssociatedObject(self, &WATableWireFormatKey, tableWireFormat ? [NSNumber numberWithInt:tableWireFormat] : nil, OBJC_ASSOCIATION_RETAIN);
+}
+
+@end
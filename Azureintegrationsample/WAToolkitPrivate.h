@@ -0,0 +1,198 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#ifndef watoolkitios_samples_WAToolkitPrivate_h
+#define watoolkitios_samples_WAToolkitPrivate_h
+
+#import <Foundation/Foundation.h>
+#import <UIKit/UIKit.h>
+
+#import "WACloudStorageClient.h"
+#import "WATableEntity.h"
+
+/*
+ Declarations for selectors that libwatoolkitios.a implements but does not ship
+ headers for, plus small helpers shared by the extensions in this project.
+ Keep the list of private selectors small.
+ */
+
+#define WAToolkitErrorDomain @"com.microsoft.WAToolkit"
+
+@interface WATableEntity (WAToolkitPrivate)
+
+- (id)initWithDictionary:(NSMutableDictionary *)dictionary fromTable:(NSString *)tableName;
+
+@end
+
+@interface NSString (WASimpleBase64)
+
+- (NSData *)dataWithBase64DecodedString;
+
+@end
+
+@interface NSData (WASimpleBase64)
+
+- (NSString *)stringWithBase64EncodedData;
+
+@end
+
+/*
+ The library does not ship WABlob.h or WABlobContainer.h; these are the parts
+ of their interfaces the extensions use.
+ */
+extern NSString * const WABlobPropertyKeyContentLength;
+extern NSString * const WABlobPropertyKeyContentMD5;
+extern NSString * const WABlobPropertyKeyContentType;
+extern NSString * const WABlobPropertyKeyEtag;
+
+@interface WABlobContainer : NSObject
+
+@property (readonly) NSString *name;
+@property (readonly) NSURL *URL;
+
+- (id)initContainerWithName:(NSString *)name;
+
+@end
+
+@interface WABlob : NSObject
+
+@property (readonly) NSString *name;
+@property (readonly) NSURL *URL;
+@property (readonly) NSString *containerName;
+@property (readonly) NSDictionary *properties;
+@property (copy) NSString *contentType;
+
+- (id)initBlobWithName:(NSString *)name URL:(NSString *)URL containerName:(NSString *)containerName properties:(NSDictionary *)properties;
+
+@end
+
+/*
+ The library does not ship WAQueueMessage.h either.
+ */
+@interface WAQueueMessage : NSObject
+
+@property (readonly) NSString *messageId;
+@property (readonly) NSString *insertionTime;
+@property (readonly) NSString *expirationTime;
+@property (readonly) NSString *popReceipt;
+@property (readonly) NSString *timeNextVisible;
+@property (readonly) NSInteger dequeueCount;
+@property (copy) NSString *messageText;
+
+- (id)initQueueMessageWithMessageId:(NSString *)messageId insertionTime:(NSString *)insertionTime expirationTime:(NSString *)expirationTime popReceipt:(NSString *)popReceipt timeNextVisible:(NSString *)timeNextVisible messageText:(NSString *)messageText dequeueCount:(NSInteger)dequeueCount;
+
+@end
+
+@interface UIApplication (WANetworkActivity)
+
+- (void)wa_pushNetworkActivity;
+- (void)wa_popNetworkActivity;
+
+@end
+
+/*
+ The storage client keeps its credential private; read it through KVC so the
+ extensions can sign their own requests against the same account.
+ */
+static inline WAAuthenticationCredential *WAStorageClientCredential(WACloudStorageClient *client)
+{
+	return [client valueForKey:@"credential"];
+}
+
+static inline NSString *WAURLEncodedString(NSString *string)
+{
+	CFStringRef encoded = CFURLCreateStringByAddingPercentEscapes(kCFAllocatorDefault, (CFStringRef)string, NULL,
+																  CFSTR("!*'();:@&=+$,/?%#[] "), kCFStringEncodingUTF8);
+	return [(NSString *)encoded autorelease];
+}
+
+static inline NSString *WAXMLEscapedString(NSString *value)
+{
+	NSMutableString *escaped = [NSMutableString stringWithString:value ? value : @""];
+	[escaped replaceOccurrencesOfString:@"&" withString:@"&amp;" options:0 range:NSMakeRange(0, escaped.length)];
+	[escaped replaceOccurrencesOfString:@"<" withString:@"&lt;" options:0 range:NSMakeRange(0, escaped.length)];
+	[escaped replaceOccurrencesOfString:@">" withString:@"&gt;" options:0 range:NSMakeRange(0, escaped.length)];
+	[escaped replaceOccurrencesOfString:@"\"" withString:@"&quot;" options:0 range:NSMakeRange(0, escaped.length)];
+	return escaped;
+}
+
+/*
+ The body of Put Message and Update Message requests.
+ */
+static inline NSData *WAQueueMessageBody(NSString *text)
+{
+	NSString *body = [NSString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><QueueMessage><MessageText>%@</MessageText></QueueMessage>", WAXMLEscapedString(text)];
+	return [body dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+/*
+ Blob names may contain slashes, which have to stay unescaped in the path.
+ */
+static inline NSString *WABlobResourcePath(NSString *containerName, NSString *blobName)
+{
+	NSMutableArray *segments = [NSMutableArray arrayWithObject:WAURLEncodedString(containerName)];
+	for (NSString *segment in [blobName componentsSeparatedByString:@"/"]) {
+		[segments addObject:WAURLEncodedString(segment)];
+	}
+	return [@"/" stringByAppendingString:[segments componentsJoinedByString:@"/"]];
+}
+
+static inline NSString *WAHeaderValueForKey(NSHTTPURLResponse *response, NSString *name)
+{
+	NSDictionary *headers = [response allHeaderFields];
+	for (NSString *key in headers) {
+		if ([key caseInsensitiveCompare:name] == NSOrderedSame) {
+			return [headers objectForKey:key];
+		}
+	}
+	return nil;
+}
+
+static inline NSError *WAToolkitError(NSInteger statusCode, NSString *reasonCode, NSString *message)
+{
+	NSMutableDictionary *userInfo = [NSMutableDictionary dictionaryWithCapacity:2];
+	if (reasonCode) {
+		[userInfo setObject:reasonCode forKey:WAErrorReasonCodeKey];
+	}
+	if (message) {
+		[userInfo setObject:message forKey:NSLocalizedDescriptionKey];
+	}
+	return [NSError errorWithDomain:WAToolkitErrorDomain code:statusCode userInfo:userInfo];
+}
+
+/*
+ Builds an error from a failed blob or queue response, whose body is an <Error>
+ document with a <Code> and a <Message>.
+ */
+static inline NSError *WAStorageErrorFromResponse(NSHTTPURLResponse *response, NSData *body)
+{
+	NSString *text = body.length ? [[[NSString alloc] initWithData:body encoding:NSUTF8StringEncoding] autorelease] : nil;
+	NSString *values[2] = { nil, nil };
+	NSString *elements[2] = { @"Code", @"Message" };
+
+	for (int i = 0; i < 2 && text; i++) {
+		NSRange start = [text rangeOfString:[NSString stringWithFormat:@"<%@>", elements[i]]];
+		NSRange end = [text rangeOfString:[NSString stringWithFormat:@"</%@>", elements[i]]];
+		if (start.location != NSNotFound && end.location != NSNotFound && end.location > NSMaxRange(start)) {
+			values[i] = [text substringWithRange:NSMakeRange(NSMaxRange(start), end.location - NSMaxRange(start))];
+		}
+	}
+
+	NSInteger statusCode = response.statusCode;
+	return WAToolkitError(statusCode, values[0], values[1] ? values[1] : [NSHTTPURLResponse localizedStringForStatusCode:statusCode]);
+}
+
+#endif
@@ -0,0 +1,36 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@class WACloudStorageClient;
+@class WABenchmarkDataset;
+
+/**
+ Benchmarks of the table, blob and queue paths of WACloudStorageClient against WAStorageEmulator, on a dataset that is the same on every run, and comparisons of response buffering, compiled filters and JSON decoding with the code they replace.
+
+ They are built into the AzureintegrationsampleBenchmarks bundle rather than AzureintegrationsampleTests, so they run only when that target is tested.
+
+ Every benchmark appends one JSON object per line to the file named by the WA_BENCHMARK_OUTPUT environment variable, or to wabenchmark.jsonl in the temporary directory, and logs the same line prefixed with WABENCHMARK. Each object has the benchmark name, the number of operations and of items they moved, the elapsed time, throughput in items and bytes per second, the p50, p95 and p99 latency of an operation in milliseconds, the failure count, the growth in heap blocks and bytes in use, the peak resident set size and the number of requests the emulator answered. A comparison records the time of both sides and the speedup instead.
+ */
+@interface WABenchmarkTests : SenTestCase {
+@private
+	WACloudStorageClient *_client;
+	WABenchmarkDataset *_dataset;
+	BOOL _rateLimiterWasEnabled;
+}
+
+@end
@@ -0,0 +1,546 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABenchmarkTests.h"
+
+#import <malloc/malloc.h>
+#import <sys/resource.h>
+
+#import "WAAuthenticationCredential.h"
+#import "WABlobDownload.h"
+#import "WABlobUpload.h"
+#import "WABufferChain.h"
+#import "WACloudStorageClient+Streaming.h"
+#import "WACloudStorageClient.h"
+#import "WACompiledFilter.h"
+#import "WAEntityStreamParser.h"
+#import "WAJSONEntityParser.h"
+#import "WAQueueBatch.h"
+#import "WAQueueConsumer.h"
+#import "WARateLimiter.h"
+#import "WARequestMetrics.h"
+#import "WATableBatch.h"
+#import "WATableEntity.h"
+#import "WATableEntityBatch.h"
+#import "WATableEntityCursor.h"
+#import "WATableFetchRequest.h"
+#import "WAToolkitPrivate.h"
+#import "WAStorageEmulator.h"
+
+#define WABenchmarkSeed 20120613
+#define WABenchmarkTimeout 300
+
+#define WABenchmarkPartitions 20
+#define WABenchmarkRowsPerPartition 50
+#define WABenchmarkScanPartitions 10
+#define WABenchmarkScanRowsPerPartition 500
+#define WABenchmarkGroupSize 100
+#define WABenchmarkChainChunkSize (16 * 1024)
+#define WABenchmarkChainChunks 4096
+#define WABenchmarkFilterIterations 20000
+#define WABenchmarkDecodedEntities 2000
+
+static NSString * const WABenchmarkContainer = @"benchmark";
+
+/*
+ Starts one operation; the operation calls done exactly once, on the calling thread.
+ */
+typedef void (^WABenchmarkOperation)(NSUInteger index, void (^done)(NSError *error));
+
+@interface WABenchmarkTests ()
+
+- (void)runBenchmark:(NSString *)name operations:(NSUInteger)operations itemsPerOperation:(NSUInteger)items bytesPerItem:(NSUInteger)bytes concurrency:(NSUInteger)concurrency usingBlock:(WABenchmarkOperation)block;
+- (void)writeResult:(NSDictionary *)result;
+- (void)writeComparison:(NSString *)name items:(NSUInteger)items seconds:(CFAbsoluteTime)seconds baselineSeconds:(CFAbsoluteTime)baselineSeconds;
+
+@end
+
+static void WAHeapStatistics(size_t *blocks, size_t *bytes)
+{
+	malloc_statistics_t statistics;
+	malloc_zone_statistics(NULL, &statistics);
+	*blocks = statistics.blocks_in_use;
+	*bytes = statistics.size_in_use;
+}
+
+static long long WAPeakResidentSize(void)
+{
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	// bytes on Darwin
+	return (long long)usage.ru_maxrss;
+}
+
+@implementation WABenchmarkTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	[WAStorageEmulator install];
+	[[WAStorageEmulator sharedEmulator] reset];
+
+	// the benchmarks measure the client, not the pacing of a real account
+	_rateLimiterWasEnabled = [WARateLimiter sharedLimiter].enabled;
+	[WARateLimiter sharedLimiter].enabled = NO;
+
+	WAAuthenticationCredential *credential = [WAAuthenticationCredential credentialWithAzureServiceAccount:WAStorageEmulatorAccountName accessKey:WAStorageEmulatorAccessKey];
+	_client = [[WACloudStorageClient storageClientWithCredential:credential] retain];
+	_dataset = [[WABenchmarkDataset alloc] initWithSeed:WABenchmarkSeed];
+}
+
+- (void)tearDown
+{
+	[_client release];
+	_client = nil;
+	[_dataset release];
+	_dataset = nil;
+
+	[WARateLimiter sharedLimiter].enabled = _rateLimiterWasEnabled;
+	[WAStorageEmulator uninstall];
+
+	[super tearDown];
+}
+
+#pragma mark - Tables
+
+- (void)testTablePointReads
+{
+	WAStorageEmulator *emulator = [WAStorageEmulator sharedEmulator];
+	[emulator populateTable:@"Orders" fromDataset:_dataset partitions:WABenchmarkPartitions rowsPerPartition:WABenchmarkRowsPerPartition];
+	NSUInteger entityCount = WABenchmarkPartitions * WABenchmarkRowsPerPartition;
+
+	// a fixed stride visits every entity in an order unrelated to the key order
+	WATableFetchRequest *(^fetchRequestAtIndex)(NSUInteger) = ^(NSUInteger index) {
+		NSUInteger entity = (index * 7919) % entityCount;
+		WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Orders"];
+		fetchRequest.partitionKey = [_dataset partitionKeyAtIndex:entity / WABenchmarkRowsPerPartition];
+		fetchRequest.rowKey = [_dataset rowKeyAtIndex:entity % WABenchmarkRowsPerPartition];
+		return fetchRequest;
+	};
+
+	[self runBenchmark:@"TablePointRead" operations:500 itemsPerOperation:1 bytesPerItem:0 concurrency:8 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		[_client fetchEntitiesWithRequest:fetchRequestAtIndex(index) usingCompletionHandler:^(NSArray *entities, WAResultContinuation *resultContinuation, NSError *error) {
+			if (!error && entities.count != 1) {
+				error = WAToolkitError(-1, nil, [NSString stringWithFormat:@"Expected one entity, got %lu.", (unsigned long)entities.count]);
+			}
+			done(error);
+		}];
+	}];
+
+	[self runBenchmark:@"TablePointReadStreaming" operations:500 itemsPerOperation:1 bytesPerItem:0 concurrency:8 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		[_client fetchEntityBatchWithRequest:fetchRequestAtIndex(index) usingCompletionHandler:^(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error) {
+			if (!error && batch.count != 1) {
+				error = WAToolkitError(-1, nil, [NSString stringWithFormat:@"Expected one entity, got %lu.", (unsigned long)batch.count]);
+			}
+			done(error);
+		}];
+	}];
+}
+
+- (void)testContinuationScans
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Scans" fromDataset:_dataset partitions:WABenchmarkScanPartitions rowsPerPartition:WABenchmarkScanRowsPerPartition];
+	NSUInteger entityCount = WABenchmarkScanPartitions * WABenchmarkScanRowsPerPartition;
+
+	[self runBenchmark:@"ContinuationScan" operations:5 itemsPerOperation:entityCount bytesPerItem:0 concurrency:1 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Scans"];
+		fetchRequest.topRows = 100;
+
+		WATableEntityCursor *cursor = [_client entityCursorWithRequest:fetchRequest prefetchDepth:WATableEntityCursorDefaultPrefetchDepth];
+		__block NSUInteger scanned = 0;
+		__block void (^nextPage)(NSArray *, NSError *) = nil;
+		nextPage = [^(NSArray *entities, NSError *error) {
+			if (entities) {
+				scanned += entities.count;
+				[cursor nextPageWithCompletionHandler:nextPage];
+				return;
+			}
+			if (!error && scanned != entityCount) {
+				error = WAToolkitError(-1, nil, [NSString stringWithFormat:@"Scanned %lu of %lu entities.", (unsigned long)scanned, (unsigned long)entityCount]);
+			}
+			[nextPage autorelease];
+			done(error);
+		} copy];
+		[cursor nextPageWithCompletionHandler:nextPage];
+	}];
+}
+
+- (void)testEntityInserts
+{
+	WAStorageEmulator *emulator = [WAStorageEmulator sharedEmulator];
+	[emulator populateTable:@"Inserts" fromDataset:_dataset partitions:0 rowsPerPartition:0];
+
+	WATableEntity *(^entityAt)(NSUInteger, NSUInteger) = ^(NSUInteger partition, NSUInteger row) {
+		WATableEntity *entity = [WATableEntity createEntityForTable:@"Inserts"];
+		entity.partitionKey = [_dataset partitionKeyAtIndex:partition];
+		entity.rowKey = [_dataset rowKeyAtIndex:row];
+		[[_dataset propertiesForPartition:partition row:row] enumerateKeysAndObjectsUsingBlock:^(id key, id value, BOOL *stop) {
+			[entity setObject:value forKey:key];
+		}];
+		return entity;
+	};
+
+	[self runBenchmark:@"EntityInsert" operations:300 itemsPerOperation:1 bytesPerItem:0 concurrency:8 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		[_client insertEntity:entityAt(0, index) withCompletionHandler:^(NSError *error) {
+			done(error);
+		}];
+	}];
+
+	[self runBenchmark:@"EntityGroupInsert" operations:30 itemsPerOperation:WABenchmarkGroupSize bytesPerItem:0 concurrency:4 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		// a transaction is limited to one partition
+		NSMutableArray *operations = [NSMutableArray arrayWithCapacity:WABenchmarkGroupSize];
+		for (NSUInteger row = 0; row < WABenchmarkGroupSize; row++) {
+			[operations addObject:[WATableOperation insertOperationWithEntity:entityAt(index + 1, row)]];
+		}
+		[_client executeTableOperations:operations withCompletionHandler:^(NSArray *results, NSError *error) {
+			done(error);
+		}];
+	}];
+
+	STAssertEquals([emulator entityCountInTable:@"Inserts"], (NSUInteger)(300 + 30 * WABenchmarkGroupSize), nil);
+}
+
+#pragma mark - Blobs
+
+- (void)testBlobTransfers
+{
+	NSUInteger sizes[] = { 1024, 256 * 1024, 4 * 1024 * 1024, 12 * 1024 * 1024 };
+	NSUInteger counts[] = { 50, 20, 4, 2 };
+	WABlobContainer *container = [[[WABlobContainer alloc] initContainerWithName:WABenchmarkContainer] autorelease];
+	NSString *directory = [NSTemporaryDirectory() stringByAppendingPathComponent:@"wabenchmark"];
+	[[NSFileManager defaultManager] createDirectoryAtPath:directory withIntermediateDirectories:YES attributes:nil error:NULL];
+
+	for (int i = 0; i < 4; i++) {
+		NSUInteger size = sizes[i];
+		NSString *blobName = [NSString stringWithFormat:@"payload-%lu", (unsigned long)size];
+		NSString *(^blobNameAtIndex)(NSUInteger) = ^(NSUInteger index) {
+			return [NSString stringWithFormat:@"%@-%lu", blobName, (unsigned long)index];
+		};
+
+		[self runBenchmark:[NSString stringWithFormat:@"BlobUpload%luKB", (unsigned long)size / 1024] operations:counts[i] itemsPerOperation:1 bytesPerItem:size concurrency:2 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+			NSInputStream *stream = [NSInputStream inputStreamWithData:[_dataset payloadOfLength:size index:index]];
+			WABlobUpload *upload = [[WABlobUpload alloc] initWithClient:_client container:container blobName:blobNameAtIndex(index) inputStream:stream];
+			[upload startWithCompletionHandler:^(NSError *error) {
+				[upload autorelease];
+				done(error);
+			}];
+		}];
+
+		STAssertEqualObjects([[WAStorageEmulator sharedEmulator] contentOfBlob:blobNameAtIndex(0) inContainer:WABenchmarkContainer], [_dataset payloadOfLength:size index:0], nil);
+
+		[self runBenchmark:[NSString stringWithFormat:@"BlobDownload%luKB", (unsigned long)size / 1024] operations:counts[i] itemsPerOperation:1 bytesPerItem:size concurrency:2 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+			NSString *URL = [NSString stringWithFormat:@"https://%@.blob.core.windows.net/%@/%@", WAStorageEmulatorAccountName, WABenchmarkContainer, blobNameAtIndex(index)];
+			WABlob *blob = [[[WABlob alloc] initBlobWithName:blobNameAtIndex(index) URL:URL containerName:WABenchmarkContainer properties:nil] autorelease];
+			NSString *path = [directory stringByAppendingPathComponent:blobNameAtIndex(index)];
+			[_client downloadBlob:blob toFile:path withCompletionHandler:^(NSError *error) {
+				if (!error && [[[NSFileManager defaultManager] attributesOfItemAtPath:path error:NULL] fileSize] != size) {
+					error = WAToolkitError(-1, nil, @"The downloaded file has the wrong size.");
+				}
+				[[NSFileManager defaultManager] removeItemAtPath:path error:NULL];
+				done(error);
+			}];
+		}];
+	}
+
+	[[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+#pragma mark - Queues
+
+- (void)testQueueEnqueueDequeue
+{
+	WAStorageEmulator *emulator = [WAStorageEmulator sharedEmulator];
+	NSString *queueName = @"benchmark";
+
+	[self runBenchmark:@"QueueCreate" operations:1 itemsPerOperation:1 bytesPerItem:0 concurrency:1 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		[_client addQueueNamed:queueName withCompletionHandler:done];
+	}];
+
+	[self runBenchmark:@"QueueAddMessage" operations:200 itemsPerOperation:1 bytesPerItem:0 concurrency:8 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		[_client addMessageToQueue:[_dataset messageTextAtIndex:index] queueName:queueName withCompletionHandler:done];
+	}];
+
+	[self runBenchmark:@"QueueBatchAdd" operations:10 itemsPerOperation:100 bytesPerItem:0 concurrency:1 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		NSMutableArray *messages = [NSMutableArray arrayWithCapacity:100];
+		for (NSUInteger i = 0; i < 100; i++) {
+			[messages addObject:[_dataset messageTextAtIndex:200 + index * 100 + i]];
+		}
+		[_client addMessages:messages toQueue:queueName withCompletionHandler:^(NSArray *errors, NSError *error) {
+			done(error);
+		}];
+	}];
+
+	NSUInteger messageCount = [emulator messageCountInQueue:queueName];
+	STAssertEquals(messageCount, (NSUInteger)1200, nil);
+
+	[self runBenchmark:@"QueueConsume" operations:1 itemsPerOperation:messageCount bytesPerItem:0 concurrency:1 usingBlock:^(NSUInteger index, void (^done)(NSError *)) {
+		WAQueueConsumer *consumer = [[WAQueueConsumer alloc] initWithClient:_client queueName:queueName];
+		consumer.batchSize = 32;
+		consumer.idlePollInterval = 0.05;
+		consumer.errorHandler = ^(NSError *error) {
+			NSLog(@"Queue consumer error: %@", error);
+		};
+
+		__block NSUInteger processed = 0;
+		[consumer startWithHandler:^(WAQueueMessage *message, WAQueueConsumerCompletion completion) {
+			completion(YES);
+			// the handler runs concurrently on global queue threads; the count and the consumer belong to the main thread
+			dispatch_async(dispatch_get_main_queue(), ^{
+				if (++processed == messageCount) {
+					[consumer stop];
+					[consumer autorelease];
+					done(nil);
+				}
+			});
+		}];
+	}];
+}
+
+#pragma mark - Codecs
+
+/*
+ Collects a large response the way connection:didReceiveData: sees it, into a
+ growing NSMutableData and into a chain.
+ */
+- (void)testBufferChainAccumulation
+{
+	NSMutableArray *chunks = [NSMutableArray arrayWithCapacity:WABenchmarkChainChunks];
+	for (NSUInteger i = 0; i < WABenchmarkChainChunks; i++) {
+		NSMutableData *chunk = [NSMutableData dataWithLength:WABenchmarkChainChunkSize];
+		memset([chunk mutableBytes], (int)(i & 0xff), WABenchmarkChainChunkSize);
+		[chunks addObject:[NSData dataWithData:chunk]];
+	}
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	NSUInteger accumulatedLength = 0;
+	@autoreleasepool {
+		NSMutableData *accumulated = [NSMutableData data];
+		for (NSData *chunk in chunks) {
+			[accumulated appendData:chunk];
+		}
+		accumulatedLength = accumulated.length;
+	}
+	CFAbsoluteTime accumulatedTime = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	NSUInteger chainedLength = 0;
+	@autoreleasepool {
+		WABufferChain *chain = [[[WABufferChain alloc] init] autorelease];
+		for (NSData *chunk in chunks) {
+			[chain appendData:chunk];
+		}
+		chainedLength = chain.length;
+	}
+	CFAbsoluteTime chainedTime = CFAbsoluteTimeGetCurrent() - start;
+
+	STAssertEquals(chainedLength, accumulatedLength, nil);
+	[self writeComparison:@"BufferChainAccumulation" items:WABenchmarkChainChunks seconds:chainedTime baselineSeconds:accumulatedTime];
+}
+
+/*
+ Compares building a fetch request by substituting values into a parsed predicate and translating it, as fetchRequestForTable:predicate:error: is used today, with binding values to a cached compiled filter.
+ */
+- (void)testCompiledFilterBinding
+{
+	NSString *format = @"PartitionKey == $customer AND RowKey >= $from AND RowKey < $to";
+	NSPredicate *template = [NSPredicate predicateWithFormat:format];
+	[WACompiledFilter removeAllCachedFilters];
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	for (NSUInteger i = 0; i < WABenchmarkFilterIterations; i++) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSDictionary *variables = [NSDictionary dictionaryWithObjectsAndKeys:[NSString stringWithFormat:@"customer%lu", (unsigned long)i], @"customer", @"2012-01", @"from", @"2012-02", @"to", nil];
+		NSPredicate *predicate = [template predicateWithSubstitutionVariables:variables];
+		[WATableFetchRequest fetchRequestForTable:@"Orders" predicate:predicate error:NULL];
+		[pool drain];
+	}
+	CFAbsoluteTime translated = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	for (NSUInteger i = 0; i < WABenchmarkFilterIterations; i++) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		NSDictionary *variables = [NSDictionary dictionaryWithObjectsAndKeys:[NSString stringWithFormat:@"customer%lu", (unsigned long)i], @"customer", @"2012-01", @"from", @"2012-02", @"to", nil];
+		[WATableFetchRequest fetchRequestForTable:@"Orders" predicateFormat:format variables:variables error:NULL];
+		[pool drain];
+	}
+	CFAbsoluteTime compiled = CFAbsoluteTimeGetCurrent() - start;
+
+	[self writeComparison:@"CompiledFilterBinding" items:WABenchmarkFilterIterations seconds:compiled baselineSeconds:translated];
+}
+
+/*
+ Compares decoding the same page from Atom and from JSON with no metadata.
+ */
+- (void)testJSONDecoding
+{
+	NSMutableString *atom = [NSMutableString stringWithString:@"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><feed xml:base=\"https://account.table.core.windows.net/\" "
+							 @"xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"><title type=\"text\">Customers</title>"];
+	NSMutableString *JSON = [NSMutableString stringWithString:@"{\"value\":["];
+	for (NSUInteger i = 0; i < WABenchmarkDecodedEntities; i++) {
+		[atom appendFormat:@"<entry m:etag=\"W/&quot;datetime'2013-08-22T01%%3A12%%3A06.2608595Z'&quot;\"><id>https://account.table.core.windows.net/Customers(PartitionKey='p%lu',RowKey='r%lu')</id>"
+		 @"<title type=\"text\"></title><updated>2013-08-22T01:12:06Z</updated><author><name /></author><link rel=\"edit\" title=\"Customers\" href=\"Customers(PartitionKey='p%lu',RowKey='r%lu')\" />"
+		 @"<category term=\"account.Customers\" scheme=\"http://schemas.microsoft.com/ado/2007/08/dataservices/scheme\" /><content type=\"application/xml\"><m:properties>"
+		 @"<d:PartitionKey>p%lu</d:PartitionKey><d:RowKey>r%lu</d:RowKey><d:Timestamp m:type=\"Edm.DateTime\">2013-08-22T01:12:06.2608595Z</d:Timestamp>"
+		 @"<d:Name>Customer %lu</d:Name><d:City>Seattle</d:City><d:Balance m:type=\"Edm.Double\">%lu.25</d:Balance><d:Orders m:type=\"Edm.Int32\">%lu</d:Orders><d:Active m:type=\"Edm.Boolean\">true</d:Active>"
+		 @"</m:properties></content></entry>", i / 100, i, i / 100, i, i / 100, i, i, i, i];
+		[JSON appendFormat:@"%@{\"PartitionKey\":\"p%lu\",\"RowKey\":\"r%lu\",\"Timestamp\":\"2013-08-22T01:12:06.2608595Z\",\"Name\":\"Customer %lu\",\"City\":\"Seattle\",\"Balance\":%lu.25,\"Orders\":%lu,\"Active\":true}",
+		 i ? @"," : @"", i / 100, i, i, i, i];
+	}
+	[atom appendString:@"</feed>"];
+	[JSON appendString:@"]}"];
+
+	NSData *atomData = [atom dataUsingEncoding:NSUTF8StringEncoding];
+	NSData *JSONData = [JSON dataUsingEncoding:NSUTF8StringEncoding];
+	__block NSUInteger decoded = 0;
+	void (^entityHandler)(WATableEntity *) = ^(WATableEntity *entity) {
+		decoded++;
+	};
+
+	CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+	WAEntityStreamParser *atomParser = [[WAEntityStreamParser alloc] initWithTableName:@"Customers" entityHandler:entityHandler];
+	[atomParser parseData:atomData error:NULL];
+	[atomParser finishWithError:NULL];
+	[atomParser release];
+	CFAbsoluteTime atomTime = CFAbsoluteTimeGetCurrent() - start;
+
+	start = CFAbsoluteTimeGetCurrent();
+	WAJSONEntityParser *JSONParser = [[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityHandler:entityHandler];
+	[JSONParser parseData:JSONData error:NULL];
+	[JSONParser finishWithError:NULL];
+	[JSONParser release];
+	CFAbsoluteTime JSONTime = CFAbsoluteTimeGetCurrent() - start;
+
+	NSLog(@"%d entities: Atom %lu bytes, JSON %lu bytes", WABenchmarkDecodedEntities, (unsigned long)atomData.length, (unsigned long)JSONData.length);
+	STAssertEquals(decoded, (NSUInteger)(2 * WABenchmarkDecodedEntities), nil);
+	STAssertTrue(JSONData.length * 2 < atomData.length, @"JSON without metadata should be under half the size of Atom");
+	[self writeComparison:@"JSONDecoding" items:WABenchmarkDecodedEntities seconds:JSONTime baselineSeconds:atomTime];
+}
+
+#pragma mark - Private
+
+- (void)runBenchmark:(NSString *)name operations:(NSUInteger)operations itemsPerOperation:(NSUInteger)items bytesPerItem:(NSUInteger)bytes concurrency:(NSUInteger)concurrency usingBlock:(WABenchmarkOperation)block
+{
+	WARequestMetricsAggregator *aggregator = [[[WARequestMetricsAggregator alloc] init] autorelease];
+	NSUInteger requestCount = [WAStorageEmulator sharedEmulator].requestCount;
+	__block NSUInteger started = 0;
+	__block NSUInteger finished = 0;
+	__block void (^startNext)(void) = nil;
+
+	size_t blocksBefore, bytesBefore;
+	WAHeapStatistics(&blocksBefore, &bytesBefore);
+	CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+
+	// copied, as the asynchronous completion handlers keep calling it
+	startNext = [[^{
+		NSUInteger index = started++;
+		CFAbsoluteTime operationBegin = CFAbsoluteTimeGetCurrent();
+		block(index, ^(NSError *error) {
+			// the latencies go through the request metrics histograms, so percentiles match what clients report
+			WARequestMetrics *metrics = [[WARequestMetrics alloc] initWithOperation:name resourceName:nil handler:nil];
+			[metrics setDuration:CFAbsoluteTimeGetCurrent() - operationBegin ofPhase:WARequestPhaseTotal];
+			metrics.error = error;
+			[aggregator recordMetrics:metrics];
+			[metrics release];
+
+			if (error) {
+				NSLog(@"%@ operation %lu failed: %@", name, (unsigned long)index, error);
+			}
+			finished++;
+			if (started < operations) {
+				startNext();
+			}
+		});
+	} copy] autorelease];
+
+	for (NSUInteger i = 0; i < MIN(MAX(concurrency, 1), operations); i++) {
+		startNext();
+	}
+
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:WABenchmarkTimeout];
+	while (finished < operations && [timeout timeIntervalSinceNow] > 0) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+		[pool drain];
+	}
+
+	CFAbsoluteTime elapsed = CFAbsoluteTimeGetCurrent() - begin;
+	size_t blocksAfter, bytesAfter;
+	WAHeapStatistics(&blocksAfter, &bytesAfter);
+
+	STAssertEquals(finished, operations, @"%@ timed out", name);
+	STAssertEquals([aggregator failureCountForOperation:name], (NSUInteger)0, @"%@ had failures", name);
+
+	double itemCount = (double)finished * items;
+	NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+							name, @"benchmark",
+							[NSNumber numberWithUnsignedLongLong:WABenchmarkSeed], @"seed",
+							[NSNumber numberWithUnsignedInteger:finished], @"operations",
+							[NSNumber numberWithDouble:itemCount], @"items",
+							[NSNumber numberWithUnsignedInteger:concurrency], @"concurrency",
+							[NSNumber numberWithDouble:elapsed], @"seconds",
+							[NSNumber numberWithDouble:elapsed > 0 ? itemCount / elapsed : 0], @"itemsPerSecond",
+							[NSNumber numberWithDouble:elapsed > 0 ? itemCount * bytes / elapsed : 0], @"bytesPerSecond",
+							[NSNumber numberWithDouble:[aggregator percentile:50 ofPhase:WARequestPhaseTotal forOperation:name] * 1000], @"p50Ms",
+							[NSNumber numberWithDouble:[aggregator percentile:95 ofPhase:WARequestPhaseTotal forOperation:name] * 1000], @"p95Ms",
+							[NSNumber numberWithDouble:[aggregator percentile:99 ofPhase:WARequestPhaseTotal forOperation:name] * 1000], @"p99Ms",
+							[NSNumber numberWithUnsignedInteger:[aggregator failureCountForOperation:name]], @"failures",
+							[NSNumber numberWithLongLong:(long long)blocksAfter - (long long)blocksBefore], @"heapBlocksDelta",
+							[NSNumber numberWithLongLong:(long long)bytesAfter - (long long)bytesBefore], @"heapBytesDelta",
+							[NSNumber numberWithLongLong:WAPeakResidentSize()], @"peakRSSBytes",
+							[NSNumber numberWithUnsignedInteger:[WAStorageEmulator sharedEmulator].requestCount - requestCount], @"requests",
+							nil];
+	[self writeResult:result];
+}
+
+- (void)writeComparison:(NSString *)name items:(NSUInteger)items seconds:(CFAbsoluteTime)seconds baselineSeconds:(CFAbsoluteTime)baselineSeconds
+{
+	NSDictionary *result = [NSDictionary dictionaryWithObjectsAndKeys:
+							name, @"benchmark",
+							[NSNumber numberWithUnsignedInteger:items], @"items",
+							[NSNumber numberWithDouble:seconds], @"seconds",
+							[NSNumber numberWithDouble:baselineSeconds], @"baselineSeconds",
+							[NSNumber numberWithDouble:seconds > 0 ? items / seconds : 0], @"itemsPerSecond",
+							[NSNumber numberWithDouble:seconds > 0 ? baselineSeconds / seconds : 0], @"speedup",
+							[NSNumber numberWithLongLong:WAPeakResidentSize()], @"peakRSSBytes",
+							nil];
+	[self writeResult:result];
+}
+
+- (void)writeResult:(NSDictionary *)result
+{
+	NSError *error = nil;
+	NSData *JSON = [NSJSONSerialization dataWithJSONObject:result options:0 error:&error];
+	STAssertNotNil(JSON, @"%@", error);
+
+	NSString *line = [[[NSString alloc] initWithData:JSON encoding:NSUTF8StringEncoding] autorelease];
+	NSLog(@"WABENCHMARK %@", line);
+
+	NSString *path = [[[NSProcessInfo processInfo] environment] objectForKey:@"WA_BENCHMARK_OUTPUT"];
+	if (!path.length) {
+		path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"wabenchmark.jsonl"];
+	}
+	if (![[NSFileManager defaultManager] fileExistsAtPath:path]) {
+		[[NSFileManager defaultManager] createFileAtPath:path contents:nil attributes:nil];
+	}
+
+	NSFileHandle *file = [NSFileHandle fileHandleForWritingAtPath:path];
+	[file seekToEndOfFile];
+	[file writeData:[[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+	[file closeFile];
+}
+
+@end
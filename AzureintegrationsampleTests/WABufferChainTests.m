@@ -0,0 +1,82 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABufferChainTests.h"
+
+#import "WABufferChain.h"
+
+@implementation WABufferChainTests
+
+- (void)testSegmentsAreNotCopied
+{
+	NSData *first = [@"<QueueMessagesList>" dataUsingEncoding:NSUTF8StringEncoding];
+	NSData *second = [@"</QueueMessagesList>" dataUsingEncoding:NSUTF8StringEncoding];
+
+	WABufferChain *chain = [[[WABufferChain alloc] init] autorelease];
+	[chain appendData:first];
+	STAssertEquals([chain contiguousData], first, @"a single segment is handed out as it is");
+
+	[chain appendData:[NSData data]];
+	[chain appendData:second];
+	STAssertEquals(chain.segmentCount, (NSUInteger)2, nil);
+	STAssertEquals(chain.length, first.length + second.length, nil);
+	STAssertEquals([chain segmentAtIndex:1], second, nil);
+
+	__block NSUInteger expectedOffset = 0;
+	[chain enumerateSegmentsUsingBlock:^(NSData *segment, NSUInteger offset, BOOL *stop) {
+		STAssertEquals(offset, expectedOffset, nil);
+		expectedOffset += segment.length;
+	}];
+}
+
+- (void)testReadsAcrossSegments
+{
+	WABufferChain *chain = [[[WABufferChain alloc] init] autorelease];
+	NSMutableData *expected = [NSMutableData data];
+	for (NSUInteger i = 0; i < 10; i++) {
+		NSData *chunk = [[NSString stringWithFormat:@"chunk %lu;", (unsigned long)i] dataUsingEncoding:NSUTF8StringEncoding];
+		[chain appendData:chunk];
+		[expected appendData:chunk];
+	}
+
+	char bytes[32];
+	for (NSUInteger location = 0; location + sizeof(bytes) <= expected.length; location += 7) {
+		[chain getBytes:bytes range:NSMakeRange(location, sizeof(bytes))];
+		STAssertTrue(memcmp(bytes, (const char *)[expected bytes] + location, sizeof(bytes)) == 0, @"at %lu", (unsigned long)location);
+	}
+
+	NSData *data = [chain contiguousData];
+	STAssertEqualObjects(data, expected, nil);
+	STAssertEquals(chain.segmentCount, (NSUInteger)1, @"the joined buffer replaces the segments");
+	STAssertEquals([chain contiguousData], data, nil);
+}
+
+- (void)testCapacity
+{
+	WABufferChain *chain = [[[WABufferChain alloc] initWithCapacity:10] autorelease];
+	[chain appendData:[@"0123456" dataUsingEncoding:NSUTF8StringEncoding]];
+	[chain appendData:[@"789abc" dataUsingEncoding:NSUTF8StringEncoding]];
+	[chain appendData:[@"def" dataUsingEncoding:NSUTF8StringEncoding]];
+
+	STAssertEquals(chain.length, (NSUInteger)10, nil);
+	STAssertEqualObjects([[[NSString alloc] initWithData:[chain contiguousData] encoding:NSUTF8StringEncoding] autorelease], @"0123456789", nil);
+
+	[chain removeAllSegments];
+	STAssertEquals(chain.length, (NSUInteger)0, nil);
+	STAssertEqualObjects([chain contiguousData], [NSData data], nil);
+}
+
+@end
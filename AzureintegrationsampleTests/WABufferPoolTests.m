@@ -0,0 +1,155 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WABufferPoolTests.h"
+
+#import "WABufferPool.h"
+#import "WAEntityStreamParser.h"
+#import "WAJSONEntityParser.h"
+#import "WATableEntity.h"
+
+#define WABufferPoolSteadyStatePages 50
+
+static NSString * const WAAtomPage = @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><feed xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" "
+	@"xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"><entry><content type=\"application/xml\"><m:properties>"
+	@"<d:PartitionKey>p</d:PartitionKey><d:RowKey>r1</d:RowKey><d:Name>First</d:Name><d:Visits m:type=\"Edm.Int32\">3</d:Visits></m:properties></content></entry>"
+	@"<entry><content type=\"application/xml\"><m:properties><d:PartitionKey>p</d:PartitionKey><d:RowKey>r2</d:RowKey><d:Name>Second</d:Name></m:properties></content></entry></feed>";
+
+static NSString * const WAJSONPage = @"{\"value\":[{\"PartitionKey\":\"p\",\"RowKey\":\"r1\",\"Name\":\"First\",\"Visits\":3},{\"PartitionKey\":\"p\",\"RowKey\":\"r2\",\"Name\":\"Second\"}]}";
+
+@implementation WABufferPoolTests
+
+- (void)testSizeClassesAndReuse
+{
+	WABufferPool *pool = [[[WABufferPool alloc] init] autorelease];
+
+	size_t capacity = 0;
+	void *bytes = [pool allocateBytes:1000 capacity:&capacity];
+	STAssertEquals(capacity, (size_t)1024, nil);
+	[pool recycleBytes:bytes capacity:capacity];
+
+	size_t reusedCapacity = 0;
+	void *reused = [pool allocateBytes:600 capacity:&reusedCapacity];
+	STAssertEquals(reused, bytes, @"a buffer of the same class is handed out again");
+	STAssertEquals(reusedCapacity, (size_t)1024, nil);
+
+	memcpy(reused, "pooled", 6);
+	void *grown = [pool growBytes:reused usedLength:6 toLength:5000 capacity:&reusedCapacity];
+	STAssertEquals(reusedCapacity, (size_t)8192, nil);
+	STAssertTrue(memcmp(grown, "pooled", 6) == 0, nil);
+	[pool recycleBytes:grown capacity:reusedCapacity];
+
+	WABufferPoolStatistics statistics = pool.statistics;
+	STAssertEquals(statistics.allocations, 2ULL, nil);
+	STAssertEquals(statistics.reuses, 1ULL, nil);
+	STAssertEquals(statistics.bytesInUse, 0ULL, nil);
+	STAssertEquals(statistics.bytesIdle, 1024ULL + 8192ULL, nil);
+	STAssertEquals(statistics.peakBytesInUse, 1024ULL + 8192ULL, nil);
+
+	size_t oversize = 0;
+	void *large = [pool allocateBytes:WABufferPoolMaximumBufferSize + 1 capacity:&oversize];
+	[pool recycleBytes:large capacity:oversize];
+	STAssertEquals(pool.statistics.releases, 1ULL, @"buffers above the largest class are not kept");
+}
+
+- (void)testIdleLimitAndTrimming
+{
+	WABufferPool *pool = [[[WABufferPool alloc] init] autorelease];
+	pool.maxIdleBytes = 4096;
+
+	void *buffers[3];
+	size_t capacities[3];
+	for (int i = 0; i < 3; i++) {
+		buffers[i] = [pool allocateBytes:2048 capacity:&capacities[i]];
+	}
+	for (int i = 0; i < 3; i++) {
+		[pool recycleBytes:buffers[i] capacity:capacities[i]];
+	}
+	STAssertEquals(pool.statistics.bytesIdle, 4096ULL, nil);
+	STAssertEquals(pool.statistics.releases, 1ULL, nil);
+
+	// the first trim starts an interval; a buffer in use during it survives the next one
+	[pool trim];
+	size_t capacity = 0;
+	void *bytes = [pool allocateBytes:2048 capacity:&capacity];
+	[pool recycleBytes:bytes capacity:capacity];
+	[pool trim];
+	STAssertEquals(pool.statistics.bytesIdle, 2048ULL, @"only the buffer needed since the last trim is kept");
+
+	[pool removeIdleBuffers];
+	STAssertEquals(pool.statistics.bytesIdle, 0ULL, nil);
+}
+
+- (void)testPooledDataRecyclesItsBuffer
+{
+	WABufferPool *pool = [[[WABufferPool alloc] init] autorelease];
+
+	@autoreleasepool {
+		size_t capacity = 0;
+		char *bytes = [pool allocateBytes:300 capacity:&capacity];
+		memcpy(bytes, "block", 5);
+		NSData *data = [pool dataWithBytesNoCopy:bytes length:5 capacity:capacity];
+		STAssertEqualObjects(data, [NSData dataWithBytes:"block" length:5], nil);
+		STAssertEquals([[data copy] autorelease], data, @"copying does not copy the bytes");
+		STAssertEquals(pool.statistics.bytesInUse, 512ULL, nil);
+	}
+
+	STAssertEquals(pool.statistics.bytesInUse, 0ULL, nil);
+	STAssertEquals(pool.statistics.bytesIdle, 512ULL, nil);
+}
+
+/*
+ Parses the same page over and over, as a paged scan does: after the first
+ page, every buffer and parser context comes from the pool.
+ */
+- (void)testParsersReachSteadyState
+{
+	NSData *pages[2] = { [WAAtomPage dataUsingEncoding:NSUTF8StringEncoding], [WAJSONPage dataUsingEncoding:NSUTF8StringEncoding] };
+
+	for (int format = 0; format < 2; format++) {
+		WABufferPool *pool = [[[WABufferPool alloc] init] autorelease];
+		__block NSUInteger entities = 0;
+
+		for (NSUInteger page = 0; page < WABufferPoolSteadyStatePages; page++) {
+			if (page == 1) {
+				[pool resetStatistics];
+			}
+
+			@autoreleasepool {
+				void (^handler)(WATableEntity *) = ^(WATableEntity *entity) {
+					entities++;
+				};
+				id<WAEntityParser> parser = format == 0 ?
+					(id<WAEntityParser>)[[[WAEntityStreamParser alloc] initWithTableName:@"Customers" entityHandler:handler] autorelease] :
+					(id<WAEntityParser>)[[[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityHandler:handler] autorelease];
+				parser.bufferPool = pool;
+				STAssertTrue([parser parseData:pages[format] error:NULL], nil);
+				STAssertTrue([parser finishWithError:NULL], nil);
+			}
+		}
+
+		WABufferPoolStatistics statistics = pool.statistics;
+		NSLog(@"%@ pages after warming up: %llu allocations, %llu reuses, %llu context allocations, %llu context reuses",
+			  format == 0 ? @"Atom" : @"JSON", statistics.allocations, statistics.reuses, statistics.contextAllocations, statistics.contextReuses);
+		STAssertEquals(entities, (NSUInteger)(2 * WABufferPoolSteadyStatePages), nil);
+		STAssertEquals(statistics.allocations, 0ULL, @"the pool allocates no buffer once it is warm");
+		STAssertEquals(statistics.contextAllocations, 0ULL, @"no parser context is created once the pool is warm");
+		STAssertTrue(statistics.reuses > 0, nil);
+		STAssertEquals(statistics.bytesInUse, 0ULL, nil);
+	}
+}
+
+@end
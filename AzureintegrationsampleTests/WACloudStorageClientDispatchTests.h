@@ -0,0 +1,30 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@class WABenchmarkDataset;
+@class WACloudStorageClient;
+
+@interface WACloudStorageClientDispatchTests : SenTestCase {
+@private
+	WACloudStorageClient *_client;
+	WABenchmarkDataset *_dataset;
+	NSOperationQueue *_workQueue;
+	dispatch_queue_t _callbackQueue;
+}
+
+@end
@@ -0,0 +1,337 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACloudStorageClientDispatchTests.h"
+
+#import "WAAuthenticationCredential.h"
+#import "WACloudStorageClient+Dispatch.h"
+#import "WACloudStorageClient+Streaming.h"
+#import "WACloudStorageClient.h"
+#import "WATableBatch.h"
+#import "WATableEntity.h"
+#import "WATableEntityBatch.h"
+#import "WATableEntityCursor.h"
+#import "WATableFetchRequest.h"
+#import "WATableScan.h"
+#import "WAStorageEmulator.h"
+
+#define WADispatchTestTimeout 30
+
+static char WACallbackQueueMarker;
+
+/*
+ Spins the run loop of the calling thread until a flag is set, so work that
+ still needs the main thread can run while a test waits.
+ */
+static BOOL WAWaitForFlag(volatile BOOL *flag)
+{
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:WADispatchTestTimeout];
+	while (!*flag && [timeout timeIntervalSinceNow] > 0) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+		[pool drain];
+	}
+	return *flag;
+}
+
+static BOOL WAIsOnCallbackQueue(void)
+{
+	return dispatch_get_specific(&WACallbackQueueMarker) == &WACallbackQueueMarker;
+}
+
+@implementation WACloudStorageClientDispatchTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	[WAStorageEmulator install];
+	[[WAStorageEmulator sharedEmulator] reset];
+
+	WAAuthenticationCredential *credential = [WAAuthenticationCredential credentialWithAzureServiceAccount:WAStorageEmulatorAccountName accessKey:WAStorageEmulatorAccessKey];
+	_client = [[WACloudStorageClient storageClientWithCredential:credential] retain];
+	_dataset = [[WABenchmarkDataset alloc] initWithSeed:20121017];
+
+	_workQueue = [[NSOperationQueue alloc] init];
+	_workQueue.maxConcurrentOperationCount = 1;
+	_callbackQueue = dispatch_queue_create("com.microsoft.watoolkit.tests.callbacks", NULL);
+	dispatch_queue_set_specific(_callbackQueue, &WACallbackQueueMarker, &WACallbackQueueMarker, NULL);
+}
+
+- (void)tearDown
+{
+	[_client release];
+	_client = nil;
+	[_dataset release];
+	_dataset = nil;
+	[_workQueue release];
+	_workQueue = nil;
+	dispatch_release(_callbackQueue);
+	_callbackQueue = NULL;
+
+	[WAStorageEmulator uninstall];
+
+	[super tearDown];
+}
+
+- (void)testPerformCallbackWithoutQueueRunsInline
+{
+	__block BOOL called = NO;
+	[_client performCallback:^{
+		called = YES;
+	}];
+	STAssertTrue(called, nil);
+}
+
+- (void)testPerformCallbackUsesCallbackQueue
+{
+	_client.callbackQueue = _callbackQueue;
+	STAssertEquals(_client.callbackQueue, _callbackQueue, nil);
+
+	__block volatile BOOL called = NO;
+	__block BOOL onQueue = NO;
+	[_client performCallback:^{
+		onQueue = WAIsOnCallbackQueue();
+		called = YES;
+	}];
+
+	STAssertTrue(WAWaitForFlag(&called), @"The callback was not called");
+	STAssertTrue(onQueue, nil);
+
+	_client.callbackQueue = NULL;
+	STAssertTrue(_client.callbackQueue == NULL, nil);
+}
+
+- (void)testStreamingFetchDeliversOnCallbackQueue
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:2 rowsPerPartition:50];
+	_client.workQueue = _workQueue;
+	_client.callbackQueue = _callbackQueue;
+
+	__block NSUInteger entityCount = 0;
+	__block NSUInteger misplacedCallbacks = 0;
+	__block volatile BOOL finished = NO;
+	__block NSError *fetchError = nil;
+
+	WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Dispatch"];
+	[_client fetchEntitiesWithRequest:fetchRequest usingEntityHandler:^(WATableEntity *entity) {
+		if (!WAIsOnCallbackQueue()) {
+			misplacedCallbacks++;
+		}
+		entityCount++;
+	} continuationHandler:^(WAResultContinuation *resultContinuation) {
+		if (!WAIsOnCallbackQueue()) {
+			misplacedCallbacks++;
+		}
+	} completionHandler:^(WAResultContinuation *resultContinuation, NSError *error) {
+		if (!WAIsOnCallbackQueue()) {
+			misplacedCallbacks++;
+		}
+		fetchError = [error retain];
+		finished = YES;
+	}];
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The fetch did not finish");
+	STAssertNil([fetchError autorelease], @"%@", fetchError);
+	STAssertEquals(entityCount, (NSUInteger)100, nil);
+	STAssertEquals(misplacedCallbacks, (NSUInteger)0, nil);
+}
+
+- (void)testEntityBatchFetchDeliversOnCallbackQueue
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:1 rowsPerPartition:20];
+	_client.workQueue = _workQueue;
+	_client.callbackQueue = _callbackQueue;
+
+	__block volatile BOOL finished = NO;
+	__block BOOL onQueue = NO;
+	__block NSUInteger count = 0;
+
+	[_client fetchEntityBatchWithRequest:[WATableFetchRequest fetchRequestForTable:@"Dispatch"] usingCompletionHandler:^(WATableEntityBatch *batch, WAResultContinuation *resultContinuation, NSError *error) {
+		onQueue = WAIsOnCallbackQueue();
+		count = batch.count;
+		finished = YES;
+	}];
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The fetch did not finish");
+	STAssertTrue(onQueue, nil);
+	STAssertEquals(count, (NSUInteger)20, nil);
+}
+
+- (void)testTableOperationsDeliverOnCallbackQueue
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:0 rowsPerPartition:0];
+	_client.workQueue = _workQueue;
+	_client.callbackQueue = _callbackQueue;
+
+	NSMutableArray *operations = [NSMutableArray array];
+	for (NSUInteger row = 0; row < 10; row++) {
+		WATableEntity *entity = [WATableEntity createEntityForTable:@"Dispatch"];
+		entity.partitionKey = [_dataset partitionKeyAtIndex:0];
+		entity.rowKey = [_dataset rowKeyAtIndex:row];
+		[operations addObject:[WATableOperation insertOperationWithEntity:entity]];
+	}
+
+	__block volatile BOOL finished = NO;
+	__block BOOL onQueue = NO;
+	__block NSError *batchError = nil;
+
+	[_client executeTableOperations:operations withCompletionHandler:^(NSArray *results, NSError *error) {
+		onQueue = WAIsOnCallbackQueue();
+		batchError = [error retain];
+		finished = YES;
+	}];
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The operations did not finish");
+	STAssertNil([batchError autorelease], @"%@", batchError);
+	STAssertTrue(onQueue, nil);
+	STAssertEquals([[WAStorageEmulator sharedEmulator] entityCountInTable:@"Dispatch"], (NSUInteger)10, nil);
+}
+
+- (void)testCallbackQueueImpliesWorkQueue
+{
+	STAssertNil(_client.workQueue, nil);
+	_client.callbackQueue = _callbackQueue;
+	NSOperationQueue *workQueue = _client.workQueue;
+	STAssertNotNil(workQueue, nil);
+	STAssertEquals(workQueue.maxConcurrentOperationCount, (NSInteger)1, nil);
+	STAssertEquals(_client.workQueue, workQueue, nil);
+
+	_client.workQueue = _workQueue;
+	STAssertEquals(_client.workQueue, _workQueue, nil);
+}
+
+- (void)testCursorOnCallbackQueue
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:3 rowsPerPartition:40];
+	// no work queue: pages after the first are requested from the callback queue
+	_client.callbackQueue = _callbackQueue;
+
+	__block NSUInteger entityCount = 0;
+	__block NSUInteger misplacedCallbacks = 0;
+	__block volatile BOOL finished = NO;
+	__block NSError *cursorError = nil;
+
+	dispatch_async(_callbackQueue, ^{
+		WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Dispatch"];
+		fetchRequest.topRows = 25;
+
+		WATableEntityCursor *cursor = [_client entityCursorWithRequest:fetchRequest prefetchDepth:2];
+		__block void (^nextPage)(NSArray *, NSError *) = nil;
+		nextPage = [^(NSArray *entities, NSError *error) {
+			if (!WAIsOnCallbackQueue()) {
+				misplacedCallbacks++;
+			}
+			if (entities) {
+				entityCount += entities.count;
+				[cursor nextPageWithCompletionHandler:nextPage];
+				return;
+			}
+			cursorError = [error retain];
+			[nextPage autorelease];
+			finished = YES;
+		} copy];
+		[cursor nextPageWithCompletionHandler:nextPage];
+	});
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The cursor did not finish");
+	STAssertNil([cursorError autorelease], @"%@", cursorError);
+	STAssertEquals(entityCount, (NSUInteger)120, nil);
+	STAssertEquals(misplacedCallbacks, (NSUInteger)0, nil);
+}
+
+- (void)testCursorWithWorkQueueCallsBackOnCreatingThread
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:2 rowsPerPartition:40];
+	_client.workQueue = _workQueue;
+
+	NSThread *thread = [NSThread currentThread];
+	__block NSUInteger entityCount = 0;
+	__block NSUInteger pageCount = 0;
+	__block NSUInteger misplacedCallbacks = 0;
+	__block volatile BOOL finished = NO;
+
+	WATableFetchRequest *fetchRequest = [WATableFetchRequest fetchRequestForTable:@"Dispatch"];
+	fetchRequest.topRows = 20;
+
+	WATableEntityCursor *cursor = [_client entityCursorWithRequest:fetchRequest prefetchDepth:3];
+	STAssertEquals(cursor.pageIndex, (NSUInteger)NSNotFound, nil);
+	__block void (^nextPage)(NSArray *, NSError *) = nil;
+	nextPage = [^(NSArray *entities, NSError *error) {
+		if ([NSThread currentThread] != thread) {
+			misplacedCallbacks++;
+		}
+		if (entities) {
+			STAssertEquals(cursor.pageIndex, pageCount, nil);
+			pageCount++;
+			entityCount += entities.count;
+			[cursor nextPageWithCompletionHandler:nextPage];
+			return;
+		}
+		STAssertNil(error, @"%@", error);
+		[nextPage autorelease];
+		finished = YES;
+	} copy];
+	[cursor nextPageWithCompletionHandler:nextPage];
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The cursor did not finish");
+	STAssertEquals(entityCount, (NSUInteger)80, nil);
+	STAssertEquals(misplacedCallbacks, (NSUInteger)0, nil);
+}
+
+- (void)testScanOnCallbackQueue
+{
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Dispatch" fromDataset:_dataset partitions:4 rowsPerPartition:30];
+	_client.workQueue = _workQueue;
+	_client.callbackQueue = _callbackQueue;
+
+	__block NSUInteger entityCount = 0;
+	__block NSUInteger misplacedCallbacks = 0;
+	__block volatile BOOL finished = NO;
+	__block NSError *scanError = nil;
+	__block WATableScan *scan = nil;
+
+	NSArray *ranges = [NSArray arrayWithObjects:
+					   [WAPartitionKeyRange rangeWithLowerBound:nil upperBound:[_dataset partitionKeyAtIndex:2]],
+					   [WAPartitionKeyRange rangeWithLowerBound:[_dataset partitionKeyAtIndex:2] upperBound:nil],
+					   nil];
+
+	dispatch_async(_callbackQueue, ^{
+		scan = [[WATableScan alloc] initWithClient:_client tableName:@"Dispatch" ranges:ranges];
+		scan.topRows = 20;
+		scan.ordering = WATableScanOrdered;
+		[scan startWithPageHandler:^(NSArray *entities) {
+			if (!WAIsOnCallbackQueue()) {
+				misplacedCallbacks++;
+			}
+			entityCount += entities.count;
+		} completionHandler:^(NSError *error) {
+			if (!WAIsOnCallbackQueue()) {
+				misplacedCallbacks++;
+			}
+			scanError = [error retain];
+			finished = YES;
+		}];
+	});
+
+	STAssertTrue(WAWaitForFlag(&finished), @"The scan did not finish");
+	STAssertNil([scanError autorelease], @"%@", scanError);
+	STAssertEquals(entityCount, (NSUInteger)120, nil);
+	STAssertEquals(misplacedCallbacks, (NSUInteger)0, nil);
+	[scan release];
+}
+
+@end
@@ -0,0 +1,125 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WACompiledFilterTests.h"
+
+#import "WACompiledFilter.h"
+
+@implementation WACompiledFilterTests
+
+- (void)setUp
+{
+	[super setUp];
+	[WACompiledFilter removeAllCachedFilters];
+}
+
+- (void)testComparisonsAndCompounds
+{
+	NSError *error = nil;
+	WACompiledFilter *filter = [WACompiledFilter compiledFilterWithPredicateFormat:@"PartitionKey == $customer AND (Amount > $minimum OR NOT Closed == YES)" error:&error];
+	STAssertNotNil(filter, @"%@", error);
+
+	NSDictionary *variables = [NSDictionary dictionaryWithObjectsAndKeys:@"O'Brien", @"customer", [NSNumber numberWithInt:250], @"minimum", nil];
+	NSString *filterString = [filter filterStringWithVariables:variables error:&error];
+	STAssertEqualObjects(filterString, @"(PartitionKey eq 'O''Brien') and ((Amount gt 250) or (not (Closed eq true)))", @"%@", error);
+	STAssertEqualObjects(filter.variableNames, ([NSArray arrayWithObjects:@"customer", @"minimum", nil]), nil);
+}
+
+- (void)testValueTypes
+{
+	WACompiledFilter *filter = [WACompiledFilter compiledFilterWithPredicateFormat:@"Value == $value" error:NULL];
+
+	NSDictionary *cases = [NSDictionary dictionaryWithObjectsAndKeys:
+						   @"Value eq 2.5", [NSNumber numberWithDouble:2.5],
+						   @"Value eq 3.0", [NSNumber numberWithDouble:3],
+						   @"Value eq 5000000000L", [NSNumber numberWithLongLong:5000000000LL],
+						   @"Value eq false", [NSNumber numberWithBool:NO],
+						   @"Value eq datetime'2001-01-01T00:00:01.5000000Z'", [NSDate dateWithTimeIntervalSinceReferenceDate:1.5],
+						   @"Value eq X'00ff'", [NSData dataWithBytes:"\x00\xff" length:2],
+						   nil];
+	for (id value in cases) {
+		NSString *filterString = [filter filterStringWithVariables:[NSDictionary dictionaryWithObject:value forKey:@"value"] error:NULL];
+		STAssertEqualObjects(filterString, [cases objectForKey:value], nil);
+	}
+}
+
+- (void)testReversedComparison
+{
+	WACompiledFilter *filter = [WACompiledFilter compiledFilterWithPredicateFormat:@"$limit <= Amount" error:NULL];
+	NSString *filterString = [filter filterStringWithVariables:[NSDictionary dictionaryWithObject:[NSNumber numberWithInt:10] forKey:@"limit"] error:NULL];
+	STAssertEqualObjects(filterString, @"Amount ge 10", nil);
+}
+
+- (void)testErrors
+{
+	NSError *error = nil;
+	STAssertNil([WACompiledFilter compiledFilterWithPredicateFormat:@"Name BEGINSWITH $prefix" error:&error], nil);
+	STAssertNotNil(error, nil);
+
+	error = nil;
+	STAssertNil([WACompiledFilter compiledFilterWithPredicateFormat:@"Name ==" error:&error], nil);
+	STAssertNotNil(error, nil);
+
+	error = nil;
+	WACompiledFilter *filter = [WACompiledFilter compiledFilterWithPredicateFormat:@"Name == $name" error:NULL];
+	STAssertNil([filter filterStringWithVariables:[NSDictionary dictionary] error:&error], nil);
+	STAssertNotNil(error, nil);
+}
+
+- (void)testCacheReturnsSameFilter
+{
+	WACompiledFilter *first = [WACompiledFilter compiledFilterWithPredicateFormat:@"RowKey == $row" error:NULL];
+	WACompiledFilter *second = [WACompiledFilter compiledFilterWithPredicateFormat:@"RowKey == $row" error:NULL];
+	STAssertTrue(first == second, nil);
+}
+
+- (void)testMatchesPredicateTranslation
+{
+	NSDictionary *variables = [NSDictionary dictionaryWithObjectsAndKeys:
+							   @"O'Brien", @"name",
+							   [NSNumber numberWithInt:250], @"amount",
+							   [NSNumber numberWithDouble:2.5], @"rate",
+							   [NSNumber numberWithBool:YES], @"closed",
+							   nil];
+	NSArray *formats = [NSArray arrayWithObjects:
+						@"Name == $name",
+						@"Name != $name",
+						@"Amount < $amount",
+						@"Amount <= $amount",
+						@"Amount > $amount",
+						@"Amount >= $amount",
+						@"Rate == $rate",
+						@"Closed == $closed",
+						@"$amount <= Amount",
+						@"Name == $name AND Amount > $amount",
+						@"Name == $name OR Rate < $rate",
+						@"NOT Closed == $closed",
+						@"PartitionKey == $name AND (Amount > $amount OR NOT Closed == $closed)",
+						nil];
+
+	for (NSString *format in formats) {
+		NSError *error = nil;
+		NSPredicate *predicate = [[NSPredicate predicateWithFormat:format] predicateWithSubstitutionVariables:variables];
+		WATableFetchRequest *translated = [WATableFetchRequest fetchRequestForTable:@"Orders" predicate:predicate error:&error];
+		STAssertNotNil(translated, @"%@: %@", format, error);
+
+		WATableFetchRequest *compiled = [WATableFetchRequest fetchRequestForTable:@"Orders" predicateFormat:format variables:variables error:&error];
+		STAssertNotNil(compiled, @"%@: %@", format, error);
+		STAssertEqualObjects(compiled.filter, translated.filter, @"%@", format);
+	}
+}
+
+@end
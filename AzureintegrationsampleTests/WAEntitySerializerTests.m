@@ -0,0 +1,147 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAEntitySerializerTests.h"
+
+#import "WAEntitySerializer.h"
+#import "WAEntityStreamParser.h"
+#import "WAJSONEntityParser.h"
+#import "WATableEntity.h"
+
+@interface WAEntitySerializerTests ()
+
+- (WATableEntity *)entityFromAtomEntry:(NSData *)entry;
+- (WATableEntity *)entityFromJSONEntity:(NSData *)JSONEntity;
+
+@end
+
+@implementation WAEntitySerializerTests
+
+- (void)testInt32RoundTrip
+{
+	WATableEntity *entity = [WATableEntity createEntityForTable:@"Customers"];
+	entity.partitionKey = @"Seattle";
+	entity.rowKey = @"Smith";
+	[entity setObject:[NSNumber numberWithInt:42] forKey:@"Visits"];
+	[entity setObject:[NSNumber numberWithLongLong:5000000000LL] forKey:@"Orders"];
+
+	NSString *entry = [[[NSString alloc] initWithData:[WAEntitySerializer atomEntryForEntity:entity] encoding:NSUTF8StringEncoding] autorelease];
+	STAssertTrue([entry rangeOfString:@"<d:Visits m:type=\"Edm.Int32\">42</d:Visits>"].location != NSNotFound, entry);
+	STAssertTrue([entry rangeOfString:@"<d:Orders m:type=\"Edm.Int64\">5000000000</d:Orders>"].location != NSNotFound, entry);
+
+	WATableEntity *read = [self entityFromAtomEntry:[entry dataUsingEncoding:NSUTF8StringEncoding]];
+	STAssertEquals(strcmp([[read objectForKey:@"Visits"] objCType], @encode(int)), 0, nil);
+	NSString *written = [[[NSString alloc] initWithData:[WAEntitySerializer atomEntryForEntity:read] encoding:NSUTF8StringEncoding] autorelease];
+	STAssertTrue([written rangeOfString:@"<d:Visits m:type=\"Edm.Int32\">42</d:Visits>"].location != NSNotFound, written);
+
+	NSDictionary *JSON = [NSJSONSerialization JSONObjectWithData:[WAEntitySerializer JSONEntityForEntity:entity] options:0 error:NULL];
+	STAssertEqualObjects([JSON objectForKey:@"Visits"], [NSNumber numberWithInt:42], nil);
+	STAssertNil([JSON objectForKey:@"Visits@odata.type"], @"an integer without an annotation is an Edm.Int32");
+	STAssertEqualObjects([JSON objectForKey:@"Orders@odata.type"], @"Edm.Int64", nil);
+
+	read = [self entityFromJSONEntity:[WAEntitySerializer JSONEntityForEntity:entity]];
+	STAssertEquals(strcmp([[read objectForKey:@"Visits"] objCType], @encode(int)), 0, nil);
+	STAssertEqualObjects([read objectForKey:@"Orders"], [NSNumber numberWithLongLong:5000000000LL], nil);
+}
+
+- (void)testGuidRoundTrip
+{
+	NSString *guid = @"c9da6455-213d-42c9-9a79-3e9149a57833";
+	WATableEntity *entity = [WATableEntity createEntityForTable:@"Customers"];
+	entity.partitionKey = @"Seattle";
+	entity.rowKey = @"Smith";
+	[entity setObject:guid forKey:@"CustomerId"];
+	[entity setEdmType:WAEdmTypeGuid forKey:@"CustomerId"];
+
+	NSData *entry = [WAEntitySerializer atomEntryForEntity:entity];
+	NSString *text = [[[NSString alloc] initWithData:entry encoding:NSUTF8StringEncoding] autorelease];
+	STAssertTrue([text rangeOfString:@"<d:CustomerId m:type=\"Edm.Guid\">c9da6455-213d-42c9-9a79-3e9149a57833</d:CustomerId>"].location != NSNotFound, text);
+
+	WATableEntity *read = [self entityFromAtomEntry:entry];
+	STAssertEqualObjects([read objectForKey:@"CustomerId"], guid, nil);
+	STAssertEquals([read edmTypeForKey:@"CustomerId"], WAEdmTypeGuid, @"the parser records the type the value cannot carry");
+	STAssertEquals([read edmTypeForKey:@"PartitionKey"], WAEdmTypeString, nil);
+
+	NSDictionary *JSON = [NSJSONSerialization JSONObjectWithData:[WAEntitySerializer JSONEntityForEntity:read] options:0 error:NULL];
+	STAssertEqualObjects([JSON objectForKey:@"CustomerId"], guid, nil);
+	STAssertEqualObjects([JSON objectForKey:@"CustomerId@odata.type"], @"Edm.Guid", nil);
+
+	read = [self entityFromJSONEntity:[WAEntitySerializer JSONEntityForEntity:read]];
+	STAssertEquals([read edmTypeForKey:@"CustomerId"], WAEdmTypeGuid, nil);
+
+	// the recorded type no longer applies once the value is not a string
+	[read setObject:[NSNumber numberWithInt:1] forKey:@"CustomerId"];
+	text = [[[NSString alloc] initWithData:[WAEntitySerializer atomEntryForEntity:read] encoding:NSUTF8StringEncoding] autorelease];
+	STAssertTrue([text rangeOfString:@"<d:CustomerId m:type=\"Edm.Int32\">1</d:CustomerId>"].location != NSNotFound, text);
+}
+
+- (void)testNonFiniteDoubleRoundTrip
+{
+	WATableEntity *entity = [WATableEntity createEntityForTable:@"Customers"];
+	entity.partitionKey = @"Seattle";
+	entity.rowKey = @"Smith";
+	[entity setObject:[NSNumber numberWithDouble:NAN] forKey:@"Missing"];
+	[entity setObject:[NSNumber numberWithDouble:INFINITY] forKey:@"High"];
+	[entity setObject:[NSNumber numberWithDouble:-INFINITY] forKey:@"Low"];
+
+	NSData *entry = [WAEntitySerializer atomEntryForEntity:entity];
+	NSString *text = [[[NSString alloc] initWithData:entry encoding:NSUTF8StringEncoding] autorelease];
+	STAssertTrue([text rangeOfString:@"<d:Missing m:type=\"Edm.Double\">NaN</d:Missing>"].location != NSNotFound, text);
+	STAssertTrue([text rangeOfString:@"<d:High m:type=\"Edm.Double\">INF</d:High>"].location != NSNotFound, text);
+	STAssertTrue([text rangeOfString:@"<d:Low m:type=\"Edm.Double\">-INF</d:Low>"].location != NSNotFound, text);
+
+	NSArray *readers = [NSArray arrayWithObjects:[self entityFromAtomEntry:entry], [self entityFromJSONEntity:[WAEntitySerializer JSONEntityForEntity:entity]], nil];
+	for (WATableEntity *read in readers) {
+		STAssertTrue(isnan([[read objectForKey:@"Missing"] doubleValue]), nil);
+		STAssertEquals([[read objectForKey:@"High"] doubleValue], (double)INFINITY, nil);
+		STAssertEquals([[read objectForKey:@"Low"] doubleValue], (double)-INFINITY, nil);
+	}
+}
+
+#pragma mark - Private
+
+- (WATableEntity *)entityFromAtomEntry:(NSData *)entry
+{
+	__block WATableEntity *read = nil;
+	WAEntityStreamParser *parser = [[[WAEntityStreamParser alloc] initWithTableName:@"Customers" entityHandler:^(WATableEntity *entity) {
+		read = [[entity retain] autorelease];
+	}] autorelease];
+
+	NSError *error = nil;
+	STAssertTrue([parser parseData:entry error:&error] && [parser finishWithError:&error], @"%@", error);
+	STAssertNotNil(read, nil);
+	return read;
+}
+
+- (WATableEntity *)entityFromJSONEntity:(NSData *)JSONEntity
+{
+	// the entity is read back as the only member of a feed
+	NSMutableData *feed = [NSMutableData dataWithData:[@"{\"value\":[" dataUsingEncoding:NSUTF8StringEncoding]];
+	[feed appendData:JSONEntity];
+	[feed appendData:[@"]}" dataUsingEncoding:NSUTF8StringEncoding]];
+
+	__block WATableEntity *read = nil;
+	WAJSONEntityParser *parser = [[[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityHandler:^(WATableEntity *entity) {
+		read = [[entity retain] autorelease];
+	}] autorelease];
+
+	NSError *error = nil;
+	STAssertTrue([parser parseData:feed error:&error] && [parser finishWithError:&error], @"%@", error);
+	STAssertNotNil(read, nil);
+	return read;
+}
+
+@end
@@ -0,0 +1,202 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAFutureTests.h"
+
+#import "WAAuthenticationCredential.h"
+#import "WACloudStorageClient+Futures.h"
+#import "WAFuture.h"
+#import "WATableEntity.h"
+#import "WATableFetchRequest.h"
+#import "WAToolkitPrivate.h"
+#import "WAStorageEmulator.h"
+
+#define WAFutureTestTimeout 30
+
+/*
+ Finishes a future from another thread after a delay.
+ */
+static void WAFinishLater(WAFuture *future, NSTimeInterval delay, id result, NSError *error)
+{
+	dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
+		[future finishWithResult:result error:error];
+	});
+}
+
+@implementation WAFutureTests
+
+- (void)testFinishesOnce
+{
+	WAFuture *future = [WAFuture future];
+	STAssertFalse(future.finished, nil);
+	STAssertTrue([future finishWithResult:@"first" error:nil], nil);
+	STAssertFalse([future finishWithResult:@"second" error:nil], nil);
+	STAssertTrue(future.finished, nil);
+	STAssertEqualObjects(future.result, @"first", nil);
+	STAssertNil(future.error, nil);
+}
+
+- (void)testErrorDiscardsResult
+{
+	NSError *error = WAToolkitError(404, @"ResourceNotFound", @"Not found");
+	WAFuture *future = [WAFuture future];
+	[future finishWithResult:@"ignored" error:error];
+	STAssertNil(future.result, nil);
+	STAssertEqualObjects(future.error, error, nil);
+}
+
+- (void)testWaitReturnsResult
+{
+	WAFuture *future = [WAFuture future];
+	WAFinishLater(future, 0.05, @"done", nil);
+
+	NSError *error = nil;
+	id result = [future waitWithTimeout:WAFutureTestTimeout error:&error];
+	STAssertEqualObjects(result, @"done", nil);
+	STAssertNil(error, nil);
+}
+
+- (void)testWaitTimesOut
+{
+	WAFuture *future = [WAFuture future];
+
+	NSError *error = nil;
+	STAssertNil([future waitWithTimeout:0.05 error:&error], nil);
+	STAssertEqualObjects([[error userInfo] objectForKey:WAErrorReasonCodeKey], WAFutureTimeoutReasonCode, nil);
+	STAssertFalse(future.finished, nil);
+}
+
+- (void)testCompletionHandlerAddedAfterFinishing
+{
+	WAFuture *future = [WAFuture futureWithResult:@"done"];
+	WAFuture *observed = [WAFuture future];
+	[future addCompletionHandler:^(id result, NSError *error) {
+		[observed finishWithResult:result error:error];
+	}];
+	STAssertEqualObjects([observed waitWithTimeout:WAFutureTestTimeout error:NULL], @"done", nil);
+}
+
+- (void)testThenChainsResults
+{
+	WAFuture *future = [[WAFuture futureWithResult:[NSNumber numberWithInt:1]] then:^WAFuture *(NSNumber *result) {
+		WAFuture *next = [WAFuture future];
+		WAFinishLater(next, 0.01, [NSNumber numberWithInt:[result intValue] + 1], nil);
+		return next;
+	}];
+	future = [future then:^WAFuture *(NSNumber *result) {
+		return [WAFuture futureWithResult:[NSNumber numberWithInt:[result intValue] * 10]];
+	}];
+
+	STAssertEqualObjects([future waitWithTimeout:WAFutureTestTimeout error:NULL], [NSNumber numberWithInt:20], nil);
+}
+
+- (void)testThenSkipsBlockAfterError
+{
+	NSError *failure = WAToolkitError(500, nil, @"Failed");
+	__block BOOL called = NO;
+	WAFuture *future = [[WAFuture futureWithError:failure] then:^WAFuture *(id result) {
+		called = YES;
+		return [WAFuture futureWithResult:@"unexpected"];
+	}];
+
+	NSError *error = nil;
+	STAssertNil([future waitWithTimeout:WAFutureTestTimeout error:&error], nil);
+	STAssertEqualObjects(error, failure, nil);
+	STAssertFalse(called, nil);
+}
+
+- (void)testWhenAllKeepsOrder
+{
+	NSMutableArray *futures = [NSMutableArray array];
+	for (NSUInteger i = 0; i < 20; i++) {
+		WAFuture *future = [WAFuture future];
+		// finish in reverse order
+		WAFinishLater(future, 0.001 * (20 - i), (i % 5) ? [NSNumber numberWithUnsignedInteger:i] : nil, nil);
+		[futures addObject:future];
+	}
+
+	NSArray *results = [[WAFuture whenAll:futures] waitWithTimeout:WAFutureTestTimeout error:NULL];
+	STAssertEquals(results.count, (NSUInteger)20, nil);
+	[results enumerateObjectsUsingBlock:^(id result, NSUInteger index, BOOL *stop) {
+		id expected = (index % 5) ? (id)[NSNumber numberWithUnsignedInteger:index] : (id)[NSNull null];
+		STAssertEqualObjects(result, expected, nil);
+	}];
+
+	STAssertEqualObjects([[WAFuture whenAll:[NSArray array]] waitWithTimeout:WAFutureTestTimeout error:NULL], [NSArray array], nil);
+}
+
+- (void)testWhenAllFailsWithFirstError
+{
+	NSError *failure = WAToolkitError(409, @"Conflict", @"Conflict");
+	WAFuture *pending = [WAFuture future];
+	WAFuture *failed = [WAFuture futureWithError:failure];
+
+	NSError *error = nil;
+	STAssertNil([[WAFuture whenAll:[NSArray arrayWithObjects:pending, failed, nil]] waitWithTimeout:WAFutureTestTimeout error:&error], nil);
+	STAssertEqualObjects(error, failure, nil);
+	STAssertFalse(pending.finished, nil);
+}
+
+- (void)testWhenAnyReturnsFirstFinished
+{
+	WAFuture *slow = [WAFuture future];
+	WAFuture *fast = [WAFuture future];
+	WAFinishLater(slow, 5, @"slow", nil);
+	WAFinishLater(fast, 0.01, @"fast", nil);
+
+	WAFuture *first = [[WAFuture whenAny:[NSArray arrayWithObjects:slow, fast, nil]] waitWithTimeout:WAFutureTestTimeout error:NULL];
+	STAssertEquals(first, fast, nil);
+	STAssertEqualObjects(first.result, @"fast", nil);
+
+	NSError *error = nil;
+	STAssertNil([[WAFuture whenAny:[NSArray array]] waitWithTimeout:WAFutureTestTimeout error:&error], nil);
+	STAssertNotNil(error, nil);
+}
+
+- (void)testClientOperationsCompose
+{
+	[WAStorageEmulator install];
+	[[WAStorageEmulator sharedEmulator] reset];
+
+	WAAuthenticationCredential *credential = [WAAuthenticationCredential credentialWithAzureServiceAccount:WAStorageEmulatorAccountName accessKey:WAStorageEmulatorAccessKey];
+	WACloudStorageClient *client = [WACloudStorageClient storageClientWithCredential:credential];
+
+	// create the table, insert in parallel, then read everything back, all from a thread that blocks
+	WAFuture *future = [[client futureCreateTableNamed:@"Futures"] then:^WAFuture *(id result) {
+		NSMutableArray *inserts = [NSMutableArray array];
+		for (NSUInteger row = 0; row < 25; row++) {
+			WATableEntity *entity = [WATableEntity createEntityForTable:@"Futures"];
+			entity.partitionKey = @"p";
+			entity.rowKey = [NSString stringWithFormat:@"%04lu", (unsigned long)row];
+			[entity setObject:@"value" forKey:@"Name"];
+			[inserts addObject:[client futureInsertEntity:entity]];
+		}
+		return [WAFuture whenAll:inserts];
+	}];
+	future = [future then:^WAFuture *(id result) {
+		return [client futureFetchEntitiesWithRequest:[WATableFetchRequest fetchRequestForTable:@"Futures"]];
+	}];
+
+	NSError *error = nil;
+	WAResultPage *page = [future waitWithTimeout:WAFutureTestTimeout error:&error];
+	STAssertNil(error, @"%@", error);
+	STAssertEquals([page.items count], (NSUInteger)25, nil);
+	STAssertNil(page.resultContinuation, nil);
+
+	[WAStorageEmulator uninstall];
+}
+
+@end
@@ -0,0 +1,182 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAJSONEntityParserTests.h"
+
+#import "WAEdmDecoding.h"
+#import "WAJSONEntityParser.h"
+#import "WATableEntity.h"
+#import "WATableEntityBatch.h"
+
+static NSString * const WAMinimalMetadataFeed = @"{\"odata.metadata\":\"https://account.table.core.windows.net/$metadata#Customers\",\"value\":["
+	@"{\"odata.etag\":\"W/\\\"datetime'2013-08-22T01%3A12%3A06.2608595Z'\\\"\",\"PartitionKey\":\"Seattle\",\"RowKey\":\"O'Brien\","
+	@"\"Timestamp@odata.type\":\"Edm.DateTime\",\"Timestamp\":\"2013-08-22T01:12:06.2608595Z\","
+	@"\"Avatar@odata.type\":\"Edm.Binary\",\"Avatar\":\"AAEC\",\"Balance\":12.5,\"Orders@odata.type\":\"Edm.Int64\",\"Orders\":\"5000000000\","
+	@"\"Visits\":42,\"Active\":true,\"Closed\":null,\"Notes\":\"caf\\u00e9 \\\"quoted\\\"\\n\\ud83d\\ude00\"},"
+	@"{\"PartitionKey\":\"Seattle\",\"RowKey\":\"Smith\",\"Timestamp@odata.type\":\"Edm.DateTime\",\"Timestamp\":\"2013-08-22T01:12:07Z\",\"Balance@odata.type\":\"Edm.Double\",\"Balance\":3}"
+	@"]}";
+
+@interface WAJSONEntityParserTests ()
+
+- (NSArray *)entitiesFromDocument:(NSString *)document chunkSize:(NSUInteger)chunkSize configuration:(void (^)(WAJSONEntityParser *parser))configuration error:(NSError **)error;
+
+@end
+
+@implementation WAJSONEntityParserTests
+
+- (void)testMinimalMetadataFeed
+{
+	NSError *error = nil;
+	NSArray *entities = [self entitiesFromDocument:WAMinimalMetadataFeed chunkSize:4096 configuration:nil error:&error];
+	STAssertEquals(entities.count, (NSUInteger)2, @"%@", error);
+
+	WATableEntity *entity = [entities objectAtIndex:0];
+	STAssertEqualObjects(entity.partitionKey, @"Seattle", nil);
+	STAssertEqualObjects(entity.rowKey, @"O'Brien", nil);
+	STAssertEqualsWithAccuracy([entity.timeStamp timeIntervalSinceReferenceDate], 398826726.26, 1.0, nil);
+	STAssertEqualObjects([entity objectForKey:@"Avatar"], [NSData dataWithBytes:"\x00\x01\x02" length:3], nil);
+	STAssertEqualObjects([entity objectForKey:@"Balance"], [NSNumber numberWithDouble:12.5], nil);
+	STAssertEqualObjects([entity objectForKey:@"Orders"], [NSNumber numberWithLongLong:5000000000LL], nil);
+	STAssertEqualObjects([entity objectForKey:@"Visits"], [NSNumber numberWithInt:42], nil);
+	STAssertEqualObjects([entity objectForKey:@"Active"], [NSNumber numberWithBool:YES], nil);
+	STAssertNil([entity objectForKey:@"Closed"], nil);
+	STAssertEqualObjects([entity objectForKey:@"Notes"], @"café \"quoted\"\n\U0001F600", nil);
+	STAssertNil([entity objectForKey:@"odata.etag"], nil);
+
+	// the annotation makes a whole number a double
+	STAssertEquals(strcmp([[[entities objectAtIndex:1] objectForKey:@"Balance"] objCType], @encode(double)), 0, nil);
+}
+
+- (void)testEveryChunkBoundary
+{
+	NSArray *expected = [self entitiesFromDocument:WAMinimalMetadataFeed chunkSize:4096 configuration:nil error:NULL];
+
+	for (NSUInteger chunkSize = 1; chunkSize < 24; chunkSize++) {
+		NSError *error = nil;
+		NSArray *entities = [self entitiesFromDocument:WAMinimalMetadataFeed chunkSize:chunkSize configuration:nil error:&error];
+		STAssertEquals(entities.count, expected.count, @"chunk size %lu: %@", (unsigned long)chunkSize, error);
+		for (NSUInteger i = 0; i < MIN(entities.count, expected.count); i++) {
+			for (NSString *key in [[expected objectAtIndex:i] keys]) {
+				STAssertEqualObjects([[entities objectAtIndex:i] objectForKey:key], [[expected objectAtIndex:i] objectForKey:key], @"chunk size %lu", (unsigned long)chunkSize);
+			}
+		}
+	}
+}
+
+- (void)testNoMetadataWithPropertyTypes
+{
+	NSString *document = @"{\"value\":[{\"PartitionKey\":\"p\",\"RowKey\":\"r\",\"Timestamp\":\"2013-08-22T01:12:06Z\",\"Joined\":\"2008-07-10T00:00:00Z\",\"Orders\":\"255\",\"Code\":\"255\",\"Ratio\":2}]}";
+	NSDictionary *types = [NSDictionary dictionaryWithObjectsAndKeys:
+						   [NSNumber numberWithInt:WAEdmTypeDateTime], @"Joined",
+						   [NSNumber numberWithInt:WAEdmTypeInt64], @"Orders",
+						   [NSNumber numberWithInt:WAEdmTypeDouble], @"Ratio",
+						   nil];
+
+	NSArray *entities = [self entitiesFromDocument:document chunkSize:7 configuration:^(WAJSONEntityParser *parser) {
+		parser.propertyTypes = types;
+	} error:NULL];
+	STAssertEquals(entities.count, (NSUInteger)1, nil);
+
+	WATableEntity *entity = [entities lastObject];
+	STAssertNotNil(entity.timeStamp, nil);
+	STAssertTrue([[entity objectForKey:@"Joined"] isKindOfClass:[NSDate class]], nil);
+	STAssertEqualObjects([entity objectForKey:@"Orders"], [NSNumber numberWithLongLong:255], nil);
+	STAssertEqualObjects([entity objectForKey:@"Code"], @"255", nil);
+	STAssertEquals(strcmp([[entity objectForKey:@"Ratio"] objCType], @encode(double)), 0, nil);
+}
+
+- (void)testProjectionSingleEntityAndErrors
+{
+	NSString *document = @"{\"odata.metadata\":\"x\",\"PartitionKey\":\"p\",\"RowKey\":\"r\",\"Name\":\"n\",\"Secret\":\"s\"}";
+	NSArray *entities = [self entitiesFromDocument:document chunkSize:5 configuration:^(WAJSONEntityParser *parser) {
+		parser.selectedProperties = [NSSet setWithObject:@"Name"];
+	} error:NULL];
+	STAssertEquals(entities.count, (NSUInteger)1, nil);
+	STAssertEqualObjects([[entities lastObject] objectForKey:@"Name"], @"n", nil);
+	STAssertNil([[entities lastObject] objectForKey:@"Secret"], nil);
+
+	WAJSONEntityParser *parser = [[[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityHandler:nil] autorelease];
+	NSString *errorDocument = @"{\"odata.error\":{\"code\":\"ResourceNotFound\",\"message\":{\"lang\":\"en-US\",\"value\":\"The specified resource does not exist.\"}}}";
+	STAssertTrue([parser parseData:[errorDocument dataUsingEncoding:NSUTF8StringEncoding] error:NULL], nil);
+	STAssertTrue([parser finishWithError:NULL], nil);
+	STAssertEqualObjects(parser.errorCode, @"ResourceNotFound", nil);
+	STAssertEqualObjects(parser.errorMessage, @"The specified resource does not exist.", nil);
+	STAssertEquals(parser.entityCount, (NSUInteger)0, nil);
+
+	NSError *error = nil;
+	STAssertNil([self entitiesFromDocument:@"{\"value\":[{\"PartitionKey\":\"p\"]}" chunkSize:64 configuration:nil error:&error], nil);
+	STAssertNotNil(error, nil);
+	error = nil;
+	STAssertNil([self entitiesFromDocument:@"{\"value\":[{\"PartitionKey\":\"p\"" chunkSize:64 configuration:nil error:&error], nil);
+	STAssertNotNil(error, nil);
+}
+
+- (void)testEntityBatch
+{
+	WATableEntityBatch *batch = [[[WATableEntityBatch alloc] initWithTableName:@"Customers"] autorelease];
+	WAJSONEntityParser *parser = [[[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityBatch:batch] autorelease];
+	STAssertTrue([parser parseData:[WAMinimalMetadataFeed dataUsingEncoding:NSUTF8StringEncoding] error:NULL], nil);
+	STAssertTrue([parser finishWithError:NULL], nil);
+
+	STAssertEquals(batch.count, (NSUInteger)2, nil);
+	NSUInteger orders = [batch indexOfColumnNamed:@"Orders"];
+	STAssertEquals([batch typeOfColumnAtIndex:orders], WAEdmTypeInt64, nil);
+	STAssertEquals(((const int64_t *)[batch valuesOfColumnAtIndex:orders])[0], 5000000000LL, nil);
+	STAssertTrue([batch isNullAtRow:1 column:orders], nil);
+}
+
+- (void)testEntityBatchMixedTypesKeepDateText
+{
+	WATableEntityBatch *batch = [[[WATableEntityBatch alloc] initWithTableName:@"Customers"] autorelease];
+	[batch beginRow];
+	[batch appendProperty:"Seen" type:WAEdmTypeDateTime bytes:"2013-08-22T01:12:06.250Z" length:24];
+	[batch endRow];
+	[batch beginRow];
+	[batch appendProperty:"Seen" type:WAEdmTypeString bytes:"never" length:5];
+	[batch endRow];
+
+	NSUInteger seen = [batch indexOfColumnNamed:@"Seen"];
+	STAssertEquals([batch typeOfColumnAtIndex:seen], WAEdmTypeString, nil);
+
+	NSString *text = [batch objectAtRow:0 column:seen];
+	NSTimeInterval interval = 0;
+	STAssertTrue(WAEdmParseDateTime([text UTF8String], strlen([text UTF8String]), &interval), @"%@", text);
+	STAssertEqualsWithAccuracy(interval, 398826726.25, 0.0005, nil);
+}
+
+#pragma mark - Private
+
+- (NSArray *)entitiesFromDocument:(NSString *)document chunkSize:(NSUInteger)chunkSize configuration:(void (^)(WAJSONEntityParser *parser))configuration error:(NSError **)error
+{
+	NSMutableArray *entities = [NSMutableArray array];
+	WAJSONEntityParser *parser = [[[WAJSONEntityParser alloc] initWithTableName:@"Customers" entityHandler:^(WATableEntity *entity) {
+		[entities addObject:entity];
+	}] autorelease];
+	if (configuration) {
+		configuration(parser);
+	}
+
+	NSData *data = [document dataUsingEncoding:NSUTF8StringEncoding];
+	for (NSUInteger offset = 0; offset < data.length; offset += chunkSize) {
+		if (![parser parseData:[data subdataWithRange:NSMakeRange(offset, MIN(chunkSize, data.length - offset))] error:error]) {
+			return nil;
+		}
+	}
+
+	return [parser finishWithError:error] ? entities : nil;
+}
+
+@end
@@ -0,0 +1,162 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/**
+ The account name the emulator answers for. Requests to any other account go to the network as usual.
+ */
+extern NSString * const WAStorageEmulatorAccountName;
+
+/**
+ A base64 access key for WAStorageEmulatorAccountName. Signatures are not checked.
+ */
+extern NSString * const WAStorageEmulatorAccessKey;
+
+/**
+ Generates the same entities, payloads and messages for a given seed on every run, so benchmark results can be compared between builds.
+ */
+@interface WABenchmarkDataset : NSObject {
+@private
+	uint64_t _seed;
+}
+
+/**
+ The seed.
+ */
+@property (readonly) uint64_t seed;
+
+/**
+ Initializes a newly created dataset.
+
+ @param seed The seed every value is derived from.
+
+ @returns The newly initialized WABenchmarkDataset object.
+ */
+- (id)initWithSeed:(uint64_t)seed;
+
+/**
+ Returns the partition key of a partition number.
+ */
+- (NSString *)partitionKeyAtIndex:(NSUInteger)partition;
+
+/**
+ Returns the row key of a row number.
+ */
+- (NSString *)rowKeyAtIndex:(NSUInteger)row;
+
+/**
+ Returns the properties of an entity, other than its keys, as a dictionary of names to NSString, NSNumber, NSDate and NSData values.
+
+ @param partition The partition number.
+ @param row The row number.
+ */
+- (NSDictionary *)propertiesForPartition:(NSUInteger)partition row:(NSUInteger)row;
+
+/**
+ Returns bytes of a given length.
+
+ @param length The number of bytes.
+ @param index A number telling payloads of the same length apart.
+ */
+- (NSData *)payloadOfLength:(NSUInteger)length index:(NSUInteger)index;
+
+/**
+ Returns the text of a queue message.
+
+ @param index The message number.
+ */
+- (NSString *)messageTextAtIndex:(NSUInteger)index;
+
+@end
+
+/**
+ An in-process stand-in for the storage service, serving the table, blob and queue requests of WAStorageEmulatorAccountName from memory through an NSURLProtocol.
+
+ It implements what the benchmarks use: entity point reads, key filters, paged scans with continuations, inserts and entity group transactions, which like the service reject a changeset that changes one entity twice; block blob uploads, range downloads and property reads; queue creation, Put Message, Get Messages, Update Message, Delete Message and the approximate message count. Anything else is answered with 501. Response bodies are delivered in chunks of chunkSize bytes, after latency seconds, so streaming parsers see data the way they do from the network.
+ */
+@interface WAStorageEmulator : NSObject {
+@private
+	NSMutableDictionary *_tables;
+	NSMutableDictionary *_blobs;
+	NSMutableDictionary *_blocks;
+	NSMutableDictionary *_queues;
+	NSTimeInterval _latency;
+	NSUInteger _chunkSize;
+	NSUInteger _requestCount;
+}
+
+/**
+ The time, in seconds, each response is delayed by. The default is 0.
+ */
+@property (assign) NSTimeInterval latency;
+
+/**
+ The size, in bytes, of the chunks response bodies are delivered in. The default is 16384.
+ */
+@property (assign) NSUInteger chunkSize;
+
+/**
+ The number of requests answered since the last reset.
+ */
+@property (readonly) NSUInteger requestCount;
+
+/**
+ Returns the emulator answering requests while it is installed.
+ */
++ (WAStorageEmulator *)sharedEmulator;
+
+/**
+ Starts answering the requests of WAStorageEmulatorAccountName.
+ */
++ (void)install;
+
+/**
+ Stops answering requests.
+ */
++ (void)uninstall;
+
+/**
+ Discards every table, blob and queue.
+ */
+- (void)reset;
+
+/**
+ Creates a table filled with entities from a dataset.
+
+ @param tableName The table name.
+ @param dataset The dataset.
+ @param partitions The number of partitions.
+ @param rows The number of rows in each partition.
+ */
+- (void)populateTable:(NSString *)tableName fromDataset:(WABenchmarkDataset *)dataset partitions:(NSUInteger)partitions rowsPerPartition:(NSUInteger)rows;
+
+/**
+ Returns the number of entities in a table.
+ */
+- (NSUInteger)entityCountInTable:(NSString *)tableName;
+
+/**
+ Returns the number of messages in a queue, visible or not.
+ */
+- (NSUInteger)messageCountInQueue:(NSString *)queueName;
+
+/**
+ Returns the content of a blob, or nil.
+ */
+- (NSData *)contentOfBlob:(NSString *)blobName inContainer:(NSString *)containerName;
+
+@end
@@ -0,0 +1,1273 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WAStorageEmulator.h"
+
+#import "WAToolkitPrivate.h"
+
+NSString * const WAStorageEmulatorAccountName = @"wabenchmark";
+NSString * const WAStorageEmulatorAccessKey = @"d2FiZW5jaG1hcmsgYWNjZXNzIGtleSwgbm90IGNoZWNrZWQ=";
+
+#define WAStorageEmulatorMaxPageSize 1000
+
+static NSString * const WADataServicesNamespaces = @"xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"";
+
+#pragma mark - Dataset
+
+static uint64_t WAMix(uint64_t value)
+{
+	// splitmix64: every input bit affects every output bit
+	value += 0x9e3779b97f4a7c15ULL;
+	value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	value = (value ^ (value >> 27)) * 0x94d049bb133111ebULL;
+	return value ^ (value >> 31);
+}
+
+static uint64_t WADatasetValue(uint64_t seed, NSUInteger a, NSUInteger b, NSUInteger field)
+{
+	return WAMix(WAMix(WAMix(seed ^ a) ^ b) ^ field);
+}
+
+@implementation WABenchmarkDataset
+
+@synthesize seed = _seed;
+
+- (id)initWithSeed:(uint64_t)seed
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_seed = seed;
+
+	return self;
+}
+
+- (NSString *)partitionKeyAtIndex:(NSUInteger)partition
+{
+	return [NSString stringWithFormat:@"customer%05lu", (unsigned long)partition];
+}
+
+- (NSString *)rowKeyAtIndex:(NSUInteger)row
+{
+	return [NSString stringWithFormat:@"order%07lu", (unsigned long)row];
+}
+
+- (NSDictionary *)propertiesForPartition:(NSUInteger)partition row:(NSUInteger)row
+{
+	static NSString *syllables[] = { @"ka", @"lo", @"mi", @"ne", @"ru", @"sa", @"to", @"vi" };
+	static NSString *cities[] = { @"Seattle", @"Redmond", @"Dublin", @"Amsterdam", @"Singapore", @"Sydney", @"São Paulo", @"Zürich" };
+
+	NSMutableString *name = [NSMutableString string];
+	uint64_t nameValue = WADatasetValue(_seed, partition, row, 1);
+	for (int i = 0; i < 3 + (int)(nameValue % 3); i++) {
+		[name appendString:syllables[(nameValue >> (8 + i * 3)) & 7]];
+	}
+
+	// notes vary in length so that entities do too, and carry characters that need escaping
+	uint64_t notesValue = WADatasetValue(_seed, partition, row, 2);
+	NSMutableString *notes = [NSMutableString stringWithString:@"R&D <priority> "];
+	while (notes.length < 64 + notesValue % 136) {
+		[notes appendString:syllables[notesValue & 7]];
+		notesValue = WAMix(notesValue);
+	}
+
+	uint64_t avatarValue = WADatasetValue(_seed, partition, row, 3);
+	NSMutableData *avatar = [NSMutableData dataWithLength:32];
+	for (NSUInteger i = 0; i < 32; i += 8) {
+		avatarValue = WAMix(avatarValue);
+		memcpy((char *)[avatar mutableBytes] + i, &avatarValue, 8);
+	}
+
+	return [NSDictionary dictionaryWithObjectsAndKeys:
+			name, @"Name",
+			cities[WADatasetValue(_seed, partition, row, 4) % 8], @"City",
+			notes, @"Notes",
+			[NSNumber numberWithDouble:(WADatasetValue(_seed, partition, row, 5) % 1000000) / 100.0], @"Amount",
+			[NSNumber numberWithInt:(int)(WADatasetValue(_seed, partition, row, 6) % 1000)], @"Quantity",
+			[NSNumber numberWithLongLong:(long long)(WADatasetValue(_seed, partition, row, 7) >> 2)], @"Visits",
+			[NSNumber numberWithBool:WADatasetValue(_seed, partition, row, 8) & 1], @"Active",
+			[NSDate dateWithTimeIntervalSinceReferenceDate:(NSTimeInterval)(WADatasetValue(_seed, partition, row, 9) % 400000000)], @"Joined",
+			avatar, @"Avatar",
+			nil];
+}
+
+- (NSData *)payloadOfLength:(NSUInteger)length index:(NSUInteger)index
+{
+	NSMutableData *payload = [NSMutableData dataWithLength:length];
+	char *bytes = [payload mutableBytes];
+	uint64_t value = WADatasetValue(_seed, index, length, 10);
+	for (NSUInteger offset = 0; offset < length; offset += sizeof(value)) {
+		value = WAMix(value);
+		memcpy(bytes + offset, &value, MIN(sizeof(value), length - offset));
+	}
+	return payload;
+}
+
+- (NSString *)messageTextAtIndex:(NSUInteger)index
+{
+	uint64_t value = WADatasetValue(_seed, index, 0, 11);
+	return [NSString stringWithFormat:@"{\"event\":%lu,\"kind\":\"order\",\"customer\":\"%@\",\"amount\":%llu}",
+			(unsigned long)index, [self partitionKeyAtIndex:(NSUInteger)(value % 100)], (value >> 8) % 100000];
+}
+
+@end
+
+#pragma mark - Helpers
+
+static NSString *WAISODateString(NSDate *date)
+{
+	static NSDateFormatter *formatter = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		formatter = [[NSDateFormatter alloc] init];
+		[formatter setLocale:[[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease]];
+		[formatter setTimeZone:[NSTimeZone timeZoneWithName:@"UTC"]];
+		[formatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSS'0000Z'"];
+	});
+	@synchronized(formatter) {
+		return [formatter stringFromDate:date];
+	}
+}
+
+static NSString *WARFC1123String(NSDate *date)
+{
+	static NSDateFormatter *formatter = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		formatter = [[NSDateFormatter alloc] init];
+		[formatter setLocale:[[[NSLocale alloc] initWithLocaleIdentifier:@"en_US_POSIX"] autorelease]];
+		[formatter setTimeZone:[NSTimeZone timeZoneWithName:@"GMT"]];
+		[formatter setDateFormat:@"EEE, dd MMM yyyy HH:mm:ss 'GMT'"];
+	});
+	@synchronized(formatter) {
+		return [formatter stringFromDate:date];
+	}
+}
+
+static NSString *WAXMLUnescapedString(NSString *value)
+{
+	NSMutableString *unescaped = [NSMutableString stringWithString:value];
+	[unescaped replaceOccurrencesOfString:@"&lt;" withString:@"<" options:0 range:NSMakeRange(0, unescaped.length)];
+	[unescaped replaceOccurrencesOfString:@"&gt;" withString:@">" options:0 range:NSMakeRange(0, unescaped.length)];
+	[unescaped replaceOccurrencesOfString:@"&quot;" withString:@"\"" options:0 range:NSMakeRange(0, unescaped.length)];
+	[unescaped replaceOccurrencesOfString:@"&apos;" withString:@"'" options:0 range:NSMakeRange(0, unescaped.length)];
+	[unescaped replaceOccurrencesOfString:@"&amp;" withString:@"&" options:0 range:NSMakeRange(0, unescaped.length)];
+	return unescaped;
+}
+
+/*
+ Returns the text between the first <name ...> and </name> in a document, or nil.
+ */
+static NSString *WAElementText(NSString *document, NSString *name)
+{
+	NSRange open = [document rangeOfString:[NSString stringWithFormat:@"<%@", name]];
+	while (open.location != NSNotFound) {
+		NSUInteger next = NSMaxRange(open);
+		unichar c = next < document.length ? [document characterAtIndex:next] : 0;
+		if (c == '>' || c == ' ' || c == '/') {
+			break;
+		}
+		open = [document rangeOfString:[NSString stringWithFormat:@"<%@", name] options:0 range:NSMakeRange(next, document.length - next)];
+	}
+	if (open.location == NSNotFound) {
+		return nil;
+	}
+
+	NSRange end = [document rangeOfString:@">" options:0 range:NSMakeRange(NSMaxRange(open), document.length - NSMaxRange(open))];
+	if (end.location == NSNotFound) {
+		return nil;
+	}
+	if ([document characterAtIndex:end.location - 1] == '/') {
+		return @"";
+	}
+
+	NSRange close = [document rangeOfString:[NSString stringWithFormat:@"</%@>", name] options:0 range:NSMakeRange(NSMaxRange(end), document.length - NSMaxRange(end))];
+	if (close.location == NSNotFound) {
+		return nil;
+	}
+	return [document substringWithRange:NSMakeRange(NSMaxRange(end), close.location - NSMaxRange(end))];
+}
+
+/*
+ Removes the first <name ...>...</name> or <name ... /> element from a fragment.
+ */
+static void WARemoveElement(NSMutableString *fragment, NSString *name)
+{
+	NSRange open = [fragment rangeOfString:[NSString stringWithFormat:@"<%@", name]];
+	if (open.location == NSNotFound) {
+		return;
+	}
+	NSRange end = [fragment rangeOfString:@">" options:0 range:NSMakeRange(NSMaxRange(open), fragment.length - NSMaxRange(open))];
+	if (end.location == NSNotFound) {
+		return;
+	}
+	if ([fragment characterAtIndex:end.location - 1] != '/') {
+		end = [fragment rangeOfString:[NSString stringWithFormat:@"</%@>", name] options:0 range:NSMakeRange(NSMaxRange(end), fragment.length - NSMaxRange(end))];
+		if (end.location == NSNotFound) {
+			return;
+		}
+	}
+	[fragment deleteCharactersInRange:NSMakeRange(open.location, NSMaxRange(end) - open.location)];
+}
+
+static NSDictionary *WAQueryParameters(NSURL *URL)
+{
+	NSMutableDictionary *parameters = [NSMutableDictionary dictionary];
+	for (NSString *pair in [[URL query] componentsSeparatedByString:@"&"]) {
+		NSRange equals = [pair rangeOfString:@"="];
+		NSString *name = equals.location == NSNotFound ? pair : [pair substringToIndex:equals.location];
+		NSString *value = equals.location == NSNotFound ? @"" : [pair substringFromIndex:NSMaxRange(equals)];
+		// a plus is kept as is, as block ids and pop receipts may contain one
+		value = [value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+		if (name.length && value) {
+			[parameters setObject:value forKey:[name stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
+		}
+	}
+	return parameters;
+}
+
+/*
+ Returns the undecoded path of a URL, so that escaped slashes and quotes in keys survive.
+ */
+static NSString *WARawPath(NSURL *URL)
+{
+	NSString *path = [(NSString *)CFURLCopyPath((CFURLRef)URL) autorelease];
+	return path.length ? path : @"/";
+}
+
+/*
+ Parses PartitionKey='a',RowKey='b' into its two keys.
+ */
+static BOOL WAParseEntityKeys(NSString *keys, NSString **partitionKey, NSString **rowKey)
+{
+	NSString *values[2] = { nil, nil };
+	NSString *names[2] = { @"PartitionKey='", @"RowKey='" };
+
+	for (int i = 0; i < 2; i++) {
+		NSRange start = [keys rangeOfString:names[i]];
+		if (start.location == NSNotFound) {
+			return NO;
+		}
+		NSMutableString *value = [NSMutableString string];
+		NSUInteger index = NSMaxRange(start);
+		while (index < keys.length) {
+			unichar c = [keys characterAtIndex:index++];
+			if (c == '\'') {
+				if (index < keys.length && [keys characterAtIndex:index] == '\'') {
+					index++;
+				} else {
+					break;
+				}
+			}
+			[value appendFormat:@"%C", c];
+		}
+		values[i] = value;
+	}
+
+	*partitionKey = values[0];
+	*rowKey = values[1];
+	return YES;
+}
+
+static NSString *WAEntityKey(NSString *partitionKey, NSString *rowKey)
+{
+	// the separator sorts before every printable character, so keys sort by partition then row
+	return [NSString stringWithFormat:@"%@\n%@", partitionKey, rowKey];
+}
+
+static NSString *WAPropertiesXML(NSDictionary *properties)
+{
+	NSMutableString *xml = [NSMutableString string];
+
+	for (NSString *name in [[properties allKeys] sortedArrayUsingSelector:@selector(compare:)]) {
+		id value = [properties objectForKey:name];
+		NSString *type = nil;
+		NSString *text = nil;
+
+		if ([value isKindOfClass:[NSString class]]) {
+			text = WAXMLEscapedString(value);
+		} else if ([value isKindOfClass:[NSDate class]]) {
+			type = @"Edm.DateTime";
+			text = WAISODateString(value);
+		} else if ([value isKindOfClass:[NSData class]]) {
+			type = @"Edm.Binary";
+			text = [value stringWithBase64EncodedData];
+		} else if (strcmp([value objCType], @encode(BOOL)) == 0 || strcmp([value objCType], "c") == 0) {
+			type = @"Edm.Boolean";
+			text = [value boolValue] ? @"true" : @"false";
+		} else if (strcmp([value objCType], @encode(double)) == 0 || strcmp([value objCType], @encode(float)) == 0) {
+			type = @"Edm.Double";
+			text = [NSString stringWithFormat:@"%.17g", [value doubleValue]];
+		} else if (strcmp([value objCType], @encode(long long)) == 0) {
+			type = @"Edm.Int64";
+			text = [NSString stringWithFormat:@"%lld", [value longLongValue]];
+		} else {
+			type = @"Edm.Int32";
+			text = [NSString stringWithFormat:@"%d", [value intValue]];
+		}
+
+		if (type) {
+			[xml appendFormat:@"<d:%@ m:type=\"%@\">%@</d:%@>", name, type, text, name];
+		} else {
+			[xml appendFormat:@"<d:%@>%@</d:%@>", name, text, name];
+		}
+	}
+
+	return xml;
+}
+
+#pragma mark - Storage
+
+@interface WAEmulatorEntity : NSObject {
+@public
+	NSString *partitionKey;
+	NSString *rowKey;
+	NSString *propertiesXML;
+	NSDate *timestamp;
+}
+
+@end
+
+@implementation WAEmulatorEntity
+
+- (void)dealloc
+{
+	[partitionKey release];
+	[rowKey release];
+	[propertiesXML release];
+	[timestamp release];
+	[super dealloc];
+}
+
+@end
+
+@interface WAEmulatorTable : NSObject {
+@public
+	NSMutableDictionary *entities;
+	NSArray *sortedKeys;
+}
+
+- (NSArray *)keys;
+
+@end
+
+@implementation WAEmulatorTable
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	entities = [[NSMutableDictionary alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[entities release];
+	[sortedKeys release];
+	[super dealloc];
+}
+
+- (NSArray *)keys
+{
+	if (!sortedKeys) {
+		sortedKeys = [[[entities allKeys] sortedArrayUsingSelector:@selector(compare:)] retain];
+	}
+	return sortedKeys;
+}
+
+- (void)setEntity:(WAEmulatorEntity *)entity
+{
+	NSString *key = WAEntityKey(entity->partitionKey, entity->rowKey);
+	if (![entities objectForKey:key]) {
+		[sortedKeys release];
+		sortedKeys = nil;
+	}
+	[entities setObject:entity forKey:key];
+}
+
+- (void)removeEntityForKey:(NSString *)key
+{
+	[entities removeObjectForKey:key];
+	[sortedKeys release];
+	sortedKeys = nil;
+}
+
+@end
+
+@interface WAEmulatorBlob : NSObject {
+@public
+	NSData *data;
+	NSString *etag;
+	NSString *contentType;
+	NSDate *lastModified;
+}
+
+@end
+
+@implementation WAEmulatorBlob
+
+- (void)dealloc
+{
+	[data release];
+	[etag release];
+	[contentType release];
+	[lastModified release];
+	[super dealloc];
+}
+
+@end
+
+@interface WAEmulatorMessage : NSObject {
+@public
+	NSString *messageId;
+	NSString *text;
+	NSString *popReceipt;
+	NSDate *insertionTime;
+	CFAbsoluteTime visibleAt;
+	NSInteger dequeueCount;
+}
+
+@end
+
+@implementation WAEmulatorMessage
+
+- (void)dealloc
+{
+	[messageId release];
+	[text release];
+	[popReceipt release];
+	[insertionTime release];
+	[super dealloc];
+}
+
+@end
+
+/*
+ A response computed by the emulator, delivered later by the protocol.
+ */
+@interface WAEmulatorResponse : NSObject {
+@public
+	NSInteger statusCode;
+	NSMutableDictionary *headers;
+	NSData *body;
+}
+
+@end
+
+@implementation WAEmulatorResponse
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	static unsigned long long requestNumber = 0;
+	headers = [[NSMutableDictionary alloc] init];
+	[headers setObject:WAStorageServiceVersion forKey:@"x-ms-version"];
+	[headers setObject:WARFC1123String([NSDate date]) forKey:@"Date"];
+	[headers setObject:[NSString stringWithFormat:@"emulator-%llu", __sync_add_and_fetch(&requestNumber, 1)] forKey:@"x-ms-request-id"];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[headers release];
+	[body release];
+	[super dealloc];
+}
+
+@end
+
+static NSString *WANewIdentifier(void)
+{
+	CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+	NSString *identifier = [(NSString *)CFUUIDCreateString(kCFAllocatorDefault, uuid) autorelease];
+	CFRelease(uuid);
+	return [identifier lowercaseString];
+}
+
+static WAEmulatorResponse *WAResponse(NSInteger statusCode, NSString *contentType, NSData *body)
+{
+	WAEmulatorResponse *response = [[[WAEmulatorResponse alloc] init] autorelease];
+	response->statusCode = statusCode;
+	response->body = [body retain];
+	if (contentType) {
+		[response->headers setObject:contentType forKey:@"Content-Type"];
+	}
+	return response;
+}
+
+static WAEmulatorResponse *WAStorageError(NSInteger statusCode, NSString *code, NSString *message)
+{
+	NSString *body = [NSString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>%@</Code><Message>%@</Message></Error>", code, message];
+	return WAResponse(statusCode, @"application/xml", [body dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+static WAEmulatorResponse *WATableError(NSInteger statusCode, NSString *code, NSString *message)
+{
+	NSString *body = [NSString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><error xmlns=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\"><code>%@</code><message xml:lang=\"en-US\">%@</message></error>", code, message];
+	return WAResponse(statusCode, @"application/xml", [body dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+@interface WAStorageEmulator ()
+
+- (WAEmulatorResponse *)responseForRequest:(NSURLRequest *)request;
+- (WAEmulatorResponse *)tableResponseForRequest:(NSURLRequest *)request;
+- (WAEmulatorResponse *)batchResponseForRequest:(NSURLRequest *)request;
+- (WAEmulatorResponse *)blobResponseForRequest:(NSURLRequest *)request;
+- (WAEmulatorResponse *)queueResponseForRequest:(NSURLRequest *)request;
+- (NSString *)entryForEntity:(WAEmulatorEntity *)entity table:(NSString *)tableName standalone:(BOOL)standalone;
+- (WAEmulatorEntity *)entityFromEntry:(NSString *)entry;
+
+@end
+
+#pragma mark - Protocol
+
+/*
+ Hands the requests of the emulated account to the shared emulator.
+ */
+@interface WAStorageEmulatorProtocol : NSURLProtocol {
+@private
+	WAEmulatorResponse *_response;
+	BOOL _stopped;
+}
+
+- (void)deliverResponse;
+
+@end
+
+@implementation WAStorageEmulatorProtocol
+
++ (BOOL)canInitWithRequest:(NSURLRequest *)request
+{
+	NSString *host = [[[request URL] host] lowercaseString];
+	return [host hasPrefix:[WAStorageEmulatorAccountName stringByAppendingString:@"."]] && [host hasSuffix:@".core.windows.net"];
+}
+
++ (NSURLRequest *)canonicalRequestForRequest:(NSURLRequest *)request
+{
+	return request;
+}
+
+- (void)dealloc
+{
+	[_response release];
+	[super dealloc];
+}
+
+- (void)startLoading
+{
+	WAStorageEmulator *emulator = [WAStorageEmulator sharedEmulator];
+	_response = [[emulator responseForRequest:[self request]] retain];
+
+	if (emulator.latency > 0) {
+		[self performSelector:@selector(deliverResponse) withObject:nil afterDelay:emulator.latency];
+	} else {
+		[self deliverResponse];
+	}
+}
+
+- (void)stopLoading
+{
+	_stopped = YES;
+	[NSObject cancelPreviousPerformRequestsWithTarget:self selector:@selector(deliverResponse) object:nil];
+}
+
+- (void)deliverResponse
+{
+	if (_stopped) {
+		return;
+	}
+
+	NSData *body = [[[self request] HTTPMethod] isEqualToString:@"HEAD"] ? nil : _response->body;
+	if (![_response->headers objectForKey:@"Content-Length"]) {
+		[_response->headers setObject:[NSString stringWithFormat:@"%lu", (unsigned long)body.length] forKey:@"Content-Length"];
+	}
+
+	NSHTTPURLResponse *response = [[[NSHTTPURLResponse alloc] initWithURL:[[self request] URL] statusCode:_response->statusCode HTTPVersion:@"HTTP/1.1" headerFields:_response->headers] autorelease];
+	[[self client] URLProtocol:self didReceiveResponse:response cacheStoragePolicy:NSURLCacheStorageNotAllowed];
+
+	NSUInteger chunkSize = MAX([WAStorageEmulator sharedEmulator].chunkSize, 1);
+	for (NSUInteger offset = 0; offset < body.length && !_stopped; offset += chunkSize) {
+		NSRange range = NSMakeRange(offset, MIN(chunkSize, body.length - offset));
+		[[self client] URLProtocol:self didLoadData:[body subdataWithRange:range]];
+	}
+
+	if (!_stopped) {
+		[[self client] URLProtocolDidFinishLoading:self];
+	}
+}
+
+@end
+
+#pragma mark - Emulator
+
+@implementation WAStorageEmulator
+
+@synthesize latency = _latency;
+@synthesize chunkSize = _chunkSize;
+@synthesize requestCount = _requestCount;
+
++ (WAStorageEmulator *)sharedEmulator
+{
+	static WAStorageEmulator *emulator = nil;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		emulator = [[WAStorageEmulator alloc] init];
+	});
+	return emulator;
+}
+
++ (void)install
+{
+	[NSURLProtocol registerClass:[WAStorageEmulatorProtocol class]];
+}
+
++ (void)uninstall
+{
+	[NSURLProtocol unregisterClass:[WAStorageEmulatorProtocol class]];
+}
+
+- (id)init
+{
+	if(!(self = [super init])) {
+		return nil;
+	}
+
+	_tables = [[NSMutableDictionary alloc] init];
+	_blobs = [[NSMutableDictionary alloc] init];
+	_blocks = [[NSMutableDictionary alloc] init];
+	_queues = [[NSMutableDictionary alloc] init];
+	_chunkSize = 16384;
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[_tables release];
+	[_blobs release];
+	[_blocks release];
+	[_queues release];
+	[super dealloc];
+}
+
+- (void)reset
+{
+	@synchronized(self) {
+		[_tables removeAllObjects];
+		[_blobs removeAllObjects];
+		[_blocks removeAllObjects];
+		[_queues removeAllObjects];
+		_requestCount = 0;
+	}
+}
+
+- (void)populateTable:(NSString *)tableName fromDataset:(WABenchmarkDataset *)dataset partitions:(NSUInteger)partitions rowsPerPartition:(NSUInteger)rows
+{
+	WAEmulatorTable *table = [[[WAEmulatorTable alloc] init] autorelease];
+	NSDate *timestamp = [NSDate dateWithTimeIntervalSinceReferenceDate:(NSTimeInterval)(dataset.seed % 400000000)];
+
+	for (NSUInteger partition = 0; partition < partitions; partition++) {
+		for (NSUInteger row = 0; row < rows; row++) {
+			NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+			WAEmulatorEntity *entity = [[WAEmulatorEntity alloc] init];
+			entity->partitionKey = [[dataset partitionKeyAtIndex:partition] copy];
+			entity->rowKey = [[dataset rowKeyAtIndex:row] copy];
+			entity->propertiesXML = [WAPropertiesXML([dataset propertiesForPartition:partition row:row]) copy];
+			entity->timestamp = [timestamp retain];
+			[table setEntity:entity];
+			[entity release];
+			[pool drain];
+		}
+	}
+
+	@synchronized(self) {
+		[_tables setObject:table forKey:tableName];
+	}
+}
+
+- (NSUInteger)entityCountInTable:(NSString *)tableName
+{
+	@synchronized(self) {
+		WAEmulatorTable *table = [_tables objectForKey:tableName];
+		return table->entities.count;
+	}
+}
+
+- (NSUInteger)messageCountInQueue:(NSString *)queueName
+{
+	@synchronized(self) {
+		return [[_queues objectForKey:queueName] count];
+	}
+}
+
+- (NSData *)contentOfBlob:(NSString *)blobName inContainer:(NSString *)containerName
+{
+	@synchronized(self) {
+		WAEmulatorBlob *blob = [_blobs objectForKey:[NSString stringWithFormat:@"%@/%@", containerName, blobName]];
+		return blob ? [[blob->data retain] autorelease] : nil;
+	}
+}
+
+#pragma mark - Private
+
+- (WAEmulatorResponse *)responseForRequest:(NSURLRequest *)request
+{
+	NSString *host = [[[request URL] host] lowercaseString];
+
+	@synchronized(self) {
+		_requestCount++;
+
+		if ([host hasPrefix:[WAStorageEmulatorAccountName stringByAppendingString:@".table."]]) {
+			return [self tableResponseForRequest:request];
+		} else if ([host hasPrefix:[WAStorageEmulatorAccountName stringByAppendingString:@".blob."]]) {
+			return [self blobResponseForRequest:request];
+		} else if ([host hasPrefix:[WAStorageEmulatorAccountName stringByAppendingString:@".queue."]]) {
+			return [self queueResponseForRequest:request];
+		}
+	}
+
+	return WAStorageError(501, @"NotImplemented", @"The emulator does not serve this host.");
+}
+
+- (NSString *)entryForEntity:(WAEmulatorEntity *)entity table:(NSString *)tableName standalone:(BOOL)standalone
+{
+	NSString *base = [NSString stringWithFormat:@"https://%@.table.core.windows.net/", WAStorageEmulatorAccountName];
+	NSString *timestamp = WAISODateString(entity->timestamp);
+	NSString *resource = [NSString stringWithFormat:@"%@(PartitionKey='%@',RowKey='%@')", tableName,
+						  WAXMLEscapedString([entity->partitionKey stringByReplacingOccurrencesOfString:@"'" withString:@"''"]),
+						  WAXMLEscapedString([entity->rowKey stringByReplacingOccurrencesOfString:@"'" withString:@"''"])];
+
+	return [NSString stringWithFormat:@"%@<entry m:etag=\"W/&quot;datetime'%@'&quot;\"%@><id>%@%@</id><title type=\"text\"></title><updated>%@</updated><author><name /></author>"
+			@"<link rel=\"edit\" title=\"%@\" href=\"%@\" /><category term=\"%@.%@\" scheme=\"http://schemas.microsoft.com/ado/2007/08/dataservices/scheme\" />"
+			@"<content type=\"application/xml\"><m:properties><d:PartitionKey>%@</d:PartitionKey><d:RowKey>%@</d:RowKey><d:Timestamp m:type=\"Edm.DateTime\">%@</d:Timestamp>%@</m:properties></content></entry>",
+			standalone ? @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>" : @"",
+			[timestamp stringByReplacingOccurrencesOfString:@":" withString:@"%3A"],
+			standalone ? [NSString stringWithFormat:@" xml:base=\"%@\" %@", base, WADataServicesNamespaces] : @"",
+			base, resource, timestamp, tableName, resource, WAStorageEmulatorAccountName, tableName,
+			WAXMLEscapedString(entity->partitionKey), WAXMLEscapedString(entity->rowKey), timestamp, entity->propertiesXML];
+}
+
+- (WAEmulatorEntity *)entityFromEntry:(NSString *)entry
+{
+	NSString *properties = WAElementText(entry, @"m:properties");
+	NSString *partitionKey = WAElementText(properties, @"d:PartitionKey");
+	NSString *rowKey = WAElementText(properties, @"d:RowKey");
+	if (!partitionKey || !rowKey) {
+		return nil;
+	}
+
+	NSMutableString *otherProperties = [NSMutableString stringWithString:properties];
+	WARemoveElement(otherProperties, @"d:PartitionKey");
+	WARemoveElement(otherProperties, @"d:RowKey");
+	WARemoveElement(otherProperties, @"d:Timestamp");
+
+	WAEmulatorEntity *entity = [[[WAEmulatorEntity alloc] init] autorelease];
+	entity->partitionKey = [WAXMLUnescapedString(partitionKey) copy];
+	entity->rowKey = [WAXMLUnescapedString(rowKey) copy];
+	entity->propertiesXML = [[otherProperties stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]] copy];
+	entity->timestamp = [[NSDate date] retain];
+	return entity;
+}
+
+- (WAEmulatorResponse *)tableResponseForRequest:(NSURLRequest *)request
+{
+	NSString *method = [request HTTPMethod];
+	NSString *path = WARawPath([request URL]);
+	NSDictionary *parameters = WAQueryParameters([request URL]);
+	NSString *body = [request HTTPBody] ? [[[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding] autorelease] : nil;
+
+	if ([path isEqualToString:@"/$batch"]) {
+		return [self batchResponseForRequest:request];
+	}
+
+	if ([path isEqualToString:@"/Tables"] || [path hasPrefix:@"/Tables("]) {
+		if ([method isEqualToString:@"POST"]) {
+			NSString *tableName = WAXMLUnescapedString(WAElementText(body, @"d:TableName"));
+			if ([_tables objectForKey:tableName]) {
+				return WATableError(409, @"TableAlreadyExists", @"The table specified already exists.");
+			}
+			[_tables setObject:[[[WAEmulatorTable alloc] init] autorelease] forKey:tableName];
+			return WAResponse(201, @"application/atom+xml", [request HTTPBody]);
+		}
+		return WATableError(501, @"NotImplemented", @"The emulator does not list tables.");
+	}
+
+	// /Table, /Table() or /Table(PartitionKey='a',RowKey='b')
+	NSString *resource = [[path substringFromIndex:1] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+	NSRange open = [resource rangeOfString:@"("];
+	NSString *tableName = open.location == NSNotFound ? resource : [resource substringToIndex:open.location];
+	NSString *keys = open.location == NSNotFound ? @"" : [resource substringWithRange:NSMakeRange(NSMaxRange(open), resource.length - NSMaxRange(open) - 1)];
+	WAEmulatorTable *table = [_tables objectForKey:tableName];
+	if (!table) {
+		return WATableError(404, @"TableNotFound", @"The table specified does not exist.");
+	}
+
+	NSString *partitionKey = nil;
+	NSString *rowKey = nil;
+	BOOL addressed = keys.length && WAParseEntityKeys(keys, &partitionKey, &rowKey);
+
+	if ([method isEqualToString:@"GET"] && addressed) {
+		WAEmulatorEntity *entity = [table->entities objectForKey:WAEntityKey(partitionKey, rowKey)];
+		if (!entity) {
+			return WATableError(404, @"ResourceNotFound", @"The specified resource does not exist.");
+		}
+		return WAResponse(200, @"application/atom+xml;charset=utf-8", [[self entryForEntity:entity table:tableName standalone:YES] dataUsingEncoding:NSUTF8StringEncoding]);
+	}
+
+	if ([method isEqualToString:@"GET"]) {
+		// key equality filters joined by and are all the benchmarks use
+		NSString *filter = [parameters objectForKey:@"$filter"];
+		NSString *filterPartitionKey = nil;
+		NSString *filterRowKey = nil;
+		for (NSString *clause in [filter componentsSeparatedByString:@" and "]) {
+			NSString *trimmed = [clause stringByTrimmingCharactersInSet:[NSCharacterSet characterSetWithCharactersInString:@"() "]];
+			NSRange quote = [trimmed rangeOfString:@"'"];
+			if (quote.location == NSNotFound || ![trimmed hasSuffix:@"'"]) {
+				continue;
+			}
+			NSString *value = [[trimmed substringWithRange:NSMakeRange(NSMaxRange(quote), trimmed.length - NSMaxRange(quote) - 1)] stringByReplacingOccurrencesOfString:@"''" withString:@"'"];
+			if ([trimmed hasPrefix:@"PartitionKey eq "]) {
+				filterPartitionKey = value;
+			} else if ([trimmed hasPrefix:@"RowKey eq "]) {
+				filterRowKey = value;
+			}
+		}
+
+		NSUInteger pageSize = [parameters objectForKey:@"$top"] ? MIN((NSUInteger)[[parameters objectForKey:@"$top"] integerValue], WAStorageEmulatorMaxPageSize) : WAStorageEmulatorMaxPageSize;
+		NSString *nextPartitionKey = [parameters objectForKey:@"NextPartitionKey"];
+		NSString *start = nextPartitionKey ? WAEntityKey(nextPartitionKey, [parameters objectForKey:@"NextRowKey"] ? [parameters objectForKey:@"NextRowKey"] : @"") : nil;
+
+		NSMutableString *feed = [NSMutableString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><feed xml:base=\"https://%@.table.core.windows.net/\" %@>"
+								 @"<title type=\"text\">%@</title><id>https://%@.table.core.windows.net/%@</id><updated>%@</updated><link rel=\"self\" title=\"%@\" href=\"%@\" />",
+								 WAStorageEmulatorAccountName, WADataServicesNamespaces, tableName, WAStorageEmulatorAccountName, tableName, WAISODateString([NSDate date]), tableName, tableName];
+		NSUInteger count = 0;
+		WAEmulatorEntity *next = nil;
+
+		for (NSString *key in [table keys]) {
+			if (start && [key compare:start] == NSOrderedAscending) {
+				continue;
+			}
+			WAEmulatorEntity *entity = [table->entities objectForKey:key];
+			if ((filterPartitionKey && ![entity->partitionKey isEqualToString:filterPartitionKey]) || (filterRowKey && ![entity->rowKey isEqualToString:filterRowKey])) {
+				continue;
+			}
+			if (count == pageSize) {
+				next = entity;
+				break;
+			}
+			[feed appendString:[self entryForEntity:entity table:tableName standalone:NO]];
+			count++;
+		}
+		[feed appendString:@"</feed>"];
+
+		WAEmulatorResponse *response = WAResponse(200, @"application/atom+xml;charset=utf-8", [feed dataUsingEncoding:NSUTF8StringEncoding]);
+		if (next) {
+			[response->headers setObject:next->partitionKey forKey:@"x-ms-continuation-NextPartitionKey"];
+			[response->headers setObject:next->rowKey forKey:@"x-ms-continuation-NextRowKey"];
+		}
+		return response;
+	}
+
+	if ([method isEqualToString:@"POST"] && !addressed) {
+		WAEmulatorEntity *entity = [self entityFromEntry:body];
+		if (!entity) {
+			return WATableError(400, @"InvalidInput", @"The entity has no partition key or row key.");
+		}
+		if ([table->entities objectForKey:WAEntityKey(entity->partitionKey, entity->rowKey)]) {
+			return WATableError(409, @"EntityAlreadyExists", @"The specified entity already exists.");
+		}
+		[table setEntity:entity];
+		return WAResponse(201, @"application/atom+xml;charset=utf-8", [[self entryForEntity:entity table:tableName standalone:YES] dataUsingEncoding:NSUTF8StringEncoding]);
+	}
+
+	if (addressed && ([method isEqualToString:@"PUT"] || [method isEqualToString:@"MERGE"] || [method isEqualToString:@"DELETE"])) {
+		NSString *key = WAEntityKey(partitionKey, rowKey);
+		WAEmulatorEntity *existing = [table->entities objectForKey:key];
+		if (!existing) {
+			return WATableError(404, @"ResourceNotFound", @"The specified resource does not exist.");
+		}
+		if ([method isEqualToString:@"DELETE"]) {
+			[table removeEntityForKey:key];
+		} else {
+			WAEmulatorEntity *entity = [self entityFromEntry:body];
+			if ([method isEqualToString:@"MERGE"]) {
+				NSString *merged = [existing->propertiesXML stringByAppendingString:entity->propertiesXML];
+				[entity->propertiesXML release];
+				entity->propertiesXML = [merged copy];
+			}
+			[table setEntity:entity];
+		}
+		return WAResponse(204, nil, nil);
+	}
+
+	return WATableError(501, @"NotImplemented", @"The emulator does not implement this request.");
+}
+
+- (WAEmulatorResponse *)batchResponseForRequest:(NSURLRequest *)request
+{
+	NSString *body = [[[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding] autorelease];
+	NSRange boundaryStart = [body rangeOfString:@"boundary=changeset_"];
+	if (boundaryStart.location == NSNotFound) {
+		return WATableError(400, @"InvalidInput", @"The batch has no changeset.");
+	}
+	NSRange boundaryEnd = [body rangeOfString:@"\r\n" options:0 range:NSMakeRange(boundaryStart.location, body.length - boundaryStart.location)];
+	NSString *changesetBoundary = [body substringWithRange:NSMakeRange(boundaryStart.location + 9, boundaryEnd.location - boundaryStart.location - 9)];
+
+	// validate every operation before applying any, as a changeset is atomic
+	NSMutableArray *operations = [NSMutableArray array];
+	NSMutableSet *keys = [NSMutableSet set];
+	NSString *tableName = nil;
+	NSString *failure = nil;
+	NSInteger failureStatus = 0;
+
+	for (NSString *part in [body componentsSeparatedByString:[@"--" stringByAppendingString:changesetBoundary]]) {
+		NSRange requestLine = [part rangeOfString:@" HTTP/1.1\r\n"];
+		if (requestLine.location == NSNotFound) {
+			continue;
+		}
+
+		NSUInteger lineStart = [part rangeOfString:@"\r\n" options:NSBackwardsSearch range:NSMakeRange(0, requestLine.location)].location;
+		lineStart = lineStart == NSNotFound ? 0 : lineStart + 2;
+		NSArray *words = [[part substringWithRange:NSMakeRange(lineStart, requestLine.location - lineStart)] componentsSeparatedByString:@" "];
+		NSString *method = [words objectAtIndex:0];
+		NSString *resource = [[[NSURL URLWithString:[words lastObject]] path] lastPathComponent];
+		NSRange open = [resource rangeOfString:@"("];
+		NSString *operationTable = open.location == NSNotFound ? resource : [resource substringToIndex:open.location];
+		NSString *entry = WAElementText(part, @"entry");
+		WAEmulatorEntity *entity = entry ? [self entityFromEntry:[NSString stringWithFormat:@"<entry>%@</entry>", entry]] : nil;
+		NSString *partitionKey = entity ? entity->partitionKey : nil;
+		NSString *rowKey = entity ? entity->rowKey : nil;
+		if (!entity && open.location != NSNotFound) {
+			WAParseEntityKeys([[resource substringFromIndex:NSMaxRange(open)] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding], &partitionKey, &rowKey);
+		}
+
+		tableName = tableName ? tableName : operationTable;
+		WAEmulatorTable *table = [_tables objectForKey:operationTable];
+		BOOL exists = partitionKey && [table->entities objectForKey:WAEntityKey(partitionKey, rowKey)] != nil;
+		BOOL repeated = partitionKey && rowKey && [keys containsObject:WAEntityKey(partitionKey, rowKey)];
+		if (!failure && !table) {
+			failureStatus = 404;
+			failure = [NSString stringWithFormat:@"%lu:The table specified does not exist.", (unsigned long)operations.count];
+		} else if (!failure && repeated) {
+			failureStatus = 400;
+			failure = [NSString stringWithFormat:@"%lu:The batch request contains multiple changes with same row key. An entity can appear only once in a batch request.", (unsigned long)operations.count];
+		} else if (!failure && [method isEqualToString:@"POST"] && exists) {
+			failureStatus = 409;
+			failure = [NSString stringWithFormat:@"%lu:The specified entity already exists.", (unsigned long)operations.count];
+		} else if (!failure && ![method isEqualToString:@"POST"] && !exists) {
+			failureStatus = 404;
+			failure = [NSString stringWithFormat:@"%lu:The specified resource does not exist.", (unsigned long)operations.count];
+		}
+
+		NSMutableDictionary *operation = [NSMutableDictionary dictionaryWithObjectsAndKeys:method, @"method", operationTable, @"table", nil];
+		if (entity) {
+			[operation setObject:entity forKey:@"entity"];
+		}
+		if (partitionKey && rowKey) {
+			[operation setObject:WAEntityKey(partitionKey, rowKey) forKey:@"key"];
+			[keys addObject:WAEntityKey(partitionKey, rowKey)];
+		}
+		[operations addObject:operation];
+	}
+
+	NSString *batchBoundary = [@"batchresponse_" stringByAppendingString:WANewIdentifier()];
+	NSString *responseBoundary = [@"changesetresponse_" stringByAppendingString:WANewIdentifier()];
+	NSMutableString *response = [NSMutableString stringWithFormat:@"--%@\r\nContent-Type: multipart/mixed; boundary=%@\r\n\r\n", batchBoundary, responseBoundary];
+
+	if (failure) {
+		[response appendFormat:@"--%@\r\nContent-Type: application/http\r\nContent-Transfer-Encoding: binary\r\n\r\nHTTP/1.1 %ld Error\r\nContent-ID: 1\r\nContent-Type: application/xml\r\n\r\n"
+		 @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><error xmlns=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\"><code>Error</code><message xml:lang=\"en-US\">%@</message></error>\r\n",
+		 responseBoundary, (long)failureStatus, failure];
+	} else {
+		[operations enumerateObjectsUsingBlock:^(NSDictionary *operation, NSUInteger index, BOOL *stop) {
+			WAEmulatorTable *table = [_tables objectForKey:[operation objectForKey:@"table"]];
+			NSString *method = [operation objectForKey:@"method"];
+			WAEmulatorEntity *entity = [operation objectForKey:@"entity"];
+			NSInteger status = 204;
+
+			if ([method isEqualToString:@"DELETE"]) {
+				[table removeEntityForKey:[operation objectForKey:@"key"]];
+			} else if (entity) {
+				[table setEntity:entity];
+				status = [method isEqualToString:@"POST"] ? 201 : 204;
+			}
+
+			[response appendFormat:@"--%@\r\nContent-Type: application/http\r\nContent-Transfer-Encoding: binary\r\n\r\nHTTP/1.1 %ld %@\r\nContent-ID: %lu\r\n\r\n\r\n",
+			 responseBoundary, (long)status, status == 201 ? @"Created" : @"No Content", (unsigned long)index + 1];
+		}];
+	}
+	[response appendFormat:@"--%@--\r\n--%@--\r\n", responseBoundary, batchBoundary];
+
+	return WAResponse(202, [NSString stringWithFormat:@"multipart/mixed; boundary=%@", batchBoundary], [response dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+- (WAEmulatorResponse *)blobResponseForRequest:(NSURLRequest *)request
+{
+	NSString *method = [request HTTPMethod];
+	NSString *path = [[WARawPath([request URL]) substringFromIndex:1] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+	NSDictionary *parameters = WAQueryParameters([request URL]);
+	NSString *comp = [parameters objectForKey:@"comp"];
+
+	NSRange slash = [path rangeOfString:@"/"];
+	if (slash.location == NSNotFound) {
+		if ([method isEqualToString:@"PUT"] && [[parameters objectForKey:@"restype"] isEqualToString:@"container"]) {
+			return WAResponse(201, nil, nil);
+		}
+		return WAStorageError(501, @"NotImplemented", @"The emulator does not implement this request.");
+	}
+
+	WAEmulatorBlob *blob = [_blobs objectForKey:path];
+
+	if ([method isEqualToString:@"PUT"] && [comp isEqualToString:@"block"]) {
+		NSMutableDictionary *blocks = [_blocks objectForKey:path];
+		if (!blocks) {
+			blocks = [NSMutableDictionary dictionary];
+			[_blocks setObject:blocks forKey:path];
+		}
+		[blocks setObject:[request HTTPBody] ? [request HTTPBody] : [NSData data] forKey:[parameters objectForKey:@"blockid"]];
+		return WAResponse(201, nil, nil);
+	}
+
+	if ([method isEqualToString:@"PUT"]) {
+		NSMutableData *content = [NSMutableData data];
+
+		if ([comp isEqualToString:@"blocklist"]) {
+			NSString *list = [[[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding] autorelease];
+			NSDictionary *blocks = [_blocks objectForKey:path];
+			NSRange search = NSMakeRange(0, list.length);
+			while (YES) {
+				NSRange open = [list rangeOfString:@"<Latest>" options:0 range:search];
+				if (open.location == NSNotFound) {
+					break;
+				}
+				NSRange close = [list rangeOfString:@"</Latest>" options:0 range:NSMakeRange(NSMaxRange(open), list.length - NSMaxRange(open))];
+				NSData *block = [blocks objectForKey:[list substringWithRange:NSMakeRange(NSMaxRange(open), close.location - NSMaxRange(open))]];
+				if (!block) {
+					return WAStorageError(400, @"InvalidBlockList", @"The specified block list is invalid.");
+				}
+				[content appendData:block];
+				search = NSMakeRange(NSMaxRange(close), list.length - NSMaxRange(close));
+			}
+			[_blocks removeObjectForKey:path];
+		} else if ([request HTTPBody]) {
+			[content appendData:[request HTTPBody]];
+		}
+
+		static unsigned long long version = 0;
+		WAEmulatorBlob *stored = [[[WAEmulatorBlob alloc] init] autorelease];
+		stored->data = [content copy];
+		stored->etag = [[NSString alloc] initWithFormat:@"\"0x8CF%011llX\"", ++version];
+		stored->contentType = [([request valueForHTTPHeaderField:@"x-ms-blob-content-type"] ? [request valueForHTTPHeaderField:@"x-ms-blob-content-type"] : [request valueForHTTPHeaderField:@"Content-Type"]) copy];
+		stored->lastModified = [[NSDate date] retain];
+		[_blobs setObject:stored forKey:path];
+
+		WAEmulatorResponse *response = WAResponse(201, nil, nil);
+		[response->headers setObject:stored->etag forKey:@"ETag"];
+		[response->headers setObject:WARFC1123String(stored->lastModified) forKey:@"Last-Modified"];
+		return response;
+	}
+
+	if ([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"]) {
+		if (!blob) {
+			return WAStorageError(404, @"BlobNotFound", @"The specified blob does not exist.");
+		}
+		NSString *ifMatch = [request valueForHTTPHeaderField:@"If-Match"];
+		if (ifMatch && ![ifMatch isEqualToString:@"*"] && ![ifMatch isEqualToString:blob->etag]) {
+			return WAStorageError(412, @"ConditionNotMet", @"The condition specified using HTTP conditional header(s) is not met.");
+		}
+
+		NSData *content = blob->data;
+		NSInteger status = 200;
+		NSString *range = [request valueForHTTPHeaderField:@"x-ms-range"] ? [request valueForHTTPHeaderField:@"x-ms-range"] : [request valueForHTTPHeaderField:@"Range"];
+		NSString *contentRange = nil;
+		if (range && [method isEqualToString:@"GET"]) {
+			NSArray *bounds = [[range stringByReplacingOccurrencesOfString:@"bytes=" withString:@""] componentsSeparatedByString:@"-"];
+			unsigned long long first = strtoull([[bounds objectAtIndex:0] UTF8String], NULL, 10);
+			unsigned long long last = bounds.count > 1 && [[bounds objectAtIndex:1] length] ? strtoull([[bounds objectAtIndex:1] UTF8String], NULL, 10) : content.length - 1;
+			if (first >= content.length) {
+				return WAStorageError(416, @"InvalidRange", @"The range specified is invalid for the current size of the resource.");
+			}
+			last = MIN(last, content.length - 1);
+			content = [content subdataWithRange:NSMakeRange((NSUInteger)first, (NSUInteger)(last - first + 1))];
+			contentRange = [NSString stringWithFormat:@"bytes %llu-%llu/%lu", first, last, (unsigned long)blob->data.length];
+			status = 206;
+		}
+
+		WAEmulatorResponse *response = WAResponse(status, blob->contentType ? blob->contentType : @"application/octet-stream", content);
+		[response->headers setObject:blob->etag forKey:@"ETag"];
+		[response->headers setObject:WARFC1123String(blob->lastModified) forKey:@"Last-Modified"];
+		[response->headers setObject:@"BlockBlob" forKey:@"x-ms-blob-type"];
+		[response->headers setObject:[NSString stringWithFormat:@"%lu", (unsigned long)content.length] forKey:@"Content-Length"];
+		if (contentRange) {
+			[response->headers setObject:contentRange forKey:@"Content-Range"];
+		}
+		return response;
+	}
+
+	if ([method isEqualToString:@"DELETE"]) {
+		if (!blob) {
+			return WAStorageError(404, @"BlobNotFound", @"The specified blob does not exist.");
+		}
+		[_blobs removeObjectForKey:path];
+		return WAResponse(202, nil, nil);
+	}
+
+	return WAStorageError(501, @"NotImplemented", @"The emulator does not implement this request.");
+}
+
+- (WAEmulatorResponse *)queueResponseForRequest:(NSURLRequest *)request
+{
+	NSString *method = [request HTTPMethod];
+	NSArray *segments = [[WARawPath([request URL]) substringFromIndex:1] componentsSeparatedByString:@"/"];
+	NSDictionary *parameters = WAQueryParameters([request URL]);
+	NSString *queueName = [[segments objectAtIndex:0] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+	NSMutableArray *queue = [_queues objectForKey:queueName];
+	CFAbsoluteTime now = CFAbsoluteTimeGetCurrent();
+
+	if (segments.count == 1) {
+		if ([method isEqualToString:@"PUT"]) {
+			if (queue) {
+				return WAResponse(204, nil, nil);
+			}
+			[_queues setObject:[NSMutableArray array] forKey:queueName];
+			return WAResponse(201, nil, nil);
+		}
+		if (!queue) {
+			return WAStorageError(404, @"QueueNotFound", @"The specified queue does not exist.");
+		}
+		if ([method isEqualToString:@"GET"] && [[parameters objectForKey:@"comp"] isEqualToString:@"metadata"]) {
+			WAEmulatorResponse *response = WAResponse(200, nil, nil);
+			[response->headers setObject:[NSString stringWithFormat:@"%lu", (unsigned long)queue.count] forKey:@"x-ms-approximate-messages-count"];
+			return response;
+		}
+		if ([method isEqualToString:@"DELETE"]) {
+			[_queues removeObjectForKey:queueName];
+			return WAResponse(204, nil, nil);
+		}
+		return WAStorageError(501, @"NotImplemented", @"The emulator does not implement this request.");
+	}
+
+	if (!queue) {
+		return WAStorageError(404, @"QueueNotFound", @"The specified queue does not exist.");
+	}
+
+	if (segments.count == 2 && [method isEqualToString:@"POST"]) {
+		NSString *body = [[[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding] autorelease];
+		NSString *text = WAElementText(body, @"MessageText");
+		if (!text) {
+			return WAStorageError(400, @"InvalidXmlDocument", @"XML specified is not syntactically valid.");
+		}
+
+		WAEmulatorMessage *message = [[[WAEmulatorMessage alloc] init] autorelease];
+		message->messageId = [WANewIdentifier() retain];
+		message->text = [WAXMLUnescapedString(text) copy];
+		message->insertionTime = [[NSDate date] retain];
+		message->visibleAt = now + [[parameters objectForKey:@"visibilitytimeout"] doubleValue];
+		[queue addObject:message];
+		return WAResponse(201, nil, nil);
+	}
+
+	if (segments.count == 2 && [method isEqualToString:@"GET"]) {
+		NSUInteger count = [parameters objectForKey:@"numofmessages"] ? (NSUInteger)[[parameters objectForKey:@"numofmessages"] integerValue] : 1;
+		NSTimeInterval visibilityTimeout = [parameters objectForKey:@"visibilitytimeout"] ? [[parameters objectForKey:@"visibilitytimeout"] doubleValue] : 30;
+		BOOL peek = [[parameters objectForKey:@"peekonly"] isEqualToString:@"true"];
+
+		NSMutableString *list = [NSMutableString stringWithString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><QueueMessagesList>"];
+		NSUInteger returned = 0;
+		for (WAEmulatorMessage *message in queue) {
+			if (returned == count) {
+				break;
+			}
+			if (message->visibleAt > now) {
+				continue;
+			}
+
+			if (!peek) {
+				message->visibleAt = now + visibilityTimeout;
+				message->dequeueCount++;
+				[message->popReceipt release];
+				message->popReceipt = [WANewIdentifier() retain];
+			}
+			NSDate *insertion = message->insertionTime;
+			[list appendFormat:@"<QueueMessage><MessageId>%@</MessageId><InsertionTime>%@</InsertionTime><ExpirationTime>%@</ExpirationTime>",
+			 message->messageId, WARFC1123String(insertion), WARFC1123String([insertion dateByAddingTimeInterval:7 * 24 * 3600])];
+			if (!peek) {
+				[list appendFormat:@"<PopReceipt>%@</PopReceipt><TimeNextVisible>%@</TimeNextVisible>", message->popReceipt, WARFC1123String([NSDate dateWithTimeIntervalSinceReferenceDate:message->visibleAt])];
+			}
+			[list appendFormat:@"<DequeueCount>%ld</DequeueCount><MessageText>%@</MessageText></QueueMessage>", (long)message->dequeueCount, WAXMLEscapedString(message->text)];
+			returned++;
+		}
+		[list appendString:@"</QueueMessagesList>"];
+		return WAResponse(200, @"application/xml", [list dataUsingEncoding:NSUTF8StringEncoding]);
+	}
+
+	if (segments.count == 2 && [method isEqualToString:@"DELETE"]) {
+		[queue removeAllObjects];
+		return WAResponse(204, nil, nil);
+	}
+
+	if (segments.count == 3) {
+		NSString *messageId = [segments objectAtIndex:2];
+		WAEmulatorMessage *message = nil;
+		for (WAEmulatorMessage *candidate in queue) {
+			if ([candidate->messageId isEqualToString:messageId]) {
+				message = candidate;
+				break;
+			}
+		}
+		if (!message) {
+			return WAStorageError(404, @"MessageNotFound", @"The specified message does not exist.");
+		}
+		if (![message->popReceipt isEqualToString:[parameters objectForKey:@"popreceipt"]]) {
+			return WAStorageError(400, @"PopReceiptMismatch", @"The specified pop receipt did not match the pop receipt for a dequeued message.");
+		}
+
+		if ([method isEqualToString:@"DELETE"]) {
+			[queue removeObjectIdenticalTo:message];
+			return WAResponse(204, nil, nil);
+		}
+
+		if ([method isEqualToString:@"PUT"]) {
+			NSString *body = [request HTTPBody] ? [[[NSString alloc] initWithData:[request HTTPBody] encoding:NSUTF8StringEncoding] autorelease] : nil;
+			NSString *text = WAElementText(body, @"MessageText");
+			if (text) {
+				[message->text release];
+				message->text = [WAXMLUnescapedString(text) copy];
+			}
+			message->visibleAt = now + [[parameters objectForKey:@"visibilitytimeout"] doubleValue];
+			[message->popReceipt release];
+			message->popReceipt = [WANewIdentifier() retain];
+
+			WAEmulatorResponse *response = WAResponse(204, nil, nil);
+			[response->headers setObject:message->popReceipt forKey:@"x-ms-popreceipt"];
+			[response->headers setObject:WARFC1123String([NSDate dateWithTimeIntervalSinceReferenceDate:message->visibleAt]) forKey:@"x-ms-time-next-visible"];
+			return response;
+		}
+	}
+
+	return WAStorageError(501, @"NotImplemented", @"The emulator does not implement this request.");
+}
+
+@end
@@ -0,0 +1,146 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableBatchTests.h"
+
+#import "WAAuthenticationCredential.h"
+#import "WACloudStorageClient.h"
+#import "WATableBatch.h"
+#import "WATableEntity.h"
+#import "WAStorageEmulator.h"
+
+#define WATableBatchTestTimeout 30
+
+@interface WATableBatchTests ()
+
+- (NSArray *)executeOperations:(NSArray *)operations error:(NSError **)error;
+
+@end
+
+@implementation WATableBatchTests
+
+- (void)setUp
+{
+	[super setUp];
+
+	[WAStorageEmulator install];
+	[[WAStorageEmulator sharedEmulator] reset];
+	[[WAStorageEmulator sharedEmulator] populateTable:@"Batch" fromDataset:nil partitions:0 rowsPerPartition:0];
+
+	WAAuthenticationCredential *credential = [WAAuthenticationCredential credentialWithAzureServiceAccount:WAStorageEmulatorAccountName accessKey:WAStorageEmulatorAccessKey];
+	_client = [[WACloudStorageClient storageClientWithCredential:credential] retain];
+}
+
+- (void)tearDown
+{
+	[_client release];
+	_client = nil;
+
+	[WAStorageEmulator uninstall];
+
+	[super tearDown];
+}
+
+- (void)testRepeatedEntityStartsNewChangeset
+{
+	WATableEntity *first = [WATableEntity createEntityForTable:@"Batch"];
+	first.partitionKey = @"p";
+	first.rowKey = @"a";
+	WATableEntity *changed = [WATableEntity createEntityForTable:@"Batch"];
+	changed.partitionKey = @"p";
+	changed.rowKey = @"a";
+	[changed setObject:@"changed" forKey:@"Name"];
+	WATableEntity *second = [WATableEntity createEntityForTable:@"Batch"];
+	second.partitionKey = @"p";
+	second.rowKey = @"b";
+
+	NSArray *operations = [NSArray arrayWithObjects:
+						   [WATableOperation insertOperationWithEntity:first],
+						   [WATableOperation mergeOperationWithEntity:changed],
+						   [WATableOperation insertOperationWithEntity:second],
+						   nil];
+	NSUInteger requestCount = [WAStorageEmulator sharedEmulator].requestCount;
+	NSError *error = nil;
+	NSArray *results = [self executeOperations:operations error:&error];
+
+	STAssertNil(error, @"%@", error);
+	STAssertEquals(results.count, (NSUInteger)3, nil);
+	for (WATableOperationResult *result in results) {
+		STAssertNil(result.error, @"%@", result.error);
+	}
+	STAssertEquals([WAStorageEmulator sharedEmulator].requestCount - requestCount, (NSUInteger)2, @"the merge of the inserted entity goes in a second changeset");
+	STAssertEquals([[WAStorageEmulator sharedEmulator] entityCountInTable:@"Batch"], (NSUInteger)2, nil);
+}
+
+- (void)testChangesetsOfPartitionRunInOrder
+{
+	// the updates land in the changeset after the one inserting their entities
+	NSMutableArray *operations = [NSMutableArray array];
+	for (NSUInteger row = 0; row < WATableBatchMaxOperations + 20; row++) {
+		WATableEntity *entity = [WATableEntity createEntityForTable:@"Batch"];
+		entity.partitionKey = @"p";
+		entity.rowKey = [NSString stringWithFormat:@"%05lu", (unsigned long)row];
+		[operations addObject:[WATableOperation insertOperationWithEntity:entity]];
+	}
+	for (NSUInteger row = 0; row < 20; row++) {
+		WATableEntity *entity = [WATableEntity createEntityForTable:@"Batch"];
+		entity.partitionKey = @"p";
+		entity.rowKey = [NSString stringWithFormat:@"%05lu", (unsigned long)row];
+		[entity setObject:@"updated" forKey:@"Name"];
+		[operations addObject:[WATableOperation updateOperationWithEntity:entity]];
+	}
+
+	NSError *error = nil;
+	NSArray *results = [self executeOperations:operations error:&error];
+
+	STAssertNil(error, @"%@", error);
+	for (WATableOperationResult *result in results) {
+		STAssertNil(result.error, @"%@", result.error);
+	}
+	STAssertEquals([[WAStorageEmulator sharedEmulator] entityCountInTable:@"Batch"], (NSUInteger)(WATableBatchMaxOperations + 20), nil);
+}
+
+#pragma mark - Private
+
+- (NSArray *)executeOperations:(NSArray *)operations error:(NSError **)error
+{
+	__block BOOL finished = NO;
+	__block NSArray *operationResults = nil;
+	__block NSError *operationError = nil;
+
+	[_client executeTableOperations:operations withCompletionHandler:^(NSArray *results, NSError *error) {
+		operationResults = [results retain];
+		operationError = [error retain];
+		finished = YES;
+	}];
+
+	NSDate *timeout = [NSDate dateWithTimeIntervalSinceNow:WATableBatchTestTimeout];
+	while (!finished && [timeout timeIntervalSinceNow] > 0) {
+		NSAutoreleasePool *pool = [[NSAutoreleasePool alloc] init];
+		[[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+		[pool drain];
+	}
+	STAssertTrue(finished, @"The operations did not finish");
+
+	if (error) {
+		*error = [operationError autorelease];
+	} else {
+		[operationError release];
+	}
+	return [operationResults autorelease];
+}
+
+@end
@@ -0,0 +1,57 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "WATableEntityCacheTests.h"
+
+#import "WATableEntity.h"
+#import "WATableEntityCache.h"
+
+@implementation WATableEntityCacheTests
+
+- (void)testChangingEntitiesDoesNotChangeTheCache
+{
+	WATableEntityCache *cache = [[[WATableEntityCache alloc] initWithByteBudget:64 * 1024] autorelease];
+	WATableEntity *entity = [WATableEntity createEntityForTable:@"Customers"];
+	entity.partitionKey = @"Seattle";
+	entity.rowKey = @"Smith";
+	[entity setObject:@"Ada" forKey:@"Name"];
+	[entity setObject:[NSMutableData dataWithBytes:"\x00\x01" length:2] forKey:@"Avatar"];
+
+	[cache storeEntity:entity];
+	NSUInteger totalBytes = cache.totalBytes;
+	[entity setObject:@"changed after it was stored" forKey:@"Name"];
+
+	WATableEntity *first = [cache entityForTable:@"Customers" partitionKey:@"Seattle" rowKey:@"Smith"];
+	STAssertTrue(first != entity, @"the cache keeps its own copy");
+	STAssertEqualObjects([first objectForKey:@"Name"], @"Ada", nil);
+	STAssertEqualObjects(first.partitionKey, @"Seattle", nil);
+	STAssertEqualObjects(first.rowKey, @"Smith", nil);
+
+	// as a caller would before a merge
+	[first setObject:@"Grace" forKey:@"Name"];
+	[first setObject:@"Pasadena" forKey:@"City"];
+	[[first objectForKey:@"Avatar"] appendBytes:"\x02" length:1];
+
+	WATableEntity *second = [cache entityForTable:@"Customers" partitionKey:@"Seattle" rowKey:@"Smith"];
+	STAssertTrue(second != first, nil);
+	STAssertEqualObjects([second objectForKey:@"Name"], @"Ada", nil);
+	STAssertNil([second objectForKey:@"City"], nil);
+	STAssertEqualObjects([second objectForKey:@"Avatar"], [NSData dataWithBytes:"\x00\x01" length:2], nil);
+	STAssertEquals(cache.totalBytes, totalBytes, @"the size of the cached entity does not change");
+	STAssertEquals(cache.hitCount, (NSUInteger)2, nil);
+}
+
+@end